@@ -36,23 +36,50 @@ void AssetManager::updateGltfImage(AssetGltfImageUpdateEvent &event)
 
 void AssetManager::addImage(std::unique_ptr<ModelImage> &image, std::string id)
 {
-	TextureAssetInfo assetInfo;
-	assetInfo.texture.mapTexture(image->getWidth(), image->getHeight(), 4, image->getData(),
-	                             image->getFormat(), true);
-
 	// samplers
+	VulkanAPI::SamplerType samplerType;
 	auto &sampler = image->getSampler();
 	if (sampler)
 	{
-		assetInfo.samplerType = VulkanAPI::Sampler::getSamplerType(sampler->mode, sampler->filter);
+		samplerType = VulkanAPI::Sampler::getSamplerType(sampler->mode, sampler->filter);
 	}
 	else
 	{
 		// use default sampler if none exsists
-		assetInfo.samplerType = VulkanAPI::Sampler::getDefaultSampler();
+		samplerType = VulkanAPI::Sampler::getDefaultSampler();
 	}
 
+	// gltf images are always rgba
+	const uint32_t width = image->getWidth();
+	const uint32_t height = image->getHeight();
+	const uint64_t imageSize = static_cast<uint64_t>(width) * height * 4;
+
+	uint64_t hash = Util::hashBytes(image->getData(), imageSize);
+	hash = Util::hashBytes(&width, sizeof(uint32_t), hash);
+
+	// the same image is often used by several materials, and within packs of models - these share the first copy
+	auto iter = imageHashes.find(hash);
+	if (iter != imageHashes.end())
+	{
+		MappedTexture &source = images[iter->second].texture;
+		if (source.textureWidth() == width && source.textureHeight() == height &&
+		    source.getFormat() == image->getFormat())
+		{
+			imageAliases[id] = { iter->second, samplerType };
+			++cacheStats.sharedImages;
+			cacheStats.bytesSaved += imageSize;
+			isDirty = true;
+			return;
+		}
+	}
+
+	TextureAssetInfo assetInfo;
+	assetInfo.texture.mapTexture(width, height, 4, image->getData(), image->getFormat(), true);
+	assetInfo.samplerType = samplerType;
+
 	images.emplace(id, std::move(assetInfo));
+	imageHashes.emplace(hash, id);
+	++cacheStats.uniqueImages;
 	isDirty = true;
 }
 
@@ -115,53 +142,72 @@ void AssetManager::loadImageFile(const std::string &filename, const std::string
 	}
 }
 
+void AssetManager::queueImageUpdate(const std::string &id, const std::string &assetId, TextureAssetInfo &info,
+                                    VulkanAPI::SamplerType samplerType,
+                                    std::unique_ptr<ComponentInterface> &componentInterface)
+{
+	// check for identifier - at the moment they are only MAT_ which sigifies a material texture
+	if (id.find(materialIdentifier) != std::string::npos)
+	{
+		auto splitStr = StringUtil::splitString(id, '_');
+		assert(!splitStr.empty());
+
+		// in the format mat_id_pbrType - get the type so we can derive the texture slot
+		std::string pbrType = splitStr[splitStr.size() - 1];
+
+		// find in list - order equates to the texture slot within the material
+		auto &materialManager = componentInterface->getManager<MaterialManager>();
+
+		uint32_t textureId = UINT32_MAX;
+		for (uint32_t i = 0; i < materialManager.textureExtensions.size(); ++i)
+		{
+			if (materialManager.textureExtensions[i] == pbrType)
+			{
+				textureId = i;
+			}
+		}
+		if (textureId == UINT32_MAX)
+		{
+			LOGGER_ERROR("Unspecified pbr texture type.");
+		}
+
+		// the material name, though the name could contain a _ character
+		// So remove the MAT_ and pbr type identifiers - bit ugly, TODO: come up with something better!
+		std::string materialName = id.substr(std::strlen(materialIdentifier), id.size());
+		size_t pos = materialName.find(pbrType);
+		materialName = materialName.substr(0, pos - 1);
+
+		uint32_t materialIndex = materialManager.findMaterial(materialName);
+		if (materialIndex == UINT32_MAX)
+		{
+			LOGGER_ERROR("Unable to find material %s for texture %s.", materialName.c_str(), id.c_str());
+		}
+
+		// shared images pass the same asset id, which the texture manager only uploads once
+		VulkanAPI::MaterialTextureUpdateEvent event{ MaterialManager::getTextureIndex(materialIndex, textureId),
+			                                         assetId, &info.texture, samplerType };
+		Global::eventManager()->addQueueEvent<VulkanAPI::MaterialTextureUpdateEvent>(event);
+	}
+	else
+	{
+		VulkanAPI::TextureUpdateEvent event{ id, &info };
+		Global::eventManager()->addQueueEvent<VulkanAPI::TextureUpdateEvent>(event);
+	}
+}
+
 void AssetManager::update(std::unique_ptr<ComponentInterface> &componentInterface)
 {
 	if (isDirty)
 	{
 		for (auto &image : images)
 		{
-			// check for identifier - at the moment they are only MAT_ which sigifies a material texture
-			if (image.first.find(materialIdentifier) != std::string::npos)
-			{
-				auto splitStr = StringUtil::splitString(image.first, '_');
-				assert(!splitStr.empty());
-
-				// in the format mat_id_pbrType - get the type so we can derive the binding number
-				std::string pbrType = splitStr[splitStr.size() - 1];
-
-				// find in list - order equates to binding order in shader
-				auto &materialManager = componentInterface->getManager<MaterialManager>();
-
-				uint32_t binding = UINT32_MAX;
-				for (auto &extension : materialManager.textureExtensions)
-				{
-					if (std::get<0>(extension) == pbrType)
-					{
-						binding = std::get<1>(extension);
-					}
-				}
-				if (binding == UINT32_MAX)
-				{
-					LOGGER_ERROR("Unspecified pbr texture type.");
-				}
-
-				// the grouped id is the material name, though the name could contain a _ character
-				// So remove the MAT_ and pbr type identifiers - bit ugly, TODO: come up with something better!
-				std::string id = image.first;
-				id = id.substr(std::strlen(materialIdentifier), id.size());
-				size_t pos = id.find(pbrType);
-				id = id.substr(0, pos - 1);
-
-				VulkanAPI::MaterialTextureUpdateEvent event{ id, binding, &image.second.texture,
-					                                         image.second.samplerType };
-				Global::eventManager()->addQueueEvent<VulkanAPI::MaterialTextureUpdateEvent>(event);
-			}
-			else
-			{
-				VulkanAPI::TextureUpdateEvent event{ image.first, &image.second };
-				Global::eventManager()->addQueueEvent<VulkanAPI::TextureUpdateEvent>(event);
-			}
+			queueImageUpdate(image.first, image.first, image.second, image.second.samplerType, componentInterface);
+		}
+
+		for (auto &alias : imageAliases)
+		{
+			queueImageUpdate(alias.first, alias.second.sourceId, images[alias.second.sourceId],
+			                 alias.second.samplerType, componentInterface);
 		}
 
 		isDirty = false;
@@ -65,6 +65,16 @@ public:
 		MappedTexture texture;
 	};
 
+	struct CacheStats
+	{
+		// images mapped for upload, and those which instead point at an identical image already added
+		uint32_t uniqueImages = 0;
+		uint32_t sharedImages = 0;
+
+		// the bytes of image data, excluding mip-maps, not mapped or uploaded thanks to the shared images
+		uint64_t bytesSaved = 0;
+	};
+
 	// texture identifiers
 	static constexpr char materialIdentifier[] = "MAT_";
 
@@ -83,11 +93,36 @@ public:
 
 	void update(std::unique_ptr<ComponentInterface> &componentInterface);
 
+	const CacheStats &getCacheStats() const
+	{
+		return cacheStats;
+	}
+
+private:
+	// the id is that of the texture, which for materials gives the slot, and the asset id that of the image
+	// data. These only differ for images sharing the data of another
+	void queueImageUpdate(const std::string &id, const std::string &assetId, TextureAssetInfo &info,
+	                      VulkanAPI::SamplerType samplerType, std::unique_ptr<ComponentInterface> &componentInterface);
+
 private:
 	// a place to store images from ktx files - this can be multiple layers and have
 	// mip-maps associated with them
 	std::unordered_map<std::string, TextureAssetInfo> images;
 
+	// gltf images with the same pixels as one already added aren't mapped again. Instead they refer to the id
+	// of the first, keeping their own sampler, and the gpu texture is shared
+	struct ImageAlias
+	{
+		std::string sourceId;
+		VulkanAPI::SamplerType samplerType;
+	};
+
+	std::unordered_map<std::string, ImageAlias> imageAliases;
+
+	// the content hash of each gltf image mapped, and its id
+	std::unordered_map<uint64_t, std::string> imageHashes;
+	CacheStats cacheStats;
+
 	bool isDirty = false;
 };
 } // namespace OmegaEngine
\ No newline at end of file
@@ -167,9 +167,14 @@ void World::extractGltfModelAssets(std::unique_ptr<GltfModel::Model>& model, uin
 	auto& animationManager = componentInterface->getManager<AnimationManager>();
 	animationOffset = animationManager.getBufferOffset();
 
-	for (auto& animation : model->animations)
+	// each instance of the model has its own skeleton, so its animations can be played independently
+	if (!model->animations.empty())
 	{
-		animationManager.addAnimation(animation);
+		uint32_t skeletonIndex = animationManager.addSkeleton();
+		for (auto& animation : model->animations)
+		{
+			animationManager.addAnimation(animation, skeletonIndex);
+		}
 	}
 }
 
@@ -1,16 +1,55 @@
 #include "AnimationManager.h"
+#include "Managers/CameraManager.h"
 #include "Managers/TransformManager.h"
 #include "Models/ModelAnimation.h"
 #include "ObjectInterface/ComponentInterface.h"
 #include "ObjectInterface/ComponentTypes.h"
 #include "ObjectInterface/ObjectManager.h"
+#include "Threading/ThreadPool.h"
 #include "Utility/logger.h"
 
+#include <algorithm>
+
 namespace OmegaEngine
 {
 
+namespace
+{
+// the skeletons of the engine read their nodes from the transform manager
+class TransformManagerSource : public AnimationManager::TransformSource
+{
+public:
+	TransformManagerSource(TransformManager &manager)
+	    : transformManager(manager)
+	{
+	}
+
+	void getLocalPose(const std::vector<uint32_t> &indices, OEMaths::TransformArrays &pose) override
+	{
+		transformManager.getLocalPose(indices, pose);
+	}
+
+	const OEMaths::mat4f &getWorldMatrix(const uint32_t index) override
+	{
+		return transformManager.getWorldMatrix(index);
+	}
+
+	uint32_t getDepth(const uint32_t index) override
+	{
+		return transformManager.getDepth(index);
+	}
+
+private:
+	TransformManager &transformManager;
+};
+} // namespace
+
 AnimationManager::AnimationManager()
 {
+	// leave a thread for the main loop
+	uint32_t threadCount = std::thread::hardware_concurrency();
+	workerCount = std::max(threadCount, 2u) - 1;
+	threadPool = std::make_unique<ThreadPool>(static_cast<uint8_t>(std::min(workerCount, 255u)));
 }
 
 AnimationManager::~AnimationManager()
@@ -18,66 +57,150 @@ AnimationManager::~AnimationManager()
 }
 
 // channel functions
-uint32_t AnimationManager::Sampler::indexFromTime(double time)
+uint32_t AnimationManager::Sampler::indexFromTime(const float time, uint32_t &cursor) const
 {
-	uint32_t index = 0;
-	uint32_t timestampCount = static_cast<uint32_t>(timeStamps.size());
-	if (timestampCount <= 1 || time <= timeStamps.front())
+	// keyframes are compared in quantised units
+	const std::vector<uint16_t> &keys = timeline.keys;
+	const float units = timeline.toUnits(time);
+
+	uint32_t timestampCount = timeline.size();
+	if (timestampCount <= 1 || units <= keys.front())
 	{
-		index = 0;
+		cursor = 0;
+		return 0;
 	}
-	else if (time >= timeStamps.back())
+	if (units >= keys.back())
 	{
-		index = timestampCount - 2;
+		cursor = timestampCount - 2;
+		return cursor;
 	}
-	else
+
+	// most of the time, we will still be in the same interval or only a few along
+	uint32_t index = std::min(cursor, timestampCount - 2);
+	if (units >= keys[index])
 	{
-		uint32_t endTime = 0;
-		while (time > timeStamps[endTime])
+		for (uint32_t step = 0; step < MaxCursorSteps; ++step, ++index)
 		{
-			++endTime;
+			if (units < keys[index + 1])
+			{
+				cursor = index;
+				return index;
+			}
 		}
-		index = endTime - 1;
 	}
+
+	// the time has jumped - either the animation has looped or the time has been changed
+	auto iter = std::upper_bound(keys.begin(), keys.end(), units,
+	                             [](const float value, const uint16_t key) { return value < key; });
+	index = static_cast<uint32_t>(iter - keys.begin()) - 1;
+
+	cursor = index;
 	return index;
 }
 
-float AnimationManager::Sampler::getPhase(double time)
+float AnimationManager::Sampler::getInvInterval(const uint32_t index) const
 {
-	double phase = 0.0;
-	uint32_t timestampCount = static_cast<uint32_t>(timeStamps.size());
-	if (timestampCount <= 1 || time <= timeStamps.front())
+	// the last keyframe has no interval
+	if (index + 1 >= timeline.size())
 	{
-		phase = 0.0f;
+		return 0.0f;
 	}
-	else if (time >= timeStamps.back())
+
+	float interval = static_cast<float>(timeline.keys[index + 1] - timeline.keys[index]);
+	return interval > 0.0f ? 1.0f / interval : 0.0f;
+}
+
+float AnimationManager::Sampler::getPhase(const float time, const uint32_t index, const float invInterval) const
+{
+	if (interpolationType == InterpolationType::Step)
 	{
-		phase = 1.0f;
+		return 0.0f;
 	}
-	else
+
+	float phase = (timeline.toUnits(time) - timeline.keys[index]) * invInterval;
+	return std::min(std::max(phase, 0.0f), 1.0f);
+}
+
+void AnimationManager::SampleBatch::resize(const size_t size)
+{
+	phase.resize(size);
+	startX.resize(size);
+	startY.resize(size);
+	startZ.resize(size);
+	startW.resize(size);
+	endX.resize(size);
+	endY.resize(size);
+	endZ.resize(size);
+	endW.resize(size);
+}
+
+uint32_t AnimationManager::addSkeleton()
+{
+	Skeleton skeleton;
+	skeleton.animationOffset = static_cast<uint32_t>(animations.size());
+	skeletons.emplace_back(skeleton);
+	return static_cast<uint32_t>(skeletons.size() - 1);
+}
+
+void AnimationManager::addAnimation(std::unique_ptr<ModelAnimation> &animation, const uint32_t skeletonIndex)
+{
+	assert(skeletonIndex < skeletons.size());
+	Skeleton &skeleton = skeletons[skeletonIndex];
+	assert(skeleton.animationOffset + skeleton.clips.size() == animations.size());
+
+	AnimationInfo animInfo;
+	animInfo.skeletonIndex = skeletonIndex;
+
+	for (auto &channel : animation->channels)
 	{
-		uint32_t endTime = 0;
-		while (time > timeStamps[endTime])
+		Channel newChannel;
+
+		if (channel.pathType == "rotation")
+		{
+			newChannel.pathType = Channel::PathType::Rotation;
+		}
+		if (channel.pathType == "scale")
 		{
-			++endTime;
+			newChannel.pathType = Channel::PathType::Scale;
 		}
+		if (channel.pathType == "translation")
+		{
+			newChannel.pathType = Channel::PathType::Translation;
+		}
+		if (channel.pathType == "weights")
+		{
+			LOGGER_INFO("Channel path type weights not yet supported.");
+			continue;
+		}
+
+		newChannel.samplerIndex = channel.samplerIndex;
 
-		uint32_t denom = (timeStamps[endTime] - timeStamps[endTime - 1]);
-		denom = denom == 0 ? 1 : denom;
-		phase = (time - timeStamps[endTime - 1]) / denom;
+		// the rest of the channel will be set later
+		animInfo.channels.emplace_back(newChannel);
 	}
-	return static_cast<float>(phase);
-}
 
-void AnimationManager::addAnimation(std::unique_ptr<ModelAnimation> &animation)
-{
-	AnimationInfo animInfo;
+	// the samplers are compressed depending on which path they drive
+	std::vector<AnimationCompressor::TrackType> trackTypes(animation->samplers.size(),
+	                                                       AnimationCompressor::TrackType::Translation);
+	for (auto &channel : animInfo.channels)
+	{
+		if (channel.pathType == Channel::PathType::Rotation)
+		{
+			trackTypes[channel.samplerIndex] = AnimationCompressor::TrackType::Rotation;
+		}
+		else if (channel.pathType == Channel::PathType::Scale)
+		{
+			trackTypes[channel.samplerIndex] = AnimationCompressor::TrackType::Scale;
+		}
+	}
 
-	// copy the samplers
-	for (auto &sampler : animation->samplers)
+	for (uint32_t i = 0; i < animation->samplers.size(); ++i)
 	{
+		auto &sampler = animation->samplers[i];
 		Sampler newSampler;
 
+		// cubic splines are only quantised as the tangents are stored with the keys
+		auto reduction = AnimationCompressor::KeyReduction::Linear;
 		if (sampler.interpolation == "LINEAR")
 		{
 			newSampler.interpolationType = Sampler::InterpolationType::Linear;
@@ -85,143 +208,882 @@ void AnimationManager::addAnimation(std::unique_ptr<ModelAnimation> &animation)
 		else if (sampler.interpolation == "STEP")
 		{
 			newSampler.interpolationType = Sampler::InterpolationType::Step;
+			reduction = AnimationCompressor::KeyReduction::Step;
 		}
 		else if (sampler.interpolation == "CUBICSPLINE")
 		{
 			newSampler.interpolationType = Sampler::InterpolationType::CubicSpline;
+			reduction = AnimationCompressor::KeyReduction::None;
 		}
 		else
 		{
 			LOGGER_INFO("Note: Unsupported sampler interpolation type requested.");
 		}
 
-		// straight copy
-		newSampler.timeStamps.resize(sampler.timeStamps.size());
-		memcpy(newSampler.timeStamps.data(), sampler.timeStamps.data(),
-		       newSampler.timeStamps.size() * sizeof(float));
+		if (sampler.outputs.size() != sampler.timeStamps.size() * newSampler.getOutputStride())
+		{
+			LOGGER_ERROR("The number of animation sampler outputs doesn't match the keyframe count.");
+		}
 
-		newSampler.outputs.resize(sampler.outputs.size());
-		memcpy(newSampler.outputs.data(), sampler.outputs.data(),
-		       newSampler.outputs.size() * sizeof(OEMaths::vec4f));
+		compressor.compress(sampler.timeStamps, sampler.outputs, trackTypes[i], reduction, newSampler.timeline,
+		                    newSampler.outputs);
 
-		animInfo.samplers.emplace_back(newSampler);
+		animInfo.samplers.emplace_back(std::move(newSampler));
 	}
 
-	for (auto &channel : animation->channels)
+	for (auto &channel : animInfo.channels)
 	{
-		Channel newChannel;
+		const Sampler &sampler = animInfo.samplers[channel.samplerIndex];
+		channel.invInterval = sampler.getInvInterval(0);
 
-		if (channel.pathType == "rotation")
+		// the first value of a cubic spline follows its in tangent
+		uint32_t referenceIndex = sampler.getOutputStride() == 3 ? 1 : 0;
+		sampler.outputs.decode(referenceIndex, channel.reference);
+	}
+
+	// start and end times for this animation
+	animInfo.start = animation->start;
+	animInfo.end = animation->end;
+
+	animations.emplace_back(std::move(animInfo));
+
+	// so models are animated without any further setup, the first animation is played by default
+	skeleton.clips.emplace_back();
+	if (skeleton.clips.size() == 1)
+	{
+		play(skeletonIndex, 0);
+	}
+}
+
+void AnimationManager::addComponentToManager(AnimationComponent *component, Object &object)
+{
+	uint32_t animBufferIndex = component->animIndex + component->bufferOffset;
+	Skeleton &skeleton = skeletons[animations[animBufferIndex].skeletonIndex];
+
+	// each node has one slot in the pose, shared by all the animations of the skeleton
+	auto iter = std::find(skeleton.nodes.begin(), skeleton.nodes.end(), &object);
+	uint32_t poseIndex = static_cast<uint32_t>(iter - skeleton.nodes.begin());
+	if (iter == skeleton.nodes.end())
+	{
+		skeleton.nodes.emplace_back(&object);
+		skeleton.isPrepared = false;
+	}
+
+	for (auto &index : component->channelIndex)
+	{
+		// link the animation channel with the node
+		Channel &channel = animations[animBufferIndex].channels[index];
+		channel.poseIndex = poseIndex;
+	}
+}
+
+uint32_t AnimationManager::getSkeletonIndex(Object &object)
+{
+	auto &component = object.getComponent<AnimationComponent>();
+	return animations[component.animIndex + component.bufferOffset].skeletonIndex;
+}
+
+AnimationManager::ClipInstance &AnimationManager::getClip(const uint32_t skeletonIndex, const uint32_t animIndex)
+{
+	assert(skeletonIndex < skeletons.size());
+	assert(animIndex < skeletons[skeletonIndex].clips.size());
+	return skeletons[skeletonIndex].clips[animIndex];
+}
+
+void AnimationManager::play(const uint32_t skeletonIndex, const uint32_t animIndex, const float fadeTime,
+                            const BlendMode blendMode)
+{
+	Skeleton &skeleton = skeletons[skeletonIndex];
+	ClipInstance &clip = getClip(skeletonIndex, animIndex);
+
+	// a clip which is already active keeps its time and place in the layers
+	if (clip.state == ClipInstance::State::Stopped)
+	{
+		clip.time = 0.0f;
+		clip.weight = 0.0f;
+		skeleton.activeClips.emplace_back(animIndex);
+	}
+
+	clip.state = ClipInstance::State::Playing;
+	clip.blendMode = blendMode;
+	clip.targetWeight = 1.0f;
+	clip.stopOnFade = false;
+
+	if (fadeTime > 0.0f)
+	{
+		clip.fadeRate = 1.0f / fadeTime;
+	}
+	else
+	{
+		clip.weight = clip.targetWeight;
+		clip.fadeRate = 0.0f;
+	}
+}
+
+void AnimationManager::stop(const uint32_t skeletonIndex, const uint32_t animIndex, const float fadeTime)
+{
+	Skeleton &skeleton = skeletons[skeletonIndex];
+	ClipInstance &clip = getClip(skeletonIndex, animIndex);
+
+	if (clip.state == ClipInstance::State::Stopped)
+	{
+		return;
+	}
+
+	if (fadeTime > 0.0f)
+	{
+		clip.targetWeight = 0.0f;
+		clip.fadeRate = 1.0f / fadeTime;
+		clip.stopOnFade = true;
+		return;
+	}
+
+	clip.state = ClipInstance::State::Stopped;
+	clip.weight = 0.0f;
+	skeleton.activeClips.erase(std::remove(skeleton.activeClips.begin(), skeleton.activeClips.end(), animIndex),
+	                           skeleton.activeClips.end());
+}
+
+void AnimationManager::setPaused(const uint32_t skeletonIndex, const uint32_t animIndex, const bool paused)
+{
+	ClipInstance &clip = getClip(skeletonIndex, animIndex);
+	if (clip.state != ClipInstance::State::Stopped)
+	{
+		clip.state = paused ? ClipInstance::State::Paused : ClipInstance::State::Playing;
+	}
+}
+
+void AnimationManager::setSpeed(const uint32_t skeletonIndex, const uint32_t animIndex, const float speed)
+{
+	getClip(skeletonIndex, animIndex).speed = speed;
+}
+
+void AnimationManager::setWeight(const uint32_t skeletonIndex, const uint32_t animIndex, const float weight)
+{
+	ClipInstance &clip = getClip(skeletonIndex, animIndex);
+	clip.weight = weight;
+	clip.targetWeight = weight;
+	clip.fadeRate = 0.0f;
+}
+
+void AnimationManager::setLooping(const uint32_t skeletonIndex, const uint32_t animIndex, const bool loop)
+{
+	getClip(skeletonIndex, animIndex).loop = loop;
+}
+
+void AnimationManager::crossFade(const uint32_t skeletonIndex, const uint32_t animIndex, const float fadeTime)
+{
+	Skeleton &skeleton = skeletons[skeletonIndex];
+
+	// take a copy as stopping without a fade alters the active list
+	std::vector<uint32_t> active = skeleton.activeClips;
+	for (uint32_t index : active)
+	{
+		if (index != animIndex && skeleton.clips[index].blendMode == BlendMode::Override)
 		{
-			newChannel.pathType = Channel::PathType::Rotation;
+			stop(skeletonIndex, index, fadeTime);
 		}
-		if (channel.pathType == "scale")
+	}
+
+	play(skeletonIndex, animIndex, fadeTime, BlendMode::Override);
+}
+
+void AnimationManager::sampleAnimation(AnimationInfo &anim, const float animTime, SampleBatch &batch,
+                                       const uint8_t *nodeMask)
+{
+	const size_t channelCount = anim.channels.size();
+	batch.resize(channelCount);
+	batch.cubics.clear();
+
+	// find the keyframes either side of the current time for each channel
+	for (size_t i = 0; i < channelCount; ++i)
+	{
+		Channel &channel = anim.channels[i];
+		const Sampler &sampler = anim.samplers[channel.samplerIndex];
+		assert(sampler.size() > 0);
+
+		if (nodeMask && channel.poseIndex != UINT32_MAX && !nodeMask[channel.poseIndex])
 		{
-			newChannel.pathType = Channel::PathType::Scale;
+			continue;
 		}
-		if (channel.pathType == "translation")
+
+		uint32_t prevCursor = channel.cursor;
+		uint32_t start = sampler.indexFromTime(animTime, channel.cursor);
+		uint32_t end = std::min(start + 1, sampler.size() - 1);
+
+		if (start != prevCursor)
 		{
-			newChannel.pathType = Channel::PathType::Translation;
+			channel.invInterval = sampler.getInvInterval(start);
 		}
-		if (channel.pathType == "weights")
+		batch.phase[i] = sampler.getPhase(animTime, start, channel.invInterval);
+
+		if (sampler.interpolationType == Sampler::InterpolationType::CubicSpline)
 		{
-			LOGGER_INFO("Channel path type weights not yet supported.");
-			continue;
+			// the tangents are per second, so are scaled by the interval
+			float interval = static_cast<float>(sampler.timeline.keys[end] - sampler.timeline.keys[start]) *
+			                 sampler.timeline.step;
+
+			SampleBatch::CubicSample cubic;
+			cubic.channel = static_cast<uint32_t>(i);
+			sampler.outputs.decode(start * 3 + 2, cubic.startTangent);
+			sampler.outputs.decode(end * 3, cubic.endTangent);
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				cubic.startTangent[c] *= interval;
+				cubic.endTangent[c] *= interval;
+			}
+			batch.cubics.emplace_back(cubic);
+
+			// the values sit between the tangents
+			start = start * 3 + 1;
+			end = end * 3 + 1;
 		}
 
-		newChannel.samplerIndex = channel.samplerIndex;
+		// decompress the keyframes
+		float startKey[4], endKey[4];
+		sampler.outputs.decodePair(start, end, startKey, endKey);
 
-		// the rest of the channel will be set later
-		animInfo.channels.emplace_back(newChannel);
+		batch.startX[i] = startKey[0];
+		batch.startY[i] = startKey[1];
+		batch.startZ[i] = startKey[2];
+		batch.startW[i] = startKey[3];
+		batch.endX[i] = endKey[0];
+		batch.endY[i] = endKey[1];
+		batch.endZ[i] = endKey[2];
+		batch.endW[i] = endKey[3];
 	}
 
-	// start and end times for this animation
-	animInfo.start = animation->start;
-	animInfo.end = animation->end;
+	float *phase = batch.phase.data();
+	float *startX = batch.startX.data();
+	float *startY = batch.startY.data();
+	float *startZ = batch.startZ.data();
+	float *startW = batch.startW.data();
+	const float *endX = batch.endX.data();
+	const float *endY = batch.endY.data();
+	const float *endZ = batch.endZ.data();
+	const float *endW = batch.endW.data();
+
+	// the cubic splines are evaluated first. Their phase is then cleared, so the linear pass leaves them as they are
+	for (const SampleBatch::CubicSample &cubic : batch.cubics)
+	{
+		const uint32_t i = cubic.channel;
+		float t = phase[i];
+		float t2 = t * t;
+		float t3 = t2 * t;
 
-	animations.emplace_back(animInfo);
+		// hermite basis functions
+		float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+		float h10 = t3 - 2.0f * t2 + t;
+		float h01 = -2.0f * t3 + 3.0f * t2;
+		float h11 = t3 - t2;
+
+		startX[i] = h00 * startX[i] + h10 * cubic.startTangent[0] + h01 * endX[i] + h11 * cubic.endTangent[0];
+		startY[i] = h00 * startY[i] + h10 * cubic.startTangent[1] + h01 * endY[i] + h11 * cubic.endTangent[1];
+		startZ[i] = h00 * startZ[i] + h10 * cubic.startTangent[2] + h01 * endZ[i] + h11 * cubic.endTangent[2];
+		startW[i] = h00 * startW[i] + h10 * cubic.startTangent[3] + h01 * endW[i] + h11 * cubic.endTangent[3];
+		phase[i] = 0.0f;
+	}
+
+	// now interpolate all the channels in one go - the result is written over the start keyframe.
+	// There are no dependencies between channels so this will be vectorised by the compiler
+	for (size_t i = 0; i < channelCount; ++i)
+	{
+		float u = phase[i];
+		startX[i] = startX[i] * (1.0f - u) + endX[i] * u;
+		startY[i] = startY[i] * (1.0f - u) + endY[i] * u;
+		startZ[i] = startZ[i] * (1.0f - u) + endZ[i] * u;
+		startW[i] = startW[i] * (1.0f - u) + endW[i] * u;
+	}
 }
 
-void AnimationManager::addComponentToManager(AnimationComponent *component, Object &object)
+void AnimationManager::prepareSkeleton(Skeleton &skeleton, TransformSource &transforms)
 {
-	uint32_t animBufferIndex = component->animIndex + component->bufferOffset;
-	for (auto &index : component->channelIndex)
+	// the transform indices are resolved once here, rather than looking up the component of each node every frame
+	skeleton.transformIndices.clear();
+	for (Object *node : skeleton.nodes)
 	{
-		Channel &channel = animations[animBufferIndex].channels[index];
-		// link object with animation channel
-		channel.object = &object;
+		uint32_t index = UINT32_MAX;
+		if (node->hasComponent<TransformComponent>())
+		{
+			index = node->getComponent<TransformComponent>().index;
+		}
+		skeleton.transformIndices.emplace_back(index);
 	}
+
+	transforms.getLocalPose(skeleton.transformIndices, skeleton.restPose);
+	skeleton.pose = skeleton.restPose;
+
+	const size_t nodeCount = skeleton.nodes.size();
+	skeleton.translationWeights.resize(nodeCount);
+	skeleton.rotationWeights.resize(nodeCount);
+	skeleton.scaleWeights.resize(nodeCount);
+	skeleton.poseMask.resize(nodeCount);
+
+	skeleton.previousPose = skeleton.restPose;
+	skeleton.blendedPose = skeleton.restPose;
+	skeleton.nodeDepths.resize(nodeCount);
+	skeleton.lodMask.assign(nodeCount, 1);
+	skeleton.hasPose = false;
+
+	skeleton.isPrepared = true;
 }
 
-void AnimationManager::updateFrame(double time, double dt,
-                                   std::unique_ptr<ObjectManager> &objectManager,
-                                   ComponentInterface *componentInterface)
+void AnimationManager::updateClips(Skeleton &skeleton, const float timeStep)
 {
-	auto &transformManager = componentInterface->getManager<TransformManager>();
+	for (uint32_t i = 0; i < skeleton.activeClips.size();)
+	{
+		uint32_t clipIndex = skeleton.activeClips[i];
+		ClipInstance &clip = skeleton.clips[clipIndex];
+		AnimationInfo &anim = animations[skeleton.animationOffset + clipIndex];
 
-	double timeSecs = time / 1000000000;
+		if (clip.state == ClipInstance::State::Playing)
+		{
+			float duration = anim.end - anim.start;
+			clip.time += timeStep * clip.speed;
+
+			if (clip.loop && duration > 0.0f)
+			{
+				clip.time = std::fmod(clip.time, duration);
+				if (clip.time < 0.0f)
+				{
+					clip.time += duration;
+				}
+			}
+			else
+			{
+				clip.time = std::min(std::max(clip.time, 0.0f), std::max(duration, 0.0f));
+			}
+		}
+
+		// fades continue whilst paused
+		if (clip.fadeRate > 0.0f)
+		{
+			float change = clip.fadeRate * timeStep;
+			if (clip.weight < clip.targetWeight)
+			{
+				clip.weight = std::min(clip.weight + change, clip.targetWeight);
+			}
+			else
+			{
+				clip.weight = std::max(clip.weight - change, clip.targetWeight);
+			}
 
-	for (auto &anim : animations)
+			if (clip.weight == clip.targetWeight)
+			{
+				clip.fadeRate = 0.0f;
+			}
+		}
+
+		if (clip.stopOnFade && clip.weight <= 0.0f)
+		{
+			clip.state = ClipInstance::State::Stopped;
+			clip.stopOnFade = false;
+			skeleton.activeClips.erase(skeleton.activeClips.begin() + i);
+			continue;
+		}
+		++i;
+	}
+}
+
+// quaternion helpers for the additive layers - x, y, z, w order
+static void multiplyQuat(const float *a, const float *b, float *out)
+{
+	float x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+	float y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+	float z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+	float w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+	out[0] = x;
+	out[1] = y;
+	out[2] = z;
+	out[3] = w;
+}
+
+static void normaliseQuat(float *q)
+{
+	float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if (length > 0.0f)
+	{
+		q[0] /= length;
+		q[1] /= length;
+		q[2] /= length;
+		q[3] /= length;
+	}
+}
+
+void AnimationManager::evaluateSkeleton(Skeleton &skeleton, SampleBatch &batch)
+{
+	OEMaths::TransformArrays &pose = skeleton.pose;
+	const OEMaths::TransformArrays &rest = skeleton.restPose;
+	const uint32_t nodeCount = static_cast<uint32_t>(skeleton.nodes.size());
+	const uint8_t *nodeMask = skeleton.reduceBones ? skeleton.lodMask.data() : nullptr;
+
+	std::fill(skeleton.translationWeights.begin(), skeleton.translationWeights.end(), 0.0f);
+	std::fill(skeleton.rotationWeights.begin(), skeleton.rotationWeights.end(), 0.0f);
+	std::fill(skeleton.scaleWeights.begin(), skeleton.scaleWeights.end(), 0.0f);
+	std::fill(skeleton.poseMask.begin(), skeleton.poseMask.end(), 0);
+
+	for (uint32_t i = 0; i < nodeCount; ++i)
 	{
-		float animTime = std::fmod(timeSecs - anim.start, anim.end);
+		pose.tx[i] = pose.ty[i] = pose.tz[i] = 0.0f;
+		pose.qx[i] = pose.qy[i] = pose.qz[i] = pose.qw[i] = 0.0f;
+		pose.sx[i] = pose.sy[i] = pose.sz[i] = 0.0f;
+	}
 
-		// go through each target and caluclate the animation transform and update on the transform manager side
-		for (auto &channel : anim.channels)
+	// first, the weighted sum of the override clips
+	for (uint32_t clipIndex : skeleton.activeClips)
+	{
+		const ClipInstance &clip = skeleton.clips[clipIndex];
+		if (clip.blendMode != BlendMode::Override || clip.weight <= 0.0f)
 		{
-			Object *obj = channel.object;
-			Sampler &sampler = anim.samplers[channel.samplerIndex];
+			continue;
+		}
+
+		AnimationInfo &anim = animations[skeleton.animationOffset + clipIndex];
+		sampleAnimation(anim, anim.start + clip.time, batch, nodeMask);
 
-			uint32_t timeIndex = sampler.indexFromTime(animTime);
-			float phase = sampler.getPhase(animTime);
+		const float w = clip.weight;
+		for (size_t i = 0; i < anim.channels.size(); ++i)
+		{
+			const Channel &channel = anim.channels[i];
+			const uint32_t slot = channel.poseIndex;
+			if (slot == UINT32_MAX || (nodeMask && !nodeMask[slot]))
+			{
+				continue;
+			}
 
 			switch (channel.pathType)
 			{
 			case Channel::PathType::Translation:
-			{
-				OEMaths::vec4f trans;
-				trans.mix(sampler.outputs[timeIndex], sampler.outputs[timeIndex + 1], phase);
-				transformManager.updateObjectTranslation(obj, trans);
+				pose.tx[slot] += batch.startX[i] * w;
+				pose.ty[slot] += batch.startY[i] * w;
+				pose.tz[slot] += batch.startZ[i] * w;
+				skeleton.translationWeights[slot] += w;
 				break;
-			}
 			case Channel::PathType::Scale:
+				pose.sx[slot] += batch.startX[i] * w;
+				pose.sy[slot] += batch.startY[i] * w;
+				pose.sz[slot] += batch.startZ[i] * w;
+				skeleton.scaleWeights[slot] += w;
+				break;
+			case Channel::PathType::Rotation:
 			{
-				OEMaths::vec4f scale;
-				scale.mix(sampler.outputs[timeIndex], sampler.outputs[timeIndex + 1], phase);
-				transformManager.updateObjectScale(obj, scale);
+				// keep the rotations being summed in the same hemisphere
+				float dot = pose.qx[slot] * batch.startX[i] + pose.qy[slot] * batch.startY[i] +
+				            pose.qz[slot] * batch.startZ[i] + pose.qw[slot] * batch.startW[i];
+				float sw = dot < 0.0f ? -w : w;
+				pose.qx[slot] += batch.startX[i] * sw;
+				pose.qy[slot] += batch.startY[i] * sw;
+				pose.qz[slot] += batch.startZ[i] * sw;
+				pose.qw[slot] += batch.startW[i] * sw;
+				skeleton.rotationWeights[slot] += w;
 				break;
 			}
+			}
+			skeleton.poseMask[slot] = 1;
+		}
+	}
+
+	// the rest pose makes up the weights when they sum to less than one, otherwise the sum is normalised
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		// nodes removed by the bone reduction keep their last pose
+		if (nodeMask && !nodeMask[i])
+		{
+			const OEMaths::TransformArrays &prev = skeleton.previousPose;
+			pose.tx[i] = prev.tx[i];
+			pose.ty[i] = prev.ty[i];
+			pose.tz[i] = prev.tz[i];
+			pose.qx[i] = prev.qx[i];
+			pose.qy[i] = prev.qy[i];
+			pose.qz[i] = prev.qz[i];
+			pose.qw[i] = prev.qw[i];
+			pose.sx[i] = prev.sx[i];
+			pose.sy[i] = prev.sy[i];
+			pose.sz[i] = prev.sz[i];
+			continue;
+		}
+
+		float tw = skeleton.translationWeights[i];
+		float tRest = std::max(1.0f - tw, 0.0f);
+		float tNorm = 1.0f / std::max(tw, 1.0f);
+		pose.tx[i] = (pose.tx[i] + rest.tx[i] * tRest) * tNorm;
+		pose.ty[i] = (pose.ty[i] + rest.ty[i] * tRest) * tNorm;
+		pose.tz[i] = (pose.tz[i] + rest.tz[i] * tRest) * tNorm;
+
+		float sw = skeleton.scaleWeights[i];
+		float sRest = std::max(1.0f - sw, 0.0f);
+		float sNorm = 1.0f / std::max(sw, 1.0f);
+		pose.sx[i] = (pose.sx[i] + rest.sx[i] * sRest) * sNorm;
+		pose.sy[i] = (pose.sy[i] + rest.sy[i] * sRest) * sNorm;
+		pose.sz[i] = (pose.sz[i] + rest.sz[i] * sRest) * sNorm;
+
+		float rRest = std::max(1.0f - skeleton.rotationWeights[i], 0.0f);
+		float dot = pose.qx[i] * rest.qx[i] + pose.qy[i] * rest.qy[i] + pose.qz[i] * rest.qz[i] +
+		            pose.qw[i] * rest.qw[i];
+		rRest = dot < 0.0f ? -rRest : rRest;
+		float q[4] = { pose.qx[i] + rest.qx[i] * rRest, pose.qy[i] + rest.qy[i] * rRest,
+			           pose.qz[i] + rest.qz[i] * rRest, pose.qw[i] + rest.qw[i] * rRest };
+		normaliseQuat(q);
+		pose.qx[i] = q[0];
+		pose.qy[i] = q[1];
+		pose.qz[i] = q[2];
+		pose.qw[i] = q[3];
+	}
+
+	// then the additive clips are layered on top, as the difference from their first keyframe
+	for (uint32_t clipIndex : skeleton.activeClips)
+	{
+		const ClipInstance &clip = skeleton.clips[clipIndex];
+		if (clip.blendMode != BlendMode::Additive || clip.weight <= 0.0f)
+		{
+			continue;
+		}
+
+		AnimationInfo &anim = animations[skeleton.animationOffset + clipIndex];
+		sampleAnimation(anim, anim.start + clip.time, batch, nodeMask);
+
+		const float w = clip.weight;
+		for (size_t i = 0; i < anim.channels.size(); ++i)
+		{
+			const Channel &channel = anim.channels[i];
+			const uint32_t slot = channel.poseIndex;
+			if (slot == UINT32_MAX || (nodeMask && !nodeMask[slot]))
+			{
+				continue;
+			}
+
+			const float *ref = channel.reference;
+			switch (channel.pathType)
+			{
+			case Channel::PathType::Translation:
+				pose.tx[slot] += (batch.startX[i] - ref[0]) * w;
+				pose.ty[slot] += (batch.startY[i] - ref[1]) * w;
+				pose.tz[slot] += (batch.startZ[i] - ref[2]) * w;
+				break;
+			case Channel::PathType::Scale:
+				pose.sx[slot] *= 1.0f + (ref[0] != 0.0f ? batch.startX[i] / ref[0] - 1.0f : 0.0f) * w;
+				pose.sy[slot] *= 1.0f + (ref[1] != 0.0f ? batch.startY[i] / ref[1] - 1.0f : 0.0f) * w;
+				pose.sz[slot] *= 1.0f + (ref[2] != 0.0f ? batch.startZ[i] / ref[2] - 1.0f : 0.0f) * w;
+				break;
 			case Channel::PathType::Rotation:
 			{
-				OEMaths::quatf quat1{
-					sampler.outputs[timeIndex].getX(),
-					sampler.outputs[timeIndex].getY(),
-					sampler.outputs[timeIndex].getZ(),
-					sampler.outputs[timeIndex].getW(),
-				};
-
-				OEMaths::quatf quat2{ sampler.outputs[timeIndex + 1].getX(),
-					                  sampler.outputs[timeIndex + 1].getY(),
-					                  sampler.outputs[timeIndex + 1].getZ(),
-					                  sampler.outputs[timeIndex + 1].getW() };
-
-				// TODO: add cubic and step interpolation
-				OEMaths::quatf rot;
-				rot.linearMix(quat1, quat2, phase);
-				rot.normalise();
-				transformManager.updateObjectRotation(obj, rot);
+				// delta = inverse(reference) * sample, scaled by the weight from the identity
+				float invRef[4] = { -ref[0], -ref[1], -ref[2], ref[3] };
+				float sample[4] = { batch.startX[i], batch.startY[i], batch.startZ[i], batch.startW[i] };
+				float delta[4];
+				multiplyQuat(invRef, sample, delta);
+
+				float sign = delta[3] < 0.0f ? -1.0f : 1.0f;
+				delta[0] *= sign * w;
+				delta[1] *= sign * w;
+				delta[2] *= sign * w;
+				delta[3] = delta[3] * sign * w + (1.0f - w);
+				normaliseQuat(delta);
+
+				float current[4] = { pose.qx[slot], pose.qy[slot], pose.qz[slot], pose.qw[slot] };
+				float result[4];
+				multiplyQuat(current, delta, result);
+				normaliseQuat(result);
+				pose.qx[slot] = result[0];
+				pose.qy[slot] = result[1];
+				pose.qz[slot] = result[2];
+				pose.qw[slot] = result[3];
 				break;
 			}
-			case Channel::PathType::CubicScale:
-				// TODO
-				break;
-			case Channel::PathType::CublicTranslation:
-				// TODO
+			}
+			skeleton.poseMask[slot] = 1;
+		}
+	}
+}
+
+void AnimationManager::updateBounds(Skeleton &skeleton, TransformSource &transforms)
+{
+	const uint32_t nodeCount = static_cast<uint32_t>(skeleton.nodes.size());
+
+	// the root is the shallowest node of the skeleton
+	uint32_t minDepth = UINT32_MAX;
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		uint32_t index = skeleton.transformIndices[i];
+		uint32_t depth = index != UINT32_MAX ? transforms.getDepth(index) : UINT32_MAX;
+		skeleton.nodeDepths[i] = depth;
+		if (depth < minDepth)
+		{
+			minDepth = depth;
+			skeleton.rootNode = i;
+		}
+	}
+
+	uint32_t rootIndex = skeleton.transformIndices[skeleton.rootNode];
+	if (rootIndex == UINT32_MAX)
+	{
+		return;
+	}
+	const float *root = transforms.getWorldMatrix(rootIndex).getData();
+
+	float radiusSq = 0.0f;
+	for (uint32_t i = 0; i < nodeCount; ++i)
+	{
+		uint32_t index = skeleton.transformIndices[i];
+		if (index == UINT32_MAX)
+		{
+			continue;
+		}
+
+		skeleton.nodeDepths[i] -= minDepth;
+
+		const float *world = transforms.getWorldMatrix(index).getData();
+		float x = world[12] - root[12];
+		float y = world[13] - root[13];
+		float z = world[14] - root[14];
+		radiusSq = std::max(radiusSq, x * x + y * y + z * z);
+	}
+	skeleton.radius = std::sqrt(radiusSq);
+}
+
+void AnimationManager::updateLod(Skeleton &skeleton, TransformSource &transforms, const OEMaths::vec3f &cameraPos,
+                                 const float *frustumPlanes)
+{
+	uint32_t rootIndex = skeleton.transformIndices[skeleton.rootNode];
+	if (rootIndex == UINT32_MAX)
+	{
+		skeleton.updateInterval = 1;
+		skeleton.isVisible = true;
+		skeleton.reduceBones = false;
+		return;
+	}
+
+	const float *root = transforms.getWorldMatrix(rootIndex).getData();
+	float x = root[12];
+	float y = root[13];
+	float z = root[14];
+
+	// sphere against the frustum planes
+	skeleton.isVisible = true;
+	if (lodSettings.pauseOffscreen)
+	{
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			const float *plane = &frustumPlanes[i * 4];
+			if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -skeleton.radius)
+			{
+				skeleton.isVisible = false;
 				break;
-			default:
-				LOGGER_ERROR("Invalid animation pathtype encountered.");
 			}
 		}
 	}
+
+	float dx = x - cameraPos.getX();
+	float dy = y - cameraPos.getY();
+	float dz = z - cameraPos.getZ();
+	float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz) - skeleton.radius, 0.0f);
+
+	skeleton.updateInterval = 1;
+	if (distance >= lodSettings.quarterRateDistance)
+	{
+		skeleton.updateInterval = 4;
+	}
+	else if (distance >= lodSettings.halfRateDistance)
+	{
+		skeleton.updateInterval = 2;
+	}
+
+	bool reduceBones = lodSettings.boneReductionDistance > 0.0f && distance >= lodSettings.boneReductionDistance;
+	if (reduceBones && !skeleton.reduceBones)
+	{
+		for (uint32_t i = 0; i < skeleton.nodes.size(); ++i)
+		{
+			skeleton.lodMask[i] = skeleton.nodeDepths[i] <= lodSettings.reducedMaxDepth ? 1 : 0;
+		}
+	}
+	skeleton.reduceBones = reduceBones;
+}
+
+void AnimationManager::blendPose(Skeleton &skeleton, const float phase)
+{
+	const OEMaths::TransformArrays &from = skeleton.previousPose;
+	const OEMaths::TransformArrays &to = skeleton.pose;
+	OEMaths::TransformArrays &out = skeleton.blendedPose;
+	const float inv = 1.0f - phase;
+
+	for (uint32_t i = 0; i < skeleton.nodes.size(); ++i)
+	{
+		out.tx[i] = from.tx[i] * inv + to.tx[i] * phase;
+		out.ty[i] = from.ty[i] * inv + to.ty[i] * phase;
+		out.tz[i] = from.tz[i] * inv + to.tz[i] * phase;
+		out.sx[i] = from.sx[i] * inv + to.sx[i] * phase;
+		out.sy[i] = from.sy[i] * inv + to.sy[i] * phase;
+		out.sz[i] = from.sz[i] * inv + to.sz[i] * phase;
+
+		float dot = from.qx[i] * to.qx[i] + from.qy[i] * to.qy[i] + from.qz[i] * to.qz[i] + from.qw[i] * to.qw[i];
+		float sign = dot < 0.0f ? -phase : phase;
+		float q[4] = { from.qx[i] * inv + to.qx[i] * sign, from.qy[i] * inv + to.qy[i] * sign,
+			           from.qz[i] * inv + to.qz[i] * sign, from.qw[i] * inv + to.qw[i] * sign };
+		normaliseQuat(q);
+		out.qx[i] = q[0];
+		out.qy[i] = q[1];
+		out.qz[i] = q[2];
+		out.qw[i] = q[3];
+	}
+}
+
+void AnimationManager::updateSkeleton(Skeleton &skeleton, SampleBatch &batch, TransformSource &transforms,
+                                      const OEMaths::vec3f &cameraPos, const float *frustumPlanes,
+                                      const float timeStep)
+{
+	updateClips(skeleton, timeStep);
+	if (skeleton.activeClips.empty() || skeleton.nodes.empty())
+	{
+		return;
+	}
+
+	updateLod(skeleton, transforms, cameraPos, frustumPlanes);
+
+	// off-screen skeletons are paused - they snap to the current pose when they become visible again
+	if (!skeleton.isVisible)
+	{
+		skeleton.hasPose = false;
+		return;
+	}
+
+	if (!skeleton.hasPose || skeleton.framesSinceUpdate >= skeleton.updateInterval)
+	{
+		std::swap(skeleton.previousPose, skeleton.pose);
+		evaluateSkeleton(skeleton, batch);
+		updateBounds(skeleton, transforms);
+
+		skeleton.framesSinceUpdate = 0;
+		if (!skeleton.hasPose)
+		{
+			skeleton.previousPose = skeleton.pose;
+			skeleton.hasPose = true;
+
+			// stagger the updates, so skeletons at the same lod aren't all evaluated on the same frame
+			uint32_t skeletonIndex = static_cast<uint32_t>(&skeleton - skeletons.data());
+			skeleton.framesSinceUpdate = skeletonIndex % skeleton.updateInterval;
+		}
+	}
+
+	float phase = static_cast<float>(skeleton.framesSinceUpdate + 1) / static_cast<float>(skeleton.updateInterval);
+	if (phase >= 1.0f)
+	{
+		skeleton.outputPose = &skeleton.pose;
+	}
+	else
+	{
+		blendPose(skeleton, phase);
+		skeleton.outputPose = &skeleton.blendedPose;
+	}
+	++skeleton.framesSinceUpdate;
+}
+
+void AnimationManager::updateFrame(double time, double dt, std::unique_ptr<ObjectManager> &objectManager,
+                                   ComponentInterface *componentInterface)
+{
+	auto &transformManager = componentInterface->getManager<TransformManager>();
+	auto &cameraManager = componentInterface->getManager<CameraManager>();
+
+	// the clips are advanced by the change in engine time (in ns)
+	float timeStep = lastTime >= 0.0 ? static_cast<float>((time - lastTime) / 1000000000.0) : 0.0f;
+	lastTime = time;
+
+	// extract the frustum planes from the view-projection matrix - the rows are combined as the matrix is
+	// column major
+	float frustumPlanes[24];
+	const OEMaths::mat4f viewProj = cameraManager.getViewProjection();
+	const float *m = viewProj.getData();
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		for (uint32_t j = 0; j < 2; ++j)
+		{
+			float sign = j == 0 ? 1.0f : -1.0f;
+			float *plane = &frustumPlanes[(i * 2 + j) * 4];
+			plane[0] = m[3] + m[i] * sign;
+			plane[1] = m[7] + m[4 + i] * sign;
+			plane[2] = m[11] + m[8 + i] * sign;
+			plane[3] = m[15] + m[12 + i] * sign;
+
+			float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			if (length > 0.0f)
+			{
+				plane[0] /= length;
+				plane[1] /= length;
+				plane[2] /= length;
+				plane[3] /= length;
+			}
+		}
+	}
+
+	// preparing reads from the transform manager, so is done before the jobs are started
+	TransformManagerSource transforms(transformManager);
+	prepareSkeletons(transforms);
+	evaluateSkeletons(transforms, cameraManager.getPosition(), frustumPlanes, timeStep);
+
+	// the transform manager isn't thread safe, so the poses are handed over on this thread - each in one go
+	for (auto &skeleton : skeletons)
+	{
+		if (skeleton.outputPose)
+		{
+			transformManager.updateLocalPose(skeleton.transformIndices, *skeleton.outputPose, skeleton.poseMask);
+			skeleton.outputPose = nullptr;
+		}
+	}
+}
+
+void AnimationManager::prepareSkeletons(TransformSource &transforms)
+{
+	for (auto &skeleton : skeletons)
+	{
+		if (!skeleton.isPrepared)
+		{
+			prepareSkeleton(skeleton, transforms);
+		}
+	}
+}
+
+void AnimationManager::evaluateSkeletons(TransformSource &transforms, const OEMaths::vec3f &cameraPos,
+                                         const float *frustumPlanes, const float timeStep, const bool threaded)
+{
+	// each skeleton only touches its own clips, channels and pose, so they are evaluated in parallel. Each job
+	// has its own sample batch
+	const uint32_t skeletonCount = static_cast<uint32_t>(skeletons.size());
+
+	uint32_t jobCount = std::min(workerCount, (skeletonCount + MinSkeletonsPerJob - 1) / MinSkeletonsPerJob);
+	jobCount = threaded ? std::max(jobCount, 1u) : 1;
+	if (batches.size() < jobCount)
+	{
+		batches.resize(jobCount);
+	}
+
+	const uint32_t skeletonsPerJob = (skeletonCount + jobCount - 1) / jobCount;
+
+	auto evaluateRange = [&](const uint32_t start, const uint32_t end, SampleBatch &batch) {
+		for (uint32_t i = start; i < end; ++i)
+		{
+			updateSkeleton(skeletons[i], batch, transforms, cameraPos, frustumPlanes, timeStep);
+		}
+	};
+
+	if (jobCount == 1)
+	{
+		evaluateRange(0, skeletonCount, batches[0]);
+		return;
+	}
+
+	std::vector<TaskFuture<void>> jobs;
+	jobs.reserve(jobCount);
+	for (uint32_t job = 0; job < jobCount; ++job)
+	{
+		uint32_t start = job * skeletonsPerJob;
+		uint32_t end = std::min(start + skeletonsPerJob, skeletonCount);
+		jobs.emplace_back(threadPool->submitTask(evaluateRange, start, end, std::ref(batches[job])));
+	}
+
+	// join before any of the poses are passed to the transforms
+	for (auto &job : jobs)
+	{
+		job.get();
+	}
 }
 
 } // namespace OmegaEngine
@@ -3,6 +3,8 @@
 #include "Managers/ManagerBase.h"
 #include "OEMaths/OEMaths.h"
 #include "OEMaths/OEMaths_Quat.h"
+#include "OEMaths/OEMaths_simd.h"
+#include "Models/AnimationCompression.h"
 #include "ObjectInterface/Object.h"
 
 #include <memory>
@@ -14,11 +16,11 @@ namespace OmegaEngine
 {
 // forward declerations
 class Object;
-class TransformManager;
 class ObjectManager;
 struct ModelAnimation;
 struct AnimationComponent;
 class ComponentInterface;
+class ThreadPool;
 
 class AnimationManager : public ManagerBase
 {
@@ -34,11 +36,29 @@ public:
 			CubicSpline
 		} interpolationType;
 
-		std::vector<float> timeStamps;
-		std::vector<OEMaths::vec4f> outputs;
+		// the keyframes are compressed when the animation is added and decoded as they are sampled
+		CompressedTimeline timeline;
+		CompressedTrack outputs;
 
-		uint32_t indexFromTime(double time);
-		float getPhase(double time);
+		// cubic splines store an in tangent, the value and an out tangent for each keyframe
+		uint32_t getOutputStride() const
+		{
+			return interpolationType == InterpolationType::CubicSpline ? 3 : 1;
+		}
+
+		// the cursor is the index found on the previous call - as time usually moves forward by less than
+		// one interval per frame, it's stepped forwards rather than searching from the first keyframe
+		uint32_t indexFromTime(const float time, uint32_t &cursor) const;
+
+		// the reciprocal of the keyframe interval, cached by the channel so the phase is just a multiply.
+		// Zero length intervals are given zero
+		float getInvInterval(const uint32_t index) const;
+		float getPhase(const float time, const uint32_t index, const float invInterval) const;
+
+		uint32_t size() const
+		{
+			return timeline.size();
+		}
 	};
 
 	struct Channel
@@ -47,13 +67,44 @@ public:
 		{
 			Translation,
 			Rotation,
-			Scale,
-			CublicTranslation,
-			CubicScale
+			Scale
 		} pathType;
 
-		Object *object;
 		uint32_t samplerIndex;
+
+		// the node this channel drives - the slot in the skeleton's pose
+		uint32_t poseIndex = UINT32_MAX;
+
+		// the first keyframe - additive clips are applied relative to this
+		float reference[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		// the cached playhead for this channel, and the reciprocal of the interval it points at
+		uint32_t cursor = 0;
+		float invInterval = 0.0f;
+	};
+
+	// the number of intervals the cursor is stepped before falling back to a binary search
+	static constexpr uint32_t MaxCursorSteps = 4;
+
+	// the keyframes either side of the current time for each channel of an animation, gathered so
+	// the interpolation can be carried out in one pass over all channels
+	struct SampleBatch
+	{
+		void resize(const size_t size);
+
+		std::vector<float> phase;
+		std::vector<float> startX, startY, startZ, startW;
+		std::vector<float> endX, endY, endZ, endW;
+
+		// the channels with cubic spline samplers, along with the out tangent of the start keyframe and the
+		// in tangent of the end keyframe, both scaled by the interval
+		struct CubicSample
+		{
+			uint32_t channel;
+			float startTangent[4];
+			float endTangent[4];
+		};
+		std::vector<CubicSample> cubics;
 	};
 
 	struct AnimationInfo
@@ -63,24 +114,225 @@ public:
 		float end = std::numeric_limits<float>::min();
 		std::vector<Sampler> samplers;
 		std::vector<Channel> channels;
+
+		// the skeleton whose nodes the channels drive
+		uint32_t skeletonIndex = UINT32_MAX;
+	};
+
+	enum class BlendMode
+	{
+		// clips are blended together by their weights, and with the rest pose if the weights sum to less than one
+		Override,
+		// applied on top of the blended pose, relative to the first keyframe of the clip
+		Additive
+	};
+
+	// the playback state of one of a skeleton's animations
+	struct ClipInstance
+	{
+		enum class State
+		{
+			Stopped,
+			Playing,
+			Paused
+		} state = State::Stopped;
+
+		BlendMode blendMode = BlendMode::Override;
+
+		// in seconds, relative to the start of the animation
+		float time = 0.0f;
+		float speed = 1.0f;
+		bool loop = true;
+
+		// the weight moves towards the target at the fade rate (per second)
+		float weight = 0.0f;
+		float targetWeight = 1.0f;
+		float fadeRate = 0.0f;
+
+		// set when the clip is fading out, so it's stopped once the weight reaches zero
+		bool stopOnFade = false;
+	};
+
+	// The nodes driven by the animations of one model instance, along with the pose they are blended into.
+	// The pose is handed to the transform manager in one go each frame
+	struct Skeleton
+	{
+		// the animations of this skeleton, each has a clip instance
+		uint32_t animationOffset = 0;
+		std::vector<ClipInstance> clips;
+
+		// indices into the clips, in the order they were played - later clips are layered on top
+		std::vector<uint32_t> activeClips;
+
+		std::vector<Object *> nodes;
+
+		// resolved from the nodes when the skeleton is prepared
+		std::vector<uint32_t> transformIndices;
+		bool isPrepared = false;
+
+		// the local transforms of the nodes before any animation is applied
+		OEMaths::TransformArrays restPose;
+
+		// the blended local transforms for this frame and the summed weights of the clips which wrote them
+		OEMaths::TransformArrays pose;
+		std::vector<float> translationWeights, rotationWeights, scaleWeights;
+
+		// whether a node was written by any clip this frame
+		std::vector<uint8_t> poseMask;
+
+		// lod - skeletons further from the camera are evaluated less often. In between, the pose written to the
+		// transforms is interpolated from the previous evaluation to the latest
+		OEMaths::TransformArrays previousPose;
+		OEMaths::TransformArrays blendedPose;
+		uint32_t updateInterval = 1;
+		uint32_t framesSinceUpdate = 0;
+		bool hasPose = false;
+		bool isVisible = true;
+
+		// the bounding sphere around the nodes, centred on the root node. The radius is updated when evaluated
+		uint32_t rootNode = 0;
+		float radius = 0.0f;
+
+		// the depth of each node below the root node - used for the bone reduction of distant skeletons
+		std::vector<uint32_t> nodeDepths;
+		std::vector<uint8_t> lodMask;
+		bool reduceBones = false;
+
+		// set by the evaluation jobs to the pose which is to be passed to the transform manager
+		OEMaths::TransformArrays *outputPose = nullptr;
+	};
+
+	struct LodSettings
+	{
+		// camera distances at which the skeletons are evaluated every 2nd and every 4th frame
+		float halfRateDistance = 20.0f;
+		float quarterRateDistance = 50.0f;
+
+		// beyond this distance only nodes up to the max depth below the root are animated - the rest keep their
+		// last pose. Zero disables the bone reduction
+		float boneReductionDistance = 80.0f;
+		uint32_t reducedMaxDepth = 3;
+
+		// skeletons outside of the view frustum aren't evaluated at all - their clips still advance
+		bool pauseOffscreen = true;
+	};
+
+	// the transforms of the nodes which are read when preparing and evaluating the skeletons. In the engine these
+	// come from the transform manager
+	class TransformSource
+	{
+	public:
+		virtual ~TransformSource() = default;
+
+		// the local transforms of the nodes before any animation is applied
+		virtual void getLocalPose(const std::vector<uint32_t> &indices, OEMaths::TransformArrays &pose) = 0;
+
+		virtual const OEMaths::mat4f &getWorldMatrix(const uint32_t index) = 0;
+		virtual uint32_t getDepth(const uint32_t index) = 0;
 	};
 
 	AnimationManager();
 	~AnimationManager();
 
 	void addComponentToManager(AnimationComponent *component, Object &object);
-	void addAnimation(std::unique_ptr<ModelAnimation> &animation);
+
+	// a skeleton is added for each model instance with animations - the animations of the model are then
+	// added to it. The first animation added is played by default
+	uint32_t addSkeleton();
+	void addAnimation(std::unique_ptr<ModelAnimation> &animation, const uint32_t skeletonIndex);
+
+	// returns the skeleton which the animated object belongs to
+	uint32_t getSkeletonIndex(Object &object);
+
+	// clip playback - the animation index is relative to the model's animations. Fade times are in seconds
+	void play(const uint32_t skeletonIndex, const uint32_t animIndex, const float fadeTime = 0.0f,
+	          const BlendMode blendMode = BlendMode::Override);
+	void stop(const uint32_t skeletonIndex, const uint32_t animIndex, const float fadeTime = 0.0f);
+	void setPaused(const uint32_t skeletonIndex, const uint32_t animIndex, const bool paused);
+	void setSpeed(const uint32_t skeletonIndex, const uint32_t animIndex, const float speed);
+	void setWeight(const uint32_t skeletonIndex, const uint32_t animIndex, const float weight);
+	void setLooping(const uint32_t skeletonIndex, const uint32_t animIndex, const bool loop);
+
+	// fades out all the override clips playing on the skeleton, whilst fading in the new clip
+	void crossFade(const uint32_t skeletonIndex, const uint32_t animIndex, const float fadeTime);
 
 	void updateFrame(double time, double dt, std::unique_ptr<ObjectManager> &objectManager,
 	                 ComponentInterface *componentInterface) override;
 
+	// resolves the transforms of skeletons which have had nodes added. This reads from the transforms, so must be
+	// called before the skeletons are evaluated
+	void prepareSkeletons(TransformSource &transforms);
+
+	// advances the clips and evaluates the pose of every skeleton, split into jobs on the thread pool unless
+	// threading is disabled. The pose to be written to each skeleton's transforms is left in its output pose
+	void evaluateSkeletons(TransformSource &transforms, const OEMaths::vec3f &cameraPos, const float *frustumPlanes,
+	                       const float timeStep, const bool threaded = true);
+
 	uint32_t getBufferOffset() const
 	{
 		return static_cast<uint32_t>(animations.size());
 	}
 
+	// the size and error of all the animations compressed so far
+	const AnimationCompressor::Stats &getCompressionStats() const
+	{
+		return compressor.getStats();
+	}
+
+	void setLodSettings(const LodSettings &settings)
+	{
+		lodSettings = settings;
+	}
+
+	// evaluates the channels of an animation at the specified time - the results are left in the batch. If a
+	// node mask is given, the channels of nodes which aren't set are skipped
+	void sampleAnimation(AnimationInfo &anim, const float animTime, SampleBatch &batch,
+	                     const uint8_t *nodeMask = nullptr);
+
+private:
+	ClipInstance &getClip(const uint32_t skeletonIndex, const uint32_t animIndex);
+
+	void prepareSkeleton(Skeleton &skeleton, TransformSource &transforms);
+
+	// advances the time and the fades of the active clips, and removes those which have stopped
+	void updateClips(Skeleton &skeleton, const float timeStep);
+
+	// selects the update rate and bone reduction of the skeleton from its distance to the camera and whether it
+	// is within the view frustum
+	void updateLod(Skeleton &skeleton, TransformSource &transforms, const OEMaths::vec3f &cameraPos,
+	               const float *frustumPlanes);
+	void updateBounds(Skeleton &skeleton, TransformSource &transforms);
+
+	// samples and blends all the active clips into the skeleton's pose
+	void evaluateSkeleton(Skeleton &skeleton, SampleBatch &batch);
+
+	// all the per-frame work for one skeleton - this is called from the evaluation jobs, so must only alter the
+	// skeleton, its animations and the batch
+	void updateSkeleton(Skeleton &skeleton, SampleBatch &batch, TransformSource &transforms,
+	                    const OEMaths::vec3f &cameraPos, const float *frustumPlanes, const float timeStep);
+
+	// interpolates from the previous to the latest pose, hiding the lower update rate of distant skeletons
+	void blendPose(Skeleton &skeleton, const float phase);
+
 private:
 	std::vector<AnimationInfo> animations;
+	std::vector<Skeleton> skeletons;
+
+	// the engine time of the last update - the clips are advanced by the difference
+	double lastTime = -1.0;
+
+	// the skeletons are split into jobs of at least this many
+	static constexpr uint32_t MinSkeletonsPerJob = 8;
+
+	std::unique_ptr<ThreadPool> threadPool;
+	uint32_t workerCount = 1;
+
+	// one for each job - kept here to avoid allocating each frame
+	std::vector<SampleBatch> batches;
+
+	AnimationCompressor compressor;
+
+	LodSettings lodSettings;
 };
 
 } // namespace OmegaEngine
@@ -113,6 +113,26 @@ public:
 		return cameras[cameraIndex].zFar;
 	}
 
+	const OEMaths::vec3f &getPosition() const
+	{
+		return currentPosition;
+	}
+
+	const OEMaths::mat4f &getProjection() const
+	{
+		return currentProjMatrix;
+	}
+
+	const OEMaths::mat4f &getView() const
+	{
+		return currentViewMatrix;
+	}
+
+	OEMaths::mat4f getViewProjection() const
+	{
+		return currentProjMatrix * currentViewMatrix;
+	}
+
 private:
 	// all the cameras that had been added to the manager
 	std::vector<Camera> cameras;
@@ -7,28 +7,217 @@
 #include "ObjectInterface/ObjectManager.h"
 #include "VulkanAPI/BufferManager.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
 
 namespace OmegaEngine
 {
 
 LightManager::LightManager()
 {
-	// allocate the memory required for the light POV data
-	alignedPovDataSize = VulkanAPI::Util::alignmentSize(sizeof(LightPOV));
-	lightPovData = (LightPOV*)Util::alloc_align(alignedPovDataSize, alignedPovDataSize * (MAX_SPOT_LIGHTS * 2));
+	lightBuffer = std::make_unique<VulkanAPI::MappedBuffer>("Light", sizeof(LightInfo), LightChunkSize, false);
+	clusterBuffer = std::make_unique<VulkanAPI::MappedBuffer>("LightClusters", sizeof(ClusterBufferInfo), 1);
+	lightIndexBuffer =
+	    std::make_unique<VulkanAPI::MappedBuffer>("LightIndices", sizeof(uint32_t), LightIndexChunkSize, false);
+	lightPovBuffer = std::make_unique<VulkanAPI::MappedBuffer>("LightDynamic", sizeof(LightPOV), LightPovChunkSize);
+	shadowBuffer =
+	    std::make_unique<VulkanAPI::MappedBuffer>("LightShadows", sizeof(ShadowViewInfo), LightPovChunkSize, false);
 }
 
 LightManager::~LightManager()
 {
-	_aligned_free(lightPovData);
 }
 
-void LightManager::calculatePointIntensity(float intensity, PointLight& light)
+uint32_t LightManager::getAlignmentSize() const
 {
-	light.intensity = intensity * static_cast<float>(M_1_PI) * 0.25f;
+	return lightPovBuffer->getAlignedSize();
 }
 
-void LightManager::calculateSpotIntensity(float intensity, float outerCone, float innerCone, SpotLight& spotLight)
+void LightManager::setShadowAtlasSize(const uint32_t size)
+{
+	shadowAtlas.init(size);
+
+	// all views are given new tiles next frame
+	for (uint32_t i = 0; i < shadowViews.size(); ++i)
+	{
+		shadowViews[i].tile = ShadowAtlas::Tile{};
+		shadowViewChanged[i] = 1;
+	}
+}
+
+bool LightManager::ShadowView::intersects(const float center[3], const float radius) const
+{
+	for (const float* plane : planes)
+	{
+		if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void LightManager::invalidateShadows(const float center[3], const float radius)
+{
+	for (ShadowView& view : shadowViews)
+	{
+		if (!view.needsRender && view.tile.isValid() && view.intersects(center, radius))
+		{
+			view.needsRender = true;
+		}
+	}
+}
+
+void LightManager::clearShadowCasters()
+{
+	casterX.clear();
+	casterY.clear();
+	casterZ.clear();
+	casterRadius.clear();
+}
+
+uint32_t LightManager::addShadowCaster(const float center[3], const float radius)
+{
+	casterX.emplace_back(center[0]);
+	casterY.emplace_back(center[1]);
+	casterZ.emplace_back(center[2]);
+	casterRadius.emplace_back(radius);
+	return static_cast<uint32_t>(casterRadius.size() - 1);
+}
+
+bool LightManager::cullShadowCasters()
+{
+	const uint32_t casterCount = static_cast<uint32_t>(casterRadius.size());
+
+	// the lists of the last cull are kept to compare against, and their storage reused for the next
+	casterViewList.swap(prevCasterViewList);
+	casterViewOffsets.swap(prevCasterViewOffsets);
+
+	// the casters within each view - views that are up to date, or have no tile, aren't drawn so are left empty
+	bool hasDrawnViews = false;
+	shadowCasterList.clear();
+	for (ShadowView& view : shadowViews)
+	{
+		view.casterOffset = static_cast<uint32_t>(shadowCasterList.size());
+
+		if (view.needsRender && view.tile.isValid())
+		{
+			hasDrawnViews = true;
+			for (uint32_t i = 0; i < casterCount; ++i)
+			{
+				const float center[3] = { casterX[i], casterY[i], casterZ[i] };
+				if (view.intersects(center, casterRadius[i]))
+				{
+					shadowCasterList.emplace_back(i);
+				}
+			}
+		}
+
+		view.casterCount = static_cast<uint32_t>(shadowCasterList.size()) - view.casterOffset;
+	}
+
+	// the same pairs by caster, as the casters are what is drawn. Each offset is first set to the end of the
+	// caster's run, then the views are filled in backwards so each run ends up in ascending order
+	casterViewOffsets.assign(casterCount + 1, 0);
+	for (uint32_t caster : shadowCasterList)
+	{
+		++casterViewOffsets[caster];
+	}
+
+	uint32_t end = 0;
+	for (uint32_t& offset : casterViewOffsets)
+	{
+		end += offset;
+		offset = end;
+	}
+
+	casterViewList.resize(shadowCasterList.size());
+	for (uint32_t i = static_cast<uint32_t>(shadowViews.size()); i-- > 0;)
+	{
+		const ShadowView& view = shadowViews[i];
+		for (uint32_t j = view.casterOffset; j < view.casterOffset + view.casterCount; ++j)
+		{
+			casterViewList[--casterViewOffsets[shadowCasterList[j]]] = i;
+		}
+	}
+
+	// a caster whose views differ is drawn into other tiles, or is added to or left out of the queue
+	bool casterViewsChanged = casterViewList != prevCasterViewList || casterViewOffsets != prevCasterViewOffsets;
+	return hasDrawnViews || casterViewsChanged;
+}
+
+const uint32_t* LightManager::getCasterViews(const uint32_t caster, uint32_t& count) const
+{
+	if (caster + 1 >= casterViewOffsets.size())
+	{
+		count = 0;
+		return nullptr;
+	}
+
+	count = casterViewOffsets[caster + 1] - casterViewOffsets[caster];
+	return casterViewList.data() + casterViewOffsets[caster];
+}
+
+uint32_t LightManager::LightArrays::add(const OEMaths::vec3f& position, const OEMaths::vec3f& target,
+                                       const OEMaths::vec3f& colour, const float lightFov, const float lightIntensity,
+                                       const float lightFallOut, const LightAnimateType animType,
+                                       const float animVel, const uint32_t firstShadowView)
+{
+	const uint32_t index = size();
+
+	posX.emplace_back(position.getX());
+	posY.emplace_back(position.getY());
+	posZ.emplace_back(position.getZ());
+	targetX.emplace_back(target.getX());
+	targetY.emplace_back(target.getY());
+	targetZ.emplace_back(target.getZ());
+	colourR.emplace_back(colour.getX());
+	colourG.emplace_back(colour.getY());
+	colourB.emplace_back(colour.getZ());
+	intensity.emplace_back(lightIntensity);
+	fov.emplace_back(lightFov);
+	fallOut.emplace_back(lightFallOut);
+	scale.emplace_back(0.0f);
+	offset.emplace_back(0.0f);
+
+	rotateX.emplace_back(animType == LightAnimateType::RotateX ? 1.0f : 0.0f);
+	rotateY.emplace_back(animType == LightAnimateType::RotateY ? 1.0f : 0.0f);
+	rotateZ.emplace_back(animType == LightAnimateType::RotateZ ? 1.0f : 0.0f);
+	velocity.emplace_back(animVel);
+
+	shadowView.emplace_back(firstShadowView);
+
+	if (animType != LightAnimateType::Static)
+	{
+		animBegin = animBegin == animEnd ? index : animBegin;
+		animEnd = index + 1;
+	}
+
+	markDirty(index, index + 1);
+	return index;
+}
+
+void LightManager::LightArrays::markDirty(const uint32_t begin, const uint32_t end)
+{
+	if (dirtyBegin == dirtyEnd)
+	{
+		dirtyBegin = begin;
+		dirtyEnd = end;
+		return;
+	}
+	dirtyBegin = std::min(dirtyBegin, begin);
+	dirtyEnd = std::max(dirtyEnd, end);
+}
+
+float LightManager::calculatePointIntensity(float intensity)
+{
+	return intensity * static_cast<float>(M_1_PI) * 0.25f;
+}
+
+float LightManager::calculateSpotIntensity(float intensity, float outerCone, float innerCone, float& scale,
+                                           float& offset)
 {
 	// first calculate the spotlight cone values
 	float outer = std::min(std::abs(outerCone), static_cast<float>(M_PI));
@@ -37,82 +226,66 @@ void LightManager::calculateSpotIntensity(float intensity, float outerCone, floa
 
 	float cosOuter = std::cos(outer);
 	float cosInner = std::cos(inner);
-	spotLight.scale = 1.0f / std::max(1.0f / 1024.0f, cosInner - cosOuter);
-	spotLight.offset = -cosOuter * spotLight.scale;
+	scale = 1.0f / std::max(1.0f / 1024.0f, cosInner - cosOuter);
+	offset = -cosOuter * scale;
 
 	// this is a more focused spot - a unfocused spot would be:#
 	// intensity * static_cast<float>(M_1_PI)
-	cosOuter = -spotLight.offset / spotLight.scale;
+	cosOuter = -offset / scale;
 	float cosHalfOuter = std::sqrt((1.0f + cosOuter) * 0.5f);
-	spotLight.intensity = intensity / (2.0f * static_cast<float>(M_PI) * (1.0f - cosHalfOuter));
+	return intensity / (2.0f * static_cast<float>(M_PI) * (1.0f - cosHalfOuter));
 }
 
 void LightManager::addSpotLight(const OEMaths::vec3f& position, const OEMaths::vec3f& target,
                                 const OEMaths::vec3f& colour, const float fov, float intensity, float fallOut,
                                 float innerCone, float outerCone, const LightAnimateType animType, const float animVel)
 {
-	auto light = std::make_unique<SpotLight>();
-	light->position = position;
-	light->target = target;
-	light->colour = colour;
-	light->fov = fov;
-	light->type = LightType::Spot;
-	light->radius = fallOut * fallOut;
+	uint32_t index = spotLights.add(position, target, colour, fov, 0.0f, fallOut, animType, animVel,
+	                                addShadowViews(LightType::Spot, spotLights.size(), 1));
 
 	// carry out some of the calculations on the cpu side to save time
-	calculateSpotIntensity(intensity, outerCone, innerCone, *light);
-
-	// animation part
-	LightAnimateInfo anim;
-	anim.animationType = animType;
-	anim.velocity = animVel;
-
-	lights.emplace_back(std::make_tuple(std::move(light), anim));
-
-	isDirty = true;
+	spotLights.intensity[index] =
+	    calculateSpotIntensity(intensity, outerCone, innerCone, spotLights.scale[index], spotLights.offset[index]);
 }
 
 void LightManager::addPointLight(const OEMaths::vec3f& position, const OEMaths::vec3f& target,
                                  const OEMaths::vec3f& colour, float fov, float intensity, float fallOut,
                                  const LightAnimateType animType, const float animVel)
 {
-	auto light = std::make_unique<PointLight>();
-	light->position = position;
-	light->target = target;
-	light->colour = colour;
-	light->radius = fallOut * fallOut;
-	light->fov = fov;
-	light->type = LightType::Point;
-
 	// carry out some of the calculations on the cpu side to save time
-	calculatePointIntensity(intensity, *light);
-
-	// animation part - defualt
-	LightAnimateInfo anim;
-	anim.animationType = animType;
-	anim.velocity = animVel;
-
-	lights.emplace_back(std::make_tuple(std::move(light), anim));
-
-	isDirty = true;
+	pointLights.add(position, target, colour, fov, calculatePointIntensity(intensity), fallOut, animType, animVel,
+	                addShadowViews(LightType::Point, pointLights.size(), 1));
 }
 
 void LightManager::addDirectionalLight(const OEMaths::vec3f& position, const OEMaths::vec3f& target,
                                        const OEMaths::vec3f& colour, float fov, float intensity)
 {
-	auto light = std::make_unique<DirectionalLight>();
-	light->position = position;
-	light->target = target;
-	light->colour = colour;
-	light->fov = fov;
-	light->type = LightType::Directional;
-	light->intensity = intensity;
+	dirLights.add(position, target, colour, fov, intensity, 0.0f, LightAnimateType::Static, 0.0f,
+	              addShadowViews(LightType::Directional, dirLights.size(), CascadeCount));
+}
 
-	lights.emplace_back(std::make_tuple(std::move(light), LightAnimateInfo{}));
+void LightManager::animateLights(LightArrays& lights, const float sinAngle, const float cosAngle)
+{
+	if (lights.animBegin == lights.animEnd)
+	{
+		return;
+	}
 
-	isDirty = true;
-}
+	// every light rotates by the same angle, so this is a straight run over the arrays. Static lights that sit
+	// within the range have no rotate weights and are left where they are
+	for (uint32_t i = lights.animBegin; i < lights.animEnd; ++i)
+	{
+		float sinPos = std::abs(sinAngle * lights.velocity[i]);
+		float cosPos = cosAngle * lights.velocity[i];
+
+		lights.posX[i] += (lights.rotateY[i] + lights.rotateZ[i]) * (sinPos - lights.posX[i]);
+		lights.posY[i] +=
+		    lights.rotateX[i] * (sinPos - lights.posY[i]) + lights.rotateZ[i] * (cosPos - lights.posY[i]);
+		lights.posZ[i] += (lights.rotateX[i] + lights.rotateY[i]) * (cosPos - lights.posZ[i]);
+	}
 
+	lights.markDirty(lights.animBegin, lights.animEnd);
+}
 
 void LightManager::updateLightPositions(double time, double dt)
 {
@@ -128,125 +301,495 @@ void LightManager::updateLightPositions(double time, double dt)
 		timer -= 1.0f;
 	}
 
-	for (auto& info : lights)
+	float angle = OEMaths::radians(timer * 360.0f);
+	float sinAngle = std::sin(angle);
+	float cosAngle = std::cos(angle);
+
+	animateLights(spotLights, sinAngle, cosAngle);
+	animateLights(pointLights, sinAngle, cosAngle);
+	animateLights(dirLights, sinAngle, cosAngle);
+}
+
+uint32_t LightManager::addShadowViews(const LightType type, const uint32_t light, const uint32_t count)
+{
+	const uint32_t first = static_cast<uint32_t>(shadowViews.size());
+	for (uint32_t cascade = 0; cascade < count; ++cascade)
+	{
+		ShadowView view;
+		view.type = type;
+		view.light = light;
+		view.cascade = cascade;
+		shadowViews.emplace_back(view);
+		shadowViewChanged.emplace_back(1);
+	}
+	return first;
+}
+
+bool LightManager::setShadowView(ShadowView& view, const OEMaths::mat4f& viewProj)
+{
+	if (memcmp(view.viewProj.getData(), viewProj.getData(), 16 * sizeof(float)) == 0)
+	{
+		return false;
+	}
+	view.viewProj = viewProj;
+
+	// the planes are found from the rows of the matrix - left, right, bottom, top, then near and far. The depth
+	// runs from zero to one, so the near plane is the depth row on its own
+	const float* m = viewProj.getData();
+	for (uint32_t i = 0; i < 6; ++i)
 	{
-		auto& light = std::get<0>(info);
-		auto& anim = std::get<1>(info);
+		const uint32_t row = i < 4 ? i / 2 : 2;
+		const float sign = (i & 1) ? -1.0f : 1.0f;
 
-		switch (anim.animationType)
+		float* plane = view.planes[i];
+		for (uint32_t k = 0; k < 4; ++k)
 		{
-		case LightAnimateType::Static:
-			break;
-		case LightAnimateType::RotateX:
+			plane[k] = i == 4 ? m[k * 4 + row] : m[k * 4 + 3] + sign * m[k * 4 + row];
+		}
+
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f)
 		{
-			light->position.setY(std::abs(std::sin(OEMaths::radians(timer * 360.0f)) * anim.velocity));
-			light->position.setZ(std::cos(OEMaths::radians(timer * 360.0f)) * anim.velocity);
-			break;
+			for (uint32_t k = 0; k < 4; ++k)
+			{
+				plane[k] /= length;
+			}
 		}
-		case LightAnimateType::RotateY:
+	}
+	return true;
+}
+
+void LightManager::updateLocalViews(LightArrays& lights, const float zNear, const float zFar)
+{
+	OEMaths::vec3f up{ 0.0f, 1.0f, 0.0f };
+
+	for (uint32_t i = lights.dirtyBegin; i < lights.dirtyEnd; ++i)
+	{
+		OEMaths::vec3f position{ lights.posX[i], lights.posY[i], lights.posZ[i] };
+		OEMaths::vec3f target{ lights.targetX[i], lights.targetY[i], lights.targetZ[i] };
+
+		// the shadow pass draws from each light's point of view
+		OEMaths::mat4f projection = OEMaths::perspective(lights.fov[i], 1.0f, zNear, zFar);
+		OEMaths::mat4f view = OEMaths::lookAt(position, target, up);
+
+		const uint32_t index = lights.shadowView[i];
+		shadowViewChanged[index] |= setShadowView(shadowViews[index], projection * view);
+	}
+}
+
+// a view looking along the direction from the origin - the cascades are placed by the bounds of their projection
+// instead, so they can be snapped to the texels of the tile
+static OEMaths::mat4f getLightRotation(const float dir[3])
+{
+	float up[3] = { 0.0f, 1.0f, 0.0f };
+	if (std::abs(dir[1]) > 0.99f)
+	{
+		up[0] = 1.0f;
+		up[1] = 0.0f;
+	}
+
+	float right[3] = { up[1] * dir[2] - up[2] * dir[1], up[2] * dir[0] - up[0] * dir[2],
+		               up[0] * dir[1] - up[1] * dir[0] };
+	float length = std::sqrt(right[0] * right[0] + right[1] * right[1] + right[2] * right[2]);
+	for (float& r : right)
+	{
+		r /= length;
+	}
+
+	float camUp[3] = { dir[1] * right[2] - dir[2] * right[1], dir[2] * right[0] - dir[0] * right[2],
+		               dir[0] * right[1] - dir[1] * right[0] };
+
+	// the rows are the axes of light space
+	OEMaths::mat4f result;
+	for (uint8_t k = 0; k < 3; ++k)
+	{
+		result(k, 0) = right[k];
+		result(k, 1) = camUp[k];
+		result(k, 2) = dir[k];
+	}
+	return result;
+}
+
+// an orthographic projection with the depth mapped to 0-1, flipped in y as the perspective projection is
+static OEMaths::mat4f getCascadeProjection(const float left, const float right, const float bottom, const float top,
+                                           const float zNear, const float zFar)
+{
+	OEMaths::mat4f result;
+	result(0, 0) = 2.0f / (right - left);
+	result(1, 1) = 2.0f / (top - bottom);
+	result(2, 2) = 1.0f / (zFar - zNear);
+	result(3, 0) = -(right + left) / (right - left);
+	result(3, 1) = -(top + bottom) / (top - bottom);
+	result(3, 2) = -zNear / (zFar - zNear);
+
+#ifdef USE_VULKAN_COORDS
+	result(1, 1) *= -1.0f;
+	result(3, 1) *= -1.0f;
+#endif
+
+	return result;
+}
+
+void LightManager::updateCascades(CameraManager& cameraManager)
+{
+	if (dirLights.size() == 0)
+	{
+		return;
+	}
+
+	// the splits blend a logarithmic and uniform spacing - logarithmic alone leaves the far cascades too large
+	const float zNear = cameraManager.getZNear();
+	const float shadowFar = std::min(cameraManager.getZFar(), CascadeDistance);
+
+	float splits[CascadeCount + 1];
+	splits[0] = zNear;
+	for (uint32_t i = 1; i <= CascadeCount; ++i)
+	{
+		float fraction = static_cast<float>(i) / CascadeCount;
+		float logSplit = zNear * std::pow(shadowFar / zNear, fraction);
+		float uniformSplit = zNear + (shadowFar - zNear) * fraction;
+		splits[i] = CascadeSplitLambda * logSplit + (1.0f - CascadeSplitLambda) * uniformSplit;
+		cascadeSplits[i - 1] = splits[i];
+	}
+
+	// each cascade bounds a slice of the camera frustum. The corners are found by taking the depth of the slice's
+	// near and far distances back through the inverse of the camera matrix
+	OEMaths::mat4f invViewProj = cameraManager.getViewProjection().inverse();
+	const float* projection = cameraManager.getProjection().getData();
+
+	float centers[CascadeCount][3];
+	float radii[CascadeCount];
+	for (uint32_t c = 0; c < CascadeCount; ++c)
+	{
+		float corners[8][3];
+		float* center = centers[c];
+		center[0] = center[1] = center[2] = 0.0f;
+
+		for (uint32_t k = 0; k < 8; ++k)
+		{
+			float depth = projection[10] + projection[14] / splits[c + (k >> 2)];
+			OEMaths::vec4f corner =
+			    invViewProj * OEMaths::vec4f{ (k & 1) ? 1.0f : -1.0f, (k & 2) ? 1.0f : -1.0f, depth, 1.0f };
+
+			corners[k][0] = corner.getX() / corner.getW();
+			corners[k][1] = corner.getY() / corner.getW();
+			corners[k][2] = corner.getZ() / corner.getW();
+			for (uint32_t axis = 0; axis < 3; ++axis)
+			{
+				center[axis] += corners[k][axis] * 0.125f;
+			}
+		}
+
+		// a sphere keeps the same size as the camera turns, so the cascade only ever moves. The radius is rounded
+		// up so small errors don't change the size of a texel
+		float radiusSq = 0.0f;
+		for (const float* corner : corners)
 		{
-			light->position.setX(std::abs(std::sin(OEMaths::radians(timer * 360.0f)) * anim.velocity));
-			light->position.setZ(std::cos(OEMaths::radians(timer * 360.0f)) * anim.velocity);
-			break;
+			float dx = corner[0] - center[0];
+			float dy = corner[1] - center[1];
+			float dz = corner[2] - center[2];
+			radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
 		}
-		case LightAnimateType::RotateZ:
+		radii[c] = std::ceil(std::sqrt(radiusSq) * 16.0f) / 16.0f;
+	}
+
+	for (uint32_t i = 0; i < dirLights.size(); ++i)
+	{
+		// the light travels from its position towards the target
+		float dir[3] = { dirLights.targetX[i] - dirLights.posX[i], dirLights.targetY[i] - dirLights.posY[i],
+			             dirLights.targetZ[i] - dirLights.posZ[i] };
+		float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		if (length <= 0.0f)
 		{
-			light->position.setX(std::abs(std::sin(OEMaths::radians(timer * 360.0f)) * anim.velocity));
-			light->position.setY(std::cos(OEMaths::radians(timer * 360.0f)) * anim.velocity);
-			break;
+			continue;
 		}
+		for (float& d : dir)
+		{
+			d /= length;
 		}
 
-		isDirty = true;
+		const OEMaths::mat4f rotation = getLightRotation(dir);
+
+		for (uint32_t c = 0; c < CascadeCount; ++c)
+		{
+			const uint32_t index = dirLights.shadowView[i] + c;
+			ShadowView& view = shadowViews[index];
+			const float radius = radii[c];
+
+			// the centre in light space is snapped to whole texels, so the edges of the shadows don't crawl as the
+			// camera moves - and the cascade is only redrawn once it has moved by a texel
+			OEMaths::vec4f center = rotation * OEMaths::vec4f{ centers[c][0], centers[c][1], centers[c][2], 1.0f };
+			const float tileSize = static_cast<float>(view.tile.isValid() ? view.tile.size : CascadeTileSize);
+			const float texel = 2.0f * radius / tileSize;
+			const float x = std::floor(center.getX() / texel) * texel;
+			const float y = std::floor(center.getY() / texel) * texel;
+			const float z = center.getZ();
+
+			OEMaths::mat4f cascadeProjection = getCascadeProjection(x - radius, x + radius, y - radius, y + radius,
+			                                                        z - radius - CascadeCasterDistance, z + radius);
+			shadowViewChanged[index] |= setShadowView(view, cascadeProjection * rotation);
+		}
 	}
 }
 
-void LightManager::updateDynamicBuffer(ComponentInterface* componentInterface)
+// the size of tile wanted for a spot or point light - the size of the last tile is kept while close to it
+static uint32_t getShadowTileSize(const float importance, const ShadowAtlas::Tile& previous)
 {
-	lightPovDataSize = 0;
+	const float size = importance * LightManager::MaxShadowTileSize;
+	const float hysteresis = LightManager::ShadowTileHysteresis;
+
+	if (previous.isValid() && size >= previous.size * (1.0f - hysteresis) &&
+	    size < previous.size * 2.0f * (1.0f + hysteresis))
+	{
+		return previous.size;
+	}
 
+	// the atlas rounds down to a power of two of at least the cell size
+	return std::max(static_cast<uint32_t>(size), ShadowAtlas::CellSize);
+}
+
+void LightManager::updateShadowViews(ComponentInterface* componentInterface)
+{
 	auto& cameraManager = componentInterface->getManager<CameraManager>();
 
-	for (auto& info : lights)
+	updateLocalViews(spotLights, cameraManager.getZNear(), cameraManager.getZFar());
+	updateLocalViews(pointLights, cameraManager.getZNear(), cameraManager.getZFar());
+	updateCascades(cameraManager);
+
+	// a light's importance is the size of its range on screen, found as for the mesh levels of detail. The
+	// cascades always come first
+	const OEMaths::vec3f& cameraPos = cameraManager.getPosition();
+	const float projectionScale = std::abs(cameraManager.getProjection().getData()[5]);
+
+	for (ShadowView& view : shadowViews)
+	{
+		if (view.type == LightType::Directional)
+		{
+			view.importance = std::numeric_limits<float>::max();
+			continue;
+		}
+
+		const LightArrays& lights = view.type == LightType::Spot ? spotLights : pointLights;
+		float dx = lights.posX[view.light] - cameraPos.getX();
+		float dy = lights.posY[view.light] - cameraPos.getY();
+		float dz = lights.posZ[view.light] - cameraPos.getZ();
+		float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+		float range = lights.fallOut[view.light];
+
+		view.importance =
+		    range <= 0.0f || distance <= range ? 1.0f : std::min(range * projectionScale / distance, 1.0f);
+	}
+
+	// the sort is stable, so the cascades stay in order
+	shadowOrder.resize(shadowViews.size());
+	std::iota(shadowOrder.begin(), shadowOrder.end(), 0);
+	std::stable_sort(shadowOrder.begin(), shadowOrder.end(), [this](const uint32_t a, const uint32_t b) {
+		return shadowViews[a].importance > shadowViews[b].importance;
+	});
+
+	// the tiles from last frame that are still the right size are claimed first, so the depth drawn into them can
+	// be kept. The rest are then placed in order of importance - the least important go without if the atlas fills
+	shadowAtlas.reset();
+	shadowTileSizes.resize(shadowViews.size());
+
+	for (uint32_t index : shadowOrder)
 	{
-		auto& light = std::get<0>(info);
-		LightPOV* lightPovPtr = (LightPOV*)((uint64_t)lightPovData + (alignedPovDataSize * lightPovDataSize));
+		ShadowView& view = shadowViews[index];
+		uint32_t size =
+		    view.type == LightType::Directional ? CascadeTileSize : getShadowTileSize(view.importance, view.tile);
 
-		OEMaths::mat4f projection =
-		    OEMaths::perspective(light->fov, 1.0f, cameraManager.getZNear(), cameraManager.getZFar());
-		OEMaths::mat4f view = OEMaths::lookAt(light->position, light->target, OEMaths::vec3f(0.0f, 1.0f, 0.0f));
-		lightPovPtr->lightMvp = projection * view;
+		bool kept = view.tile.isValid() && view.tile.size == size && shadowAtlas.reserve(view.tile);
+		shadowTileSizes[index] = kept ? 0 : size;
+	}
 
-		light->lightMvp = lightPovPtr->lightMvp;
+	for (uint32_t index : shadowOrder)
+	{
+		if (!shadowTileSizes[index])
+		{
+			continue;
+		}
 
-		++lightPovDataSize;
+		ShadowView& view = shadowViews[index];
+		ShadowAtlas::Tile tile = shadowAtlas.allocate(shadowTileSizes[index]);
+		if (!(tile == view.tile))
+		{
+			view.tile = tile;
+			shadowViewChanged[index] = 1;
+		}
 	}
 
-	// now queue ready for uploading to the gpu
-	VulkanAPI::BufferUpdateEvent event{ "LightDynamic", (void*)lightPovData, alignedPovDataSize * lightPovDataSize,
-		                                VulkanAPI::MemoryUsage::VK_BUFFER_DYNAMIC };
-	Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+	// only the views that have changed are written, and their tiles drawn again
+	const uint32_t viewCount = std::max(static_cast<uint32_t>(shadowViews.size()), 1u);
+	lightPovBuffer->reserve(viewCount);
+	shadowBuffer->reserve(viewCount);
+
+	const float atlasScale = shadowAtlas.getSize() > 0 ? 1.0f / shadowAtlas.getSize() : 0.0f;
+	for (uint32_t i = 0; i < shadowViews.size(); ++i)
+	{
+		if (!shadowViewChanged[i])
+		{
+			continue;
+		}
+
+		ShadowView& view = shadowViews[i];
+		lightPovBuffer->get<LightPOV>(i)->lightMvp = view.viewProj;
+
+		ShadowViewInfo* info = shadowBuffer->get<ShadowViewInfo>(i);
+		info->viewProj = view.viewProj;
+		info->atlasRect = OEMaths::vec4f{ view.tile.x * atlasScale, view.tile.y * atlasScale,
+			                              view.tile.size * atlasScale, view.tile.size * atlasScale };
+
+		view.needsRender = view.needsRender || view.tile.isValid();
+		shadowViewChanged[i] = 0;
+	}
 }
 
-void LightManager::updateFrame(double time, double dt, std::unique_ptr<ObjectManager>& objectManager,
-                               ComponentInterface* componentInterface)
+void LightManager::uploadLights(LightArrays& lights, const LightType type, const uint32_t base)
 {
-	updateLightPositions(time, dt);
-
-	if (isDirty)
+	// adding a light of an earlier type moves these along the buffer, so all of them need writing again
+	if (lights.uploadBase != base)
 	{
-		// update dynamic buffers used by shadow pipeline
-		updateDynamicBuffer(componentInterface);
+		lights.markDirty(0, lights.size());
+		lights.uploadBase = base;
+	}
 
-		// now update ready for uploading on the gpu side
-		uint32_t spotlightCount = 0;
-		uint32_t pointlightCount = 0;
-		uint32_t dirLightCount = 0;
-		
-		for (auto& info : lights)
+	for (uint32_t i = lights.dirtyBegin; i < lights.dirtyEnd; ++i)
+	{
+		OEMaths::vec3f position{ lights.posX[i], lights.posY[i], lights.posZ[i] };
+		OEMaths::vec3f target{ lights.targetX[i], lights.targetY[i], lights.targetZ[i] };
+
+		LightInfo info;
+		float fallOutSq = lights.fallOut[i] * lights.fallOut[i];
+		info.position = OEMaths::vec4f{ position, fallOutSq > 0.0f ? 1.0f / fallOutSq : 0.0f };
+		info.colour = OEMaths::vec4f{ lights.colourR[i], lights.colourG[i], lights.colourB[i], lights.intensity[i] };
+		info.scale = lights.scale[i];
+		info.offset = lights.offset[i];
+		info.type = static_cast<uint32_t>(type);
+		info.shadowIndex = lights.shadowView[i];
+
+		if (type == LightType::Spot)
 		{
-			auto& light = std::get<0>(info);
-			if (light->type == LightType::Spot)
+			// the direction points back towards the light, as does the light vector in the shader
+			OEMaths::vec3f dir = position - target;
+			float length = dir.length();
+			if (length > 0.0f)
 			{
-				const auto& spotLight = static_cast<SpotLight*>(light.get());
-
-				// fill in the data to be sent to the gpu
-				SpotLightUbo ubo(light->lightMvp, OEMaths::vec4f{ spotLight->position, 1.0f },
-				                 OEMaths::vec4f{ spotLight->target, 1.0f }, spotLight->colour, spotLight->fallOut,
-				                 spotLight->intensity, spotLight->scale, spotLight->offset);
-				lightBuffer.spotLights[spotlightCount++] = ubo;
+				dir = dir * (1.0f / length);
 			}
-			else if (light->type == LightType::Point)
-			{
-				const auto& pointLight = static_cast<PointLight*>(light.get());
+			info.direction = OEMaths::vec4f{ dir, 0.0f };
+		}
+		else if (type == LightType::Directional)
+		{
+			info.direction = OEMaths::vec4f{ target, 1.0f };
+		}
 
-				// fill in the data to be sent to the gpu
-				PointLightUbo ubo(light->lightMvp, OEMaths::vec4f{ pointLight->position, 1.0f }, pointLight->colour,
-				                  pointLight->intensity, pointLight->fallOut);
-				lightBuffer.pointLights[pointlightCount++] = ubo;
-			}
-			else if (light->type == LightType::Directional)
-			{
-				const auto& dirLight = static_cast<DirectionalLight*>(light.get());
+		*lightBuffer->get<LightInfo>(base + i) = info;
+	}
 
-				// fill in the data to be sent to the gpu
-				DirectionalLightUbo ubo(dirLight->lightMvp, OEMaths::vec4f{ dirLight->position, 1.0f },
-				                        OEMaths::vec4f{ dirLight->target, 1.0f }, dirLight->colour,
-				                        dirLight->intensity);
-				lightBuffer.dirLights[dirLightCount++] = ubo;
+	uploadCount += lights.dirtyEnd - lights.dirtyBegin;
+	lights.dirtyBegin = lights.dirtyEnd = 0;
+}
+
+void LightManager::updateLightBuffers()
+{
+	// the buffers are only ever grown - if they move, the old contents are copied across and the descriptors
+	// rebound by the buffer manager, so only the dirty lights still need writing
+	uint32_t lightCount = std::max(getLightCount(), 1u);
+	lightBuffer->reserve(lightCount);
+
+	uploadCount = 0;
+
+	// directional lights are lit everywhere so come first, followed by the spot and point lights the clusters
+	// refer to
+	uploadLights(dirLights, LightType::Directional, 0);
+	uploadLights(spotLights, LightType::Spot, dirLights.size());
+	uploadLights(pointLights, LightType::Point, dirLights.size() + spotLights.size());
+}
+
+void LightManager::updateClusters(ComponentInterface* componentInterface)
+{
+	auto& cameraManager = componentInterface->getManager<CameraManager>();
+	clusterBuilder.setProjection(cameraManager.getProjection(), cameraManager.getZNear(), cameraManager.getZFar());
+
+	const OEMaths::mat4f& view = cameraManager.getView();
+
+	viewLights.clear();
+	for (const LightArrays* lights : { &spotLights, &pointLights })
+	{
+		const bool isSpot = lights == &spotLights;
+
+		for (uint32_t i = 0; i < lights->size(); ++i)
+		{
+			LightClusterBuilder::ViewLight viewLight;
+			viewLight.range = lights->fallOut[i];
+
+			OEMaths::vec4f position = view * OEMaths::vec4f{ lights->posX[i], lights->posY[i], lights->posZ[i], 1.0f };
+			viewLight.position[0] = position.getX();
+			viewLight.position[1] = position.getY();
+			viewLight.position[2] = position.getZ();
+
+			if (isSpot)
+			{
+				OEMaths::vec4f axis = view * OEMaths::vec4f{ lights->targetX[i] - lights->posX[i],
+					                                         lights->targetY[i] - lights->posY[i],
+					                                         lights->targetZ[i] - lights->posZ[i], 0.0f };
+				float length =
+				    std::sqrt(axis.getX() * axis.getX() + axis.getY() * axis.getY() + axis.getZ() * axis.getZ());
+				if (length > 0.0f)
+				{
+					viewLight.axis[0] = axis.getX() / length;
+					viewLight.axis[1] = axis.getY() / length;
+					viewLight.axis[2] = axis.getZ() / length;
+
+					// the outer cone angle is recovered from the angle scale and offset
+					viewLight.cosAngle = -lights->offset[i] / lights->scale[i];
+					viewLight.sinAngle = std::sqrt(std::max(1.0f - viewLight.cosAngle * viewLight.cosAngle, 0.0f));
+				}
 			}
+
+			viewLights.emplace_back(viewLight);
 		}
+	}
+
+	clusterBuilder.build(viewLights);
 
-		//lightBuffer.spotLightCount = spotlightCount;
-		//lightBuffer.pointLightCount = pointlightCount;
+	clusterBuffer->reserve(1);
+	ClusterBufferInfo* clusterInfo = clusterBuffer->get<ClusterBufferInfo>(0);
 
-		VulkanAPI::BufferUpdateEvent event{ "Light", (void*)&lightBuffer, sizeof(LightUboBuffer),
-			                                VulkanAPI::MemoryUsage::VK_BUFFER_DYNAMIC };
+	ClusterParams& params = clusterInfo->params;
+	params.view = view;
+	params.projScaleX = clusterBuilder.getProjScaleX();
+	params.projScaleY = clusterBuilder.getProjScaleY();
+	params.sliceScale = clusterBuilder.getSliceScale();
+	params.sliceBias = clusterBuilder.getSliceBias();
+	params.dirLightCount = dirLights.size();
+	params.localLightCount = spotLights.size() + pointLights.size();
+	memcpy(params.cascadeSplits, cascadeSplits, sizeof(cascadeSplits));
 
-		// let the buffer manager know that the buffers needs creating/updating via the event process
-		Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+	const auto& clusters = clusterBuilder.getClusters();
+	memcpy(clusterInfo->clusters, clusters.data(), clusters.size() * sizeof(LightClusterBuilder::ClusterRange));
 
-		isDirty = false;
+	const auto& lightIndices = clusterBuilder.getLightIndices();
+	lightIndexBuffer->reserve(std::max(static_cast<uint32_t>(lightIndices.size()), 1u));
+	if (!lightIndices.empty())
+	{
+		memcpy(lightIndexBuffer->get<uint32_t>(0), lightIndices.data(), lightIndices.size() * sizeof(uint32_t));
 	}
 }
+
+void LightManager::updateFrame(double time, double dt, std::unique_ptr<ObjectManager>& objectManager,
+                               ComponentInterface* componentInterface)
+{
+	updateLightPositions(time, dt);
+
+	// the shadow views of moved lights, and the cascades which follow the camera, are only drawn again if they
+	// have changed
+	updateShadowViews(componentInterface);
+
+	// only the lights added or moved since the last frame are written, directly into the mapped buffers
+	updateLightBuffers();
+
+	// the clusters are in view space, so follow the camera every frame
+	updateClusters(componentInterface);
+}
 }    // namespace OmegaEngine
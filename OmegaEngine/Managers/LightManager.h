@@ -2,17 +2,20 @@
 
 #include "Managers/ManagerBase.h"
 #include "OEMaths/OEMaths.h"
+#include "Rendering/LightClusterBuilder.h"
+#include "Rendering/ShadowAtlas.h"
 
 #include <cstdint>
-#include <tuple>
 #include <vector>
 
-#define MAX_SPOT_LIGHTS 50
-#define MAX_POINT_LIGHTS 50
-#define MAX_DIR_LIGHTS 5
+namespace VulkanAPI
+{
+class MappedBuffer;
+}
 
 namespace OmegaEngine
 {
+class CameraManager;
 
 struct LightPOV
 {
@@ -34,144 +37,106 @@ enum class LightAnimateType
 	RotateZ
 };
 
-struct LightAnimateInfo
+class LightManager : public ManagerBase
 {
-	LightAnimateInfo() = default;
 
-	LightAnimateInfo(const LightAnimateType type, const float vel)
-	    : animationType(type)
-	    , velocity(vel)
+public:
+	// a mirror of the shader struct. All light types share the one buffer - the directional lights first, then the
+	// spot lights followed by the point lights
+	struct LightInfo
 	{
-	}
-
-	// default to static
-	LightAnimateType animationType = LightAnimateType::Static;
-	float velocity = 5.0f;
-};
+		// w holds the inverse of the squared fall out distance - the shader attenuates to zero at the fall out
+		OEMaths::vec4f position;
+		OEMaths::vec4f direction;
 
-struct LightBase
-{
-	LightBase() = default;
-	virtual ~LightBase()
-	{
-	}
+		// the alpha channel holds the intensity
+		OEMaths::vec4f colour = OEMaths::vec4f{ 1.0f, 1.0f, 1.0f, 1000.0f };
 
-	OEMaths::mat4f lightMvp;
-	OEMaths::vec3f position;
-	OEMaths::vec3f target;
-	OEMaths::vec3f colour = OEMaths::vec3f{ 1.0f, 1.0f, 1.0f };
-	float fov = 90.0f;
-	LightType type;
-};
+		float scale = 0.0f;
+		float offset = 0.0f;
+		uint32_t type = 0;
 
-struct DirectionalLight : public LightBase
-{
-	float intensity = 10000.0f;
-};
+		// the light's view in the shadow buffer - directional lights have a view for each cascade, in order
+		uint32_t shadowIndex = 0;
+	};
 
-struct PointLight : public LightBase
-{
-	float fallOut = 10.0f;
-	float radius = 25.0f;
-	float intensity = 1000.0f;
-};
+	// the number of cascades the shadows of each directional light are split into. Must match the deferred shader
+	static constexpr uint32_t CascadeCount = 4;
 
-struct SpotLight : public LightBase
-{
-	float fallOut = 10.0f;
-	float radius = 25.0f;
-	float scale = 1.0f;
-	float offset = 0.0f;
-	float intensity = 1000.0f;
-};
+	// the start of the cluster buffer - all the shader needs to find the cluster of a pixel. The light indices
+	// in the clusters are relative to the first spot light
+	struct ClusterParams
+	{
+		OEMaths::mat4f view;
+
+		// the view space depth at which each cascade ends
+		float cascadeSplits[CascadeCount];
+
+		float projScaleX;
+		float projScaleY;
+		float sliceScale;
+		float sliceBias;
+		uint32_t dirLightCount;
+		uint32_t localLightCount;
+		uint32_t pad0;
+		uint32_t pad1;
+	};
 
-class LightManager : public ManagerBase
-{
+	struct ClusterBufferInfo
+	{
+		ClusterParams params;
+		LightClusterBuilder::ClusterRange clusters[LightClusterBuilder::ClusterCount];
+	};
 
-public:
-	// a mirror of the shader structs
-	struct PointLightUbo
+	// a view a shadow map is drawn from - one for each spot and point light, and one for each cascade of a
+	// directional light. Each has its own tile of the shadow atlas
+	struct ShadowView
 	{
-		PointLightUbo() = default;
-		PointLightUbo(const OEMaths::mat4f& mvp, const OEMaths::vec4f& pos, const OEMaths::vec3f& col, float fo,
-		              float intensity)
-		    : lightMvp(mvp)
-		    , position(pos)
-		    , colour(OEMaths::vec4f{ col, intensity })
-		    , fallOut(fo)
+		// true if any part of the world space sphere lies within the view
+		bool intersects(const float center[3], const float radius) const;
 
-		{
-		}
+		OEMaths::mat4f viewProj;
 
-		OEMaths::mat4f lightMvp;
-		OEMaths::vec4f position;
-		OEMaths::vec4f colour = OEMaths::vec4f{ 1.0f, 1.0f, 1.0f, 1000.0f };
-		float fallOut;
-	};
+		// the planes of the view frustum, facing inwards, with the distance in the last component
+		float planes[6][4] = {};
 
-	struct SpotLightUbo
-	{
-		SpotLightUbo() = default;
-		SpotLightUbo(const OEMaths::mat4f& mvp, const OEMaths::vec4f& pos, const OEMaths::vec4f& dir,
-		             const OEMaths::vec3f& col, float fo, float intensity, float sca, float ofs)
-		    : lightMvp(mvp)
-		    , position(pos)
-		    , direction(dir)
-		    , colour(OEMaths::vec4f{ col, intensity })
-		    , fallOut(fo)
-		    , scale(sca)
-		    , offset(ofs)
+		ShadowAtlas::Tile tile;
 
-		{
-		}
+		// the views with the highest importance are given tiles first
+		float importance = 0.0f;
 
-		OEMaths::mat4f lightMvp;
-		OEMaths::vec4f position;
-		OEMaths::vec4f direction;
-		OEMaths::vec4f colour = OEMaths::vec4f{ 1.0f, 1.0f, 1.0f, 1000.0f };
-		float scale;
-		float offset;
-		float fallOut;
-	};
+		LightType type = LightType::Spot;
+		uint32_t light = 0;
+		uint32_t cascade = 0;
 
-	struct DirectionalLightUbo
-	{
-		DirectionalLightUbo() = default;
-		DirectionalLightUbo(const OEMaths::mat4f& mvp, const OEMaths::vec4f& pos, const OEMaths::vec4f& dir,
-		             const OEMaths::vec3f& col, float intensity)
-		    : lightMvp(mvp)
-		    , position(pos)
-		    , direction(dir)
-		    , colour(OEMaths::vec4f{ col, intensity })
-		{
-		}
+		// the casters drawn into the view this frame, as a run of the caster list. Empty unless the view is drawn
+		uint32_t casterOffset = 0;
+		uint32_t casterCount = 0;
 
-		OEMaths::mat4f lightMvp;
-		OEMaths::vec4f position;
-		OEMaths::vec4f direction;
-		OEMaths::vec4f colour = OEMaths::vec4f{ 1.0f, 1.0f, 1.0f, 1000.0f };
+		// the depth in the tile is out of date - set when the view or its tile change, or a caster within the view
+		// moves. Only these tiles are cleared and drawn by the shadow pass, which resets the flag
+		bool needsRender = true;
 	};
 
-	struct LightUboBuffer
+	// mirrors the shader - the matrix of each shadow view, and where its tile lies in the atlas as an offset and
+	// size in uvs. Views without a tile have a size of zero and are unshadowed
+	struct ShadowViewInfo
 	{
-		SpotLightUbo spotLights[MAX_SPOT_LIGHTS];
-		PointLightUbo pointLights[MAX_POINT_LIGHTS];
-		DirectionalLightUbo dirLights[MAX_DIR_LIGHTS];			// not anticipating as many directional lights required
+		OEMaths::mat4f viewProj;
+		OEMaths::vec4f atlasRect;
 	};
 
 	LightManager();
 	~LightManager();
 
-	// not used at present - just here to keep the inheritance demons happy
 	void updateFrame(double time, double dt, std::unique_ptr<ObjectManager>& objectManager,
 	                 ComponentInterface* componentInterface) override;
 
 	void updateLightPositions(double time, double dt);
 
-	void updateDynamicBuffer(ComponentInterface* componentInterface);
-
-	void calculatePointIntensity(float intensity, PointLight& light);
-	void calculateSpotIntensity(float intensity, float outerCone, float innerCone, SpotLight& spotLight);
+	static float calculatePointIntensity(float intensity);
+	static float calculateSpotIntensity(float intensity, float outerCone, float innerCone, float& scale,
+	                                    float& offset);
 
 	void addSpotLight(const OEMaths::vec3f& position, const OEMaths::vec3f& target, const OEMaths::vec3f& colour,
 	                  const float fov, float intensity, float fallout, float innerCone, float outerCone,
@@ -181,34 +146,199 @@ public:
 	                   float fov, float intensity, float fallOut,
 	                   const LightAnimateType animType = LightAnimateType::Static, const float animVel = 0.0f);
 
-	void LightManager::addDirectionalLight(const OEMaths::vec3f& position, const OEMaths::vec3f& target,
-	                                       const OEMaths::vec3f& colour, float fov, float intensity);
+	void addDirectionalLight(const OEMaths::vec3f& position, const OEMaths::vec3f& target,
+	                         const OEMaths::vec3f& colour, float fov, float intensity);
 
 	uint32_t getLightCount() const
 	{
-		return static_cast<uint32_t>(lights.size());
+		return dirLights.size() + spotLights.size() + pointLights.size();
 	}
 
-	uint32_t getAlignmentSize() const
+	uint32_t getAlignmentSize() const;
+
+	// the size of the square depth image all shadow views share
+	void setShadowAtlasSize(const uint32_t size);
+
+	std::vector<ShadowView>& getShadowViews()
 	{
-		return alignedPovDataSize;
+		return shadowViews;
 	}
 
+	// marks the views that can see the world space sphere as needing to be drawn again. Used for casters that have
+	// moved, both where they were and where they are now
+	void invalidateShadows(const float center[3], const float radius);
+
+	// the world space bounds of the shadow casters are gathered each frame, then culled against the views that are
+	// to be drawn. Adding a caster returns the index its views are found by. Culling returns true if any views are
+	// to be drawn, or the views of any caster differ from the last cull, as the shadow pass then draws differently
+	void clearShadowCasters();
+	uint32_t addShadowCaster(const float center[3], const float radius);
+	bool cullShadowCasters();
+
+	// the views the caster is drawn into this frame, in ascending order
+	const uint32_t* getCasterViews(const uint32_t caster, uint32_t& count) const;
+
+	// the number of caster draws into the shadow atlas this frame
+	uint32_t getShadowDrawCount() const
+	{
+		return static_cast<uint32_t>(shadowCasterList.size());
+	}
+
+	const LightClusterBuilder::Stats& getClusterStats() const
+	{
+		return clusterBuilder.getStats();
+	}
+
+	// the number of lights written to the light buffers last frame
+	uint32_t getUploadCount() const
+	{
+		return uploadCount;
+	}
+
+	// the light pov and shadow buffers grow in chunks of this many shadow views
+	static constexpr uint32_t LightPovChunkSize = 32;
+
+	// the light and light index buffers grow in chunks of these sizes
+	static constexpr uint32_t LightChunkSize = 32;
+	static constexpr uint32_t LightIndexChunkSize = 4096;
+
+	// directional light shadows only reach this far from the camera
+	static constexpr float CascadeDistance = 100.0f;
+
+	// the cascade splits are blended between a uniform (0) and logarithmic (1) spacing
+	static constexpr float CascadeSplitLambda = 0.75f;
+
+	// casters up to this far beyond a cascade, towards the light, still cast shadows into it
+	static constexpr float CascadeCasterDistance = 100.0f;
+
+	static constexpr uint32_t CascadeTileSize = 1024;
+
+	// the tile of a spot or point light whose range fills the screen. It halves in size each time the range's
+	// size on screen halves, with a little hysteresis so a tile isn't redrawn every frame at the boundary
+	static constexpr uint32_t MaxShadowTileSize = 1024;
+	static constexpr float ShadowTileHysteresis = 0.2f;
+
 private:
-	std::vector<std::tuple<std::unique_ptr<LightBase>, LightAnimateInfo>> lights;
+	// the lights of one type, densely packed as a structure of arrays. Fields a type doesn't use stay at zero
+	struct LightArrays
+	{
+		uint32_t add(const OEMaths::vec3f& position, const OEMaths::vec3f& target, const OEMaths::vec3f& colour,
+		             const float fov, const float intensity, const float fallOut, const LightAnimateType animType,
+		             const float animVel, const uint32_t firstShadowView);
+
+		uint32_t size() const
+		{
+			return static_cast<uint32_t>(posX.size());
+		}
 
-	// buffer on the vulkan side which will hold all lighting info
-	LightUboBuffer lightBuffer;
+		// expands the range of lights that need writing to the gpu
+		void markDirty(const uint32_t begin, const uint32_t end);
 
-	// dynamic buffer for light pov - used for shadow drawing
-	LightPOV* lightPovData = nullptr;
-	uint32_t alignedPovDataSize = 0;
-	uint32_t lightPovDataSize = 0;
+		std::vector<float> posX, posY, posZ;
+		std::vector<float> targetX, targetY, targetZ;
+		std::vector<float> colourR, colourG, colourB;
+		std::vector<float> intensity;
+		std::vector<float> fov;
+		std::vector<float> fallOut;
+		std::vector<float> scale, offset;
+
+		// one for the axis each light rotates about, otherwise zero - so the animation needs no branches
+		std::vector<float> rotateX, rotateY, rotateZ;
+		std::vector<float> velocity;
+
+		// the first of the light's shadow views
+		std::vector<uint32_t> shadowView;
+
+		// the range of animated lights - only these are updated and marked dirty each frame
+		uint32_t animBegin = 0;
+		uint32_t animEnd = 0;
+
+		// the lights changed since the last upload, as a half open range
+		uint32_t dirtyBegin = 0;
+		uint32_t dirtyEnd = 0;
+
+		// where the lights started in the light buffer at the last upload
+		uint32_t uploadBase = 0;
+	};
+
+	void animateLights(LightArrays& lights, const float sinAngle, const float cosAngle);
+
+	// adds the views a new light's shadows are drawn from, returning the index of the first
+	uint32_t addShadowViews(const LightType type, const uint32_t light, const uint32_t count);
+
+	// the perspective views of the dirty spot or point lights
+	void updateLocalViews(LightArrays& lights, const float zNear, const float zFar);
+
+	// fits the cascades of each directional light around a slice of the camera frustum
+	void updateCascades(CameraManager& cameraManager);
+
+	// gives the shadow views their tiles, in order of importance, and writes the views that changed to the pov
+	// and shadow buffers. Must come before the lights are uploaded, as it reads their dirty ranges
+	void updateShadowViews(ComponentInterface* componentInterface);
+
+	// sets the matrix and frustum of a view - returns false if the matrix hasn't changed
+	bool setShadowView(ShadowView& view, const OEMaths::mat4f& viewProj);
+
+	// writes the dirty lights of one type, starting at the given index of the light buffer
+	void uploadLights(LightArrays& lights, const LightType type, const uint32_t base);
+
+	void updateLightBuffers();
+
+	// bins the point and spot lights into the clusters of the current camera
+	void updateClusters(ComponentInterface* componentInterface);
+
+private:
+	LightArrays dirLights;
+	LightArrays spotLights;
+	LightArrays pointLights;
+
+	// buffer on the vulkan side which will hold all lighting info - persistently mapped and written in place
+	std::unique_ptr<VulkanAPI::MappedBuffer> lightBuffer;
+
+	// the light lists of each cluster - the ranges along with the indices they refer to
+	std::unique_ptr<VulkanAPI::MappedBuffer> clusterBuffer;
+	std::unique_ptr<VulkanAPI::MappedBuffer> lightIndexBuffer;
+
+	LightClusterBuilder clusterBuilder;
+	std::vector<LightClusterBuilder::ViewLight> viewLights;
+
+	// every light's shadow views, in the order the lights were added
+	std::vector<ShadowView> shadowViews;
+
+	// the views whose matrix or tile has changed, so need writing to the gpu
+	std::vector<uint8_t> shadowViewChanged;
+
+	// scratch space for placing the tiles - the views in order of importance, and the size of tile each wants,
+	// or zero if it kept its tile from last frame
+	std::vector<uint32_t> shadowOrder;
+	std::vector<uint32_t> shadowTileSizes;
+
+	// the world space bounding sphere of each caster, as a structure of arrays
+	std::vector<float> casterX, casterY, casterZ, casterRadius;
+
+	// the casters within each view in turn, and the same pairs ordered by caster. casterViewOffsets has an extra
+	// entry for the end of the last caster
+	std::vector<uint32_t> shadowCasterList;
+	std::vector<uint32_t> casterViewList;
+	std::vector<uint32_t> casterViewOffsets;
+
+	// the caster views of the last cull, to find whether they have changed
+	std::vector<uint32_t> prevCasterViewList;
+	std::vector<uint32_t> prevCasterViewOffsets;
+
+	ShadowAtlas shadowAtlas;
+	float cascadeSplits[CascadeCount] = {};
+
+	// dynamic buffer for light pov - used for shadow drawing. One entry per shadow view
+	std::unique_ptr<VulkanAPI::MappedBuffer> lightPovBuffer;
+
+	// the matrices and atlas tiles of the shadow views, for the deferred pass
+	std::unique_ptr<VulkanAPI::MappedBuffer> shadowBuffer;
+
+	uint32_t uploadCount = 0;
 
 	// dirty timer for light animations
 	float timer = 0.0f;
-
-	bool isDirty = false;
 };
 
 }    // namespace OmegaEngine
@@ -5,6 +5,7 @@
 #include "Models/ModelImage.h"
 #include "OEMaths/OEMaths_transform.h"
 #include "ObjectInterface/ComponentInterface.h"
+#include "VulkanAPI/BufferManager.h"
 #include "VulkanAPI/VkTextureManager.h"
 
 namespace OmegaEngine
@@ -12,6 +13,9 @@ namespace OmegaEngine
 
 MaterialManager::MaterialManager()
 {
+	// std430 arrays of structs are aligned to a vec4, which the size already is, so no uniform alignment needed
+	materialBuffer = std::make_unique<VulkanAPI::MappedBuffer>("Materials", sizeof(MaterialBufferInfo),
+	                                                           MaterialChunkSize, false);
 }
 
 MaterialManager::~MaterialManager()
@@ -24,6 +28,22 @@ MaterialInfo &MaterialManager::get(uint32_t index)
 	return materials[index];
 }
 
+uint32_t MaterialManager::getTextureIndex(const uint32_t materialIndex, const uint32_t textureId)
+{
+	const uint32_t fallbackCount = static_cast<uint32_t>(VulkanAPI::VkTextureManager::FallbackTexture::Count);
+	return fallbackCount + materialIndex * TextureCount + textureId;
+}
+
+uint32_t MaterialManager::findMaterial(const std::string &name) const
+{
+	auto iter = materialIndices.find(name);
+	if (iter == materialIndices.end())
+	{
+		return UINT32_MAX;
+	}
+	return iter->second;
+}
+
 void MaterialManager::addComponentToManager(MaterialComponent *component)
 {
 	MaterialInfo newMaterial;
@@ -43,21 +63,12 @@ void MaterialManager::addComponentToManager(MaterialComponent *component)
 	newMaterial.alphaMask = MaterialInfo::AlphaMode::Opaque;
 
 	// TODO : this needs looking at, possiblr decoupling from materials. Textures should be a separate component and linked via name
-	// or offset. For now, just use dummy textures
-	for (uint32_t i = 0; i < (int)ModelMaterial::TextureId::Count; ++i)
-	{
-		
-			MappedTexture dummyTexture;
-			dummyTexture.createEmptyTexture(1024, 1024, TextureFormat::Image8UC4, true);
-		    std::string matId = AssetManager::materialIdentifier + newMaterial.name + '_' +
-		                        std::get<0>(textureExtensions[i]);
-
-		    AssetImageUpdateEvent event{ matId, dummyTexture };
-		    Global::eventManager()->instantNotification(std::move(event));
-	}
+	// or offset. For now, no maps are set so all use the shared fallback textures
 
+	materialIndices.emplace(newMaterial.name, static_cast<uint32_t>(materials.size()));
 	materials.emplace_back(newMaterial);
 	component->offset = materials.size() - 1;
+	isDirty = true;
 }
 
 void MaterialManager::addMaterial(std::unique_ptr<ModelMaterial> &material,
@@ -120,27 +131,64 @@ void MaterialManager::addMaterial(std::unique_ptr<ModelMaterial> &material,
 		if (id > -1)
 		{
 			std::string matId = AssetManager::materialIdentifier + newMaterial.name +
-			                                       '_' + std::get<0>(textureExtensions[i]);
+			                                       '_' + textureExtensions[i];
 			
 			AssetGltfImageUpdateEvent event{ matId, std::move(images[id]) };
 			Global::eventManager()->instantNotification(event);
 
 			newMaterial.hasTexture[i] = true;
 		}
-		else
-		{
-			MappedTexture dummyTexture;
-			dummyTexture.createEmptyTexture(1024, 1024, TextureFormat::Image8UC4, true);
-			std::string matId = AssetManager::materialIdentifier +
-			                                         newMaterial.name + '_' +
-			                                         std::get<0>(textureExtensions[i]);
-
-			AssetImageUpdateEvent event{ matId, dummyTexture };
-			Global::eventManager()->instantNotification(std::move(event));
-		}
 	}
 
+	materialIndices.emplace(newMaterial.name, static_cast<uint32_t>(materials.size()));
 	materials.emplace_back(newMaterial);
+	isDirty = true;
+}
+
+void MaterialManager::addToBuffer(const uint32_t index)
+{
+	MaterialInfo &mat = materials[index];
+	MaterialBufferInfo *info = materialBuffer->get<MaterialBufferInfo>(index);
+
+	info->baseColorFactor = mat.factors.baseColour;
+	info->emissiveFactor = OEMaths::vec4f(mat.factors.emissive, 0.0f);
+	info->diffuseFactor = mat.factors.diffuse;
+	info->specularFactor = OEMaths::vec4f(mat.factors.specular, 0.0f);
+	info->metallicFactor = mat.factors.metallic;
+	info->roughnessFactor = mat.factors.roughness;
+	info->alphaMask = (float)mat.alphaMask;
+	info->alphaMaskCutoff = mat.alphaMaskCutOff;
+
+	info->baseColourUvSet = mat.uvSets.baseColour;
+	info->metallicRoughnessUvSet = mat.uvSets.metallicRoughness;
+	info->normalUvSet = mat.uvSets.normal;
+	info->emissiveUvSet = mat.uvSets.emissive;
+	info->occlusionUvSet = mat.uvSets.occlusion;
+	info->usingSpecularGlossiness = mat.usingSpecularGlossiness ? 1 : 0;
+
+	if (mat.usingSpecularGlossiness)
+	{
+		info->metallicRoughnessUvSet = mat.uvSets.specularGlossiness;
+		info->baseColourUvSet = mat.uvSets.diffuse;
+	}
+
+	using FallbackTexture = VulkanAPI::VkTextureManager::FallbackTexture;
+
+	// materials sharing a name share the textures of the first, as that is how the textures are traced
+	const uint32_t textureBase = materialIndices[mat.name];
+	auto textureIndex = [&](ModelMaterial::TextureId id, FallbackTexture fallback) {
+		return mat.hasTexture[(int)id] ? getTextureIndex(textureBase, (uint32_t)id) : static_cast<uint32_t>(fallback);
+	};
+
+	// the fallbacks give the same result as the factors alone. A specular glossiness map of black gives no
+	// specular and, with an alpha of one, no roughness
+	FallbackTexture mrFallback = mat.usingSpecularGlossiness ? FallbackTexture::Black : FallbackTexture::White;
+
+	info->baseColourTexture = textureIndex(ModelMaterial::TextureId::BaseColour, FallbackTexture::White);
+	info->normalTexture = textureIndex(ModelMaterial::TextureId::Normal, FallbackTexture::FlatNormal);
+	info->mrTexture = textureIndex(ModelMaterial::TextureId::MetallicRoughness, mrFallback);
+	info->emissiveTexture = textureIndex(ModelMaterial::TextureId::Emissive, FallbackTexture::White);
+	info->aoTexture = textureIndex(ModelMaterial::TextureId::Occlusion, FallbackTexture::White);
 }
 
 void MaterialManager::updateFrame(double time, double dt,
@@ -149,7 +197,15 @@ void MaterialManager::updateFrame(double time, double dt,
 {
 	if (isDirty)
 	{
-		// not much to do yet....
+		// the current contents are copied across if the buffer has to move
+		materialBuffer->reserve(static_cast<uint32_t>(materials.size()));
+
+		for (uint32_t i = uploadedCount; i < materials.size(); ++i)
+		{
+			addToBuffer(i);
+		}
+		uploadedCount = static_cast<uint32_t>(materials.size());
+
 		isDirty = false;
 	}
 }
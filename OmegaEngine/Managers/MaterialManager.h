@@ -9,6 +9,11 @@
 #include <tuple>
 #include <unordered_map>
 
+namespace VulkanAPI
+{
+class MappedBuffer;
+}
+
 namespace OmegaEngine
 {
 // forward declerations
@@ -59,19 +64,55 @@ struct MaterialInfo
 	bool usingSpecularGlossiness = false;
 };
 
+// the gpu side material - one per material in the storage buffer, indexed by the material index pushed with each
+// draw. This must match the layout in the model fragment shader (std430)
+struct MaterialBufferInfo
+{
+	OEMaths::vec4f baseColorFactor;
+	OEMaths::vec4f emissiveFactor;
+	OEMaths::vec4f diffuseFactor;
+	OEMaths::vec4f specularFactor;
+	float metallicFactor;
+	float roughnessFactor;
+
+	// alpha
+	float alphaMask;
+	float alphaMaskCutoff;
+
+	// uv sets for each texture
+	uint32_t baseColourUvSet;
+	uint32_t metallicRoughnessUvSet;
+	uint32_t normalUvSet;
+	uint32_t emissiveUvSet;
+	uint32_t occlusionUvSet;
+	uint32_t usingSpecularGlossiness;
+	uint32_t pad0;
+	uint32_t pad1;
+
+	// the elements of the bindless texture array - a shared fallback texture if the material doesn't have the map
+	uint32_t baseColourTexture;
+	uint32_t normalTexture;
+	uint32_t mrTexture;
+	uint32_t emissiveTexture;
+	uint32_t aoTexture;
+	uint32_t pad2;
+	uint32_t pad3;
+	uint32_t pad4;
+};
+
 class MaterialManager : public ManagerBase
 {
 
 public:
+	static constexpr uint32_t TextureCount = static_cast<uint32_t>(ModelMaterial::TextureId::Count);
+
+	// the number of materials the buffer grows by
+	static constexpr uint32_t MaterialChunkSize = 64;
+
 	// this must be in the same order as the model material texture enum -
-	// includes the binding number as per the model shader
-	const std::vector<std::tuple<std::string, uint32_t>> textureExtensions = {
-		{ "BaseColour", 0 },
-		{ "Emissive", 3 },
-		{ "MetallicRoughness", 2 },
-		{ "Normal", 1 },
-		{ "Occlusion", 4 }
-	};
+	// the position gives the texture slot within the material
+	const std::vector<std::string> textureExtensions = { "BaseColour", "Emissive", "MetallicRoughness", "Normal",
+		                                                 "Occlusion" };
 
 	MaterialManager();
 	~MaterialManager();
@@ -86,13 +127,32 @@ public:
 	                 std::vector<std::unique_ptr<ModelImage>> &images);
 	MaterialInfo &get(uint32_t index);
 
+	// the index of the first material with this name, or UINT32_MAX if there isn't one
+	uint32_t findMaterial(const std::string &name) const;
+
+	// each material has a texture slot for each type, in the order of the texture id enum. The slots follow
+	// the fallback textures at the start of the bindless array
+	static uint32_t getTextureIndex(const uint32_t materialIndex, const uint32_t textureId);
+
 	uint32_t getBufferOffset() const
 	{
 		return static_cast<uint32_t>(materials.size());
 	}
 
+private:
+	void addToBuffer(const uint32_t index);
+
 private:
 	std::vector<MaterialInfo> materials;
+
+	// the first material of each name - textures are traced by the material name
+	std::unordered_map<std::string, uint32_t> materialIndices;
+
+	// the factors and texture indices of all materials - materials are only ever added, so only those
+	// after the uploaded count are written
+	std::unique_ptr<VulkanAPI::MappedBuffer> materialBuffer;
+	uint32_t uploadedCount = 0;
+
 	bool isDirty = true;
 };
 
@@ -11,9 +11,333 @@
 #include "VulkanAPI/BufferManager.h"
 #include "Rendering/ProgramStateManager.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
 namespace OmegaEngine
 {
 
+static int16_t packSnorm16(const float value)
+{
+	float clamped = std::max(-1.0f, std::min(1.0f, value));
+	return static_cast<int16_t>(std::round(clamped * 32767.0f));
+}
+
+static uint8_t packUnorm8(const float value)
+{
+	float clamped = std::max(0.0f, std::min(1.0f, value));
+	return static_cast<uint8_t>(std::round(clamped * 255.0f));
+}
+
+// round to nearest float to half conversion - values too large for a half are clamped to the largest finite value
+static uint16_t packHalf(const float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(float));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t floatExponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x007fffff;
+
+	// nan and infinity
+	if (floatExponent == 0xff)
+	{
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+
+	int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+	if (exponent >= 31)
+	{
+		return static_cast<uint16_t>(sign | 0x7bff);
+	}
+
+	// denormal halfs - anything smaller is flushed to zero
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x00800000;
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+		{
+			++half;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	// a carry from the rounding into the exponent still gives the correct result
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+	{
+		++half;
+	}
+	return static_cast<uint16_t>(std::min(half, sign | 0x7bff));
+}
+
+// projects the normal onto an octahedron, which is then unfolded into a square
+static void packOctahedral(const OEMaths::vec3f& normal, int16_t* out)
+{
+	float x = normal.getX();
+	float y = normal.getY();
+	float z = normal.getZ();
+
+	float length = std::abs(x) + std::abs(y) + std::abs(z);
+	if (length < FLT_EPSILON)
+	{
+		out[0] = 0;
+		out[1] = 0;
+		return;
+	}
+	x /= length;
+	y /= length;
+
+	// the lower hemisphere is folded over the diagonals
+	if (z < 0.0f)
+	{
+		float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	out[0] = packSnorm16(x);
+	out[1] = packSnorm16(y);
+}
+
+// the rounding can leave the weights not summing to one, so the difference is added to the largest weight
+static void packWeights(const OEMaths::vec4f& weight, uint8_t* out)
+{
+	float weights[4] = { weight.getX(), weight.getY(), weight.getZ(), weight.getW() };
+
+	int32_t total = 0;
+	uint32_t largest = 0;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		out[i] = packUnorm8(weights[i]);
+		total += out[i];
+		if (weights[i] > weights[largest])
+		{
+			largest = i;
+		}
+	}
+
+	if (total > 0)
+	{
+		int32_t corrected = static_cast<int32_t>(out[largest]) + 255 - total;
+		out[largest] = static_cast<uint8_t>(std::max(0, std::min(255, corrected)));
+	}
+}
+
+static bool hasPackableJoints(const std::vector<ModelMesh::Vertex>& vertices)
+{
+	for (auto& vertex : vertices)
+	{
+		float joints[4] = { vertex.joint.getX(), vertex.joint.getY(), vertex.joint.getZ(), vertex.joint.getW() };
+		for (float joint : joints)
+		{
+			if (joint < 0.0f || joint > 255.0f)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// the positions are quantised over the bounds of the mesh, so each axis uses the full snorm16 range
+static MeshManager::QuantisationInfo getQuantisation(const std::vector<ModelMesh::Vertex>& vertices)
+{
+	float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (auto& vertex : vertices)
+	{
+		float position[3] = { vertex.position.getX(), vertex.position.getY(), vertex.position.getZ() };
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			minimum[i] = std::min(minimum[i], position[i]);
+			maximum[i] = std::max(maximum[i], position[i]);
+		}
+	}
+
+	float offset[3] = { 0.0f, 0.0f, 0.0f };
+	float scale[3] = { 1.0f, 1.0f, 1.0f };
+	if (!vertices.empty())
+	{
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			offset[i] = (minimum[i] + maximum[i]) * 0.5f;
+
+			// flat axes only have the one value, which will be packed as zero
+			float extent = (maximum[i] - minimum[i]) * 0.5f;
+			scale[i] = extent > 0.0f ? extent : 1.0f;
+		}
+	}
+
+	MeshManager::QuantisationInfo info;
+	info.offset = OEMaths::vec4f(offset[0], offset[1], offset[2], 0.0f);
+	info.scale = OEMaths::vec4f(scale[0], scale[1], scale[2], 1.0f);
+	return info;
+}
+
+// the attributes shared by the static and skinned packed layouts
+template <typename T>
+static void packVertex(const ModelMesh::Vertex& vertex, const MeshManager::QuantisationInfo& info, T& out)
+{
+	out.position[0] = packSnorm16((vertex.position.getX() - info.offset.getX()) / info.scale.getX());
+	out.position[1] = packSnorm16((vertex.position.getY() - info.offset.getY()) / info.scale.getY());
+	out.position[2] = packSnorm16((vertex.position.getZ() - info.offset.getZ()) / info.scale.getZ());
+	out.position[3] = 0;
+
+	out.uv0[0] = packHalf(vertex.uv0.getX());
+	out.uv0[1] = packHalf(vertex.uv0.getY());
+	out.uv1[0] = packHalf(vertex.uv1.getX());
+	out.uv1[1] = packHalf(vertex.uv1.getY());
+
+	packOctahedral(vertex.normal, out.normal);
+}
+
+MeshBufferPool::MeshBufferPool(const char* _id, const uint32_t _elementSize, const uint32_t _capacity)
+    : id(_id)
+    , elementSize(_elementSize)
+    , capacity(_capacity)
+{
+	freeRanges[0] = capacity;
+}
+
+uint32_t MeshBufferPool::allocate(const uint32_t count)
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (auto iter = freeRanges.begin(); iter != freeRanges.end(); ++iter)
+	{
+		if (iter->second >= count)
+		{
+			uint32_t offset = iter->first;
+			uint32_t remaining = iter->second - count;
+
+			freeRanges.erase(iter);
+			if (remaining > 0)
+			{
+				freeRanges[offset + count] = remaining;
+			}
+
+			used += count;
+			return offset;
+		}
+	}
+
+	if (!grow(count))
+	{
+		return UINT32_MAX;
+	}
+	return allocate(count);
+}
+
+bool MeshBufferPool::grow(const uint32_t count)
+{
+	// a free range at the end of the pool is extended, so only the remainder of the count is needed
+	uint32_t tail = 0;
+	if (!freeRanges.empty())
+	{
+		auto last = std::prev(freeRanges.end());
+		if (last->first + last->second == capacity)
+		{
+			tail = last->second;
+		}
+	}
+
+	// at least doubles, so the buffer is moved as few times as possible whilst a scene is loaded. Segment sizes are
+	// held in 32 bits by the allocator, which limits the size of the buffer
+	const uint64_t maxCapacity = (1ull << 31) / elementSize;
+	uint64_t newCapacity =
+	    std::max(static_cast<uint64_t>(capacity) * 2, static_cast<uint64_t>(capacity) + count - tail);
+	newCapacity = std::min(newCapacity, maxCapacity);
+	if (newCapacity - capacity + tail < count)
+	{
+		return false;
+	}
+
+	uint32_t start = capacity - tail;
+	freeRanges[start] = static_cast<uint32_t>(newCapacity) - start;
+	capacity = static_cast<uint32_t>(newCapacity);
+	return true;
+}
+
+void MeshBufferPool::free(const uint32_t offset, const uint32_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	assert(offset + count <= capacity);
+	uint32_t start = offset;
+	uint32_t size = count;
+
+	// merge with the free ranges either side
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && next->first == offset + count)
+	{
+		size += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin())
+	{
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset)
+		{
+			start = prev->first;
+			size += prev->second;
+			freeRanges.erase(prev);
+		}
+	}
+
+	freeRanges[start] = size;
+	used -= count;
+}
+
+void MeshBufferPool::upload()
+{
+	if (pending.empty())
+	{
+		return;
+	}
+
+	// the buffer is allocated at its full size, with no data, so the ranges can be written into it. Once the pool
+	// has grown, the same event moves the buffer to a larger one with the current contents
+	if (bufferCapacity < capacity)
+	{
+		VulkanAPI::BufferUpdateEvent event{ id, nullptr, static_cast<uint64_t>(capacity) * elementSize,
+			                                VulkanAPI::MemoryUsage::VK_BUFFER_STATIC };
+		Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+		bufferCapacity = capacity;
+	}
+
+	uploading.swap(staging);
+	staging.clear();
+
+	for (auto& range : pending)
+	{
+		VulkanAPI::BufferUpdateEvent event{ id,
+			                                uploading.data() + range.stagingOffset,
+			                                static_cast<uint64_t>(range.count) * elementSize,
+			                                VulkanAPI::MemoryUsage::VK_BUFFER_STATIC,
+			                                false,
+			                                static_cast<uint64_t>(range.offset) * elementSize };
+		Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+	}
+	pending.clear();
+}
+
 MeshManager::MeshManager()
 {
 }
@@ -33,59 +357,354 @@ void MeshManager::linkMaterialWithMesh(MeshComponent* meshComponent, MaterialCom
 	}
 }
 
-void MeshManager::addComponentToManager(MeshComponent* component)
+static void getPrimitiveBounds(const std::vector<ModelMesh::Vertex>& vertices, const std::vector<uint32_t>& indices,
+                               PrimitiveMesh& primitive)
 {
-	StaticMesh mesh;
-	auto vertexData = component->mesh->vertices;
+	float minPos[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float maxPos[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
 
-	// copy data from model into the manager
-	if (!component->mesh->skinned)
+	uint32_t end = std::min(primitive.indexBase + primitive.indexCount, static_cast<uint32_t>(indices.size()));
+	if (end <= primitive.indexBase)
 	{
-		mesh.type = StateMesh::Static;
-		mesh.vertexBufferOffset = static_cast<uint32_t>(staticVertices.size());
+		return;
+	}
 
-		for (auto& vertex : vertexData)
+	for (uint32_t i = primitive.indexBase; i < end; ++i)
+	{
+		const OEMaths::vec4f& pos = vertices[indices[i]].position;
+		float p[3] = { pos.getX(), pos.getY(), pos.getZ() };
+		for (uint32_t k = 0; k < 3; ++k)
 		{
-			Vertex vert;
-			vert.normal = vertex.normal;
-			vert.position = vertex.position;
-			vert.uv0 = vertex.uv0;
-			vert.uv1 = vertex.uv1;
+			minPos[k] = std::min(minPos[k], p[k]);
+			maxPos[k] = std::max(maxPos[k], p[k]);
+		}
+	}
+
+	float size[3] = { maxPos[0] - minPos[0], maxPos[1] - minPos[1], maxPos[2] - minPos[2] };
+	primitive.center = OEMaths::vec3f{ minPos[0] + size[0] * 0.5f, minPos[1] + size[1] * 0.5f,
+		                               minPos[2] + size[2] * 0.5f };
+	primitive.radius = 0.5f * std::sqrt(size[0] * size[0] + size[1] * size[1] + size[2] * size[2]);
+}
+
+void MeshManager::setVertexPacking(const bool packStatic, const bool packSkinned)
+{
+	this->packStatic = packStatic;
+	this->packSkinned = packSkinned;
+}
+
+MeshBufferPool& MeshManager::getVertexPool(const StateMesh type)
+{
+	switch (type)
+	{
+	case StateMesh::Skinned:
+		return skinnedVertices;
+	case StateMesh::StaticPacked:
+		return packedVertices;
+	case StateMesh::SkinnedPacked:
+		return packedSkinnedVertices;
+	default:
+		return staticVertices;
+	}
+}
+
+bool MeshManager::packMesh(MeshComponent* component, StaticMesh& mesh, const bool skinned)
+{
+	auto& vertexData = component->mesh->vertices;
+	const uint32_t vertexCount = static_cast<uint32_t>(vertexData.size());
 
-			staticVertices.emplace_back(vert);
+	mesh.type = skinned ? StateMesh::SkinnedPacked : StateMesh::StaticPacked;
+	MeshBufferPool& pool = getVertexPool(mesh.type);
+
+	mesh.quantisationIndex = quantisation.allocate(1);
+	if (mesh.quantisationIndex == UINT32_MAX)
+	{
+		return false;
+	}
+
+	mesh.vertexBufferOffset = pool.allocate(vertexCount);
+	if (mesh.vertexBufferOffset == UINT32_MAX)
+	{
+		quantisation.free(mesh.quantisationIndex, 1);
+		return false;
+	}
+
+	QuantisationInfo info = getQuantisation(vertexData);
+	*quantisation.stage<QuantisationInfo>(mesh.quantisationIndex, 1) = info;
+
+	if (!skinned)
+	{
+		PackedVertex* verts = pool.stage<PackedVertex>(mesh.vertexBufferOffset, vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			packVertex(vertexData[i], info, verts[i]);
 		}
 	}
 	else
 	{
-		mesh.type = StateMesh::Skinned;
-		mesh.vertexBufferOffset = static_cast<uint32_t>(skinnedVertices.size());
+		PackedSkinnedVertex* verts = pool.stage<PackedSkinnedVertex>(mesh.vertexBufferOffset, vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			auto& vertex = vertexData[i];
+			PackedSkinnedVertex& vert = verts[i];
+			packVertex(vertex, info, vert);
+			packWeights(vertex.weight, vert.weight);
+
+			vert.joint[0] = static_cast<uint8_t>(vertex.joint.getX());
+			vert.joint[1] = static_cast<uint8_t>(vertex.joint.getY());
+			vert.joint[2] = static_cast<uint8_t>(vertex.joint.getZ());
+			vert.joint[3] = static_cast<uint8_t>(vertex.joint.getW());
+		}
+	}
+	return true;
+}
+
+bool MeshManager::addVertices(MeshComponent* component, StaticMesh& mesh, const bool skinned)
+{
+	auto& vertexData = component->mesh->vertices;
+	const uint32_t vertexCount = static_cast<uint32_t>(vertexData.size());
+
+	mesh.type = skinned ? StateMesh::Skinned : StateMesh::Static;
+	MeshBufferPool& pool = getVertexPool(mesh.type);
+
+	mesh.vertexBufferOffset = pool.allocate(vertexCount);
+	if (mesh.vertexBufferOffset == UINT32_MAX)
+	{
+		return false;
+	}
 
-		for (auto& vertex : vertexData)
+	if (!skinned)
+	{
+		Vertex* verts = pool.stage<Vertex>(mesh.vertexBufferOffset, vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			verts[i].normal = vertexData[i].normal;
+			verts[i].position = vertexData[i].position;
+			verts[i].uv0 = vertexData[i].uv0;
+			verts[i].uv1 = vertexData[i].uv1;
+		}
+	}
+	else
+	{
+		SkinnedVertex* verts = pool.stage<SkinnedVertex>(mesh.vertexBufferOffset, vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
 		{
-			SkinnedVertex vert;
-			vert.normal = vertex.normal;
-			vert.position = vertex.position;
-			vert.uv0 = vertex.uv0;
-			vert.uv1 = vertex.uv1;
-			vert.weight = vertex.weight;
-			vert.joint = vertex.joint;
+			verts[i].normal = vertexData[i].normal;
+			verts[i].position = vertexData[i].position;
+			verts[i].uv0 = vertexData[i].uv0;
+			verts[i].uv1 = vertexData[i].uv1;
+			verts[i].weight = vertexData[i].weight;
+			verts[i].joint = vertexData[i].joint;
+		}
+	}
+	return true;
+}
+
+bool MeshManager::addIndices(MeshComponent* component, StaticMesh& mesh)
+{
+	auto& modelIndices = component->mesh->indices;
+	mesh.indexCount = static_cast<uint32_t>(modelIndices.size());
+
+	// the indices are kept relative to the mesh, so small meshes can use 16-bit indices wherever they are in the
+	// vertex buffer
+	mesh.shortIndices = mesh.vertexCount <= MaxShortIndexVertices;
+	MeshBufferPool& pool = mesh.shortIndices ? shortIndices : indices;
 
-			skinnedVertices.emplace_back(vert);
+	mesh.indexBufferOffset = pool.allocate(mesh.indexCount);
+	if (mesh.indexBufferOffset == UINT32_MAX)
+	{
+		return false;
+	}
+
+	if (mesh.shortIndices)
+	{
+		uint16_t* dst = pool.stage<uint16_t>(mesh.indexBufferOffset, mesh.indexCount);
+		for (uint32_t i = 0; i < mesh.indexCount; ++i)
+		{
+			dst[i] = static_cast<uint16_t>(modelIndices[i]);
 		}
 	}
+	else
+	{
+		uint32_t* dst = pool.stage<uint32_t>(mesh.indexBufferOffset, mesh.indexCount);
+		std::copy(modelIndices.begin(), modelIndices.end(), dst);
+	}
+	return true;
+}
 
-	// and now the indices
+void MeshManager::buildMeshlets(MeshComponent* component, StaticMesh& mesh)
+{
+	auto& vertexData = component->mesh->vertices;
 	auto& modelIndices = component->mesh->indices;
 
-	uint32_t indexOffset = static_cast<uint32_t>(indices.size());
-	mesh.indexBufferOffset = indexOffset;
+	// the bounds of skinned meshes would only hold for the bind pose
+	if (component->mesh->skinned || mesh.topology != StateTopology::List || vertexData.empty())
+	{
+		return;
+	}
+
+	MeshletBuilder builder;
+	const float* positions = reinterpret_cast<const float*>(&vertexData[0].position);
+
+	for (auto& primitive : mesh.primitives)
+	{
+		size_t start = std::min<size_t>(primitive.indexBase, modelIndices.size());
+		size_t count = std::min<size_t>(primitive.indexCount, modelIndices.size() - start);
+
+		primitive.meshletOffset = static_cast<uint32_t>(meshlets.size());
+		primitive.meshletCount =
+		    builder.build(&modelIndices[start], count - count % 3, positions, vertexData.size(),
+		                  sizeof(ModelMesh::Vertex), meshlets, meshletVertices, meshletTriangles);
+	}
+}
+
+void MeshManager::removeMeshlets(const StaticMesh& mesh)
+{
+	// the clusters of a mesh are appended in one go, so lie in a single range of each list
+	uint32_t first = UINT32_MAX;
+	uint32_t last = 0;
+	for (auto& primitive : mesh.primitives)
+	{
+		if (primitive.meshletCount > 0)
+		{
+			first = std::min(first, primitive.meshletOffset);
+			last = std::max(last, primitive.meshletOffset + primitive.meshletCount);
+		}
+	}
+
+	if (first == UINT32_MAX)
+	{
+		return;
+	}
+
+	const uint32_t vertexStart = meshlets[first].vertexOffset;
+	const uint32_t vertexEnd = meshlets[last - 1].vertexOffset + meshlets[last - 1].vertexCount;
+	const uint32_t triangleStart = meshlets[first].triangleOffset;
+	const uint32_t triangleEnd = meshlets[last - 1].triangleOffset + meshlets[last - 1].triangleCount;
+
+	meshlets.erase(meshlets.begin() + first, meshlets.begin() + last);
+	meshletVertices.erase(meshletVertices.begin() + vertexStart, meshletVertices.begin() + vertexEnd);
+	meshletTriangles.erase(meshletTriangles.begin() + triangleStart * 3, meshletTriangles.begin() + triangleEnd * 3);
+
+	for (size_t i = first; i < meshlets.size(); ++i)
+	{
+		meshlets[i].vertexOffset -= vertexEnd - vertexStart;
+		meshlets[i].triangleOffset -= triangleEnd - triangleStart;
+	}
+
+	auto shiftOffsets = [first, last](StaticMesh& other) {
+		for (auto& primitive : other.primitives)
+		{
+			if (primitive.meshletCount > 0 && primitive.meshletOffset >= last)
+			{
+				primitive.meshletOffset -= last - first;
+			}
+		}
+	};
+
+	// the shared meshes hold a copy of the primitives which is handed to later instances
+	for (auto& other : meshBuffer)
+	{
+		shiftOffsets(other);
+	}
+	for (auto& shared : sharedMeshes)
+	{
+		shiftOffsets(shared.second.mesh);
+	}
+}
+
+// the hash covers everything the gpu data and primitive bounds are derived from, though not the materials
+static uint64_t hashMesh(const ModelMesh& modelMesh)
+{
+	uint64_t hash = Util::hashBytes(modelMesh.vertices.data(), modelMesh.vertices.size() * sizeof(ModelMesh::Vertex));
+	hash = Util::hashBytes(modelMesh.indices.data(), modelMesh.indices.size() * sizeof(uint32_t), hash);
+
+	const uint32_t topology = static_cast<uint32_t>(modelMesh.topology);
+	hash = Util::hashBytes(&topology, sizeof(uint32_t), hash);
+
+	for (auto& primitive : modelMesh.primitives)
+	{
+		uint32_t range[2] = { primitive.indexBase, primitive.indexCount };
+		hash = Util::hashBytes(range, sizeof(range), hash);
+		for (auto& lod : primitive.lods)
+		{
+			uint32_t lodRange[2] = { lod.indexBase, lod.indexCount };
+			hash = Util::hashBytes(lodRange, sizeof(lodRange), hash);
+		}
+	}
+	return hash;
+}
+
+bool MeshManager::findSharedMesh(MeshComponent* component, StaticMesh& mesh)
+{
+	auto iter = sharedMeshes.find(mesh.contentHash);
+	if (iter == sharedMeshes.end())
+	{
+		return false;
+	}
+
+	// guard against a hash collision between meshes of different sizes
+	const StaticMesh& sharedMesh = iter->second.mesh;
+	if (sharedMesh.vertexCount != mesh.vertexCount ||
+	    sharedMesh.indexCount != static_cast<uint32_t>(component->mesh->indices.size()) ||
+	    sharedMesh.primitives.size() != component->mesh->primitives.size())
+	{
+		return false;
+	}
+
+	// the bounds, levels and meshlets of the primitives are shared too, only the materials differ
+	mesh = sharedMesh;
+	auto& modelPrimitives = component->mesh->primitives;
+	for (size_t i = 0; i < modelPrimitives.size(); ++i)
+	{
+		mesh.primitives[i].materialId = modelPrimitives[i].materialId + component->materialBufferOffset;
+	}
+
+	++iter->second.refCount;
+	++cacheStats.sharedMeshes;
+
+	const uint32_t indexSize = mesh.shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+	cacheStats.bytesSaved += static_cast<uint64_t>(mesh.vertexCount) * getVertexPool(mesh.type).getElementSize() +
+	                         static_cast<uint64_t>(mesh.indexCount) * indexSize;
+	return true;
+}
+
+void MeshManager::addComponentToManager(MeshComponent* component)
+{
+	StaticMesh mesh;
+	auto& vertexData = component->mesh->vertices;
+	mesh.vertexCount = static_cast<uint32_t>(vertexData.size());
+	mesh.topology = component->mesh->topology;
+
+	// the joints of packed skinned vertices are eight bit, so larger skins use the float layout
+	const bool skinned = component->mesh->skinned;
+	const bool packed = skinned ? packSkinned && hasPackableJoints(vertexData) : packStatic;
 
-	// simple copy from the model data to the manager
-	for (uint32_t i = 0; i < modelIndices.size(); ++i)
+	// identical meshes, which are common across models, are only uploaded once
+	if (!skinned)
 	{
-		indices.emplace_back(modelIndices[i] + mesh.vertexBufferOffset);
+		mesh.contentHash = hashMesh(*component->mesh);
 	}
 
+	if (mesh.contentHash != 0 && findSharedMesh(component, mesh))
+	{
+		addMeshSlot(component, mesh);
+		return;
+	}
+
+	// copy data from model into the staging area of the pools
+	bool hasVertices = packed ? packMesh(component, mesh, skinned) : addVertices(component, mesh, skinned);
+	bool hasIndices = hasVertices && addIndices(component, mesh);
+
+	// the pools grow as meshes are added, so this is only reached once a buffer would be too large to allocate
+	if (!hasIndices)
+	{
+		LOGGER_ERROR("Unable to allocate space for a mesh with %u vertices and %u indices - the mesh pools are at "
+		             "their maximum size.",
+		             mesh.vertexCount, static_cast<uint32_t>(component->mesh->indices.size()));
+	}
+
+	auto& modelIndices = component->mesh->indices;
+
 	// and the primitive data
 	auto& modelPrimitives = component->mesh->primitives;
 
@@ -95,45 +714,114 @@ void MeshManager::addComponentToManager(MeshComponent* component)
 		primitive.indexBase = modelPrimitive.indexBase;
 		primitive.indexCount = modelPrimitive.indexCount;
 		primitive.materialId = modelPrimitive.materialId + component->materialBufferOffset;
+
+		primitive.lods[0] = { primitive.indexBase, primitive.indexCount, 0.0f };
+		for (auto& modelLod : modelPrimitive.lods)
+		{
+			if (primitive.lodCount == MeshSimplifier::MaxLods)
+			{
+				break;
+			}
+			primitive.lods[primitive.lodCount++] = { modelLod.indexBase, modelLod.indexCount, modelLod.error };
+		}
+
+		getPrimitiveBounds(vertexData, modelIndices, primitive);
 		mesh.primitives.emplace_back(primitive);
 	}
 
-	mesh.topology = component->mesh->topology;
+	buildMeshlets(component, mesh);
+	++cacheStats.uniqueMeshes;
 
-	meshBuffer.emplace_back(mesh);
+	// a colliding hash of a different mesh leaves this one unshared
+	if (mesh.contentHash != 0 && !sharedMeshes.count(mesh.contentHash))
+	{
+		sharedMeshes[mesh.contentHash] = { mesh, 1 };
+	}
+	else
+	{
+		mesh.contentHash = 0;
+	}
 
-	// store the buffer index in the mesh component
-	component->index = static_cast<uint32_t>(meshBuffer.size() - 1);
+	addMeshSlot(component, mesh);
 }
 
+void MeshManager::addMeshSlot(MeshComponent* component, const StaticMesh& mesh)
+{
+	// reuse the slot of a removed mesh if there is one
+	if (!freeMeshSlots.empty())
+	{
+		component->index = freeMeshSlots.back();
+		freeMeshSlots.pop_back();
+		meshBuffer[component->index] = mesh;
+	}
+	else
+	{
+		meshBuffer.emplace_back(mesh);
+		component->index = static_cast<uint32_t>(meshBuffer.size() - 1);
+	}
+}
 
-void MeshManager::updateFrame(double time, double dt, std::unique_ptr<ObjectManager>& objectManager,
-                              ComponentInterface* componentInterface)
+void MeshManager::releaseMesh(StaticMesh& mesh)
 {
-	if (isDirty)
+	if (mesh.contentHash != 0)
 	{
-		// static and skinned meshes if any
-		if (!staticVertices.empty())
+		auto iter = sharedMeshes.find(mesh.contentHash);
+		assert(iter != sharedMeshes.end());
+		if (--iter->second.refCount > 0)
 		{
-			VulkanAPI::BufferUpdateEvent event{ "StaticVertices", staticVertices.data(),
-				                                staticVertices.size() * sizeof(Vertex),
-				                                VulkanAPI::MemoryUsage::VK_BUFFER_STATIC };
-			Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+			return;
 		}
-		if (!skinnedVertices.empty())
+		sharedMeshes.erase(iter);
+	}
+
+	if (mesh.vertexCount > 0)
+	{
+		getVertexPool(mesh.type).free(mesh.vertexBufferOffset, mesh.vertexCount);
+		MeshBufferPool& indexPool = mesh.shortIndices ? shortIndices : indices;
+		indexPool.free(mesh.indexBufferOffset, mesh.indexCount);
+
+		if (isPackedMesh(mesh.type))
 		{
-			VulkanAPI::BufferUpdateEvent event{ "SkinnedVertices", skinnedVertices.data(),
-				                                skinnedVertices.size() * sizeof(SkinnedVertex),
-				                                VulkanAPI::MemoryUsage::VK_BUFFER_STATIC };
-			Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+			quantisation.free(mesh.quantisationIndex, 1);
 		}
+	}
 
-		// and the indices....
-		VulkanAPI::BufferUpdateEvent event{ "Indices", indices.data(), indices.size() * sizeof(uint32_t),
-			                                VulkanAPI::MemoryUsage::VK_BUFFER_STATIC };
-		Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
+	// the meshlets are only used on the cpu, so the lists are compacted rather than leaving holes
+	removeMeshlets(mesh);
+}
+
+void MeshManager::removeComponentFromManager(MeshComponent* component)
+{
+	assert(component->index < meshBuffer.size());
+	StaticMesh& mesh = meshBuffer[component->index];
+
+	releaseMesh(mesh);
 
-		isDirty = false;
+	mesh = StaticMesh();
+	freeMeshSlots.emplace_back(component->index);
+}
+
+void MeshManager::updateFrame(double time, double dt, std::unique_ptr<ObjectManager>& objectManager,
+                              ComponentInterface* componentInterface)
+{
+	// only the ranges of meshes added since the last frame are uploaded
+	staticVertices.upload();
+	skinnedVertices.upload();
+	packedVertices.upload();
+	packedSkinnedVertices.upload();
+	quantisation.upload();
+	indices.upload();
+	shortIndices.upload();
+
+	// the compute skinning pass writes into this buffer, using the same layout as the static vertices so the same
+	// indices can be used to draw the skinned meshes with the static pipelines. It grows along with the skinned pool
+	if (skinnedVertices.isCreated() && skinnedOutputCapacity < skinnedVertices.getCapacity())
+	{
+		skinnedOutputCapacity = skinnedVertices.getCapacity();
+		VulkanAPI::BufferUpdateEvent outputEvent{ "SkinnedOutput", nullptr,
+			                                      static_cast<uint64_t>(skinnedOutputCapacity) * sizeof(Vertex),
+			                                      VulkanAPI::MemoryUsage::VK_BUFFER_STATIC };
+		Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(outputEvent);
 	}
 }
 }    // namespace OmegaEngine
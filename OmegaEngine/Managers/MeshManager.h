@@ -1,12 +1,17 @@
 #pragma once
 #include "Managers/ManagerBase.h"
+#include "Models/MeshSimplifier.h"
+#include "Models/MeshletBuilder.h"
 #include "OEMaths/OEMaths.h"
 #include "OEMaths/OEMaths_Quat.h"
 #include "Utility/logger.h"
 
+#include <array>
+#include <map>
 #include <memory>
 #include <tuple>
 #include <unordered_map>
+#include <vector>
 
 namespace OmegaEngine
 {
@@ -27,6 +32,25 @@ enum class StateMesh;
 
 	// material id
 	uint32_t materialId;
+
+	// the primitive's clusters in the manager's meshlet list - static triangle lists only
+	uint32_t meshletOffset = 0;
+	uint32_t meshletCount = 0;
+
+	// the levels of detail, with the full primitive as the first. The error is relative to the radius
+	struct Lod
+	{
+		uint32_t indexBase = 0;
+		uint32_t indexCount = 0;
+		float error = 0.0f;
+	};
+
+	std::array<Lod, MeshSimplifier::MaxLods> lods;
+	uint32_t lodCount = 1;
+
+	// model space bounding sphere, used to find the size of the primitive on screen
+	OEMaths::vec3f center;
+	float radius = 0.0f;
 };
 
 struct StaticMesh
@@ -39,18 +63,132 @@ struct StaticMesh
 	// states
 	StateTopology topology;
 
-	// offset into mega buffer
-	uint32_t vertexBufferOffset;
-	uint32_t indexBufferOffset;
+	// offset into mega buffer - the indices are relative to the mesh, the vertex offset is added by the draw
+	uint32_t vertexBufferOffset = 0;
+	uint32_t indexBufferOffset = 0;
+	uint32_t vertexCount = 0;
+
+	// all the indices of the mesh, including those of the levels of detail
+	uint32_t indexCount = 0;
+
+	// meshes with few enough vertices use the 16-bit index buffer - the offset is into this buffer
+	bool shortIndices = false;
+
+	// skinned meshes can be skinned by the compute pre-pass, in which case they are drawn
+	// as static geometry from the skinned output buffer
+	bool computeSkinned = false;
+
+	// packed meshes only - index into the dequantisation buffer, passed to the shader as the first instance
+	uint32_t quantisationIndex = 0;
+
+	// meshes with the same content hash share their ranges in the gpu buffers. Zero if the mesh isn't shared
+	uint64_t contentHash = 0;
+};
+
+// Sub-allocates ranges of elements within one of the gpu mesh buffers. The buffer is created at its full capacity
+// when first used, after which only the ranges of newly added meshes are uploaded, so adding a mesh doesn't
+// re-upload the scene. Freed ranges are merged with their neighbours and reused first fit. When there is no free
+// range large enough the pool grows, and the buffer is moved to a larger one with its contents at the next upload
+class MeshBufferPool
+{
+public:
+	MeshBufferPool(const char* id, const uint32_t elementSize, const uint32_t capacity);
+
+	// returns the offset of the range in elements, or UINT32_MAX if the pool can't grow large enough
+	uint32_t allocate(const uint32_t count);
+	void free(const uint32_t offset, const uint32_t count);
+
+	// room in the staging area for the elements of an allocated range, which will be uploaded at the next update.
+	// The pointer is only valid until the next call
+	template <typename T>
+	T* stage(const uint32_t offset, const uint32_t count)
+	{
+		assert(sizeof(T) == elementSize);
+		if (count == 0)
+		{
+			return nullptr;
+		}
+
+		size_t stagingOffset = staging.size();
+		staging.resize(stagingOffset + static_cast<size_t>(count) * elementSize);
+
+		// ranges which follow on from the last, as when a model is loaded, are sent as one upload
+		if (!pending.empty() && pending.back().offset + pending.back().count == offset)
+		{
+			pending.back().count += count;
+		}
+		else
+		{
+			pending.push_back({ offset, count, stagingOffset });
+		}
+		return reinterpret_cast<T*>(staging.data() + stagingOffset);
+	}
+
+	// queues the buffer creation or move, if needed, and the staged ranges with the buffer manager
+	void upload();
+
+	bool isCreated() const
+	{
+		return bufferCapacity > 0;
+	}
+
+	uint32_t getCapacity() const
+	{
+		return capacity;
+	}
+
+	uint32_t getUsed() const
+	{
+		return used;
+	}
+
+	uint32_t getElementSize() const
+	{
+		return elementSize;
+	}
+
+private:
+	struct PendingRange
+	{
+		uint32_t offset;
+		uint32_t count;
+		size_t stagingOffset;
+	};
+
+	// adds free space to the end of the pool so a range of the count fits - returns false if the buffer would be
+	// too large to allocate
+	bool grow(const uint32_t count);
+
+	const char* id;
+	uint32_t elementSize;
+	uint32_t capacity;
+	uint32_t used = 0;
+
+	// the capacity of the gpu buffer - zero until it is created, and behind the pool's capacity once it has grown
+	uint32_t bufferCapacity = 0;
+
+	// offset - count of each free range, sorted so neighbours can be merged
+	std::map<uint32_t, uint32_t> freeRanges;
+
+	std::vector<uint8_t> staging;
+	std::vector<PendingRange> pending;
+
+	// the buffer events are queued, so the data they point to is kept until the following update
+	std::vector<uint8_t> uploading;
 };
 
 class MeshManager : public ManagerBase
 {
 
 public:
-	// a user-defined size for the vertex and index gpu mem blocks - this should maybe made more dynamic? Also needs checking for overspill....
-	static constexpr float VertexBlockSize = 1e+5;
-	static constexpr float IndexBlockSize = 1e+5;
+	// the initial capacity, in elements, of each of the gpu vertex and index pools. A pool is only allocated once a
+	// mesh uses it, and grows when a mesh doesn't fit
+	static constexpr uint32_t VertexPoolSize = 1 << 19;
+	static constexpr uint32_t IndexPoolSize = 1 << 21;
+	static constexpr uint32_t QuantisationPoolSize = 4096;
+
+	// meshes with up to this many vertices use 16-bit indices
+	static constexpr uint32_t MaxShortIndexVertices = 65535;
 
 	struct Dimensions
 	{
@@ -81,6 +219,44 @@ public:
 		OEMaths::vec4f joint;
 	};
 
+	// Compact layouts used when vertex packing is enabled. Positions are snorm16 over the bounds of the mesh and
+	// dequantised in the shader, uvs are half floats and normals are octahedral encoded as snorm16
+	struct PackedVertex
+	{
+		int16_t position[4];
+		uint16_t uv0[2];
+		uint16_t uv1[2];
+		int16_t normal[2];
+	};
+
+	// joints are limited to 256 per skin - meshes referencing more fall back to the float layout
+	struct PackedSkinnedVertex
+	{
+		int16_t position[4];
+		uint16_t uv0[2];
+		uint16_t uv1[2];
+		int16_t normal[2];
+		uint8_t weight[4];
+		uint8_t joint[4];
+	};
+
+	// per-mesh position dequantisation: position = packed * scale + offset
+	struct QuantisationInfo
+	{
+		OEMaths::vec4f offset;
+		OEMaths::vec4f scale;
+	};
+
+	struct CacheStats
+	{
+		// meshes uploaded to the gpu, and those which instead point at an identical mesh already uploaded
+		uint32_t uniqueMeshes = 0;
+		uint32_t sharedMeshes = 0;
+
+		// gpu vertex and index memory not used thanks to the shared meshes
+		uint64_t bytesSaved = 0;
+	};
+
 	MeshManager();
 	~MeshManager();
 
@@ -90,27 +266,106 @@ public:
 
 	void addComponentToManager(MeshComponent* component);
 
+	// frees the mesh's ranges in the gpu buffers for reuse by later meshes. Any renderables drawing the mesh must
+	// have been removed first
+	void removeComponentFromManager(MeshComponent* component);
+
 	void linkMaterialWithMesh(MeshComponent* meshComponent, MaterialComponent* materialComponent);
 
+	// must be set before any meshes are added. Skinned meshes shouldn't be packed when skinned by the compute
+	// pass, as it reads the float layout
+	void setVertexPacking(const bool packStatic, const bool packSkinned);
+
 	StaticMesh& getMesh(MeshComponent& comp)
 	{
 		assert(comp.index < meshBuffer.size());
 		return meshBuffer[comp.index];
 	}
 
+	// the meshlet vertices index the mesh's vertices, so are offset by the mesh's vertex offset as with the indices
+	const std::vector<Meshlet>& getMeshlets() const
+	{
+		return meshlets;
+	}
+
+	const std::vector<uint32_t>& getMeshletVertices() const
+	{
+		return meshletVertices;
+	}
+
+	const std::vector<uint8_t>& getMeshletTriangles() const
+	{
+		return meshletTriangles;
+	}
+
+	const CacheStats& getCacheStats() const
+	{
+		return cacheStats;
+	}
+
+private:
+	// copies the model vertices into the packed buffers and adds the mesh's dequantisation transform
+	bool packMesh(MeshComponent* component, StaticMesh& mesh, const bool skinned);
+
+	// allocates and stages the vertices in the float layouts - returns false if the pool is full
+	bool addVertices(MeshComponent* component, StaticMesh& mesh, const bool skinned);
+	bool addIndices(MeshComponent* component, StaticMesh& mesh);
+
+	MeshBufferPool& getVertexPool(const StateMesh type);
+
+	// splits each primitive into clusters with their own culling bounds
+	void buildMeshlets(MeshComponent* component, StaticMesh& mesh);
+
+	// erases the clusters of a released mesh and shifts the offsets of those after it
+	void removeMeshlets(const StaticMesh& mesh);
+
+	// points the mesh at the gpu data of an identical mesh if one has been added - returns false if there is none
+	bool findSharedMesh(MeshComponent* component, StaticMesh& mesh);
+
+	// frees the mesh's ranges in the pools, unless they are still used by another mesh
+	void releaseMesh(StaticMesh& mesh);
+
+	// stores the mesh in a free slot, or at the end of the mesh buffer
+	void addMeshSlot(MeshComponent* component, const StaticMesh& mesh);
+
 private:
 	// the buffers containing all the model data
 	std::vector<StaticMesh> meshBuffer;
 
-	// all vertices and indices held in one large buffer
-	std::vector<Vertex> staticVertices;
-	std::vector<SkinnedVertex> skinnedVertices;
-	std::vector<uint32_t> indices;
+	// slots in the mesh buffer freed by removed meshes
+	std::vector<uint32_t> freeMeshSlots;
+
+	// the vertices and indices of all meshes are sub-allocated from these
+	MeshBufferPool staticVertices{ "StaticVertices", sizeof(Vertex), VertexPoolSize };
+	MeshBufferPool skinnedVertices{ "SkinnedVertices", sizeof(SkinnedVertex), VertexPoolSize };
+	MeshBufferPool packedVertices{ "PackedVertices", sizeof(PackedVertex), VertexPoolSize };
+	MeshBufferPool packedSkinnedVertices{ "PackedSkinnedVertices", sizeof(PackedSkinnedVertex), VertexPoolSize };
+	MeshBufferPool indices{ "Indices", sizeof(uint32_t), IndexPoolSize };
+	MeshBufferPool shortIndices{ "ShortIndices", sizeof(uint16_t), IndexPoolSize };
+	MeshBufferPool quantisation{ "MeshQuantisation", sizeof(QuantisationInfo), QuantisationPoolSize };
+
+	// The gpu data of each mesh which can be shared, keyed by the hash of its vertices, indices and primitives.
+	// Skinned meshes aren't shared as each has its own range in the skinning output
+	struct SharedMesh
+	{
+		// the mesh as first added - the material ids of the primitives are replaced by those of each new mesh
+		StaticMesh mesh;
+		uint32_t refCount = 0;
+	};
+
+	std::unordered_map<uint64_t, SharedMesh> sharedMeshes;
+	CacheStats cacheStats;
+
+	// the output of the compute skinning pass mirrors the skinned vertex pool in the static layout
+	uint32_t skinnedOutputCapacity = 0;
 
-	uint32_t globalVertexOffset = 0;
-	uint32_t globalIndexOffset = 0;
+	// clusters of the static meshes, used for culling at a finer level than the primitive
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint8_t> meshletTriangles;
 
-	bool isDirty = true;
+	bool packStatic = false;
+	bool packSkinned = false;
 };
 
 }    // namespace OmegaEngine
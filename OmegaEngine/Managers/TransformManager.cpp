@@ -19,26 +19,16 @@ namespace OmegaEngine
 
 TransformManager::TransformManager()
 {
-	transformAligned = VulkanAPI::Util::alignmentSize(sizeof(TransformBufferInfo));
-	skinnedAligned = VulkanAPI::Util::alignmentSize(sizeof(SkinnedBufferInfo));
-
-	// allocate the memory used to store the transforms on the CPU side. This will be aligned as we are using dynamic buffers on the Vulkan side
-	transformBufferData = (TransformBufferInfo *)Util::alloc_align(
-	    transformAligned, transformAligned * TransformBlockSize);
-	skinnedBufferData =
-	    (SkinnedBufferInfo *)Util::alloc_align(skinnedAligned, skinnedAligned * SkinnedBlockSize);
+	transformBuffer =
+	    std::make_unique<VulkanAPI::MappedBuffer>("Transform", sizeof(TransformBufferInfo), TransformChunkSize);
+	skinnedBuffer = std::make_unique<VulkanAPI::MappedBuffer>("SkinnedTransform", sizeof(SkinnedBufferInfo),
+	                                                          SkinnedChunkSize);
+	jointPalette = std::make_unique<VulkanAPI::MappedBuffer>("SkinnedJoints", sizeof(OEMaths::mat4f),
+	                                                         JointChunkSize, false);
 }
 
 TransformManager::~TransformManager()
 {
-	if (transformBufferData)
-	{
-		_aligned_free(transformBufferData);
-	}
-	if (skinnedBufferData)
-	{
-		_aligned_free(skinnedBufferData);
-	}
 }
 
 std::unique_ptr<ModelTransform> TransformManager::transform(const OEMaths::vec3f &trans,
@@ -53,20 +43,21 @@ void TransformManager::addComponentToManager(TransformComponent *component)
 {
 	TransformData transform;
 
+	// the decomposed form is always added so the indices match the transform data
+	localTransforms.add(component->transform->translation, component->transform->scale,
+	                    component->transform->rotation);
+
 	if (component->transform->hasMatrix)
 	{
 		transform.setLocalMatrix(component->transform->trsMatrix);
 	}
-	else
-	{
-		transform.setTranslation(component->transform->translation);
-		transform.setScale(component->transform->scale);
-		transform.setRotation(component->transform->rotation);
-	}
 
 	transforms.emplace_back(transform);
 
 	component->index = static_cast<uint32_t>(transforms.size() - 1);
+
+	// the hierarchy will need rebuilding to link this transform with its parent
+	isDirty = true;
 }
 
 bool TransformManager::addComponentToManager(SkeletonComponent *component, Object *object)
@@ -96,10 +87,6 @@ void TransformManager::addSkin(std::unique_ptr<ModelSkin> &skin)
 	SkinInfo skinInfo;
 
 	// inv bind matrices are just a straight copy
-	skinInfo.jointMatrices.resize(skin->jointMatrices.size());
-	memcpy(skinInfo.jointMatrices.data(), skin->jointMatrices.data(),
-	       skinInfo.jointMatrices.size() * sizeof(OEMaths::mat4f));
-
 	skinInfo.invBindMatrices.resize(skin->invBindMatrices.size());
 	memcpy(skinInfo.invBindMatrices.data(), skin->invBindMatrices.data(),
 	       skinInfo.invBindMatrices.size() * sizeof(OEMaths::mat4f));
@@ -108,171 +95,396 @@ void TransformManager::addSkin(std::unique_ptr<ModelSkin> &skin)
 	skinBuffer.emplace_back(skinInfo);
 }
 
-OEMaths::mat4f TransformManager::updateMatrixFromTree(Object &obj,
-                                                      std::unique_ptr<ObjectManager> &objectManager)
+void TransformManager::buildHierarchyRecursive(Object &obj, uint32_t parentIndex,
+                                               uint32_t rootIndex, uint32_t depth)
 {
-	uint32_t objIndex = obj.getComponent<TransformComponent>().index;
-	OEMaths::mat4f mat = transforms[objIndex].getLocalMatrix();
+	uint32_t index = parentIndex;
 
-	Object* parentObject = &obj;
-	uint64_t parentId = parentObject->getParent();
-	while (parentId != UINT64_MAX)
+	if (obj.hasComponent<TransformComponent>())
 	{
-		parentObject = objectManager->getObject(parentId);
+		auto &transformComponent = obj.getComponent<TransformComponent>();
+		index = transformComponent.index;
+
+		TransformData &transform = transforms[index];
+		transform.parentIndex = parentIndex;
+		transform.rootIndex = rootIndex;
+		transform.depth = depth;
 
-		if (parentObject->hasComponent<TransformComponent>())
+		if (parentIndex != UINT32_MAX)
 		{
-			uint32_t parentIndex = parentObject->getComponent<TransformComponent>().index;
-			mat = transforms[parentIndex].getLocalMatrix() * mat;
+			transforms[parentIndex].children.emplace_back(index);
 		}
-		parentId = parentObject->getParent();
+
+		// only meshes require their transform uploading to the gpu
+		if (obj.hasComponent<MeshComponent>())
+		{
+			transformComponent.dynamicUboOffset = transformBuffer->getOffset(transformBufferSize);
+
+			if (!obj.hasComponent<SkinnedComponent>())
+			{
+				transform.bufferIndex = transformBufferSize;
+			}
+			else
+			{
+				auto &skinnedComponent = obj.getComponent<SkinnedComponent>();
+
+				SkinnedMeshInfo skinnedMesh;
+				skinnedMesh.transformBufferIndex = transformBufferSize;
+				skinnedMesh.skinIndex = skinnedComponent.index + skinnedComponent.bufferOffset;
+				skinnedMesh.bufferIndex = skinnedBufferSize;
+				skinnedMeshes.emplace_back(skinnedMesh);
+
+				skinnedComponent.dynamicUboOffset = skinnedBuffer->getOffset(skinnedBufferSize);
+				++skinnedBufferSize;
+			}
+
+			++transformBufferSize;
+		}
+
+		++depth;
 	}
 
-	// the root object should contain the world transform - though make sure
-	OEMaths::mat4f world;
-	if (parentObject->hasComponent<WorldTransformComponent>())
+	for (auto &child : obj.getChildren())
 	{
-		auto component = parentObject->getComponent<WorldTransformComponent>();
-		OEMaths::mat4f rot = OEMaths::mat4f(component.rotation);
-		world = OEMaths::mat4f::translate(component.translation) * rot *
-		        OEMaths::mat4f::scale(component.scale);
+		buildHierarchyRecursive(child, index, rootIndex, depth);
 	}
+}
 
-	return mat * world;
+void TransformManager::buildHierarchy(std::unique_ptr<ObjectManager> &objectManager)
+{
+	// the local transforms are kept, it's only the links between them that are rebuilt
+	for (auto &transform : transforms)
+	{
+		transform.parentIndex = UINT32_MAX;
+		transform.rootIndex = UINT32_MAX;
+		transform.bufferIndex = UINT32_MAX;
+		transform.children.clear();
+	}
+
+	rootWorldMatrices.clear();
+	skinnedMeshes.clear();
+	transformBufferSize = 0;
+	skinnedBufferSize = 0;
+	jointPaletteSize = 0;
+
+	for (auto &obj : objectManager->getObjectsList())
+	{
+		Object &rootObject = obj.second;
+
+		// the root object should contain the world transform - though make sure
+		OEMaths::mat4f world;
+		if (rootObject.hasComponent<WorldTransformComponent>())
+		{
+			auto &component = rootObject.getComponent<WorldTransformComponent>();
+			OEMaths::mat4f rot = OEMaths::mat4f(component.rotation);
+			world = OEMaths::mat4f::translate(component.translation) * rot *
+			        OEMaths::mat4f::scale(component.scale);
+		}
+		rootWorldMatrices.emplace_back(world);
+
+		buildHierarchyRecursive(rootObject, UINT32_MAX,
+		                        static_cast<uint32_t>(rootWorldMatrices.size() - 1), 0);
+	}
+
+	// make sure the gpu buffers can hold everything - if they move, the descriptors are rebound by the buffer manager
+	transformBuffer->reserve(transformBufferSize);
+	skinnedBuffer->reserve(skinnedBufferSize);
+
+	// link the skin joints with their transforms and give each skin its range within the palette
+	for (auto &skin : skinBuffer)
+	{
+		skin.jointIndices.clear();
+		for (Object *joint : skin.joints)
+		{
+			skin.jointIndices.emplace_back(joint->getComponent<TransformComponent>().index);
+		}
+
+		skin.jointOffset = jointPaletteSize;
+		skin.jointCount = static_cast<uint32_t>(std::min(skin.jointIndices.size(), skin.invBindMatrices.size()));
+		jointPaletteSize += skin.jointCount;
+	}
+	jointPalette->reserve(jointPaletteSize);
+
+	// the palette ranges only change when the hierarchy is rebuilt, so the skinned buffer is only written here
+	for (auto &skinnedMesh : skinnedMeshes)
+	{
+		const SkinInfo &skin = skinBuffer[skinnedMesh.skinIndex];
+		SkinnedBufferInfo *info = skinnedBuffer->get<SkinnedBufferInfo>(skinnedMesh.bufferIndex);
+		info->jointOffset = skin.jointOffset;
+		info->jointCount = skin.jointCount;
+
+		transformBuffer->get<TransformBufferInfo>(skinnedMesh.transformBufferIndex)->modelMatrix = OEMaths::mat4f();
+	}
+
+	// everything will need recalculating - only the root nodes need adding to the dirty list
+	// as the children will be updated as part of their sub-tree
+	dirtyNodes.clear();
+	for (uint32_t i = 0; i < transforms.size(); ++i)
+	{
+		transforms[i].isDirty = true;
+		if (transforms[i].parentIndex == UINT32_MAX)
+		{
+			dirtyNodes.emplace_back(i);
+		}
+	}
 }
 
-void TransformManager::updateTransformRecursive(std::unique_ptr<ObjectManager> &objectManager,
-                                                Object &obj, uint32_t transformAlignment,
-                                                uint32_t skinnedAlignment)
+void TransformManager::markDirty(uint32_t index)
 {
-	OEMaths::mat4f mat;
+	// if already dirty, then this node is either on the list or will be updated with its parent
+	if (transforms[index].isDirty)
+	{
+		return;
+	}
 
-	if (obj.hasComponent<MeshComponent>() && obj.hasComponent<TransformComponent>())
+	transforms[index].isDirty = true;
+	dirtyNodes.emplace_back(index);
+
+	// propogate down the hierarchy - stop at nodes which are already dirty as their children will be too
+	std::vector<uint32_t> stack(transforms[index].children);
+	while (!stack.empty())
 	{
-		auto &transformComponent = obj.getComponent<TransformComponent>();
-		uint32_t objIndex = transformComponent.index;
+		uint32_t childIndex = stack.back();
+		stack.pop_back();
+
+		TransformData &child = transforms[childIndex];
+		if (!child.isDirty)
+		{
+			child.isDirty = true;
+			stack.insert(stack.end(), child.children.begin(), child.children.end());
+		}
+	}
+}
 
-		TransformBufferInfo *transformBuffer =
-		    (TransformBufferInfo *)((uint64_t)transformBufferData +
-		                            (transformAlignment * transformBufferSize));
+void TransformManager::updateTransform()
+{
+	++updateCount;
 
-		transformComponent.dynamicUboOffset = transformBufferSize * transformAlignment;
+	// gather all the nodes within the dirty sub-trees. If a node and one of its children were both
+	// altered, the child will have been added as part of its parents sub-tree
+	std::sort(dirtyNodes.begin(), dirtyNodes.end(), [this](const uint32_t lhs, const uint32_t rhs) {
+		return transforms[lhs].depth < transforms[rhs].depth;
+	});
 
-		mat = updateMatrixFromTree(obj, objectManager);
-		transformBuffer->modelMatrix = mat;
+	updateList.clear();
+	for (uint32_t nodeIndex : dirtyNodes)
+	{
+		if (!transforms[nodeIndex].isDirty)
+		{
+			continue;
+		}
 
-		++transformBufferSize;
+		transforms[nodeIndex].isDirty = false;
+		size_t first = updateList.size();
+		updateList.emplace_back(nodeIndex);
 
-		if (obj.hasComponent<SkinnedComponent>())
+		for (size_t i = first; i < updateList.size(); ++i)
+		{
+			for (uint32_t child : transforms[updateList[i]].children)
+			{
+				transforms[child].isDirty = false;
+				updateList.emplace_back(child);
+			}
+		}
+	}
+	dirtyNodes.clear();
+
+	// group by depth - the nodes at each level only rely on the level above
+	std::stable_sort(updateList.begin(), updateList.end(),
+	                 [this](const uint32_t lhs, const uint32_t rhs) {
+		                 return transforms[lhs].depth < transforms[rhs].depth;
+	                 });
+
+	// recompose the local matrices which have been altered
+	composeList.clear();
+	composeOutput.clear();
+	for (uint32_t index : updateList)
+	{
+		TransformData &transform = transforms[index];
+		if (transform.recalculateLocal)
 		{
-			auto &skinnedComponent = obj.getComponent<SkinnedComponent>();
-			SkinnedBufferInfo *skinnedBufferPtr =
-			    (SkinnedBufferInfo *)((uint64_t)skinnedBufferData +
-			                          (skinnedAlignment * skinnedBufferSize));
+			composeList.emplace_back(index);
+			composeOutput.emplace_back(transform.getLocalMatrix().getData());
+			transform.recalculateLocal = false;
+		}
+	}
+	OEMaths::batchComposeTRS(localTransforms, composeList.data(),
+	                         static_cast<uint32_t>(composeList.size()), composeOutput.data());
 
-			// skinned transform
-			skinnedComponent.dynamicUboOffset = skinnedBufferSize * skinnedAlignment;
+	// now parent * local for each level, writing straight into the gpu buffer for meshes
+	size_t levelStart = 0;
+	while (levelStart < updateList.size())
+	{
+		uint32_t depth = transforms[updateList[levelStart]].depth;
 
-			uint32_t skinIndex = skinnedComponent.index;
+		parentMatrices.clear();
+		localMatrices.clear();
+		worldMatrices.clear();
+		gpuMatrices.clear();
 
-			// prepare fianl output matrices buffer
-			uint64_t jointSize = static_cast<uint32_t>(skinBuffer[skinIndex].joints.size()) > 256 ?
-			                         256 :
-			                         skinBuffer[skinIndex].joints.size();
-			skinBuffer[skinIndex].jointMatrices.resize(jointSize);
+		size_t levelEnd = levelStart;
+		for (; levelEnd < updateList.size() && transforms[updateList[levelEnd]].depth == depth;
+		     ++levelEnd)
+		{
+			TransformData &transform = transforms[updateList[levelEnd]];
 
-			skinnedBufferPtr->jointCount = jointSize;
+			const OEMaths::mat4f &parentWorld =
+			    transform.parentIndex == UINT32_MAX ?
+			        rootWorldMatrices[transform.rootIndex] :
+			        transforms[transform.parentIndex].getWorldMatrix();
 
-			// transform to local space
-			OEMaths::mat4f inverseMat = mat.inverse();
+			parentMatrices.emplace_back(parentWorld.getData());
+			localMatrices.emplace_back(transform.getLocalMatrix().getData());
+			worldMatrices.emplace_back(transform.getWorldMatrix().getData());
 
-			for (uint32_t i = 0; i < jointSize; ++i)
+			float *gpuMatrix = nullptr;
+			if (transform.bufferIndex != UINT32_MAX)
 			{
-				Object *joint_obj = skinBuffer[skinIndex].joints[i];
-				OEMaths::mat4f jointMatrix = updateMatrixFromTree(*joint_obj, objectManager) *
-				                             skinBuffer[skinIndex].invBindMatrices[i];
-
-				// transform joint to local (joint) space
-				OEMaths::mat4f localMatrix = inverseMat * jointMatrix;
-				skinBuffer[skinIndex].jointMatrices[i] = localMatrix;
-				skinnedBufferPtr->jointMatrices[i] = localMatrix;
+				gpuMatrix =
+				    transformBuffer->get<TransformBufferInfo>(transform.bufferIndex)->modelMatrix.getData();
 			}
+			gpuMatrices.emplace_back(gpuMatrix);
 
-			++skinnedBufferSize;
+			transform.lastUpdated = updateCount;
 		}
-	}
 
-	// now update all child nodes too - TODO: do this without recursion
-	auto children = obj.getChildren();
+		OEMaths::batchMultiply(parentMatrices.data(), localMatrices.data(), worldMatrices.data(),
+		                       gpuMatrices.data(), static_cast<uint32_t>(worldMatrices.size()));
 
-	for (auto &child : children)
-	{
-		updateTransformRecursive(objectManager, child, transformAlignment, skinnedAlignment);
+		levelStart = levelEnd;
 	}
 }
 
-void TransformManager::updateTransform(std::unique_ptr<ObjectManager> &objectManager)
+void TransformManager::updateSkinnedTransform()
 {
-	// TODO: refactor this
-	auto objectList = objectManager->getObjectsList();
-
-	transformBufferSize = 0;
-	skinnedBufferSize = 0;
+	parentMatrices.clear();
+	localMatrices.clear();
+	worldMatrices.clear();
+	gpuMatrices.clear();
 
-	for (auto obj : objectList)
+	for (auto &skin : skinBuffer)
 	{
-		updateTransformRecursive(objectManager, obj.second, transformAligned, skinnedAligned);
+		// only recalculate the joint matrices if one of the joints moved this update
+		bool hasChanged = false;
+		for (uint32_t i = 0; i < skin.jointCount && !hasChanged; ++i)
+		{
+			hasChanged = transforms[skin.jointIndices[i]].lastUpdated == updateCount;
+		}
+		if (!hasChanged)
+		{
+			continue;
+		}
+
+		// the joint world matrices are already up to date, so each joint is just world * inverse bind
+		for (uint32_t i = 0; i < skin.jointCount; ++i)
+		{
+			parentMatrices.emplace_back(transforms[skin.jointIndices[i]].getWorldMatrix().getData());
+			localMatrices.emplace_back(skin.invBindMatrices[i].getData());
+			worldMatrices.emplace_back(jointPalette->get<OEMaths::mat4f>(skin.jointOffset + i)->getData());
+			gpuMatrices.emplace_back(nullptr);
+		}
 	}
+
+	// all the altered skins in one batch, written straight into the palette
+	OEMaths::batchMultiply(parentMatrices.data(), localMatrices.data(), worldMatrices.data(),
+	                       gpuMatrices.data(), static_cast<uint32_t>(worldMatrices.size()));
 }
 
 void TransformManager::updateFrame(double time, double dt,
                                    std::unique_ptr<ObjectManager> &objectManager,
                                    ComponentInterface *componentInterface)
 {
-	// check whether static data need updating
+	// the hierarchy only needs rebuilding when new transforms have been added
 	if (isDirty)
 	{
-		updateTransform(objectManager);
-
-		if (transformBufferSize)
-		{
-			VulkanAPI::BufferUpdateEvent event{ "Transform", (void *)transformBufferData,
-				                                transformAligned * transformBufferSize,
-				                                VulkanAPI::MemoryUsage::VK_BUFFER_DYNAMIC };
-			Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
-		}
-		if (skinnedBufferSize)
-		{
-			VulkanAPI::BufferUpdateEvent event{ "SkinnedTransform", (void *)skinnedBufferData,
-				                                skinnedAligned * skinnedBufferSize,
-				                                VulkanAPI::MemoryUsage::VK_BUFFER_DYNAMIC };
-			Global::eventManager()->addQueueEvent<VulkanAPI::BufferUpdateEvent>(event);
-		}
-
+		buildHierarchy(objectManager);
 		isDirty = false;
 	}
+
+	if (dirtyNodes.empty())
+	{
+		return;
+	}
+
+	// the buffers are persistently mapped, so the matrices are written straight into gpu memory
+	updateTransform();
+	updateSkinnedTransform();
 }
 
 void TransformManager::updateObjectTranslation(Object *obj, OEMaths::vec4f trans)
 {
 	uint32_t index = obj->getComponent<TransformComponent>().index;
-	transforms[index].setTranslation(OEMaths::vec3f{ trans.getX(), trans.getY(), trans.getZ() });
-
-	// this will update all lists - though TODO: add objects which need updating for that frame to a list - should be faster?
-	isDirty = true;
+	localTransforms.setTranslation(index, OEMaths::vec3f{ trans.getX(), trans.getY(), trans.getZ() });
+	transforms[index].recalculateLocal = true;
+	transforms[index].hasMatrix = false;
+	markDirty(index);
 }
 
 void TransformManager::updateObjectScale(Object *obj, OEMaths::vec4f scale)
 {
 	uint32_t index = obj->getComponent<TransformComponent>().index;
-	transforms[index].setScale(OEMaths::vec3f{ scale.getX(), scale.getY(), scale.getZ() });
-	isDirty = true;
+	localTransforms.setScale(index, OEMaths::vec3f{ scale.getX(), scale.getY(), scale.getZ() });
+	transforms[index].recalculateLocal = true;
+	transforms[index].hasMatrix = false;
+	markDirty(index);
 }
 
 void TransformManager::updateObjectRotation(Object *obj, OEMaths::quatf rot)
 {
 	uint32_t index = obj->getComponent<TransformComponent>().index;
-	transforms[index].setRotation(rot);
-	isDirty = true;
+	localTransforms.setRotation(index, rot);
+	transforms[index].recalculateLocal = true;
+	transforms[index].hasMatrix = false;
+	markDirty(index);
+}
+
+void TransformManager::getLocalPose(const std::vector<uint32_t> &indices, OEMaths::TransformArrays &pose)
+{
+	pose = OEMaths::TransformArrays();
+	for (uint32_t index : indices)
+	{
+		if (index == UINT32_MAX)
+		{
+			pose.add(OEMaths::vec3f{ 0.0f, 0.0f, 0.0f }, OEMaths::vec3f{ 1.0f, 1.0f, 1.0f },
+			         OEMaths::quatf{ 0.0f, 0.0f, 0.0f, 1.0f });
+			continue;
+		}
+
+		pose.add(OEMaths::vec3f{ localTransforms.tx[index], localTransforms.ty[index], localTransforms.tz[index] },
+		         OEMaths::vec3f{ localTransforms.sx[index], localTransforms.sy[index], localTransforms.sz[index] },
+		         OEMaths::quatf{ localTransforms.qx[index], localTransforms.qy[index], localTransforms.qz[index],
+		                         localTransforms.qw[index] });
+	}
 }
+
+void TransformManager::updateLocalPose(const std::vector<uint32_t> &indices, const OEMaths::TransformArrays &pose,
+                                       const std::vector<uint8_t> &mask)
+{
+	assert(indices.size() == pose.size() && indices.size() == mask.size());
+
+	for (uint32_t i = 0; i < indices.size(); ++i)
+	{
+		uint32_t index = indices[i];
+		if (!mask[i] || index == UINT32_MAX)
+		{
+			continue;
+		}
+
+		localTransforms.tx[index] = pose.tx[i];
+		localTransforms.ty[index] = pose.ty[i];
+		localTransforms.tz[index] = pose.tz[i];
+		localTransforms.qx[index] = pose.qx[i];
+		localTransforms.qy[index] = pose.qy[i];
+		localTransforms.qz[index] = pose.qz[i];
+		localTransforms.qw[index] = pose.qw[i];
+		localTransforms.sx[index] = pose.sx[i];
+		localTransforms.sy[index] = pose.sy[i];
+		localTransforms.sz[index] = pose.sz[i];
+
+		transforms[index].recalculateLocal = true;
+		transforms[index].hasMatrix = false;
+		markDirty(index);
+	}
+}
+
 } // namespace OmegaEngine
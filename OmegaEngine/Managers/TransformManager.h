@@ -2,12 +2,19 @@
 #include "Managers/ManagerBase.h"
 #include "OEMaths/OEMaths.h"
 #include "OEMaths/OEMaths_Quat.h"
+#include "OEMaths/OEMaths_simd.h"
 #include "OEMaths/OEMaths_transform.h"
 #include "Utility/logger.h"
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+namespace VulkanAPI
+{
+class MappedBuffer;
+}
+
 namespace OmegaEngine
 {
 // forward decleartions
@@ -23,70 +30,53 @@ class TransformManager : public ManagerBase
 public:
 	struct TransformData
 	{
-		// static
-		struct LocalTransform
-		{
-			OEMaths::vec3f translation;
-			OEMaths::vec3f scale = OEMaths::vec3f{ 1.0f, 1.0f, 1.0f };
-			OEMaths::mat4f rotation;
-		};
-
-		void calculateLocalMatrix()
+		// the decomposed translation, rotation and scale are stored in the manager as a structure of arrays
+		// so the local matrices can be calculated in batches
+		void setLocalMatrix(OEMaths::mat4f &local)
 		{
-			local = OEMaths::mat4f::translate(localTransform.translation) *
-			        localTransform.rotation * OEMaths::mat4f::scale(localTransform.scale);
+			this->local = local;
+			hasMatrix = true;
+			recalculateLocal = false;
 		}
 
-		void setTranslation(OEMaths::vec3f &trans)
+		OEMaths::mat4f &getLocalMatrix()
 		{
-			localTransform.translation = trans;
-			recalculateLocal = true;
+			return local;
 		}
 
-		void setRotation(OEMaths::mat4f &rot)
+		void setWorldMatrix(const OEMaths::mat4f &world)
 		{
-			localTransform.rotation = rot;
-			recalculateLocal = true;
+			this->world = world;
 		}
 
-		void setRotation(OEMaths::quatf &q)
+		OEMaths::mat4f &getWorldMatrix()
 		{
-			localTransform.rotation = OEMaths::mat4f(q);
-			recalculateLocal = true;
+			return world;
 		}
 
-		void setScale(OEMaths::vec3f &scale)
-		{
-			localTransform.scale = scale;
-			recalculateLocal = true;
-		}
+		// set when the decomposed form has been altered and the local matrix needs recomposing
+		bool recalculateLocal = true;
 
-		OEMaths::mat4f getLocalMatrix()
-		{
-			if (recalculateLocal)
-			{
-				calculateLocalMatrix();
-				recalculateLocal = false;
-			}
-			return local;
-		}
+		// some models have the local matrix baked, in which case there is no decomposed form
+		bool hasMatrix = false;
 
-		void setLocalMatrix(OEMaths::mat4f &local)
-		{
-			this->local = local;
-		}
+		// hierarchy info - indices into the transform list. Parents are always resolved before their children
+		uint32_t parentIndex = UINT32_MAX;
+		uint32_t rootIndex = UINT32_MAX; // index into the root world matrices for nodes without a transform parent
+		uint32_t depth = 0;
+		std::vector<uint32_t> children;
 
-		void setWorldMatixrix(OEMaths::mat4f &world)
-		{
-			this->world = world;
-		}
+		// the slot within the dynamic transform buffer - only static meshes have their world matrix uploaded
+		uint32_t bufferIndex = UINT32_MAX;
 
-	private:
-		bool recalculateLocal = false;
+		// set when this node or one of its ancestors has changed and the world matrix needs recalculating
+		bool isDirty = true;
 
-		// decomposed form
-		LocalTransform localTransform;
+		// the update count when the world matrix was last calculated - used to determine which skins need updating
+		uint64_t lastUpdated = 0;
 
+	private:
+		// cached matrices
 		OEMaths::mat4f local;
 		OEMaths::mat4f world;
 	};
@@ -97,10 +87,12 @@ public:
 		OEMaths::mat4f modelMatrix;
 	};
 
+	// the joint matrices themselves live in the joint palette, this tells the shader where
+	// the skin used by the mesh begins
 	struct SkinnedBufferInfo
 	{
-		OEMaths::mat4f jointMatrices[6];
-		float jointCount;
+		uint32_t jointOffset;
+		uint32_t jointCount;
 	};
 
 	struct SkinInfo
@@ -109,13 +101,29 @@ public:
 		Object *skeleton;
 		std::vector<Object *> joints;
 		std::vector<OEMaths::mat4f> invBindMatrices;
-		std::vector<OEMaths::mat4f> jointMatrices;
+
+		// resolved when the hierarchy is built - indices into the transform list
+		std::vector<uint32_t> jointIndices;
+
+		// the range of this skin within the joint palette
+		uint32_t jointOffset = 0;
+		uint32_t jointCount = 0;
+	};
+
+	// a skinned mesh which uses the joint matrices of a skin
+	struct SkinnedMeshInfo
+	{
+		uint32_t skinIndex = UINT32_MAX;
+		uint32_t bufferIndex = UINT32_MAX;
+
+		// the joint matrices are in world space, so the mesh's slot in the transform buffer is the identity
+		uint32_t transformBufferIndex = UINT32_MAX;
 	};
 
-	// the number of models to allocate mem space for - this will need optimising
-	// could also be dynamic and be altered to the archietecture being used
-	const uint32_t TransformBlockSize = 25;
-	const uint32_t SkinnedBlockSize = 25;
+	// the gpu buffers grow in chunks of this many elements
+	static constexpr uint32_t TransformChunkSize = 1024;
+	static constexpr uint32_t SkinnedChunkSize = 64;
+	static constexpr uint32_t JointChunkSize = 1024;
 
 	TransformManager();
 	~TransformManager();
@@ -131,41 +139,86 @@ public:
 	void updateFrame(double time, double dt, std::unique_ptr<ObjectManager> &objectManager,
 	                 ComponentInterface *componentInterface) override;
 
-	// local transform and skinning update
-	OEMaths::mat4f updateMatrixFromTree(Object &obj, std::unique_ptr<ObjectManager> &objectManager);
-	void updateTransform(std::unique_ptr<ObjectManager> &objectManager);
-	void updateTransformRecursive(std::unique_ptr<ObjectManager> &objectManager, Object &obj,
-	                              uint32_t alignment, uint32_t skinnedAlignment);
+	// hierarchy build - only required when transform components are added
+	void buildHierarchy(std::unique_ptr<ObjectManager> &objectManager);
+	void buildHierarchyRecursive(Object &obj, uint32_t parentIndex, uint32_t rootIndex,
+	                             uint32_t depth);
+
+	// local transform and skinning update - only dirty sub-trees are recalculated
+	void markDirty(uint32_t index);
+	void updateTransform();
+	void updateSkinnedTransform();
 
 	// object update functions
 	void updateObjectTranslation(Object *obj, OEMaths::vec4f trans);
 	void updateObjectScale(Object *obj, OEMaths::vec4f scale);
 	void updateObjectRotation(Object *obj, OEMaths::quatf rot);
 
+	// copies the decomposed local transforms of a set of nodes - used for the rest pose of animated skeletons
+	void getLocalPose(const std::vector<uint32_t> &indices, OEMaths::TransformArrays &pose);
+
+	// writes the local transforms of a set of nodes in one go - i.e. the blended pose of a skeleton. Only the
+	// nodes with a non-zero mask are updated
+	void updateLocalPose(const std::vector<uint32_t> &indices, const OEMaths::TransformArrays &pose,
+	                     const std::vector<uint8_t> &mask);
+
 	uint32_t getSkinnedBufferOffset() const
 	{
 		return static_cast<uint32_t>(skinBuffer.size());
 	}
 
+	OEMaths::mat4f &getWorldMatrix(const uint32_t index)
+	{
+		return transforms[index].getWorldMatrix();
+	}
+
+	uint32_t getDepth(const uint32_t index) const
+	{
+		return transforms[index].depth;
+	}
+
 private:
 	// transform data for static meshes
 	std::vector<TransformData> transforms;
 
+	// the decomposed local transforms - indexed the same as the transform data
+	OEMaths::TransformArrays localTransforms;
+
 	// skinned transform data
 	std::vector<SkinInfo> skinBuffer;
-
-	// store locally the aligned buffer sizes
-	uint32_t transformAligned = 0;
-	uint32_t skinnedAligned = 0;
-
-	// transform data for each object which will be added to the GPU
-	TransformBufferInfo *transformBufferData = nullptr;
-	SkinnedBufferInfo *skinnedBufferData = nullptr;
+	std::vector<SkinnedMeshInfo> skinnedMeshes;
+
+	// the world matrices of root objects, derived from the world transform component
+	std::vector<OEMaths::mat4f> rootWorldMatrices;
+
+	// nodes which have been directly altered since the last update. Children are flagged as dirty,
+	// but not added to this list, as they will be updated along with their parent
+	std::vector<uint32_t> dirtyNodes;
+	uint64_t updateCount = 0;
+
+	// scratch lists for the batched update - kept here to avoid allocating each frame
+	std::vector<uint32_t> updateList;
+	std::vector<uint32_t> composeList;
+	std::vector<float *> composeOutput;
+	std::vector<const float *> parentMatrices;
+	std::vector<const float *> localMatrices;
+	std::vector<float *> worldMatrices;
+	std::vector<float *> gpuMatrices;
+
+	// transform data for each object, persistently mapped and written in place. These are dynamic buffers,
+	// so each element is aligned
+	std::unique_ptr<VulkanAPI::MappedBuffer> transformBuffer;
+	std::unique_ptr<VulkanAPI::MappedBuffer> skinnedBuffer;
+
+	// the joint matrices of every skin, packed one after the other and indexed in the shader
+	// via the skin's joint offset. So there is no limit on the number of joints per skin
+	std::unique_ptr<VulkanAPI::MappedBuffer> jointPalette;
 
 	uint32_t transformBufferSize = 0;
 	uint32_t skinnedBufferSize = 0;
+	uint32_t jointPaletteSize = 0;
 
-	// flag which tells us whether we need to update the static data
+	// flag which tells us whether the hierarchy needs rebuilding - i.e. new components have been added
 	bool isDirty = true;
 };
 
@@ -0,0 +1,442 @@
+#include "AnimationCompression.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace OmegaEngine
+{
+
+namespace
+{
+// the smallest three components of a unit quaternion are within +/- 1/sqrt(2)
+constexpr float InvSqrt2 = 0.70710678f;
+
+void interpolateKey(const float *start, const float *end, const float u, const bool normalise, float *out)
+{
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		out[c] = start[c] * (1.0f - u) + end[c] * u;
+	}
+
+	if (normalise)
+	{
+		float length = std::sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2] + out[3] * out[3]);
+		if (length > 0.0f)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				out[c] /= length;
+			}
+		}
+	}
+}
+
+float keyError(const float *a, const float *b, const bool isRotation)
+{
+	float error = 0.0f;
+	float negatedError = 0.0f;
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		error = std::max(error, std::abs(a[c] - b[c]));
+		negatedError = std::max(negatedError, std::abs(a[c] + b[c]));
+	}
+
+	// q and -q are the same rotation
+	return isRotation ? std::min(error, negatedError) : error;
+}
+
+uint16_t quantise(const float value, const float maxValue)
+{
+	float clamped = std::min(std::max(value, 0.0f), maxValue);
+	return static_cast<uint16_t>(clamped + 0.5f);
+}
+
+} // namespace
+
+// ================================== compressed tracks =============================================
+
+void CompressedTrack::decode(const uint32_t index, float *out) const
+{
+	const uint16_t *words = &data[index * stride];
+
+	if (format == Format::SmallestThree)
+	{
+		uint64_t bits = (static_cast<uint64_t>(words[0]) << 32) | (static_cast<uint64_t>(words[1]) << 16) |
+		                static_cast<uint64_t>(words[2]);
+		uint32_t largest = static_cast<uint32_t>(bits >> 45) & 0x3;
+
+		float sum = 0.0f;
+		uint32_t shift = 30;
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			if (c == largest)
+			{
+				continue;
+			}
+
+			uint32_t value = static_cast<uint32_t>(bits >> shift) & 0x7fff;
+			out[c] = (static_cast<float>(value) / MaxSmallest * 2.0f - 1.0f) * InvSqrt2;
+			sum += out[c] * out[c];
+			shift -= 15;
+		}
+
+		// the encoder always makes the largest component positive
+		out[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+		return;
+	}
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		out[c] = minimum[c];
+		if (c < stride)
+		{
+			out[c] += static_cast<float>(words[c]) * scale[c];
+		}
+	}
+}
+
+void CompressedTrack::decodePair(const uint32_t start, const uint32_t end, float *outStart, float *outEnd) const
+{
+	decode(start, outStart);
+	decode(end, outEnd);
+
+	if (format == Format::SmallestThree)
+	{
+		float dot = outStart[0] * outEnd[0] + outStart[1] * outEnd[1] + outStart[2] * outEnd[2] +
+		            outStart[3] * outEnd[3];
+		if (dot < 0.0f)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				outEnd[c] = -outEnd[c];
+			}
+		}
+	}
+}
+
+// ================================== compressor =============================================
+
+AnimationCompressor::AnimationCompressor(const Settings &_settings)
+    : settings(_settings)
+{
+}
+
+float AnimationCompressor::getTolerance(const TrackType type) const
+{
+	switch (type)
+	{
+	case TrackType::Translation:
+		return settings.translationTolerance;
+	case TrackType::Rotation:
+		return settings.rotationTolerance;
+	case TrackType::Scale:
+		return settings.scaleTolerance;
+	}
+	return 0.0f;
+}
+
+std::vector<uint32_t> AnimationCompressor::reduceKeys(const std::vector<float> &timeStamps,
+                                                      const std::vector<float> &values, const TrackType type,
+                                                      const KeyReduction reduction) const
+{
+	uint32_t keyCount = static_cast<uint32_t>(std::min(timeStamps.size(), values.size() / 4));
+	const float tolerance = getTolerance(type);
+	const bool isRotation = type == TrackType::Rotation;
+
+	std::vector<uint32_t> kept;
+	if (keyCount == 0)
+	{
+		return kept;
+	}
+	kept.emplace_back(0);
+
+	if (reduction == KeyReduction::Step)
+	{
+		// a key can only be removed if it holds the same value as the key before it
+		for (uint32_t i = 1; i + 1 < keyCount; ++i)
+		{
+			if (keyError(&values[kept.back() * 4], &values[i * 4], isRotation) > tolerance)
+			{
+				kept.emplace_back(i);
+			}
+		}
+	}
+	else
+	{
+		// greedily extend the span from the last kept key until one of the keys within it can no longer
+		// be rebuilt by interpolating between the ends of the span
+		uint32_t anchor = 0;
+		for (uint32_t end = 2; end < keyCount; ++end)
+		{
+			float duration = timeStamps[end] - timeStamps[anchor];
+			bool withinTolerance = duration > 0.0f;
+
+			for (uint32_t i = anchor + 1; i < end && withinTolerance; ++i)
+			{
+				float u = (timeStamps[i] - timeStamps[anchor]) / duration;
+
+				float key[4];
+				interpolateKey(&values[anchor * 4], &values[end * 4], u, isRotation, key);
+				withinTolerance = keyError(key, &values[i * 4], isRotation) <= tolerance;
+			}
+
+			if (!withinTolerance)
+			{
+				anchor = end - 1;
+				kept.emplace_back(anchor);
+			}
+		}
+	}
+
+	if (keyCount > 1)
+	{
+		kept.emplace_back(keyCount - 1);
+	}
+	return kept;
+}
+
+void AnimationCompressor::quantiseTimes(const std::vector<float> &timeStamps, CompressedTimeline &timeline) const
+{
+	if (timeStamps.empty())
+	{
+		return;
+	}
+
+	timeline.start = timeStamps.front();
+	float duration = timeStamps.back() - timeline.start;
+	timeline.step = duration > 0.0f ? duration / CompressedTimeline::MaxUnits : 0.0f;
+	timeline.invStep = duration > 0.0f ? CompressedTimeline::MaxUnits / duration : 0.0f;
+
+	timeline.keys.reserve(timeStamps.size());
+	for (float time : timeStamps)
+	{
+		timeline.keys.emplace_back(quantise(timeline.toUnits(time), CompressedTimeline::MaxUnits));
+	}
+}
+
+void AnimationCompressor::quantiseOutputs(const std::vector<float> &values, const std::vector<uint32_t> &kept,
+                                          const TrackType type, const KeyReduction reduction,
+                                          CompressedTrack &track) const
+{
+	if (kept.empty())
+	{
+		return;
+	}
+
+	// cubic splines also store tangents, which aren't unit quaternions
+	if (type == TrackType::Rotation && reduction != KeyReduction::None)
+	{
+		track.format = CompressedTrack::Format::SmallestThree;
+		track.stride = 3;
+		track.data.reserve(kept.size() * track.stride);
+
+		for (uint32_t index : kept)
+		{
+			const float *quat = &values[index * 4];
+
+			uint32_t largest = 0;
+			for (uint32_t c = 1; c < 4; ++c)
+			{
+				if (std::abs(quat[c]) > std::abs(quat[largest]))
+				{
+					largest = c;
+				}
+			}
+
+			// the largest component is rebuilt from the others, so it must always be positive
+			float sign = quat[largest] < 0.0f ? -1.0f : 1.0f;
+
+			uint64_t bits = static_cast<uint64_t>(largest) << 45;
+			uint32_t shift = 30;
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				if (c == largest)
+				{
+					continue;
+				}
+
+				float normalised = (quat[c] * sign / InvSqrt2 + 1.0f) * 0.5f;
+				bits |= static_cast<uint64_t>(quantise(normalised * CompressedTrack::MaxSmallest,
+				                                       CompressedTrack::MaxSmallest))
+				        << shift;
+				shift -= 15;
+			}
+
+			track.data.emplace_back(static_cast<uint16_t>(bits >> 32));
+			track.data.emplace_back(static_cast<uint16_t>(bits >> 16));
+			track.data.emplace_back(static_cast<uint16_t>(bits));
+		}
+		return;
+	}
+
+	// translations and scales don't use the w component
+	track.format = CompressedTrack::Format::Ranged;
+	track.stride = type == TrackType::Rotation ? 4 : 3;
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		float minValue = values[kept.front() * 4 + c];
+		float maxValue = minValue;
+		if (c < track.stride)
+		{
+			for (uint32_t index : kept)
+			{
+				minValue = std::min(minValue, values[index * 4 + c]);
+				maxValue = std::max(maxValue, values[index * 4 + c]);
+			}
+		}
+
+		track.minimum[c] = minValue;
+		track.scale[c] = (maxValue - minValue) / CompressedTrack::MaxRanged;
+	}
+
+	track.data.reserve(kept.size() * track.stride);
+	for (uint32_t index : kept)
+	{
+		for (uint32_t c = 0; c < track.stride; ++c)
+		{
+			float units = track.scale[c] > 0.0f ? (values[index * 4 + c] - track.minimum[c]) / track.scale[c] : 0.0f;
+			track.data.emplace_back(quantise(units, CompressedTrack::MaxRanged));
+		}
+	}
+}
+
+float AnimationCompressor::measureError(const std::vector<float> &timeStamps, const std::vector<float> &values,
+                                        const TrackType type, const KeyReduction reduction,
+                                        const CompressedTimeline &timeline, const CompressedTrack &track) const
+{
+	const bool isRotation = type == TrackType::Rotation;
+	const uint32_t valueCount = static_cast<uint32_t>(values.size() / 4);
+	float maxError = 0.0f;
+
+	// nothing was removed, so only the quantisation needs checking
+	if (reduction == KeyReduction::None)
+	{
+		for (uint32_t i = 0; i < valueCount; ++i)
+		{
+			float key[4];
+			track.decode(i, key);
+			maxError = std::max(maxError, keyError(key, &values[i * 4], isRotation));
+		}
+		return maxError;
+	}
+
+	// otherwise, sample the compressed track at each of the original keyframes - this is done in the same
+	// way as the animation manager, at the quantised time of the keyframe
+	const uint32_t keyCount = std::min(static_cast<uint32_t>(timeStamps.size()), valueCount);
+	const uint32_t compressedCount = timeline.size();
+
+	for (uint32_t i = 0; i < keyCount; ++i)
+	{
+		float units = static_cast<float>(quantise(timeline.toUnits(timeStamps[i]), CompressedTimeline::MaxUnits));
+
+		uint32_t start = 0;
+		float phase = 0.0f;
+		if (compressedCount > 1)
+		{
+			auto iter = std::upper_bound(timeline.keys.begin(), timeline.keys.end(), units,
+			                             [](const float value, const uint16_t key) { return value < key; });
+			start = static_cast<uint32_t>(iter - timeline.keys.begin());
+			start = std::min(std::max(start, 1u) - 1, compressedCount - 2);
+
+			float interval = static_cast<float>(timeline.keys[start + 1] - timeline.keys[start]);
+			if (reduction == KeyReduction::Linear && interval > 0.0f)
+			{
+				phase = std::min(std::max((units - timeline.keys[start]) / interval, 0.0f), 1.0f);
+			}
+		}
+		uint32_t end = std::min(start + 1, compressedCount - 1);
+
+		float startKey[4], endKey[4], key[4];
+		track.decodePair(start, end, startKey, endKey);
+		interpolateKey(startKey, endKey, phase, isRotation, key);
+
+		maxError = std::max(maxError, keyError(key, &values[i * 4], isRotation));
+	}
+	return maxError;
+}
+
+void AnimationCompressor::compress(const std::vector<float> &timeStamps, const std::vector<OEMaths::vec4f> &outputs,
+                                   const TrackType type, const KeyReduction reduction,
+                                   CompressedTimeline &timeline, CompressedTrack &track)
+{
+	const bool isRotation = type == TrackType::Rotation && reduction != KeyReduction::None;
+
+	std::vector<float> values;
+	values.reserve(outputs.size() * 4);
+	for (const auto &output : outputs)
+	{
+		float key[4] = { output.getX(), output.getY(), output.getZ(), output.getW() };
+
+		if (isRotation)
+		{
+			// keep consecutive rotations in the same hemisphere so they can be interpolated when reducing
+			interpolateKey(key, key, 0.0f, true, key);
+
+			if (!values.empty())
+			{
+				const float *prev = &values[values.size() - 4];
+				if (prev[0] * key[0] + prev[1] * key[1] + prev[2] * key[2] + prev[3] * key[3] < 0.0f)
+				{
+					for (uint32_t c = 0; c < 4; ++c)
+					{
+						key[c] = -key[c];
+					}
+				}
+			}
+		}
+
+		values.insert(values.end(), key, key + 4);
+	}
+
+	// the times are quantised first, so keys are removed using the same times as the animation manager will
+	// use to interpolate between the remaining keys
+	quantiseTimes(timeStamps, timeline);
+
+	std::vector<uint32_t> kept;
+	if (reduction == KeyReduction::None)
+	{
+		// cubic splines have three outputs per keyframe, so these are kept as they are
+		for (uint32_t i = 0; i < outputs.size(); ++i)
+		{
+			kept.emplace_back(i);
+		}
+	}
+	else
+	{
+		std::vector<float> units(timeline.keys.begin(), timeline.keys.end());
+		kept = reduceKeys(units, values, type, reduction);
+
+		std::vector<uint16_t> keptKeys;
+		keptKeys.reserve(kept.size());
+		for (uint32_t index : kept)
+		{
+			keptKeys.emplace_back(timeline.keys[index]);
+		}
+		timeline.keys.swap(keptKeys);
+	}
+
+	quantiseOutputs(values, kept, type, reduction, track);
+
+	float error = measureError(timeStamps, values, type, reduction, timeline, track);
+	switch (type)
+	{
+	case TrackType::Translation:
+		stats.maxTranslationError = std::max(stats.maxTranslationError, error);
+		break;
+	case TrackType::Rotation:
+		stats.maxRotationError = std::max(stats.maxRotationError, error);
+		break;
+	case TrackType::Scale:
+		stats.maxScaleError = std::max(stats.maxScaleError, error);
+		break;
+	}
+
+	stats.rawKeys += static_cast<uint32_t>(timeStamps.size());
+	stats.keptKeys += timeline.size();
+	stats.rawBytes += timeStamps.size() * sizeof(float) + outputs.size() * sizeof(OEMaths::vec4f);
+	stats.compressedBytes += timeline.keys.size() * sizeof(uint16_t) + track.data.size() * sizeof(uint16_t);
+}
+
+} // namespace OmegaEngine
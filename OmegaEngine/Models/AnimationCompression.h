@@ -0,0 +1,147 @@
+#pragma once
+#include "OEMaths/OEMaths.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace OmegaEngine
+{
+
+// Keyframe times quantised to 16 bits over the duration of a sampler. The query time is converted into
+// quantised units once, so keyframes are compared without being decoded
+struct CompressedTimeline
+{
+	static constexpr float MaxUnits = 65535.0f;
+
+	float toUnits(const float time) const
+	{
+		return (time - start) * invStep;
+	}
+
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(keys.size());
+	}
+
+	float start = 0.0f;
+
+	// seconds per quantised unit
+	float step = 0.0f;
+	float invStep = 0.0f;
+
+	std::vector<uint16_t> keys;
+};
+
+// Keyframe outputs quantised to 16 bit words. Rotations are stored as the smallest three components of the
+// quaternion (48 bits per key), everything else as 16 bits per component over the range of the track
+struct CompressedTrack
+{
+	enum class Format
+	{
+		SmallestThree,
+		Ranged
+	} format = Format::Ranged;
+
+	static constexpr float MaxRanged = 65535.0f;
+	static constexpr float MaxSmallest = 32767.0f;
+
+	// decodes a keyframe into four floats
+	void decode(const uint32_t index, float *out) const;
+
+	// decodes the two keyframes either side of an interval. Smallest three keys always have a positive largest
+	// component, so the end key is flipped into the same hemisphere as the start for the interpolation
+	void decodePair(const uint32_t start, const uint32_t end, float *outStart, float *outEnd) const;
+
+	uint32_t size() const
+	{
+		return stride > 0 ? static_cast<uint32_t>(data.size() / stride) : 0;
+	}
+
+	// the number of 16 bit words per keyframe
+	uint32_t stride = 0;
+
+	// ranged tracks only - the minimum and the size of one quantised step for each component. Components which
+	// aren't stored (i.e. the w of translations) are restored from the minimum
+	float minimum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float scale[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	std::vector<uint16_t> data;
+};
+
+class AnimationCompressor
+{
+
+public:
+	enum class TrackType
+	{
+		Translation,
+		Rotation,
+		Scale
+	};
+
+	// how keyframes may be removed - this follows the interpolation of the sampler
+	enum class KeyReduction
+	{
+		Linear,
+		Step,
+		None
+	};
+
+	// the maximum error allowed when removing keyframes. The quantisation adds at most half a step on
+	// top of this - 1/65535 of the track range for translations and scales, and 2.2e-5 for rotation components
+	struct Settings
+	{
+		float translationTolerance = 0.001f;
+		float rotationTolerance = 0.0005f;
+		float scaleTolerance = 0.0001f;
+	};
+
+	struct Stats
+	{
+		// the size of the keyframes when stored as floats
+		size_t rawBytes = 0;
+		size_t compressedBytes = 0;
+
+		uint32_t rawKeys = 0;
+		uint32_t keptKeys = 0;
+
+		// the largest component error of the compressed tracks, measured at the original keyframes
+		float maxTranslationError = 0.0f;
+		float maxRotationError = 0.0f;
+		float maxScaleError = 0.0f;
+	};
+
+	AnimationCompressor() = default;
+	AnimationCompressor(const Settings &_settings);
+
+	void compress(const std::vector<float> &timeStamps, const std::vector<OEMaths::vec4f> &outputs,
+	              const TrackType type, const KeyReduction reduction, CompressedTimeline &timeline,
+	              CompressedTrack &track);
+
+	const Stats &getStats() const
+	{
+		return stats;
+	}
+
+private:
+	float getTolerance(const TrackType type) const;
+
+	// returns the indices of the keyframes which must be kept. The times are in quantised units
+	std::vector<uint32_t> reduceKeys(const std::vector<float> &timeStamps, const std::vector<float> &values,
+	                                 const TrackType type, const KeyReduction reduction) const;
+
+	void quantiseTimes(const std::vector<float> &timeStamps, CompressedTimeline &timeline) const;
+
+	void quantiseOutputs(const std::vector<float> &values, const std::vector<uint32_t> &kept,
+	                     const TrackType type, const KeyReduction reduction, CompressedTrack &track) const;
+
+	float measureError(const std::vector<float> &timeStamps, const std::vector<float> &values,
+	                   const TrackType type, const KeyReduction reduction, const CompressedTimeline &timeline,
+	                   const CompressedTrack &track) const;
+
+private:
+	Settings settings;
+	Stats stats;
+};
+
+} // namespace OmegaEngine
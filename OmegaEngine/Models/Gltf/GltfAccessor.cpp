@@ -0,0 +1,232 @@
+#include "GltfAccessor.h"
+#include "Utility/logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+namespace OmegaEngine
+{
+namespace GltfModel
+{
+
+static uint32_t getComponentSize(const int componentType)
+{
+	switch (componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		return 1;
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		return 2;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+	case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t getComponentCount(const int type)
+{
+	switch (type)
+	{
+	case TINYGLTF_TYPE_SCALAR:
+		return 1;
+	case TINYGLTF_TYPE_VEC2:
+		return 2;
+	case TINYGLTF_TYPE_VEC3:
+		return 3;
+	case TINYGLTF_TYPE_VEC4:
+	case TINYGLTF_TYPE_MAT2:
+		return 4;
+	case TINYGLTF_TYPE_MAT3:
+		return 9;
+	case TINYGLTF_TYPE_MAT4:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+// the buffer data has no alignment guarentees, so components are always loaded through memcpy
+template <typename T>
+static T load(const unsigned char *src)
+{
+	T value;
+	memcpy(&value, src, sizeof(T));
+	return value;
+}
+
+template <typename T>
+static void convert(const unsigned char *src, const size_t srcStride, const size_t count, const uint32_t components,
+                    const bool normalized, float *dst, const size_t dstStride)
+{
+	// signed types map the lowest value to -1.0 along with the one above it, as laid out by the gltf spec
+	const float scale = normalized ? 1.0f / static_cast<float>(std::numeric_limits<T>::max()) : 1.0f;
+	const bool clamp = normalized && std::is_signed<T>::value;
+
+	unsigned char *out = reinterpret_cast<unsigned char *>(dst);
+	for (size_t i = 0; i < count; ++i)
+	{
+		float *element = reinterpret_cast<float *>(out);
+		for (uint32_t k = 0; k < components; ++k)
+		{
+			float value = static_cast<float>(load<T>(src + k * sizeof(T))) * scale;
+			element[k] = clamp ? std::max(value, -1.0f) : value;
+		}
+		src += srcStride;
+		out += dstStride;
+	}
+}
+
+template <typename T>
+static void convertIndices(const unsigned char *src, const size_t srcStride, const size_t count, const uint32_t base,
+                           uint32_t *dst)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		dst[i] = static_cast<uint32_t>(load<T>(src)) + base;
+		src += srcStride;
+	}
+}
+
+AccessorView::AccessorView(const tinygltf::Model &model, const int accessorIndex)
+{
+	if (accessorIndex < 0 || accessorIndex >= static_cast<int>(model.accessors.size()))
+	{
+		return;
+	}
+
+	const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+	count = accessor.count;
+	componentType = accessor.componentType;
+	componentCount = GltfModel::getComponentCount(accessor.type);
+	componentSize = getComponentSize(accessor.componentType);
+	normalized = accessor.normalized;
+
+	if (componentCount == 0 || componentSize == 0)
+	{
+		LOGGER_ERROR("Unsupported gltf accessor type %i with component type %i.", accessor.type,
+		             accessor.componentType);
+	}
+
+	// accessors without a buffer view are all zeros
+	if (accessor.bufferView < 0)
+	{
+		valid = true;
+		return;
+	}
+
+	const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+	const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+
+	// a stride of zero means the elements are tightly packed
+	const size_t elementSize = componentCount * componentSize;
+	stride = bufferView.byteStride > 0 ? bufferView.byteStride : elementSize;
+
+	const size_t offset = bufferView.byteOffset + accessor.byteOffset;
+	if (count > 0 && offset + (count - 1) * stride + elementSize > buffer.data.size())
+	{
+		LOGGER_ERROR("Gltf accessor %i reads outside of its buffer.", accessorIndex);
+	}
+
+	data = buffer.data.data() + offset;
+	valid = true;
+}
+
+bool AccessorView::read(float *dst, const uint32_t components, const size_t dstStride) const
+{
+	if (!valid)
+	{
+		return false;
+	}
+
+	const uint32_t readCount = std::min(components, componentCount);
+
+	if (!data)
+	{
+		unsigned char *out = reinterpret_cast<unsigned char *>(dst);
+		for (size_t i = 0; i < count; ++i)
+		{
+			std::fill_n(reinterpret_cast<float *>(out + i * dstStride), readCount, 0.0f);
+		}
+		return true;
+	}
+
+	// tightly packed floats on both sides can be copied in one go
+	if (componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && readCount == componentCount &&
+	    stride == readCount * sizeof(float) && dstStride == stride)
+	{
+		memcpy(dst, data, count * stride);
+		return true;
+	}
+
+	switch (componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		convert<float>(data, stride, count, readCount, false, dst, dstStride);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_BYTE:
+		convert<int8_t>(data, stride, count, readCount, normalized, dst, dstStride);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		convert<uint8_t>(data, stride, count, readCount, normalized, dst, dstStride);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_SHORT:
+		convert<int16_t>(data, stride, count, readCount, normalized, dst, dstStride);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		convert<uint16_t>(data, stride, count, readCount, normalized, dst, dstStride);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		convert<uint32_t>(data, stride, count, readCount, normalized, dst, dstStride);
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+bool AccessorView::readIndices(uint32_t *dst, const uint32_t base) const
+{
+	if (!valid || componentCount != 1)
+	{
+		return false;
+	}
+
+	if (!data)
+	{
+		std::fill_n(dst, count, base);
+		return true;
+	}
+
+	switch (componentType)
+	{
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		if (base == 0 && stride == sizeof(uint32_t))
+		{
+			memcpy(dst, data, count * sizeof(uint32_t));
+			break;
+		}
+		convertIndices<uint32_t>(data, stride, count, base, dst);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		convertIndices<uint16_t>(data, stride, count, base, dst);
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		convertIndices<uint8_t>(data, stride, count, base, dst);
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace GltfModel
+} // namespace OmegaEngine
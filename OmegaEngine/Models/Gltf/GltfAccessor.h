@@ -0,0 +1,66 @@
+#pragma once
+#include "tiny_gltf.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace OmegaEngine
+{
+
+namespace GltfModel
+{
+
+// A view of an accessor that reads straight from the loaded buffer, without copying the buffer, view or
+// accessor. The stride of the buffer view is honoured, so interleaved vertex data can be read as well
+// as tightly packed data. All reads convert a whole accessor at once into a destination sized by the caller
+class AccessorView
+{
+
+public:
+	AccessorView(const tinygltf::Model &model, const int accessorIndex);
+
+	// false if the accessor doesn't exist or its data lies outside of the buffer
+	bool isValid() const
+	{
+		return valid;
+	}
+
+	size_t getCount() const
+	{
+		return count;
+	}
+
+	uint32_t getComponentCount() const
+	{
+		return componentCount;
+	}
+
+	int getComponentType() const
+	{
+		return componentType;
+	}
+
+	// converts the first components of each element to floats, written to dst with dstStride bytes between
+	// elements. Integer components are mapped to [0, 1] or [-1, 1] if the accessor is normalised, otherwise
+	// converted by value. Components the accessor doesn't have are left untouched
+	bool read(float *dst, const uint32_t components, const size_t dstStride) const;
+
+	// converts scalar unsigned integer data to 32-bit indices, with the base added to each
+	bool readIndices(uint32_t *dst, const uint32_t base) const;
+
+private:
+	const unsigned char *data = nullptr;
+
+	size_t count = 0;
+	size_t stride = 0;
+
+	int componentType = 0;
+	uint32_t componentCount = 0;
+	uint32_t componentSize = 0;
+	bool normalized = false;
+
+	bool valid = false;
+};
+
+} // namespace GltfModel
+} // namespace OmegaEngine
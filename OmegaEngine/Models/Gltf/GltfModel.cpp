@@ -1,4 +1,7 @@
 #include "GltfModel.h"
+#include "Models/Gltf/GltfAccessor.h"
+#include "Models/MeshOptimiser.h"
+#include "Models/MeshSimplifier.h"
 #include "Utility/FileUtil.h"
 #include "Utility/logger.h"
 
@@ -86,18 +89,18 @@ std::unique_ptr<Model> load(std::string filename)
 namespace Extract
 {
 
-std::unique_ptr<OmegaEngine::ModelImage> image(tinygltf::Model &model, tinygltf::Texture &texture)
+std::unique_ptr<OmegaEngine::ModelImage> image(const tinygltf::Model &model, const tinygltf::Texture &texture)
 {
 	auto modelImage = std::make_unique<OmegaEngine::ModelImage>();
 
 	// map to temporary storage until transferred to the asset manager
-	tinygltf::Image image = model.images[texture.source];
+	const tinygltf::Image &image = model.images[texture.source];
 	modelImage->map(image.width, image.height, image.image.data());
 
 	// not guarenteed to have a sampler
 	if (texture.sampler > -1)
 	{
-		tinygltf::Sampler gltfSampler = model.samplers[texture.sampler];
+		const tinygltf::Sampler &gltfSampler = model.samplers[texture.sampler];
 
 		modelImage->addSampler(gltfSampler.wrapS, gltfSampler.minFilter);
 	}
@@ -105,7 +108,7 @@ std::unique_ptr<OmegaEngine::ModelImage> image(tinygltf::Model &model, tinygltf:
 	return std::move(modelImage);
 }
 
-std::unique_ptr<OmegaEngine::ModelMesh> mesh(tinygltf::Model &model, tinygltf::Node &node)
+std::unique_ptr<OmegaEngine::ModelMesh> mesh(const tinygltf::Model &model, const tinygltf::Node &node)
 {
 	auto modelMesh = std::make_unique<OmegaEngine::ModelMesh>();
 	
@@ -114,6 +117,9 @@ std::unique_ptr<OmegaEngine::ModelMesh> mesh(tinygltf::Model &model, tinygltf::N
 	uint32_t localVertexOffset = 0;
 	uint32_t localIndexOffset = 0;
 
+	// only triangle lists can be reordered by the optimiser
+	bool isTriangleList = true;
+
 	// get all the primitives associated with this mesh
 	for (uint32_t i = 0; i < mesh.primitives.size(); ++i)
 	{
@@ -127,81 +133,18 @@ std::unique_ptr<OmegaEngine::ModelMesh> mesh(tinygltf::Model &model, tinygltf::N
 		}
 
 		// lets get the vertex data....
-		if (primitive.attributes.find("POSITION") == primitive.attributes.end())
+		auto findAttribute = [&primitive](const char *name) -> int {
+			auto iter = primitive.attributes.find(name);
+			return iter != primitive.attributes.end() ? iter->second : -1;
+		};
+
+		AccessorView posView(model, findAttribute("POSITION"));
+		if (!posView.isValid())
 		{
 			LOGGER_ERROR(
 			    "Problem parsing gltf file. Appears to be missing position attribute. Exiting....");
 		}
 
-		const tinygltf::Accessor &posAccessor =
-		    model.accessors[primitive.attributes.find("POSITION")->second];
-		const tinygltf::BufferView &posBufferView = model.bufferViews[posAccessor.bufferView];
-		const float *posBuffer = reinterpret_cast<const float *>(
-		    &(model.buffers[posBufferView.buffer]
-		          .data[posAccessor.byteOffset + posBufferView.byteOffset]));
-
-		// find normal data
-		const float *normBuffer = nullptr;
-		if (primitive.attributes.find("NORMAL") != primitive.attributes.end())
-		{
-			const tinygltf::Accessor &normAccessor =
-			    model.accessors[primitive.attributes.find("NORMAL")->second];
-			const tinygltf::BufferView &normBufferView = model.bufferViews[normAccessor.bufferView];
-			normBuffer = reinterpret_cast<const float *>(
-			    &(model.buffers[normBufferView.buffer]
-			          .data[normAccessor.byteOffset + normBufferView.byteOffset]));
-		}
-
-		// and parse uv data - there can be two tex coord buffers, we need to check for both
-		const float *uvBuffer0 = nullptr;
-		if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end())
-		{
-			const tinygltf::Accessor &uvAccessor =
-			    model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-			const tinygltf::BufferView &uvBufferView = model.bufferViews[uvAccessor.bufferView];
-			uvBuffer0 = reinterpret_cast<const float *>(
-			    &(model.buffers[uvBufferView.buffer]
-			          .data[uvAccessor.byteOffset + uvBufferView.byteOffset]));
-		}
-
-		const float *uvBuffer1 = nullptr;
-		if (primitive.attributes.find("TEXCOORD_1") != primitive.attributes.end())
-		{
-			const tinygltf::Accessor &uvAccessor =
-			    model.accessors[primitive.attributes.find("TEXCOORD_1")->second];
-			const tinygltf::BufferView &uvBufferView = model.bufferViews[uvAccessor.bufferView];
-			uvBuffer1 = reinterpret_cast<const float *>(
-			    &(model.buffers[uvBufferView.buffer]
-			          .data[uvAccessor.byteOffset + uvBufferView.byteOffset]));
-		}
-
-		// check whether this model has skinning data - joints first
-		const uint16_t *jointBuffer = nullptr;
-		if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end())
-		{
-			modelMesh->skinned = true;
-			const tinygltf::Accessor &jointAccessor =
-			    model.accessors[primitive.attributes.find("JOINTS_0")->second];
-			const tinygltf::BufferView &jointBufferView =
-			    model.bufferViews[jointAccessor.bufferView];
-			jointBuffer = reinterpret_cast<const uint16_t *>(
-			    &(model.buffers[jointBufferView.buffer]
-			          .data[jointAccessor.byteOffset + jointBufferView.byteOffset]));
-		}
-
-		// and then weights. It must contain both to for the data to be used for animations
-		const float *weightBuffer = nullptr;
-		if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end())
-		{
-			const tinygltf::Accessor &weightAccessor =
-			    model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-			const tinygltf::BufferView &weightBufferView =
-			    model.bufferViews[weightAccessor.bufferView];
-			weightBuffer = reinterpret_cast<const float *>(
-			    &(model.buffers[weightBufferView.buffer]
-			          .data[weightAccessor.byteOffset + weightBufferView.byteOffset]));
-		}
-
 		// get the min and max values for this primitive TODO:: FIX THIS!
 		OEMaths::vec3f primMin{
 			0.0f, 0.0f, 0.0f
@@ -210,72 +153,60 @@ std::unique_ptr<OmegaEngine::ModelMesh> mesh(tinygltf::Model &model, tinygltf::N
 			0.0f, 0.0f, 0.0f
 		}; //{ posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2] };
 
-		// now convert the data to a form that we can use with Vulkan - skinned and non-skinned meshes treated separately
-		for (uint32_t j = 0; j < posAccessor.count; ++j)
-		{
-			OmegaEngine::ModelMesh::Vertex vertex;
-			vertex.position = OEMaths::vec4f(OEMaths::vec3f(posBuffer), 1.0f);
-			posBuffer += 3;
+		// the vertices are sized up front and each attribute is then converted straight into place
+		const size_t vertexCount = posView.getCount();
+		OmegaEngine::ModelMesh::Vertex defaultVertex;
+		defaultVertex.position = OEMaths::vec4f(0.0f, 0.0f, 0.0f, 1.0f);
+		modelMesh->vertices.resize(vertexStart + vertexCount, defaultVertex);
 
-			if (normBuffer)
-			{
-				vertex.normal = OEMaths::vec3f(normBuffer);
-				normBuffer += 3;
-			}
-			if (uvBuffer0)
+		OmegaEngine::ModelMesh::Vertex *vertices = &modelMesh->vertices[vertexStart];
+		const size_t vertexStride = sizeof(OmegaEngine::ModelMesh::Vertex);
+
+		posView.read(reinterpret_cast<float *>(&vertices->position), 3, vertexStride);
+
+		// all other attributes are optional, but must match the position count if present
+		auto readAttribute = [&](const char *name, float *dst, const uint32_t components) -> bool {
+			int index = findAttribute(name);
+			if (index < 0)
 			{
-				vertex.uv0 = OEMaths::vec2f(uvBuffer0);
-				uvBuffer0 += 2;
+				return false;
 			}
-			if (uvBuffer1)
+			AccessorView view(model, index);
+			if (view.getCount() != vertexCount)
 			{
-				vertex.uv1 = OEMaths::vec2f(uvBuffer1);
-				uvBuffer1 += 2;
+				LOGGER_INFO("Gltf attribute %s has a different count to the positions. Ignoring.", name);
+				return false;
 			}
+			return view.read(dst, components, vertexStride);
+		};
 
-			// if we have skin data, also convert this to a palatable form
-			if (weightBuffer && jointBuffer)
-			{
-				vertex.joint = OEMaths::vec4f(jointBuffer);
-				vertex.weight = OEMaths::vec4f(weightBuffer);
-				jointBuffer += 4;
-				weightBuffer += 4;
-			}
+		readAttribute("NORMAL", reinterpret_cast<float *>(&vertices->normal), 3);
+
+		// and parse uv data - there can be two tex coord buffers, we need to check for both
+		readAttribute("TEXCOORD_0", reinterpret_cast<float *>(&vertices->uv0), 2);
+		readAttribute("TEXCOORD_1", reinterpret_cast<float *>(&vertices->uv1), 2);
 
-			modelMesh->vertices.push_back(vertex);
+		// check whether this model has skinning data - joints are integers and weights may be normalised
+		// integers, both are converted to floats. It must contain both for the data to be used for animations
+		if (findAttribute("JOINTS_0") >= 0 && findAttribute("WEIGHTS_0") >= 0)
+		{
+			modelMesh->skinned = true;
+			readAttribute("JOINTS_0", reinterpret_cast<float *>(&vertices->joint), 4);
+			readAttribute("WEIGHTS_0", reinterpret_cast<float *>(&vertices->weight), 4);
 		}
 
-		localVertexOffset += static_cast<uint32_t>(posAccessor.count);
+		localVertexOffset += static_cast<uint32_t>(vertexCount);
 
-		// Now obtain the indicies data from the gltf file
-		const tinygltf::Accessor &indAccessor = model.accessors[primitive.indices];
-		const tinygltf::BufferView &indBufferView = model.bufferViews[indAccessor.bufferView];
-		const tinygltf::Buffer &indBuffer = model.buffers[indBufferView.buffer];
+		// Now obtain the indicies data from the gltf file - the indices can be stored in various formats, these
+		// are all converted to 32-bit
+		AccessorView indView(model, primitive.indices);
+		uint32_t indexCount = static_cast<uint32_t>(indView.getCount());
 
-		uint32_t indexCount = static_cast<uint32_t>(indAccessor.count);
+		size_t indexStart = modelMesh->indices.size();
+		modelMesh->indices.resize(indexStart + indexCount);
 
-		// the indicies can be stored in various formats - this can be determined from the component type in the accessor
-		switch (indAccessor.componentType)
-		{
-		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+		if (!indView.readIndices(modelMesh->indices.data() + indexStart, vertexStart))
 		{
-			parseIndices<uint32_t>(indAccessor, indBufferView, indBuffer, modelMesh->indices,
-			                       vertexStart);
-			break;
-		}
-		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
-		{
-			parseIndices<uint16_t>(indAccessor, indBufferView, indBuffer, modelMesh->indices,
-			                       vertexStart);
-			break;
-		}
-		case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
-		{
-			parseIndices<uint8_t>(indAccessor, indBufferView, indBuffer, modelMesh->indices,
-			                      vertexStart);
-			break;
-		}
-		default:
 			throw std::runtime_error(
 			    "Unable to parse indices data. Unsupported accessor component type.");
 		}
@@ -283,6 +214,31 @@ std::unique_ptr<OmegaEngine::ModelMesh> mesh(tinygltf::Model &model, tinygltf::N
 		modelMesh->primitives.push_back(
 		    { localIndexOffset, indexCount, static_cast<int32_t>(primitive.material) });
 		localIndexOffset += indexCount;
+
+		if (primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode != -1)
+		{
+			isTriangleList = false;
+		}
+	}
+
+	// the indices are reordered for the vertex cache and overdraw, and the vertices into the order they're fetched
+	if (isTriangleList)
+	{
+		MeshOptimiser optimiser;
+		optimiser.optimise(*modelMesh);
+
+		const MeshOptimiser::Stats &stats = optimiser.getStats();
+		LOGGER_INFO("Optimised mesh %s: vertices %u -> %u, acmr %.3f -> %.3f, atvr %.3f -> %.3f", mesh.name.c_str(),
+		            stats.inputVertices, stats.outputVertices, stats.before.acmr, stats.after.acmr,
+		            stats.before.atvr, stats.after.atvr);
+
+		// the levels of detail share the optimised vertices, their indices are added after the primitives'
+		MeshSimplifier simplifier;
+		simplifier.generateLods(*modelMesh);
+
+		const MeshSimplifier::Stats &lodStats = simplifier.getStats();
+		LOGGER_INFO("Generated %u levels of detail for mesh %s: %u triangles, %u in the levels", lodStats.lods,
+		            mesh.name.c_str(), lodStats.triangles, lodStats.lodTriangles);
 	}
 
 	return std::move(modelMesh);
@@ -454,27 +410,15 @@ std::unique_ptr<OmegaEngine::ModelAnimation> animation(tinygltf::Model &gltfMode
 		ModelAnimation::Sampler samplerInfo;
 		samplerInfo.interpolation = sampler.interpolation;
 
-		tinygltf::Accessor timeAccessor = gltfModel.accessors[sampler.input];
-		tinygltf::BufferView timeBufferView = gltfModel.bufferViews[timeAccessor.bufferView];
-		tinygltf::Buffer timeBuffer = gltfModel.buffers[timeBufferView.buffer];
-
 		// only supporting floats at the moment. This can be expaned on if the need arises...
-		switch (timeAccessor.componentType)
-		{
-		case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		AccessorView timeView(gltfModel, sampler.input);
+		if (timeView.getComponentType() == TINYGLTF_COMPONENT_TYPE_FLOAT)
 		{
-			float *buffer = new float[timeAccessor.count];
-			memcpy(buffer, &timeBuffer.data[timeAccessor.byteOffset + timeBufferView.byteOffset],
-			       timeAccessor.count * sizeof(float));
-
-			for (uint32_t i = 0; i < timeAccessor.count; ++i)
-			{
-				samplerInfo.timeStamps.emplace_back(buffer[i]);
-			}
-			delete buffer;
-			break;
+			samplerInfo.timeStamps.resize(timeView.getCount());
+			timeView.read(samplerInfo.timeStamps.data(), 1, sizeof(float));
 		}
-		default:
+		else
+		{
 			LOGGER_ERROR("Unsupported component type used for time accessor.");
 		}
 
@@ -491,41 +435,17 @@ std::unique_ptr<OmegaEngine::ModelAnimation> animation(tinygltf::Model &gltfMode
 			}
 		}
 
-		// get TRS data
-		tinygltf::Accessor trsAccessor = gltfModel.accessors[sampler.output];
-		tinygltf::BufferView trsBufferView = gltfModel.bufferViews[trsAccessor.bufferView];
-		tinygltf::Buffer trsBuffer = gltfModel.buffers[trsBufferView.buffer];
-
-		// again, for now, only supporting floats
-		switch (trsAccessor.componentType)
-		{
-		case TINYGLTF_COMPONENT_TYPE_FLOAT:
+		// get TRS data - all types will be converted to vec4 for ease of use. Rotations may be stored as
+		// normalised integers, these are converted to floats by the view
+		AccessorView trsView(gltfModel, sampler.output);
+		if (trsView.getComponentCount() == 3 || trsView.getComponentCount() == 4)
 		{
-			// all types will be converted to vec4 for ease of use
-			switch (trsAccessor.type)
-			{
-			case TINYGLTF_TYPE_VEC3:
-			{
-				OEMaths::vec3f *buffer = reinterpret_cast<OEMaths::vec3f *>(
-				    &trsBuffer.data[trsAccessor.byteOffset + trsBufferView.byteOffset]);
-				for (uint32_t i = 0; i < trsAccessor.count; ++i)
-				{
-					samplerInfo.outputs.push_back(OEMaths::vec4f(buffer[i], 0.0f));
-				}
-				break;
-			}
-			case TINYGLTF_TYPE_VEC4:
-			{
-				samplerInfo.outputs.resize(trsAccessor.count);
-				memcpy(samplerInfo.outputs.data(),
-				       &trsBuffer.data[trsAccessor.byteOffset + trsBufferView.byteOffset],
-				       trsAccessor.count * sizeof(OEMaths::vec4f));
-				break;
-			}
-			default:
-				LOGGER_ERROR("Unsupported component type used for TRS accessor.");
-			}
+			samplerInfo.outputs.resize(trsView.getCount(), OEMaths::vec4f(0.0f, 0.0f, 0.0f, 0.0f));
+			trsView.read(reinterpret_cast<float *>(samplerInfo.outputs.data()), 4, sizeof(OEMaths::vec4f));
 		}
+		else
+		{
+			LOGGER_ERROR("Unsupported component type used for TRS accessor.");
 		}
 
 		modelAnim->samplers.emplace_back(samplerInfo);
@@ -589,14 +509,12 @@ std::unique_ptr<OmegaEngine::ModelSkin> skin(tinygltf::Model &gltfModel, tinyglt
 	// get the inverse bind matricies, if there are any
 	if (skin.inverseBindMatrices > -1)
 	{
-		tinygltf::Accessor accessor = gltfModel.accessors[skin.inverseBindMatrices];
-		tinygltf::BufferView bufferView = gltfModel.bufferViews[accessor.bufferView];
-		tinygltf::Buffer buffer = gltfModel.buffers[bufferView.buffer];
-
-		modelSkin->invBindMatrices.resize(accessor.count);
-		memcpy(modelSkin->invBindMatrices.data(),
-		       &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-		       accessor.count * sizeof(OEMaths::mat4f));
+		AccessorView view(gltfModel, skin.inverseBindMatrices);
+		if (view.getComponentCount() == 16)
+		{
+			modelSkin->invBindMatrices.resize(view.getCount());
+			view.read(reinterpret_cast<float *>(modelSkin->invBindMatrices.data()), 16, sizeof(OEMaths::mat4f));
+		}
 	}
 
 	return std::move(modelSkin);
@@ -44,9 +44,9 @@ std::unique_ptr<Model> load(std::string filename);
 
 namespace Extract
 {
-std::unique_ptr<OmegaEngine::ModelImage> image(tinygltf::Model &model, tinygltf::Texture &texture);
+std::unique_ptr<OmegaEngine::ModelImage> image(const tinygltf::Model &model, const tinygltf::Texture &texture);
 
-std::unique_ptr<OmegaEngine::ModelMesh> mesh(tinygltf::Model &model, tinygltf::Node &node);
+std::unique_ptr<OmegaEngine::ModelMesh> mesh(const tinygltf::Model &model, const tinygltf::Node &node);
 
 std::unique_ptr<OmegaEngine::ModelMaterial> material(tinygltf::Material &gltfMaterial);
 
@@ -58,24 +58,6 @@ std::unique_ptr<OmegaEngine::ModelTransform> transform(tinygltf::Node &node);
 
 std::unique_ptr<OmegaEngine::ModelSkin> skin(tinygltf::Model &gltfModel, tinygltf::Skin &skin,
                      std::unique_ptr<GltfModel::Model> &model, uint32_t skinIndex);
-
-template <typename T>
-void parseIndices(tinygltf::Accessor accessor, tinygltf::BufferView bufferView,
-                  tinygltf::Buffer buffer, std::vector<uint32_t> &indiciesBuffer,
-                  uint32_t indexStart)
-{
-	T *buf = new T[accessor.count];
-	memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-	       accessor.count * sizeof(T));
-
-	// copy the data to our indices buffer at the correct offset
-	for (uint32_t j = 0; j < accessor.count; ++j)
-	{
-		indiciesBuffer.push_back(buf[j] + indexStart);
-	}
-
-	delete buf;
-}
 } // namespace Extract
 } // namespace GltfModel
 
@@ -0,0 +1,577 @@
+#include "MeshOptimiser.h"
+#include "Models/ModelMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace OmegaEngine
+{
+
+// the scoring constants from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static constexpr uint32_t MaxCacheSize = 32;
+static constexpr float CacheDecayPower = 1.5f;
+static constexpr float LastTriangleScore = 0.75f;
+static constexpr float ValenceBoostScale = 2.0f;
+static constexpr float ValenceBoostPower = 0.5f;
+
+static float getVertexScore(const int32_t cachePosition, const uint32_t remainingTriangles)
+{
+	// no triangles left to draw so this vertex is of no use
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// the vertices of the last triangle are given a fixed score, so the next triangle doesn't just share its edge
+		if (cachePosition < 3)
+		{
+			score = LastTriangleScore;
+		}
+		else
+		{
+			const float scaler = 1.0f / static_cast<float>(MaxCacheSize - 3);
+			score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scaler, CacheDecayPower);
+		}
+	}
+
+	// vertices with few triangles left are boosted, so they are finished off rather than left as stragglers
+	score += ValenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -ValenceBoostPower);
+	return score;
+}
+
+// a fifo cache - a vertex is a hit if it was added within the last cacheSize misses
+struct FifoCache
+{
+	FifoCache(const size_t vertexCount, const uint32_t size)
+	    : cacheSize(size)
+	    , timeStamps(vertexCount, 0)
+	    , time(size + 1)
+	{
+	}
+
+	bool access(const uint32_t vertex)
+	{
+		if (time - timeStamps[vertex] > cacheSize)
+		{
+			timeStamps[vertex] = time++;
+			return false;
+		}
+		return true;
+	}
+
+	void flush()
+	{
+		time += cacheSize + 1;
+	}
+
+	uint32_t cacheSize;
+	std::vector<uint32_t> timeStamps;
+	uint32_t time;
+};
+
+struct VertexHasher
+{
+	size_t operator()(const uint32_t index) const
+	{
+		// fnv-1a over the bytes of the vertex
+		const unsigned char *bytes = data + index * vertexSize;
+		size_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < vertexSize; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	const unsigned char *data;
+	size_t vertexSize;
+};
+
+struct VertexEqual
+{
+	bool operator()(const uint32_t lhs, const uint32_t rhs) const
+	{
+		return std::memcmp(data + lhs * vertexSize, data + rhs * vertexSize, vertexSize) == 0;
+	}
+
+	const unsigned char *data;
+	size_t vertexSize;
+};
+
+MeshOptimiser::MeshOptimiser(const Settings &_settings)
+    : settings(_settings)
+{
+}
+
+uint32_t MeshOptimiser::generateVertexRemap(const void *vertices, const size_t vertexCount, const size_t vertexSize,
+                                            std::vector<uint32_t> &remap)
+{
+	const unsigned char *data = static_cast<const unsigned char *>(vertices);
+
+	std::unordered_map<uint32_t, uint32_t, VertexHasher, VertexEqual> uniqueVertices(
+	    vertexCount, VertexHasher{ data, vertexSize }, VertexEqual{ data, vertexSize });
+
+	remap.resize(vertexCount);
+	uint32_t uniqueCount = 0;
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		auto iter = uniqueVertices.find(i);
+		if (iter != uniqueVertices.end())
+		{
+			remap[i] = iter->second;
+		}
+		else
+		{
+			uniqueVertices.emplace(i, uniqueCount);
+			remap[i] = uniqueCount++;
+		}
+	}
+
+	return uniqueCount;
+}
+
+void MeshOptimiser::optimiseVertexCache(const uint32_t *indices, const size_t indexCount, const size_t vertexCount,
+                                        uint32_t *output)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// the triangles using each vertex, stored as ranges of one list. The remaining triangles are kept at the
+	// front of each range so the count is also the end of the range
+	std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		++remainingTriangles[indices[i]];
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount);
+	uint32_t offset = 0;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		adjacencyOffsets[i] = offset;
+		offset += remainingTriangles[i];
+	}
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> fillOffsets = adjacencyOffsets;
+	for (uint32_t tri = 0; tri < triangleCount; ++tri)
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			adjacency[fillOffsets[indices[tri * 3 + k]]++] = tri;
+		}
+	}
+
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		vertexScores[i] = getVertexScore(-1, remainingTriangles[i]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+
+	uint32_t bestTriangle = 0;
+	for (uint32_t tri = 0; tri < triangleCount; ++tri)
+	{
+		const uint32_t *triIndices = &indices[tri * 3];
+		triangleScores[tri] =
+		    vertexScores[triIndices[0]] + vertexScores[triIndices[1]] + vertexScores[triIndices[2]];
+
+		if (triangleScores[tri] > triangleScores[bestTriangle])
+		{
+			bestTriangle = tri;
+		}
+	}
+
+	// an lru cache, with room for the vertices of the new triangle before the oldest are evicted
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(MaxCacheSize + 3);
+	newCache.reserve(MaxCacheSize + 3);
+
+	size_t nextUnemitted = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		// nothing in the cache is connected to a remaining triangle - carry on from the input order
+		if (bestTriangle == UINT32_MAX)
+		{
+			while (emitted[nextUnemitted])
+			{
+				++nextUnemitted;
+			}
+			bestTriangle = static_cast<uint32_t>(nextUnemitted);
+		}
+
+		const uint32_t *triIndices = &indices[bestTriangle * 3];
+		output[emittedCount * 3] = triIndices[0];
+		output[emittedCount * 3 + 1] = triIndices[1];
+		output[emittedCount * 3 + 2] = triIndices[2];
+		emitted[bestTriangle] = true;
+
+		// remove the triangle from the remaining triangles of its vertices
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			uint32_t vertex = triIndices[k];
+			uint32_t *triangles = &adjacency[adjacencyOffsets[vertex]];
+			uint32_t count = remainingTriangles[vertex];
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				if (triangles[i] == bestTriangle)
+				{
+					triangles[i] = triangles[count - 1];
+					--remainingTriangles[vertex];
+					break;
+				}
+			}
+		}
+
+		// the triangle's vertices move to the front of the cache
+		newCache.clear();
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			if (std::find(newCache.begin(), newCache.end(), triIndices[k]) == newCache.end())
+			{
+				newCache.emplace_back(triIndices[k]);
+			}
+		}
+		for (uint32_t vertex : cache)
+		{
+			if (vertex != triIndices[0] && vertex != triIndices[1] && vertex != triIndices[2])
+			{
+				newCache.emplace_back(vertex);
+			}
+		}
+
+		// update the scores of the cached and evicted vertices, and of the triangles which use them
+		for (uint32_t i = 0; i < newCache.size(); ++i)
+		{
+			uint32_t vertex = newCache[i];
+			int32_t position = i < MaxCacheSize ? static_cast<int32_t>(i) : -1;
+
+			float score = getVertexScore(position, remainingTriangles[vertex]);
+			float delta = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+
+			const uint32_t *triangles = &adjacency[adjacencyOffsets[vertex]];
+			for (uint32_t j = 0; j < remainingTriangles[vertex]; ++j)
+			{
+				triangleScores[triangles[j]] += delta;
+			}
+		}
+
+		newCache.resize(std::min<size_t>(newCache.size(), MaxCacheSize));
+		std::swap(cache, newCache);
+
+		// only the triangles using cached vertices are candidates for the next triangle
+		bestTriangle = UINT32_MAX;
+		float bestScore = -1.0f;
+		for (uint32_t vertex : cache)
+		{
+			const uint32_t *triangles = &adjacency[adjacencyOffsets[vertex]];
+			for (uint32_t j = 0; j < remainingTriangles[vertex]; ++j)
+			{
+				if (triangleScores[triangles[j]] > bestScore)
+				{
+					bestScore = triangleScores[triangles[j]];
+					bestTriangle = triangles[j];
+				}
+			}
+		}
+	}
+}
+
+void MeshOptimiser::optimiseOverdraw(const uint32_t *indices, const size_t indexCount, const float *positions,
+                                     const size_t vertexCount, const size_t positionStride, const uint32_t cacheSize,
+                                     const float threshold, uint32_t *output)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// hard boundaries are where the cache has been flushed, i.e. all three vertices of a triangle miss. The
+	// clusters can be reordered between these without any loss to the cache efficiency
+	std::vector<uint32_t> hardBoundaries;
+	FifoCache cache(vertexCount, cacheSize);
+
+	for (uint32_t tri = 0; tri < triangleCount; ++tri)
+	{
+		uint32_t misses = 0;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			misses += cache.access(indices[tri * 3 + k]) ? 0 : 1;
+		}
+		if (misses == 3)
+		{
+			hardBoundaries.emplace_back(tri);
+		}
+	}
+	hardBoundaries.emplace_back(static_cast<uint32_t>(triangleCount));
+
+	// the hard clusters are usually large, so they are split further where the cache efficiency of the
+	// cluster so far is within the threshold of the whole cluster
+	std::vector<uint32_t> clusters;
+	for (size_t i = 0; i + 1 < hardBoundaries.size(); ++i)
+	{
+		uint32_t start = hardBoundaries[i];
+		uint32_t end = hardBoundaries[i + 1];
+
+		cache.flush();
+		uint32_t clusterMisses = 0;
+		for (uint32_t tri = start; tri < end; ++tri)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				clusterMisses += cache.access(indices[tri * 3 + k]) ? 0 : 1;
+			}
+		}
+		float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+		clusters.emplace_back(start);
+		cache.flush();
+
+		uint32_t softStart = start;
+		uint32_t softMisses = 0;
+		for (uint32_t tri = start; tri < end; ++tri)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				softMisses += cache.access(indices[tri * 3 + k]) ? 0 : 1;
+			}
+
+			float acmr = static_cast<float>(softMisses) / static_cast<float>(tri - softStart + 1);
+			if (acmr <= clusterThreshold && tri + 1 < end)
+			{
+				clusters.emplace_back(tri + 1);
+				softStart = tri + 1;
+				softMisses = 0;
+				cache.flush();
+			}
+		}
+	}
+	clusters.emplace_back(static_cast<uint32_t>(triangleCount));
+
+	// the area weighted centroid and normal of each cluster, and the centroid of the whole mesh
+	auto getPosition = [&](const uint32_t vertex) -> const float * {
+		return reinterpret_cast<const float *>(reinterpret_cast<const unsigned char *>(positions) +
+		                                       vertex * positionStride);
+	};
+
+	const size_t clusterCount = clusters.size() - 1;
+	std::vector<float> clusterCentroids(clusterCount * 3, 0.0f);
+	std::vector<float> clusterNormals(clusterCount * 3, 0.0f);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	for (size_t i = 0; i < clusterCount; ++i)
+	{
+		float *centroid = &clusterCentroids[i * 3];
+		float *normal = &clusterNormals[i * 3];
+		float clusterArea = 0.0f;
+
+		for (uint32_t tri = clusters[i]; tri < clusters[i + 1]; ++tri)
+		{
+			const float *p0 = getPosition(indices[tri * 3]);
+			const float *p1 = getPosition(indices[tri * 3 + 1]);
+			const float *p2 = getPosition(indices[tri * 3 + 2]);
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+				               e1[0] * e2[1] - e1[1] * e2[0] };
+			float area = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				centroid[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.0f);
+				normal[k] += cross[k];
+			}
+			clusterArea += area;
+		}
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			meshCentroid[k] += centroid[k];
+			centroid[k] = clusterArea > 0.0f ? centroid[k] / clusterArea : 0.0f;
+		}
+		meshArea += clusterArea;
+
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			normal[k] = length > 0.0f ? normal[k] / length : 0.0f;
+		}
+	}
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		meshCentroid[k] = meshArea > 0.0f ? meshCentroid[k] / meshArea : 0.0f;
+	}
+
+	// clusters facing away from the centre are more likely to occlude the rest of the mesh so are drawn first
+	std::vector<float> sortKeys(clusterCount);
+	std::vector<uint32_t> order(clusterCount);
+	for (uint32_t i = 0; i < clusterCount; ++i)
+	{
+		const float *centroid = &clusterCentroids[i * 3];
+		const float *normal = &clusterNormals[i * 3];
+
+		sortKeys[i] = (centroid[0] - meshCentroid[0]) * normal[0] + (centroid[1] - meshCentroid[1]) * normal[1] +
+		              (centroid[2] - meshCentroid[2]) * normal[2];
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(),
+	                 [&sortKeys](const uint32_t lhs, const uint32_t rhs) { return sortKeys[lhs] > sortKeys[rhs]; });
+
+	size_t outputOffset = 0;
+	for (uint32_t cluster : order)
+	{
+		size_t start = clusters[cluster] * 3;
+		size_t end = clusters[cluster + 1] * 3;
+		std::copy(indices + start, indices + end, output + outputOffset);
+		outputOffset += end - start;
+	}
+}
+
+uint32_t MeshOptimiser::generateFetchRemap(const uint32_t *indices, const size_t indexCount, const size_t vertexCount,
+                                           std::vector<uint32_t> &remap)
+{
+	remap.assign(vertexCount, UINT32_MAX);
+	uint32_t nextVertex = 0;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		if (remap[indices[i]] == UINT32_MAX)
+		{
+			remap[indices[i]] = nextVertex++;
+		}
+	}
+
+	return nextVertex;
+}
+
+MeshOptimiser::CacheStats MeshOptimiser::analyseVertexCache(const uint32_t *indices, const size_t indexCount,
+                                                            const size_t vertexCount, const uint32_t cacheSize)
+{
+	CacheStats cacheStats;
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return cacheStats;
+	}
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	uint32_t misses = 0;
+	uint32_t uniqueVertices = 0;
+
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+	{
+		misses += cache.access(indices[i]) ? 0 : 1;
+
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = true;
+			++uniqueVertices;
+		}
+	}
+
+	cacheStats.acmr = static_cast<float>(misses) / static_cast<float>(triangleCount);
+	cacheStats.atvr = static_cast<float>(misses) / static_cast<float>(uniqueVertices);
+	return cacheStats;
+}
+
+void MeshOptimiser::optimise(ModelMesh &mesh)
+{
+	stats = Stats();
+
+	auto &vertices = mesh.vertices;
+	auto &indices = mesh.indices;
+
+	stats.inputVertices = static_cast<uint32_t>(vertices.size());
+	stats.outputVertices = stats.inputVertices;
+	stats.triangles = static_cast<uint32_t>(indices.size() / 3);
+
+	if (vertices.empty() || indices.empty())
+	{
+		return;
+	}
+
+	// merge the duplicate vertices
+	std::vector<uint32_t> remap;
+	uint32_t uniqueCount =
+	    generateVertexRemap(vertices.data(), vertices.size(), sizeof(ModelMesh::Vertex), remap);
+
+	std::vector<ModelMesh::Vertex> newVertices(uniqueCount);
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		newVertices[remap[i]] = vertices[i];
+	}
+	for (auto &index : indices)
+	{
+		index = remap[index];
+	}
+	vertices.swap(newVertices);
+
+	// measured after merging, as an unwelded mesh always misses three times per triangle
+	stats.before = analyseVertexCache(indices.data(), indices.size(), vertices.size(), settings.cacheSize);
+
+	// the triangles can only be reordered within each primitive, as these are drawn separately
+	const float *positions = reinterpret_cast<const float *>(&vertices[0].position);
+	std::vector<uint32_t> cacheOrdered(indices.size());
+
+	for (auto &primitive : mesh.primitives)
+	{
+		size_t start = std::min<size_t>(primitive.indexBase, indices.size());
+		size_t count = std::min<size_t>(primitive.indexCount, indices.size() - start);
+		count -= count % 3;
+
+		optimiseVertexCache(&indices[start], count, vertices.size(), &cacheOrdered[start]);
+
+		if (settings.optimiseOverdraw)
+		{
+			optimiseOverdraw(&cacheOrdered[start], count, positions, vertices.size(), sizeof(ModelMesh::Vertex),
+			                 settings.cacheSize, settings.overdrawThreshold, &indices[start]);
+		}
+		else
+		{
+			std::copy(cacheOrdered.begin() + start, cacheOrdered.begin() + start + count, indices.begin() + start);
+		}
+	}
+
+	// and finally the vertices are reordered into the order they are used - unused vertices are removed
+	uint32_t referencedCount = generateFetchRemap(indices.data(), indices.size(), vertices.size(), remap);
+
+	newVertices.resize(referencedCount);
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		if (remap[i] != UINT32_MAX)
+		{
+			newVertices[remap[i]] = vertices[i];
+		}
+	}
+	for (auto &index : indices)
+	{
+		index = remap[index];
+	}
+	vertices.swap(newVertices);
+
+	stats.outputVertices = referencedCount;
+	stats.after = analyseVertexCache(indices.data(), indices.size(), vertices.size(), settings.cacheSize);
+}
+
+} // namespace OmegaEngine
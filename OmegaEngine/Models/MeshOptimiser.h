@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OmegaEngine
+{
+struct ModelMesh;
+
+// Import time optimisation of indexed triangle lists. The steps can be used on their own, they only need the index
+// buffer and, where stated, the positions. optimise() runs them all over a model mesh:
+// 1. duplicate vertices are merged
+// 2. the triangles of each primitive are reordered for the post-transform vertex cache (Forsyth)
+// 3. the triangles are grouped into clusters which are sorted to reduce overdraw, keeping most of the cache gain
+// 4. the vertices are reordered into the order they are first used, for vertex fetch locality
+class MeshOptimiser
+{
+
+public:
+	struct Settings
+	{
+		// the size of the fifo cache used to simulate the gpu, when splitting clusters and measuring
+		uint32_t cacheSize = 16;
+
+		// how much the cache efficiency of a cluster may be traded for smaller clusters when sorting for overdraw.
+		// 1.0 only splits at cache flushes
+		float overdrawThreshold = 1.05f;
+
+		bool optimiseOverdraw = true;
+	};
+
+	struct CacheStats
+	{
+		// cache misses per triangle - 0.5 is optimal for a regular grid, 3.0 is the worst case
+		float acmr = 0.0f;
+
+		// cache misses per referenced vertex - 1.0 is optimal
+		float atvr = 0.0f;
+	};
+
+	struct Stats
+	{
+		uint32_t inputVertices = 0;
+		uint32_t outputVertices = 0;
+		uint32_t triangles = 0;
+
+		// before is measured once the duplicate vertices have been merged
+		CacheStats before;
+		CacheStats after;
+	};
+
+	MeshOptimiser() = default;
+	MeshOptimiser(const Settings &_settings);
+
+	// runs all the stages over the mesh. Only triangle lists should be passed - the primitives keep their index
+	// ranges, though the triangles within each range will be reordered
+	void optimise(ModelMesh &mesh);
+
+	const Stats &getStats() const
+	{
+		return stats;
+	}
+
+	// fills the remap table with the new index of each vertex, merging vertices whose bytes are identical.
+	// Returns the number of unique vertices
+	static uint32_t generateVertexRemap(const void *vertices, const size_t vertexCount, const size_t vertexSize,
+	                                    std::vector<uint32_t> &remap);
+
+	// reorders the triangles to reduce post-transform vertex cache misses
+	static void optimiseVertexCache(const uint32_t *indices, const size_t indexCount, const size_t vertexCount,
+	                                uint32_t *output);
+
+	// splits the cache optimised triangles into clusters, which are sorted so those facing away from the mesh
+	// centre, and so more likely to occlude, are drawn first. Positions are three floats at the given stride
+	static void optimiseOverdraw(const uint32_t *indices, const size_t indexCount, const float *positions,
+	                             const size_t vertexCount, const size_t positionStride, const uint32_t cacheSize,
+	                             const float threshold, uint32_t *output);
+
+	// fills the remap table with the order in which the vertices are first referenced. Unreferenced vertices are
+	// given UINT32_MAX. Returns the number of referenced vertices
+	static uint32_t generateFetchRemap(const uint32_t *indices, const size_t indexCount, const size_t vertexCount,
+	                                   std::vector<uint32_t> &remap);
+
+	// simulates a fifo cache of the given size
+	static CacheStats analyseVertexCache(const uint32_t *indices, const size_t indexCount, const size_t vertexCount,
+	                                     const uint32_t cacheSize);
+
+private:
+	Settings settings;
+	Stats stats;
+};
+
+} // namespace OmegaEngine
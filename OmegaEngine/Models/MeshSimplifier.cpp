@@ -0,0 +1,416 @@
+#include "MeshSimplifier.h"
+#include "Models/MeshOptimiser.h"
+#include "Models/ModelMesh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+namespace OmegaEngine
+{
+
+// the cosine of the largest rotation of a triangle allowed by one collapse. A triangle can be changed by several
+// collapses, so this is kept well inside 90 degrees to stop them adding up to a flip
+static constexpr double MaxNormalChange = 0.5;
+
+// the symmetric 4x4 matrix of the sum of squared distances to a set of planes. The planes are weighted by the
+// area of their triangle, and the weight is kept so the error is an average distance rather than one which
+// grows with the size of the triangles
+struct Quadric
+{
+	void addPlane(const double *normal, const double distance, const double weight)
+	{
+		a00 += normal[0] * normal[0] * weight;
+		a01 += normal[0] * normal[1] * weight;
+		a02 += normal[0] * normal[2] * weight;
+		a11 += normal[1] * normal[1] * weight;
+		a12 += normal[1] * normal[2] * weight;
+		a22 += normal[2] * normal[2] * weight;
+		b0 += normal[0] * distance * weight;
+		b1 += normal[1] * distance * weight;
+		b2 += normal[2] * distance * weight;
+		c += distance * distance * weight;
+		w += weight;
+	}
+
+	void add(const Quadric &other)
+	{
+		a00 += other.a00;
+		a01 += other.a01;
+		a02 += other.a02;
+		a11 += other.a11;
+		a12 += other.a12;
+		a22 += other.a22;
+		b0 += other.b0;
+		b1 += other.b1;
+		b2 += other.b2;
+		c += other.c;
+		w += other.w;
+	}
+
+	// the mean squared distance of the point to the planes
+	double evaluate(const float *p) const
+	{
+		if (w <= 0.0)
+		{
+			return 0.0;
+		}
+
+		double x = p[0];
+		double y = p[1];
+		double z = p[2];
+		double error = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+		               2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return std::max(error / w, 0.0);
+	}
+
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+	double c = 0.0;
+	double w = 0.0;
+};
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+static const float *getPosition(const float *positions, const size_t positionStride, const uint32_t vertex)
+{
+	return reinterpret_cast<const float *>(reinterpret_cast<const unsigned char *>(positions) +
+	                                       vertex * positionStride);
+}
+
+static void triangleNormal(const float *p0, const float *p1, const float *p2, double *normal)
+{
+	double e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	double e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	normal[0] = e0[1] * e1[2] - e0[2] * e1[1];
+	normal[1] = e0[2] * e1[0] - e0[0] * e1[2];
+	normal[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+static uint64_t getEdgeKey(uint32_t a, uint32_t b)
+{
+	if (a > b)
+	{
+		std::swap(a, b);
+	}
+	return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+MeshSimplifier::MeshSimplifier(const Settings &_settings)
+    : settings(_settings)
+{
+}
+
+size_t MeshSimplifier::simplify(const uint32_t *indices, const size_t indexCount, const float *positions,
+                                const size_t vertexCount, const size_t positionStride, const size_t targetIndexCount,
+                                const float targetError, uint32_t *output, float *resultError)
+{
+	std::vector<uint32_t> current(indices, indices + indexCount - indexCount % 3);
+	const double maxCost = static_cast<double>(targetError) * targetError;
+	double largestCost = 0.0;
+
+	// vertices on an open or non-manifold edge are never collapsed
+	std::vector<bool> locked(vertexCount, false);
+	std::unordered_map<uint64_t, uint32_t> edgeUse;
+	for (size_t i = 0; i < current.size(); i += 3)
+	{
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			++edgeUse[getEdgeKey(current[i + k], current[i + (k + 1) % 3])];
+		}
+	}
+	for (auto &edge : edgeUse)
+	{
+		if (edge.second != 2)
+		{
+			locked[edge.first >> 32] = true;
+			locked[edge.first & 0xffffffff] = true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < current.size(); i += 3)
+	{
+		const float *p0 = getPosition(positions, positionStride, current[i]);
+		const float *p1 = getPosition(positions, positionStride, current[i + 1]);
+		const float *p2 = getPosition(positions, positionStride, current[i + 2]);
+
+		double normal[3];
+		triangleNormal(p0, p1, p2, normal);
+		double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length == 0.0)
+		{
+			continue;
+		}
+
+		normal[0] /= length;
+		normal[1] /= length;
+		normal[2] /= length;
+		double distance = -(normal[0] * p0[0] + normal[1] * p0[1] + normal[2] * p0[2]);
+
+		// the length of the cross product is twice the area
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			quadrics[current[i + k]].addPlane(normal, distance, length * 0.5);
+		}
+	}
+
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint32_t> passLocked(vertexCount, 0);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+
+	const size_t targetTriangles = targetIndexCount / 3;
+
+	for (uint32_t pass = 1; current.size() / 3 > targetTriangles; ++pass)
+	{
+		const size_t triangleCount = current.size() / 3;
+
+		// the triangles using each vertex
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : current)
+		{
+			++adjacencyOffsets[index + 1];
+		}
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		adjacency.resize(current.size());
+		std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t tri = 0; tri < triangleCount; ++tri)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				adjacency[fillOffsets[current[tri * 3 + k]]++] = tri;
+			}
+		}
+
+		// each edge can be collapsed either way - the cost is the error of moving the removed vertex onto the other
+		collapses.clear();
+		for (uint32_t tri = 0; tri < triangleCount; ++tri)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				uint32_t a = current[tri * 3 + k];
+				uint32_t b = current[tri * 3 + (k + 1) % 3];
+				if (!locked[a])
+				{
+					collapses.push_back({ a, b, quadrics[a].evaluate(getPosition(positions, positionStride, b)) });
+				}
+				if (!locked[b])
+				{
+					collapses.push_back({ b, a, quadrics[b].evaluate(getPosition(positions, positionStride, a)) });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(),
+		          [](const Collapse &lhs, const Collapse &rhs) { return lhs.cost < rhs.cost; });
+
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			remap[i] = static_cast<uint32_t>(i);
+		}
+
+		// the collapses in a pass don't overlap, so the triangles around each one are as they were at the start
+		size_t removedTriangles = 0;
+		uint32_t collapseCount = 0;
+		for (const Collapse &collapse : collapses)
+		{
+			if (collapse.cost > maxCost || triangleCount - removedTriangles <= targetTriangles)
+			{
+				break;
+			}
+			if (passLocked[collapse.from] == pass || passLocked[collapse.to] == pass)
+			{
+				continue;
+			}
+
+			// reject the collapse if any of the remaining triangles would turn too far or become degenerate
+			const float *target = getPosition(positions, positionStride, collapse.to);
+			bool isValid = true;
+			size_t removed = 0;
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; ++j)
+			{
+				const uint32_t *tri = &current[adjacency[j] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+				{
+					++removed;
+					continue;
+				}
+
+				const float *p[3];
+				const float *moved[3];
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					p[k] = getPosition(positions, positionStride, tri[k]);
+					moved[k] = tri[k] == collapse.from ? target : p[k];
+				}
+
+				double before[3];
+				double after[3];
+				triangleNormal(p[0], p[1], p[2], before);
+				triangleNormal(moved[0], moved[1], moved[2], after);
+				double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				double lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+				                           (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+				if (dot <= MaxNormalChange * lengths)
+				{
+					isValid = false;
+					break;
+				}
+			}
+
+			if (!isValid)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			largestCost = std::max(largestCost, collapse.cost);
+			removedTriangles += removed;
+			++collapseCount;
+
+			// the ring of the removed vertex now has new triangles, so isn't touched again this pass
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; ++j)
+			{
+				const uint32_t *tri = &current[adjacency[j] * 3];
+				passLocked[tri[0]] = pass;
+				passLocked[tri[1]] = pass;
+				passLocked[tri[2]] = pass;
+			}
+		}
+
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// remove the triangles which have collapsed to a line
+		size_t writeIndex = 0;
+		for (size_t i = 0; i < current.size(); i += 3)
+		{
+			uint32_t i0 = remap[current[i]];
+			uint32_t i1 = remap[current[i + 1]];
+			uint32_t i2 = remap[current[i + 2]];
+			if (i0 != i1 && i1 != i2 && i0 != i2)
+			{
+				current[writeIndex++] = i0;
+				current[writeIndex++] = i1;
+				current[writeIndex++] = i2;
+			}
+		}
+		current.resize(writeIndex);
+	}
+
+	std::copy(current.begin(), current.end(), output);
+	if (resultError)
+	{
+		*resultError = static_cast<float>(std::sqrt(largestCost));
+	}
+	return current.size();
+}
+
+void MeshSimplifier::generateLods(ModelMesh &mesh)
+{
+	stats = Stats();
+
+	auto &vertices = mesh.vertices;
+	auto &indices = mesh.indices;
+	if (vertices.empty() || indices.empty())
+	{
+		return;
+	}
+
+	const float *positions = reinterpret_cast<const float *>(&vertices[0].position);
+	const uint32_t lodCount = std::min(settings.lodCount, MaxLods - 1);
+
+	for (auto &primitive : mesh.primitives)
+	{
+		size_t start = std::min<size_t>(primitive.indexBase, indices.size());
+		size_t count = std::min<size_t>(primitive.indexCount, indices.size() - start);
+		count -= count % 3;
+
+		++stats.primitives;
+		stats.triangles += static_cast<uint32_t>(count / 3);
+
+		if (count / 3 < settings.minTriangles)
+		{
+			continue;
+		}
+
+		// the levels are appended to the indices, so the primitive's are copied first
+		std::vector<uint32_t> source(indices.begin() + start, indices.begin() + start + count);
+
+		// the error is kept relative to the size of the primitive, so the lod can be chosen from its size on screen
+		float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t index : source)
+		{
+			const float *p = getPosition(positions, sizeof(ModelMesh::Vertex), index);
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				min[k] = std::min(min[k], p[k]);
+				max[k] = std::max(max[k], p[k]);
+			}
+		}
+		float radius = 0.5f * std::sqrt((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) +
+		                                (max[2] - min[2]) * (max[2] - min[2]));
+		if (radius <= 0.0f)
+		{
+			continue;
+		}
+
+		std::vector<uint32_t> simplified(count);
+		std::vector<uint32_t> reordered(count);
+		size_t lastCount = count;
+		float lastError = 0.0f;
+
+		// each level is simplified from the full detail, so the errors don't build on each other
+		for (uint32_t level = 1; level <= lodCount; ++level)
+		{
+			size_t target = static_cast<size_t>(count * std::pow(settings.reduction, static_cast<float>(level)));
+			target -= target % 3;
+			if (target / 3 < settings.minTriangles)
+			{
+				break;
+			}
+
+			float error = 0.0f;
+			size_t newCount = simplify(source.data(), count, positions, vertices.size(), sizeof(ModelMesh::Vertex),
+			                           target, settings.maxError * radius, simplified.data(), &error);
+
+			// the error limit has been reached - the level wouldn't be worth drawing
+			if (newCount == 0 || newCount * 10 > lastCount * 9)
+			{
+				break;
+			}
+
+			MeshOptimiser::optimiseVertexCache(simplified.data(), newCount, vertices.size(), reordered.data());
+
+			ModelMesh::Lod lod;
+			lod.indexBase = static_cast<uint32_t>(indices.size());
+			lod.indexCount = static_cast<uint32_t>(newCount);
+			lod.error = std::max(lastError, error / radius);
+			primitive.lods.emplace_back(lod);
+
+			indices.insert(indices.end(), reordered.begin(), reordered.begin() + newCount);
+
+			lastCount = newCount;
+			lastError = lod.error;
+
+			++stats.lods;
+			stats.lodTriangles += static_cast<uint32_t>(newCount / 3);
+		}
+	}
+}
+
+} // namespace OmegaEngine
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OmegaEngine
+{
+struct ModelMesh;
+
+// Quadric error metric simplification of indexed triangle lists. Edges are collapsed onto one of their existing
+// vertices, so every level of detail is just a new index list over the same vertex buffer. Vertices on open edges
+// are never removed - this keeps the outline of the mesh and, as the vertices on uv and normal seams are split,
+// stops the seams from tearing
+class MeshSimplifier
+{
+
+public:
+	// the maximum number of levels per primitive, including the full detail
+	static constexpr uint32_t MaxLods = 5;
+
+	struct Settings
+	{
+		// the number of simplified levels generated for each primitive, so up to MaxLods - 1
+		uint32_t lodCount = 3;
+
+		// the fraction of the triangles kept by each level compared to the one before
+		float reduction = 0.5f;
+
+		// the largest error allowed relative to the radius of the primitive - generation stops at this
+		float maxError = 0.1f;
+
+		// primitives, and levels, with fewer triangles than this aren't simplified further
+		uint32_t minTriangles = 32;
+	};
+
+	struct Stats
+	{
+		uint32_t primitives = 0;
+		uint32_t lods = 0;
+
+		// the triangles of the full detail primitives and those added by all the levels
+		uint32_t triangles = 0;
+		uint32_t lodTriangles = 0;
+	};
+
+	MeshSimplifier() = default;
+	MeshSimplifier(const Settings &_settings);
+
+	// adds the levels of each primitive to the mesh. Only triangle lists should be passed
+	void generateLods(ModelMesh &mesh);
+
+	const Stats &getStats() const
+	{
+		return stats;
+	}
+
+	// reduces the triangles until at most the target index count remain, or no collapse is within the target
+	// error. Positions are three floats at the given stride. Returns the new index count, and the largest error
+	// introduced in the units of the positions
+	static size_t simplify(const uint32_t *indices, const size_t indexCount, const float *positions,
+	                       const size_t vertexCount, const size_t positionStride, const size_t targetIndexCount,
+	                       const float targetError, uint32_t *output, float *resultError);
+
+private:
+	Settings settings;
+	Stats stats;
+};
+
+} // namespace OmegaEngine
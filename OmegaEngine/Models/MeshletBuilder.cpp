@@ -0,0 +1,285 @@
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace OmegaEngine
+{
+
+static constexpr uint8_t UnusedVertex = 0xff;
+
+static const float *getPosition(const float *positions, const size_t positionStride, const uint32_t vertex)
+{
+	return reinterpret_cast<const float *>(reinterpret_cast<const unsigned char *>(positions) +
+	                                       vertex * positionStride);
+}
+
+static float distanceSquared(const float *a, const float *b)
+{
+	float dx = a[0] - b[0];
+	float dy = a[1] - b[1];
+	float dz = a[2] - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// Ritter's bounding sphere - the most separated pair of the axis extremes is used as the initial sphere, which is
+// then grown to take in any vertices outside of it
+static void computeSphere(const std::vector<const float *> &points, float *center, float &radius)
+{
+	uint32_t minPoint[3] = { 0, 0, 0 };
+	uint32_t maxPoint[3] = { 0, 0, 0 };
+	for (uint32_t i = 0; i < points.size(); ++i)
+	{
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			minPoint[axis] = points[i][axis] < points[minPoint[axis]][axis] ? i : minPoint[axis];
+			maxPoint[axis] = points[i][axis] > points[maxPoint[axis]][axis] ? i : maxPoint[axis];
+		}
+	}
+
+	uint32_t widest = 0;
+	float widestDistance = 0.0f;
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		float distance = distanceSquared(points[minPoint[axis]], points[maxPoint[axis]]);
+		if (distance > widestDistance)
+		{
+			widestDistance = distance;
+			widest = axis;
+		}
+	}
+
+	const float *p0 = points[minPoint[widest]];
+	const float *p1 = points[maxPoint[widest]];
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		center[k] = (p0[k] + p1[k]) * 0.5f;
+	}
+	radius = std::sqrt(widestDistance) * 0.5f;
+
+	for (const float *point : points)
+	{
+		float distance = distanceSquared(point, center);
+		if (distance > radius * radius)
+		{
+			distance = std::sqrt(distance);
+			float newRadius = (radius + distance) * 0.5f;
+			float shift = (newRadius - radius) / distance;
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				center[k] += (point[k] - center[k]) * shift;
+			}
+			radius = newRadius;
+		}
+	}
+}
+
+MeshletBuilder::MeshletBuilder(const Settings &_settings)
+    : settings(_settings)
+{
+}
+
+uint32_t MeshletBuilder::build(const uint32_t *indices, const size_t indexCount, const float *positions,
+                               const size_t vertexCount, const size_t positionStride, std::vector<Meshlet> &meshlets,
+                               std::vector<uint32_t> &meshletVertices, std::vector<uint8_t> &meshletTriangles)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return 0;
+	}
+
+	const uint32_t maxVertices = std::max(3u, std::min(settings.maxVertices, MaxVertices));
+	const uint32_t maxTriangles = std::max(1u, settings.maxTriangles);
+
+	// the position of each vertex within the current meshlet
+	std::vector<uint8_t> localIndices(vertexCount, UnusedVertex);
+
+	const uint32_t firstMeshlet = static_cast<uint32_t>(meshlets.size());
+
+	Meshlet meshlet;
+	meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+	meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size() / 3);
+
+	auto finishMeshlet = [&]() {
+		computeBounds(meshlet, &meshletVertices[meshlet.vertexOffset], &meshletTriangles[meshlet.triangleOffset * 3],
+		              positions, positionStride);
+		if (meshlet.coneCutoff >= 1.0f)
+		{
+			++stats.degenerateCones;
+		}
+
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+		{
+			localIndices[meshletVertices[meshlet.vertexOffset + i]] = UnusedVertex;
+		}
+
+		meshlets.emplace_back(meshlet);
+		stats.vertices += meshlet.vertexCount;
+
+		meshlet = Meshlet();
+		meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size() / 3);
+	};
+
+	for (size_t tri = 0; tri < triangleCount; ++tri)
+	{
+		const uint32_t *triIndices = &indices[tri * 3];
+
+		uint32_t newVertices = 0;
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			// repeated indices of a degenerate triangle are only counted once
+			bool repeated = (k > 0 && triIndices[k] == triIndices[0]) || (k > 1 && triIndices[k] == triIndices[1]);
+			newVertices += localIndices[triIndices[k]] == UnusedVertex && !repeated ? 1 : 0;
+		}
+
+		if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount >= maxTriangles)
+		{
+			finishMeshlet();
+		}
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			uint32_t vertex = triIndices[k];
+			if (localIndices[vertex] == UnusedVertex)
+			{
+				localIndices[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+				meshletVertices.emplace_back(vertex);
+			}
+			meshletTriangles.emplace_back(localIndices[vertex]);
+		}
+		++meshlet.triangleCount;
+	}
+
+	if (meshlet.triangleCount > 0)
+	{
+		finishMeshlet();
+	}
+
+	uint32_t added = static_cast<uint32_t>(meshlets.size()) - firstMeshlet;
+	stats.meshlets += added;
+	stats.triangles += static_cast<uint32_t>(triangleCount);
+
+	return added;
+}
+
+void MeshletBuilder::computeBounds(Meshlet &meshlet, const uint32_t *meshletVertices,
+                                   const uint8_t *meshletTriangles, const float *positions,
+                                   const size_t positionStride)
+{
+	std::vector<const float *> points(meshlet.vertexCount);
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+	{
+		points[i] = getPosition(positions, positionStride, meshletVertices[i]);
+	}
+
+	computeSphere(points, meshlet.center, meshlet.radius);
+
+	// the cone axis is the average of the triangle normals - degenerate triangles don't contribute
+	std::vector<float> normals(meshlet.triangleCount * 3, 0.0f);
+	std::vector<bool> validNormal(meshlet.triangleCount, false);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (uint32_t tri = 0; tri < meshlet.triangleCount; ++tri)
+	{
+		const float *p0 = points[meshletTriangles[tri * 3]];
+		const float *p1 = points[meshletTriangles[tri * 3 + 1]];
+		const float *p2 = points[meshletTriangles[tri * 3 + 2]];
+
+		float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0f)
+		{
+			continue;
+		}
+
+		for (uint32_t k = 0; k < 3; ++k)
+		{
+			normals[tri * 3 + k] = n[k] / length;
+			axis[k] += normals[tri * 3 + k];
+		}
+		validNormal[tri] = true;
+	}
+
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	std::copy(meshlet.center, meshlet.center + 3, meshlet.coneApex);
+	meshlet.coneCutoff = 1.0f;
+
+	if (axisLength == 0.0f)
+	{
+		return;
+	}
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		axis[k] /= axisLength;
+		meshlet.coneAxis[k] = axis[k];
+	}
+
+	// the spread of the cone is given by the normal furthest from the axis
+	float minDot = 1.0f;
+	for (uint32_t tri = 0; tri < meshlet.triangleCount; ++tri)
+	{
+		if (validNormal[tri])
+		{
+			const float *n = &normals[tri * 3];
+			minDot = std::min(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+		}
+	}
+
+	// more than a hemisphere - there is always a viewpoint from which some triangle is visible
+	if (minDot <= 0.0f)
+	{
+		return;
+	}
+
+	// the apex is moved back along the axis until it is behind the planes of all the triangles, so the test
+	// holds from any viewpoint and not just from the centre
+	float maxT = 0.0f;
+	for (uint32_t tri = 0; tri < meshlet.triangleCount; ++tri)
+	{
+		if (!validNormal[tri])
+		{
+			continue;
+		}
+
+		const float *p0 = points[meshletTriangles[tri * 3]];
+		const float *n = &normals[tri * 3];
+
+		float dc = (meshlet.center[0] - p0[0]) * n[0] + (meshlet.center[1] - p0[1]) * n[1] +
+		           (meshlet.center[2] - p0[2]) * n[2];
+		float dn = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+
+		maxT = std::max(maxT, dc / dn);
+	}
+
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		meshlet.coneApex[k] = meshlet.center[k] - axis[k] * maxT;
+	}
+
+	// the cone is tested against the view direction, so the cutoff is the sine of the cone angle
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+bool MeshletBuilder::isBackfacing(const Meshlet &meshlet, const float *eye)
+{
+	if (meshlet.coneCutoff >= 1.0f)
+	{
+		return false;
+	}
+
+	float view[3] = { meshlet.coneApex[0] - eye[0], meshlet.coneApex[1] - eye[1], meshlet.coneApex[2] - eye[2] };
+	float length = std::sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+
+	// dot(normalize(view), axis) >= cutoff without the divide
+	float dot = view[0] * meshlet.coneAxis[0] + view[1] * meshlet.coneAxis[1] + view[2] * meshlet.coneAxis[2];
+	return dot >= meshlet.coneCutoff * length;
+}
+
+} // namespace OmegaEngine
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OmegaEngine
+{
+
+// A small cluster of a primitive's triangles. The vertices are indices into the mesh's vertices, and the
+// triangles are three byte indices into the meshlet's vertices. The bounds are in model space
+struct Meshlet
+{
+	// offsets into the meshlet vertex and triangle lists - the triangle offset is in triangles
+	uint32_t vertexOffset = 0;
+	uint32_t triangleOffset = 0;
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+
+	float center[3] = { 0.0f, 0.0f, 0.0f };
+	float radius = 0.0f;
+
+	// every triangle faces away from the viewer when dot(normalize(apex - eye), axis) >= cutoff. Clusters
+	// whose normals spread over more than a hemisphere have a cutoff of 1.0 and are never culled
+	float coneApex[3] = { 0.0f, 0.0f, 0.0f };
+	float coneCutoff = 1.0f;
+	float coneAxis[3] = { 0.0f, 0.0f, 0.0f };
+};
+
+// Partitions indexed triangle lists into meshlets so they can be culled at a finer granularity than the
+// primitive. The triangles are taken in order, so the input should already be optimised for locality
+class MeshletBuilder
+{
+
+public:
+	// the triangle indices are stored as bytes, so this is the hard limit for the vertices of a meshlet
+	static constexpr uint32_t MaxVertices = 255;
+
+	struct Settings
+	{
+		uint32_t maxVertices = 64;
+		uint32_t maxTriangles = 124;
+	};
+
+	struct Stats
+	{
+		uint32_t meshlets = 0;
+		uint32_t triangles = 0;
+		uint32_t vertices = 0;
+
+		// meshlets which can't be cone culled as their normals are too spread
+		uint32_t degenerateCones = 0;
+	};
+
+	MeshletBuilder() = default;
+	MeshletBuilder(const Settings &_settings);
+
+	// appends the meshlets of a triangle list to the given lists. Positions are three floats at the given stride.
+	// Returns the number of meshlets added
+	uint32_t build(const uint32_t *indices, const size_t indexCount, const float *positions, const size_t vertexCount,
+	               const size_t positionStride, std::vector<Meshlet> &meshlets, std::vector<uint32_t> &meshletVertices,
+	               std::vector<uint8_t> &meshletTriangles);
+
+	// calculates the bounding sphere and normal cone of a meshlet from its vertices and triangles
+	static void computeBounds(Meshlet &meshlet, const uint32_t *meshletVertices, const uint8_t *meshletTriangles,
+	                          const float *positions, const size_t positionStride);
+
+	// the eye position must be in the same space as the meshlet, i.e. model space
+	static bool isBackfacing(const Meshlet &meshlet, const float *eye);
+
+	const Stats &getStats() const
+	{
+		return stats;
+	}
+
+private:
+	Settings settings;
+	Stats stats;
+};
+
+} // namespace OmegaEngine
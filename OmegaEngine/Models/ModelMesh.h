@@ -33,6 +33,14 @@ struct ModelMesh
 		OEMaths::vec4f joint;
 	};
 
+	// a coarser version of a primitive, using the same vertices. The error is relative to the radius of the primitive
+	struct Lod
+	{
+		uint32_t indexBase = 0;
+		uint32_t indexCount = 0;
+		float error = 0.0f;
+	};
+
 	struct Primitive
 	{
 		Primitive(uint32_t offset, uint32_t size, int32_t matId)
@@ -49,6 +57,9 @@ struct ModelMesh
 		// index offsets
 		uint32_t indexBase = 0;
 		uint32_t indexCount = 0;
+
+		// the simplified levels, from finest to coarsest - the indices are appended after those of all the primitives
+		std::vector<Lod> lods;
 	};
 
 	// defines the topology to use in the program state
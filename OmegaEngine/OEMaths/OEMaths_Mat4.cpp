@@ -131,15 +131,16 @@ void mat4f::setCol(const uint8_t col, vec4f &v)
 
 vec4f operator*(const mat4f &mat, const vec4f &vec)
 {
+	// column major - the same as the matrix product and the shaders
 	vec4f result;
 	result.x =
-	    mat.data[0] * vec.x + mat.data[1] * vec.y + mat.data[2] * vec.z + mat.data[3] * vec.w;
+	    mat.data[0] * vec.x + mat.data[4] * vec.y + mat.data[8] * vec.z + mat.data[12] * vec.w;
 	result.y =
-	    mat.data[4] * vec.x + mat.data[5] * vec.y + mat.data[6] * vec.z + mat.data[7] * vec.w;
+	    mat.data[1] * vec.x + mat.data[5] * vec.y + mat.data[9] * vec.z + mat.data[13] * vec.w;
 	result.z =
-	    mat.data[8] * vec.x + mat.data[9] * vec.y + mat.data[10] * vec.z + mat.data[11] * vec.w;
+	    mat.data[2] * vec.x + mat.data[6] * vec.y + mat.data[10] * vec.z + mat.data[14] * vec.w;
 	result.w =
-	    mat.data[12] * vec.x + mat.data[13] * vec.y + mat.data[14] * vec.z + mat.data[15] * vec.w;
+	    mat.data[3] * vec.x + mat.data[7] * vec.y + mat.data[11] * vec.z + mat.data[15] * vec.w;
 	return result;
 }
 
@@ -183,7 +184,7 @@ mat4f mat4f::translate(vec3f &trans)
 	mat4f result;
 	result[12] = trans.getX();
 	result[13] = trans.getY();
-	result[14] = trans.getX();
+	result[14] = trans.getZ();
 	result[15] = 1.0f;
 	return result;
 }
@@ -67,6 +67,17 @@ public:
 		data[index] = value;
 	}
 
+	// raw access for the simd batch functions
+	float *getData()
+	{
+		return data;
+	}
+
+	const float *getData() const
+	{
+		return data;
+	}
+
 private:
 	float data[16];
 };
@@ -0,0 +1,397 @@
+#include "OEMaths_simd.h"
+#include "OEMaths/OEMaths_Quat.h"
+#include "OEMaths/OEMaths_Vec3.h"
+
+#if defined(OEMATHS_USE_AVX2)
+#include <immintrin.h>
+#elif defined(OEMATHS_USE_SSE)
+#include <xmmintrin.h>
+#elif defined(OEMATHS_USE_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace OEMaths
+{
+
+uint32_t TransformArrays::add(const vec3f &translation, const vec3f &scale, const quatf &rotation)
+{
+	tx.emplace_back(translation.getX());
+	ty.emplace_back(translation.getY());
+	tz.emplace_back(translation.getZ());
+	qx.emplace_back(rotation.getX());
+	qy.emplace_back(rotation.getY());
+	qz.emplace_back(rotation.getZ());
+	qw.emplace_back(rotation.getW());
+	sx.emplace_back(scale.getX());
+	sy.emplace_back(scale.getY());
+	sz.emplace_back(scale.getZ());
+	return static_cast<uint32_t>(tx.size() - 1);
+}
+
+void TransformArrays::setTranslation(const uint32_t index, const vec3f &translation)
+{
+	tx[index] = translation.getX();
+	ty[index] = translation.getY();
+	tz[index] = translation.getZ();
+}
+
+void TransformArrays::setScale(const uint32_t index, const vec3f &scale)
+{
+	sx[index] = scale.getX();
+	sy[index] = scale.getY();
+	sz[index] = scale.getZ();
+}
+
+void TransformArrays::setRotation(const uint32_t index, const quatf &rotation)
+{
+	qx[index] = rotation.getX();
+	qy[index] = rotation.getY();
+	qz[index] = rotation.getZ();
+	qw[index] = rotation.getW();
+}
+
+// scalar versions - used for the remainder of a batch and when no simd is available
+static void composeTRS(const TransformArrays &t, const uint32_t index, float *m)
+{
+	float twoX = 2.0f * t.qx[index];
+	float twoY = 2.0f * t.qy[index];
+	float twoZ = 2.0f * t.qz[index];
+
+	float twoXX = twoX * t.qx[index];
+	float twoXY = twoX * t.qy[index];
+	float twoXZ = twoX * t.qz[index];
+	float twoXW = twoX * t.qw[index];
+	float twoYY = twoY * t.qy[index];
+	float twoYZ = twoY * t.qz[index];
+	float twoYW = twoY * t.qw[index];
+	float twoZZ = twoZ * t.qz[index];
+	float twoZW = twoZ * t.qw[index];
+
+	// the rotation columns match mat4f(quatf), each scaled by the scale component
+	m[0] = (1.0f - (twoYY + twoZZ)) * t.sx[index];
+	m[1] = (twoXY - twoZW) * t.sx[index];
+	m[2] = (twoXZ + twoYW) * t.sx[index];
+	m[3] = 0.0f;
+
+	m[4] = (twoXY + twoZW) * t.sy[index];
+	m[5] = (1.0f - (twoXX + twoZZ)) * t.sy[index];
+	m[6] = (twoYZ - twoXW) * t.sy[index];
+	m[7] = 0.0f;
+
+	m[8] = (twoXZ - twoYW) * t.sz[index];
+	m[9] = (twoYZ + twoXW) * t.sz[index];
+	m[10] = (1.0f - (twoXX + twoYY)) * t.sz[index];
+	m[11] = 0.0f;
+
+	m[12] = t.tx[index];
+	m[13] = t.ty[index];
+	m[14] = t.tz[index];
+	m[15] = 1.0f;
+}
+
+#if !defined(OEMATHS_USE_SSE) && !defined(OEMATHS_USE_NEON)
+static void multiply(const float *a, const float *b, float *out, float *gpuOut)
+{
+	float result[16];
+	for (uint8_t col = 0; col < 4; ++col)
+	{
+		for (uint8_t row = 0; row < 4; ++row)
+		{
+			result[col * 4 + row] = a[row] * b[col * 4] + a[4 + row] * b[col * 4 + 1] +
+			                        a[8 + row] * b[col * 4 + 2] + a[12 + row] * b[col * 4 + 3];
+		}
+	}
+
+	for (uint8_t i = 0; i < 16; ++i)
+	{
+		out[i] = result[i];
+	}
+	if (gpuOut)
+	{
+		for (uint8_t i = 0; i < 16; ++i)
+		{
+			gpuOut[i] = result[i];
+		}
+	}
+}
+#endif
+
+#if defined(OEMATHS_USE_SSE)
+
+static inline __m128 gather4(const std::vector<float> &v, const uint32_t *indices)
+{
+	return _mm_set_ps(v[indices[3]], v[indices[2]], v[indices[1]], v[indices[0]]);
+}
+
+// c0 - c3 hold one column for four transforms - transpose so each register holds the column of a single transform
+static inline void storeColumn4(__m128 c0, __m128 c1, __m128 c2, __m128 c3, float *const *out,
+                                const uint32_t col)
+{
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_storeu_ps(out[0] + col * 4, c0);
+	_mm_storeu_ps(out[1] + col * 4, c1);
+	_mm_storeu_ps(out[2] + col * 4, c2);
+	_mm_storeu_ps(out[3] + col * 4, c3);
+}
+
+static void composeTRS4(const TransformArrays &t, const uint32_t *indices, float *const *out)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 x = gather4(t.qx, indices);
+	__m128 y = gather4(t.qy, indices);
+	__m128 z = gather4(t.qz, indices);
+	__m128 w = gather4(t.qw, indices);
+
+	__m128 twoX = _mm_add_ps(x, x);
+	__m128 twoY = _mm_add_ps(y, y);
+	__m128 twoZ = _mm_add_ps(z, z);
+
+	__m128 twoXX = _mm_mul_ps(twoX, x);
+	__m128 twoXY = _mm_mul_ps(twoX, y);
+	__m128 twoXZ = _mm_mul_ps(twoX, z);
+	__m128 twoXW = _mm_mul_ps(twoX, w);
+	__m128 twoYY = _mm_mul_ps(twoY, y);
+	__m128 twoYZ = _mm_mul_ps(twoY, z);
+	__m128 twoYW = _mm_mul_ps(twoY, w);
+	__m128 twoZZ = _mm_mul_ps(twoZ, z);
+	__m128 twoZW = _mm_mul_ps(twoZ, w);
+
+	__m128 sx = gather4(t.sx, indices);
+	__m128 sy = gather4(t.sy, indices);
+	__m128 sz = gather4(t.sz, indices);
+
+	storeColumn4(_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(twoYY, twoZZ)), sx),
+	             _mm_mul_ps(_mm_sub_ps(twoXY, twoZW), sx), _mm_mul_ps(_mm_add_ps(twoXZ, twoYW), sx),
+	             zero, out, 0);
+	storeColumn4(_mm_mul_ps(_mm_add_ps(twoXY, twoZW), sy),
+	             _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(twoXX, twoZZ)), sy),
+	             _mm_mul_ps(_mm_sub_ps(twoYZ, twoXW), sy), zero, out, 1);
+	storeColumn4(_mm_mul_ps(_mm_sub_ps(twoXZ, twoYW), sz), _mm_mul_ps(_mm_add_ps(twoYZ, twoXW), sz),
+	             _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(twoXX, twoYY)), sz), zero, out, 2);
+	storeColumn4(gather4(t.tx, indices), gather4(t.ty, indices), gather4(t.tz, indices), one, out,
+	             3);
+}
+
+static inline void multiplySse(const float *a, const float *b, float *out, float *gpuOut)
+{
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+
+	__m128 result[4];
+	for (uint8_t col = 0; col < 4; ++col)
+	{
+		// each column of the result is a linear combination of the columns of a
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[col * 4]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[col * 4 + 1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[col * 4 + 2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[col * 4 + 3])));
+		result[col] = r;
+	}
+
+	for (uint8_t col = 0; col < 4; ++col)
+	{
+		_mm_storeu_ps(out + col * 4, result[col]);
+	}
+	if (gpuOut)
+	{
+		for (uint8_t col = 0; col < 4; ++col)
+		{
+			_mm_storeu_ps(gpuOut + col * 4, result[col]);
+		}
+	}
+}
+
+#endif
+
+#if defined(OEMATHS_USE_AVX2)
+
+#if defined(__FMA__)
+#define OEMATHS_FMADD256(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define OEMATHS_FMADD256(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+
+static inline __m256 gather8(const std::vector<float> &v, const uint32_t *indices)
+{
+	return _mm256_set_ps(v[indices[7]], v[indices[6]], v[indices[5]], v[indices[4]], v[indices[3]],
+	                     v[indices[2]], v[indices[1]], v[indices[0]]);
+}
+
+static inline void storeColumn8(__m256 c0, __m256 c1, __m256 c2, __m256 c3, float *const *out,
+                                const uint32_t col)
+{
+	storeColumn4(_mm256_castps256_ps128(c0), _mm256_castps256_ps128(c1),
+	             _mm256_castps256_ps128(c2), _mm256_castps256_ps128(c3), out, col);
+	storeColumn4(_mm256_extractf128_ps(c0, 1), _mm256_extractf128_ps(c1, 1),
+	             _mm256_extractf128_ps(c2, 1), _mm256_extractf128_ps(c3, 1), out + 4, col);
+}
+
+static void composeTRS8(const TransformArrays &t, const uint32_t *indices, float *const *out)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 x = gather8(t.qx, indices);
+	__m256 y = gather8(t.qy, indices);
+	__m256 z = gather8(t.qz, indices);
+	__m256 w = gather8(t.qw, indices);
+
+	__m256 twoX = _mm256_add_ps(x, x);
+	__m256 twoY = _mm256_add_ps(y, y);
+	__m256 twoZ = _mm256_add_ps(z, z);
+
+	__m256 twoXX = _mm256_mul_ps(twoX, x);
+	__m256 twoXY = _mm256_mul_ps(twoX, y);
+	__m256 twoXZ = _mm256_mul_ps(twoX, z);
+	__m256 twoXW = _mm256_mul_ps(twoX, w);
+	__m256 twoYY = _mm256_mul_ps(twoY, y);
+	__m256 twoYZ = _mm256_mul_ps(twoY, z);
+	__m256 twoYW = _mm256_mul_ps(twoY, w);
+	__m256 twoZZ = _mm256_mul_ps(twoZ, z);
+	__m256 twoZW = _mm256_mul_ps(twoZ, w);
+
+	__m256 sx = gather8(t.sx, indices);
+	__m256 sy = gather8(t.sy, indices);
+	__m256 sz = gather8(t.sz, indices);
+
+	storeColumn8(_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(twoYY, twoZZ)), sx),
+	             _mm256_mul_ps(_mm256_sub_ps(twoXY, twoZW), sx),
+	             _mm256_mul_ps(_mm256_add_ps(twoXZ, twoYW), sx), zero, out, 0);
+	storeColumn8(_mm256_mul_ps(_mm256_add_ps(twoXY, twoZW), sy),
+	             _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(twoXX, twoZZ)), sy),
+	             _mm256_mul_ps(_mm256_sub_ps(twoYZ, twoXW), sy), zero, out, 1);
+	storeColumn8(_mm256_mul_ps(_mm256_sub_ps(twoXZ, twoYW), sz),
+	             _mm256_mul_ps(_mm256_add_ps(twoYZ, twoXW), sz),
+	             _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(twoXX, twoYY)), sz), zero, out, 2);
+	storeColumn8(gather8(t.tx, indices), gather8(t.ty, indices), gather8(t.tz, indices), one, out,
+	             3);
+}
+
+static inline __m256 combine(const __m128 lo, const __m128 hi)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+// two matrix multiplies at once - the lower half of each register holds the first matrix, the upper half the second
+static void multiplyAvx2(const float *const *a, const float *const *b, float *const *out,
+                         float *const *gpuOut)
+{
+	__m256 a0 = combine(_mm_loadu_ps(a[0]), _mm_loadu_ps(a[1]));
+	__m256 a1 = combine(_mm_loadu_ps(a[0] + 4), _mm_loadu_ps(a[1] + 4));
+	__m256 a2 = combine(_mm_loadu_ps(a[0] + 8), _mm_loadu_ps(a[1] + 8));
+	__m256 a3 = combine(_mm_loadu_ps(a[0] + 12), _mm_loadu_ps(a[1] + 12));
+
+	__m256 result[4];
+	for (uint8_t col = 0; col < 4; ++col)
+	{
+		const float *b0 = b[0] + col * 4;
+		const float *b1 = b[1] + col * 4;
+
+		__m256 r = _mm256_mul_ps(a0, combine(_mm_set1_ps(b0[0]), _mm_set1_ps(b1[0])));
+		r = OEMATHS_FMADD256(a1, combine(_mm_set1_ps(b0[1]), _mm_set1_ps(b1[1])), r);
+		r = OEMATHS_FMADD256(a2, combine(_mm_set1_ps(b0[2]), _mm_set1_ps(b1[2])), r);
+		r = OEMATHS_FMADD256(a3, combine(_mm_set1_ps(b0[3]), _mm_set1_ps(b1[3])), r);
+		result[col] = r;
+	}
+
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		for (uint8_t col = 0; col < 4; ++col)
+		{
+			__m128 c = i == 0 ? _mm256_castps256_ps128(result[col]) :
+			                    _mm256_extractf128_ps(result[col], 1);
+			_mm_storeu_ps(out[i] + col * 4, c);
+			if (gpuOut[i])
+			{
+				_mm_storeu_ps(gpuOut[i] + col * 4, c);
+			}
+		}
+	}
+}
+
+#endif
+
+#if defined(OEMATHS_USE_NEON)
+
+static inline void multiplyNeon(const float *a, const float *b, float *out, float *gpuOut)
+{
+	float32x4_t a0 = vld1q_f32(a);
+	float32x4_t a1 = vld1q_f32(a + 4);
+	float32x4_t a2 = vld1q_f32(a + 8);
+	float32x4_t a3 = vld1q_f32(a + 12);
+
+	float32x4_t result[4];
+	for (uint8_t col = 0; col < 4; ++col)
+	{
+		float32x4_t r = vmulq_n_f32(a0, b[col * 4]);
+		r = vmlaq_n_f32(r, a1, b[col * 4 + 1]);
+		r = vmlaq_n_f32(r, a2, b[col * 4 + 2]);
+		r = vmlaq_n_f32(r, a3, b[col * 4 + 3]);
+		result[col] = r;
+	}
+
+	for (uint8_t col = 0; col < 4; ++col)
+	{
+		vst1q_f32(out + col * 4, result[col]);
+		if (gpuOut)
+		{
+			vst1q_f32(gpuOut + col * 4, result[col]);
+		}
+	}
+}
+
+#endif
+
+void batchComposeTRS(const TransformArrays &transforms, const uint32_t *indices,
+                     const uint32_t count, float *const *out)
+{
+	uint32_t i = 0;
+
+#if defined(OEMATHS_USE_AVX2)
+	for (; i + 8 <= count; i += 8)
+	{
+		composeTRS8(transforms, indices + i, out + i);
+	}
+#endif
+#if defined(OEMATHS_USE_SSE)
+	for (; i + 4 <= count; i += 4)
+	{
+		composeTRS4(transforms, indices + i, out + i);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		composeTRS(transforms, indices[i], out[i]);
+	}
+}
+
+void batchMultiply(const float *const *parents, const float *const *locals, float *const *out,
+                   float *const *gpuOut, const uint32_t count)
+{
+	uint32_t i = 0;
+
+#if defined(OEMATHS_USE_AVX2)
+	for (; i + 2 <= count; i += 2)
+	{
+		multiplyAvx2(parents + i, locals + i, out + i, gpuOut + i);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+#if defined(OEMATHS_USE_SSE)
+		multiplySse(parents[i], locals[i], out[i], gpuOut[i]);
+#elif defined(OEMATHS_USE_NEON)
+		multiplyNeon(parents[i], locals[i], out[i], gpuOut[i]);
+#else
+		multiply(parents[i], locals[i], out[i], gpuOut[i]);
+#endif
+	}
+}
+
+} // namespace OEMaths
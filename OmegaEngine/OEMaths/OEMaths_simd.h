@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Select the widest instruction set available at compile time. AVX2 must be enabled explicitly
+// through the compiler flags (see OMEGA_ENABLE_AVX2), SSE2 is always available on x64
+#if defined(__AVX2__)
+#define OEMATHS_USE_AVX2 1
+#define OEMATHS_USE_SSE 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OEMATHS_USE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OEMATHS_USE_NEON 1
+#endif
+
+namespace OEMaths
+{
+class vec3f;
+class quatf;
+
+// Decomposed transforms stored as a structure of arrays, so batches of transforms can be
+// loaded straight into simd registers
+struct TransformArrays
+{
+	uint32_t add(const vec3f &translation, const vec3f &scale, const quatf &rotation);
+
+	void setTranslation(const uint32_t index, const vec3f &translation);
+	void setScale(const uint32_t index, const vec3f &scale);
+	void setRotation(const uint32_t index, const quatf &rotation);
+
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(tx.size());
+	}
+
+	std::vector<float> tx, ty, tz;
+	std::vector<float> qx, qy, qz, qw;
+	std::vector<float> sx, sy, sz;
+};
+
+// Composes translate * rotate * scale for each index directly from the quaternion, without
+// building the intermediate matrices. Each output is a column-major 4x4 matrix - i.e. a mat4f
+void batchComposeTRS(const TransformArrays &transforms, const uint32_t *indices,
+                     const uint32_t count, float *const *out);
+
+// out[i] = parents[i] * locals[i]. If gpuOut[i] is not null, the result is also written there
+// (for instance, the aligned buffer which will be uploaded to the gpu)
+void batchMultiply(const float *const *parents, const float *const *locals, float *const *out,
+                   float *const *gpuOut, const uint32_t count);
+
+} // namespace OEMaths
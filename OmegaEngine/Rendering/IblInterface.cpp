@@ -149,8 +149,8 @@ void IblInterface::createSpecularMap(VulkanAPI::Interface &vkInterface)
 	renderPass.prepareFramebuffer(offscreenTexture.getImageView(), specularMapDim, specularMapDim);
 
 	// prepare the shader
-	if (!state.shader.add(vkInterface.getDevice(), "env/PreFilter/specularmap-vert.spv",
-	                      VulkanAPI::StageType::Vertex, "env/PreFilter/specularmap-frag.spv",
+	if (!state.shader.add(vkInterface.getDevice(), "Env/PreFilter/specularmap-vert.spv",
+	                      VulkanAPI::StageType::Vertex, "Env/PreFilter/specularmap-frag.spv",
 	                      VulkanAPI::StageType::Fragment))
 	{
 		LOGGER_ERROR("Error. Unable to open specular map shader.\n");
@@ -299,8 +299,8 @@ void IblInterface::createIrradianceMap(VulkanAPI::Interface &vkInterface)
 	                              irradianceMapDim);
 
 	// prepare the shader
-	if (!state.shader.add(vkInterface.getDevice(), "env/irradiance/irradiance_map-vert.spv",
-	                      VulkanAPI::StageType::Vertex, "env/irradiance/irradiance_map-frag.spv",
+	if (!state.shader.add(vkInterface.getDevice(), "Env/Irradiance/irradiance_map-vert.spv",
+	                      VulkanAPI::StageType::Vertex, "Env/Irradiance/irradiance_map-frag.spv",
 	                      VulkanAPI::StageType::Fragment))
 	{
 		LOGGER_ERROR("Error. Unable to open irradiance map shader.\n");
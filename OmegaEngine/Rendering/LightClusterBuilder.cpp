@@ -0,0 +1,272 @@
+#include "LightClusterBuilder.h"
+#include "OEMaths/OEMaths_Mat4.h"
+#include "OEMaths/OEMaths_simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(OEMATHS_USE_SSE)
+#include <xmmintrin.h>
+#endif
+
+namespace OmegaEngine
+{
+
+LightClusterBuilder::LightClusterBuilder()
+{
+	clusters.resize(ClusterCount);
+}
+
+bool LightClusterBuilder::setProjection(const OEMaths::mat4f &projection, const float nearPlane, const float farPlane)
+{
+	const float *data = projection.getData();
+	if (data[0] == projScaleX && data[5] == projScaleY && nearPlane == zNear && farPlane == zFar)
+	{
+		return false;
+	}
+
+	projScaleX = data[0];
+	projScaleY = data[5];
+	zNear = nearPlane;
+	zFar = farPlane;
+
+	// slice k starts at near * (far / near)^(k / GridZ)
+	float logRatio = std::log(zFar / zNear);
+	sliceScale = static_cast<float>(GridZ) / logRatio;
+	sliceBias = -static_cast<float>(GridZ) * std::log(zNear) / logRatio;
+
+	buildBounds();
+	return true;
+}
+
+void LightClusterBuilder::buildBounds()
+{
+	for (auto *v : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ, &centerX, &centerY, &centerZ, &radius })
+	{
+		v->resize(ClusterCount);
+	}
+
+	for (uint32_t slice = 0; slice < GridZ; ++slice)
+	{
+		float z0 = zNear * std::pow(zFar / zNear, static_cast<float>(slice) / GridZ);
+		float z1 = zNear * std::pow(zFar / zNear, static_cast<float>(slice + 1) / GridZ);
+
+		for (uint32_t y = 0; y < GridY; ++y)
+		{
+			float ndcY0 = static_cast<float>(y) / GridY * 2.0f - 1.0f;
+			float ndcY1 = static_cast<float>(y + 1) / GridY * 2.0f - 1.0f;
+
+			for (uint32_t x = 0; x < GridX; ++x)
+			{
+				float ndcX0 = static_cast<float>(x) / GridX * 2.0f - 1.0f;
+				float ndcX1 = static_cast<float>(x + 1) / GridX * 2.0f - 1.0f;
+
+				// the tile widens with depth, so the extents lie on the corners at the near or far plane of the
+				// slice. Dividing by the projection scale also takes care of a flipped y axis
+				float xs[4] = { ndcX0 * z0, ndcX1 * z0, ndcX0 * z1, ndcX1 * z1 };
+				float ys[4] = { ndcY0 * z0, ndcY1 * z0, ndcY0 * z1, ndcY1 * z1 };
+				for (uint32_t k = 0; k < 4; ++k)
+				{
+					xs[k] /= projScaleX;
+					ys[k] /= projScaleY;
+				}
+
+				uint32_t index = (slice * GridY + y) * GridX + x;
+				minX[index] = *std::min_element(xs, xs + 4);
+				maxX[index] = *std::max_element(xs, xs + 4);
+				minY[index] = *std::min_element(ys, ys + 4);
+				maxY[index] = *std::max_element(ys, ys + 4);
+				minZ[index] = z0;
+				maxZ[index] = z1;
+
+				float hx = (maxX[index] - minX[index]) * 0.5f;
+				float hy = (maxY[index] - minY[index]) * 0.5f;
+				float hz = (z1 - z0) * 0.5f;
+				centerX[index] = minX[index] + hx;
+				centerY[index] = minY[index] + hy;
+				centerZ[index] = z0 + hz;
+				radius[index] = std::sqrt(hx * hx + hy * hy + hz * hz);
+			}
+		}
+	}
+}
+
+uint32_t LightClusterBuilder::getSlice(const float z) const
+{
+	if (z <= zNear)
+	{
+		return 0;
+	}
+	float slice = std::log(z) * sliceScale + sliceBias;
+	return std::min(static_cast<uint32_t>(slice), GridZ - 1);
+}
+
+#if defined(OEMATHS_USE_SSE)
+
+void LightClusterBuilder::cullSlice(const uint32_t slice, const ViewLight &light)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 px = _mm_set1_ps(light.position[0]);
+	const __m128 py = _mm_set1_ps(light.position[1]);
+	const __m128 pz = _mm_set1_ps(light.position[2]);
+	const __m128 rangeSq = _mm_set1_ps(light.range * light.range);
+
+	const bool cone = light.cosAngle > 0.0f;
+	const __m128 ax = _mm_set1_ps(light.axis[0]);
+	const __m128 ay = _mm_set1_ps(light.axis[1]);
+	const __m128 az = _mm_set1_ps(light.axis[2]);
+	const __m128 cosAngle = _mm_set1_ps(light.cosAngle);
+	const __m128 sinAngle = _mm_set1_ps(light.sinAngle);
+	const __m128 range = _mm_set1_ps(light.range);
+
+	const uint32_t first = slice * TileCount;
+	for (uint32_t i = first; i < first + TileCount; i += 4)
+	{
+		// the squared distance from the light to the closest point of each aabb
+		__m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[i]), px), _mm_sub_ps(px, _mm_loadu_ps(&maxX[i])));
+		__m128 dy = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[i]), py), _mm_sub_ps(py, _mm_loadu_ps(&maxY[i])));
+		__m128 dz = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[i]), pz), _mm_sub_ps(pz, _mm_loadu_ps(&maxZ[i])));
+		dx = _mm_max_ps(dx, zero);
+		dy = _mm_max_ps(dy, zero);
+		dz = _mm_max_ps(dz, zero);
+
+		__m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 hit = _mm_cmple_ps(distSq, rangeSq);
+
+		if (cone && _mm_movemask_ps(hit))
+		{
+			// the cone against the bounding sphere of each cluster - the distance from the centre to the cone
+			// surface is along the perpendicular of the axis, less the part along the axis
+			__m128 r = _mm_loadu_ps(&radius[i]);
+			__m128 vx = _mm_sub_ps(_mm_loadu_ps(&centerX[i]), px);
+			__m128 vy = _mm_sub_ps(_mm_loadu_ps(&centerY[i]), py);
+			__m128 vz = _mm_sub_ps(_mm_loadu_ps(&centerZ[i]), pz);
+
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+			__m128 alongAxis = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, ax), _mm_mul_ps(vy, ay)), _mm_mul_ps(vz, az));
+			__m128 perp = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(alongAxis, alongAxis)), zero));
+			__m128 closest = _mm_sub_ps(_mm_mul_ps(cosAngle, perp), _mm_mul_ps(alongAxis, sinAngle));
+
+			__m128 inside = _mm_cmple_ps(closest, r);
+			inside = _mm_and_ps(inside, _mm_cmple_ps(alongAxis, _mm_add_ps(range, r)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(alongAxis, _mm_sub_ps(zero, r)));
+			hit = _mm_and_ps(hit, inside);
+		}
+
+		int mask = _mm_movemask_ps(hit);
+		while (mask)
+		{
+			uint32_t lane = 0;
+			while (!(mask & (1 << lane)))
+			{
+				++lane;
+			}
+			hits.emplace_back(i + lane);
+			mask &= mask - 1;
+		}
+	}
+}
+
+#else
+
+void LightClusterBuilder::cullSlice(const uint32_t slice, const ViewLight &light)
+{
+	const bool cone = light.cosAngle > 0.0f;
+	const float rangeSq = light.range * light.range;
+
+	const uint32_t first = slice * TileCount;
+	for (uint32_t i = first; i < first + TileCount; ++i)
+	{
+		float dx = std::max(std::max(minX[i] - light.position[0], light.position[0] - maxX[i]), 0.0f);
+		float dy = std::max(std::max(minY[i] - light.position[1], light.position[1] - maxY[i]), 0.0f);
+		float dz = std::max(std::max(minZ[i] - light.position[2], light.position[2] - maxZ[i]), 0.0f);
+		if (dx * dx + dy * dy + dz * dz > rangeSq)
+		{
+			continue;
+		}
+
+		if (cone)
+		{
+			float vx = centerX[i] - light.position[0];
+			float vy = centerY[i] - light.position[1];
+			float vz = centerZ[i] - light.position[2];
+
+			float lengthSq = vx * vx + vy * vy + vz * vz;
+			float alongAxis = vx * light.axis[0] + vy * light.axis[1] + vz * light.axis[2];
+			float perp = std::sqrt(std::max(lengthSq - alongAxis * alongAxis, 0.0f));
+			float closest = light.cosAngle * perp - alongAxis * light.sinAngle;
+
+			if (closest > radius[i] || alongAxis > light.range + radius[i] || alongAxis < -radius[i])
+			{
+				continue;
+			}
+		}
+
+		hits.emplace_back(i);
+	}
+}
+
+#endif
+
+void LightClusterBuilder::build(const std::vector<ViewLight> &lights)
+{
+	stats = Stats();
+	stats.lights = static_cast<uint32_t>(lights.size());
+
+	hits.clear();
+	hitOffsets.resize(lights.size() + 1);
+
+	for (uint32_t i = 0; i < lights.size(); ++i)
+	{
+		const ViewLight &light = lights[i];
+		hitOffsets[i] = static_cast<uint32_t>(hits.size());
+
+		// only the slices the light's depth range overlaps are tested
+		float lightNear = light.position[2] - light.range;
+		float lightFar = light.position[2] + light.range;
+		if (lightFar <= zNear || lightNear >= zFar || light.range <= 0.0f)
+		{
+			continue;
+		}
+
+		uint32_t lastSlice = getSlice(lightFar);
+		for (uint32_t slice = getSlice(lightNear); slice <= lastSlice; ++slice)
+		{
+			cullSlice(slice, light);
+		}
+	}
+	hitOffsets[lights.size()] = static_cast<uint32_t>(hits.size());
+
+	// count the lights in each cluster, then give each cluster its run of the index list
+	std::fill(clusters.begin(), clusters.end(), ClusterRange{});
+	for (uint32_t cluster : hits)
+	{
+		++clusters[cluster].count;
+	}
+
+	uint32_t offset = 0;
+	for (ClusterRange &cluster : clusters)
+	{
+		cluster.offset = offset;
+		offset += cluster.count;
+
+		stats.occupiedClusters += cluster.count > 0 ? 1 : 0;
+		stats.maxClusterLights = std::max(stats.maxClusterLights, cluster.count);
+		cluster.count = 0;
+	}
+
+	// the lights are visited in order, so each list ends up sorted
+	lightIndices.resize(hits.size());
+	for (uint32_t i = 0; i < lights.size(); ++i)
+	{
+		for (uint32_t hit = hitOffsets[i]; hit < hitOffsets[i + 1]; ++hit)
+		{
+			ClusterRange &cluster = clusters[hits[hit]];
+			lightIndices[cluster.offset + cluster.count++] = i;
+		}
+	}
+
+	stats.lightIndices = static_cast<uint32_t>(lightIndices.size());
+}
+
+} // namespace OmegaEngine
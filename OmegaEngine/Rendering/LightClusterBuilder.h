@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace OEMaths
+{
+class mat4f;
+}
+
+namespace OmegaEngine
+{
+
+// Bins point and spot lights into a froxel grid - screen tiles split into exponentially spaced depth slices - so the
+// lighting pass only has to consider the lights that reach the cluster a pixel lies in. Everything is worked out in
+// view space, with the cluster bounds only rebuilt when the projection changes. The lights are tested against four
+// clusters at a time
+class LightClusterBuilder
+{
+
+public:
+	// these must match the deferred shader
+	static constexpr uint32_t GridX = 16;
+	static constexpr uint32_t GridY = 9;
+	static constexpr uint32_t GridZ = 24;
+
+	static constexpr uint32_t TileCount = GridX * GridY;
+	static constexpr uint32_t ClusterCount = TileCount * GridZ;
+
+	// the entries of a cluster in the light index list
+	struct ClusterRange
+	{
+		uint32_t offset = 0;
+		uint32_t count = 0;
+	};
+
+	// a light in view space. Spot lights also give the axis and the outer angle of their cone - a cosine of zero or
+	// less, which is a hemisphere or wider, is culled as a sphere
+	struct ViewLight
+	{
+		float position[3];
+		float range = 0.0f;
+
+		float axis[3] = { 0.0f, 0.0f, 1.0f };
+		float cosAngle = 0.0f;
+		float sinAngle = 1.0f;
+	};
+
+	struct Stats
+	{
+		uint32_t lights = 0;
+		uint32_t lightIndices = 0;
+		uint32_t occupiedClusters = 0;
+		uint32_t maxClusterLights = 0;
+	};
+
+	LightClusterBuilder();
+
+	// rebuilds the cluster bounds if the projection or depth range has changed - returns true if they were
+	bool setProjection(const OEMaths::mat4f &projection, const float nearPlane, const float farPlane);
+
+	// the cluster lists hold indices into the given lights, in ascending order
+	void build(const std::vector<ViewLight> &lights);
+
+	const std::vector<ClusterRange> &getClusters() const
+	{
+		return clusters;
+	}
+
+	const std::vector<uint32_t> &getLightIndices() const
+	{
+		return lightIndices;
+	}
+
+	// the slice of a view space depth is log(z) * scale + bias
+	float getSliceScale() const
+	{
+		return sliceScale;
+	}
+
+	float getSliceBias() const
+	{
+		return sliceBias;
+	}
+
+	// the x and y scales of the projection, used by the shader to find the tile of a view space position
+	float getProjScaleX() const
+	{
+		return projScaleX;
+	}
+
+	float getProjScaleY() const
+	{
+		return projScaleY;
+	}
+
+	const Stats &getStats() const
+	{
+		return stats;
+	}
+
+private:
+	void buildBounds();
+
+	uint32_t getSlice(const float z) const;
+
+	// appends the clusters of a slice that the light reaches to the hit list
+	void cullSlice(const uint32_t slice, const ViewLight &light);
+
+private:
+	float projScaleX = 0.0f;
+	float projScaleY = 0.0f;
+	float zNear = 0.0f;
+	float zFar = 0.0f;
+
+	float sliceScale = 0.0f;
+	float sliceBias = 0.0f;
+
+	// the view space aabb and bounding sphere of each cluster, as a structure of arrays
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+	std::vector<float> centerX, centerY, centerZ, radius;
+
+	// the clusters reached by each light in turn - hitOffsets has an extra entry for the end of the last light
+	std::vector<uint32_t> hits;
+	std::vector<uint32_t> hitOffsets;
+
+	std::vector<ClusterRange> clusters;
+	std::vector<uint32_t> lightIndices;
+
+	Stats stats;
+};
+
+} // namespace OmegaEngine
@@ -58,12 +58,25 @@ enum class StateFill
 	WireFrame
 };
 
+// the packed variants use the compact vertex layouts - see MeshManager::PackedVertex
 enum class StateMesh
 {
 	Static,
-	Skinned
+	Skinned,
+	StaticPacked,
+	SkinnedPacked
 };
 
+inline bool isSkinnedMesh(const StateMesh mesh)
+{
+	return mesh == StateMesh::Skinned || mesh == StateMesh::SkinnedPacked;
+}
+
+inline bool isPackedMesh(const StateMesh mesh)
+{
+	return mesh == StateMesh::StaticPacked || mesh == StateMesh::SkinnedPacked;
+}
+
 struct StateId
 {
 	StateId() = default;
@@ -118,7 +131,7 @@ struct StateEqual
 	bool operator()(const StateId& lhs, const StateId& rhs) const
 	{
 		return lhs.type == rhs.type && lhs.flags.topology == rhs.flags.topology && lhs.flags.alpha == rhs.flags.alpha &&
-		       lhs.flags.fill == rhs.flags.fill;
+		       lhs.flags.fill == rhs.flags.fill && lhs.flags.mesh == rhs.flags.mesh;
 	}
 };
 
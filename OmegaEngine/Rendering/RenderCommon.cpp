@@ -18,7 +18,7 @@ namespace Rendering
 {
 void renderObjects(std::unique_ptr<RenderQueue> &renderQueue, VulkanAPI::RenderPass &renderpass,
                    std::unique_ptr<VulkanAPI::CommandBuffer> &cmdBuffer, QueueType type,
-                   RenderConfig &renderConfig, bool clearAttachment)
+                   RenderConfig &renderConfig, bool clearAttachment, const QueuePrologue &prologue)
 {
 
 	// sort by the set order - layer, shader, material and depth
@@ -44,7 +44,7 @@ void renderObjects(std::unique_ptr<RenderQueue> &renderQueue, VulkanAPI::RenderP
 	cmdBuffer->beginRenderpass(beginInfo, true);
 
 	// now draw everything in the designated queue
-	renderQueue->threadedDispatch(cmdBuffer, type);
+	renderQueue->threadedDispatch(cmdBuffer, type, prologue);
 
 	// end the primary pass and buffer
 	cmdBuffer->endRenderpass();
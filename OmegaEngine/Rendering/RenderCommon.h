@@ -1,5 +1,6 @@
 #pragma once
 #include "Rendering/ProgramStateManager.h"
+#include "Rendering/RenderQueue.h"
 #include "VulkanAPI/CommandBuffer.h"
 #include "VulkanAPI/CommandBufferManager.h"
 #include "VulkanAPI/Datatypes/Texture.h"
@@ -24,9 +25,10 @@ struct RenderConfig;
 
 namespace Rendering
 {
+// the prologue, if given, is recorded within the pass before any of the queue is drawn
 void renderObjects(std::unique_ptr<RenderQueue> &renderQueue, VulkanAPI::RenderPass &renderpass,
                    std::unique_ptr<VulkanAPI::CommandBuffer> &cmdBuffer, QueueType type,
-                   RenderConfig &renderConfig, bool clearAttachment);
+                   RenderConfig &renderConfig, bool clearAttachment, const QueuePrologue &prologue = nullptr);
 }
 
 class PresentationPass
@@ -28,5 +28,21 @@ void RenderConfig::load()
 		int renderer = doc["Renderer"].GetInt();
 		general.renderer = static_cast<RendererType>(renderer);
 	}
+	if (doc.HasMember("ComputeSkinning"))
+	{
+		general.useComputeSkinning = doc["ComputeSkinning"].GetBool();
+	}
+	if (doc.HasMember("PackedVertices"))
+	{
+		general.usePackedVertices = doc["PackedVertices"].GetBool();
+	}
+	if (doc.HasMember("LodScreenError"))
+	{
+		general.lodScreenError = doc["LodScreenError"].GetFloat();
+	}
+	if (doc.HasMember("LodBias"))
+	{
+		general.lodBias = doc["LodBias"].GetFloat();
+	}
 }
 } // namespace OmegaEngine
\ No newline at end of file
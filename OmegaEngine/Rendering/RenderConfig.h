@@ -25,6 +25,19 @@ struct RenderConfig
 		bool sortRenderQueue = true;
 		bool hasIblImages = false;
 
+		// skin the skinned meshes once per frame in a compute pass rather than in each pass's vertex shader
+		bool useComputeSkinning = true;
+
+		// use the compact vertex layouts - less than half the size of the float layouts, which cuts the vertex
+		// fetch bandwidth of the gbuffer and shadow passes
+		bool usePackedVertices = false;
+
+		// the largest simplification error allowed on screen, as a fraction of half the screen height, when
+		// choosing a mesh's level of detail. The bias scales this in powers of two - positive values use coarser
+		// levels sooner
+		float lodScreenError = 0.002f;
+		float lodBias = 0.0f;
+
 	} general;
 
 	struct Deferred
@@ -58,9 +71,8 @@ struct RenderConfig
 		bool fogEnabled = true;
 	} postProcess;
 
-	// shadows
-	uint32_t shadowWidth = 2048;
-	uint32_t shadowHeight = 2048;
+	// shadows - all lights share the one square atlas, which must be a power of two in size
+	uint32_t shadowAtlasSize = 4096;
 	vk::Format shadowFormat = vk::Format::eD16Unorm;
 
 	float biasConstant = 1.25f;
@@ -18,6 +18,7 @@
 #include "Rendering/ProgramStateManager.h"
 #include "Rendering/RenderQueue.h"
 #include "Rendering/Renderers/DeferredRenderer.h"
+#include "Rendering/SkinningPass.h"
 #include "Threading/ThreadPool.h"
 #include "Utility/FileUtil.h"
 #include "Utility/logger.h"
@@ -28,6 +29,8 @@
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 
+#include <cmath>
+
 namespace OmegaEngine
 {
 RenderInterface::RenderInterface()
@@ -76,6 +79,17 @@ void RenderInterface::init(std::unique_ptr<VulkanAPI::Device>& device, const uin
 
 void RenderInterface::initRenderer(std::unique_ptr<ComponentInterface>& componentInterface)
 {
+	// the skinning pass must be created before the renderer so its cmd buffer is submitted first
+	if (renderConfig.general.useComputeSkinning)
+	{
+		skinningPass = std::make_unique<SkinningPass>(*vkInterface);
+	}
+
+	// the compute skinning pass reads the float layout, so only skinned meshes drawn by the vertex shader are packed
+	bool usePacking = renderConfig.general.usePackedVertices;
+	componentInterface->getManager<MeshManager>().setVertexPacking(
+	    usePacking, usePacking && !renderConfig.general.useComputeSkinning);
+
 	// setup the renderer pipeline
 	switch (static_cast<RendererType>(renderConfig.general.renderer))
 	{
@@ -89,6 +103,10 @@ void RenderInterface::initRenderer(std::unique_ptr<ComponentInterface>& componen
 		             "is supported.");
 		break;
 	}
+
+	auto& lightManager = componentInterface->getManager<LightManager>();
+	lightManager.setShadowAtlasSize(renderConfig.shadowAtlasSize);
+	renderer->setLightManager(&lightManager);
 }
 
 void RenderInterface::buildRenderableMeshTree(Object& obj, std::unique_ptr<ComponentInterface>& componentInterface,
@@ -101,6 +119,13 @@ void RenderInterface::buildRenderableMeshTree(Object& obj, std::unique_ptr<Compo
 	{
 		auto& mesh = meshManager.getMesh(obj.getComponent<MeshComponent>());
 
+		// skinned meshes are skinned once per frame by the compute pass and then drawn as static meshes
+		if (skinningPass && mesh.type == StateMesh::Skinned && !mesh.computeSkinned)
+		{
+			mesh.computeSkinned = true;
+			skinningPass->addMesh(*vkInterface, mesh, obj.getComponent<SkinnedComponent>().dynamicUboOffset);
+		}
+
 		// we need to add all the primitve sub meshes as renderables
 		for (auto& primitive : mesh.primitives)
 		{
@@ -110,9 +135,14 @@ void RenderInterface::buildRenderableMeshTree(Object& obj, std::unique_ptr<Compo
 			// if using shadows, then draw the meshes into the offscreen depth buffer too
 			if (obj.hasComponent<ShadowComponent>())
 			{
-				addRenderable<RenderableShadow>(stateManager, vkInterface, obj.getComponent<ShadowComponent>(), mesh,
-				                                primitive, lightManager.getLightCount(),
-				                                lightManager.getAlignmentSize(), renderer);
+				uint32_t shadowIndex =
+				    addRenderable<RenderableShadow>(stateManager, vkInterface, obj.getComponent<ShadowComponent>(),
+				                                    mesh, primitive, obj, lightManager, renderer);
+
+				// the shadow is drawn at the level of detail selected for the mesh
+				RenderableBase* meshRenderable = getRenderable(meshIndex).renderable;
+				static_cast<RenderableShadow*>(getRenderable(shadowIndex).renderable)
+				    ->setMeshInstance(meshRenderable->getInstanceData<RenderableMesh::MeshInstance>());
 			}
 		}
 	}
@@ -150,14 +180,94 @@ void RenderInterface::updateRenderables(std::unique_ptr<ObjectManager>& objectMa
 
 		isDirty = false;
 	}
+
+	updateLods(componentInterface);
+	updateShadowCasters(componentInterface);
+}
+
+void RenderInterface::updateLods(std::unique_ptr<ComponentInterface>& componentInterface)
+{
+	auto& cameraManager = componentInterface->getManager<CameraManager>();
+	auto& transformManager = componentInterface->getManager<TransformManager>();
+
+	const float projectionScale = std::abs(cameraManager.getProjection().getData()[5]);
+	const float maxScreenError = renderConfig.general.lodScreenError * std::exp2(renderConfig.general.lodBias);
+	const OEMaths::vec3f cameraPos = cameraManager.getPosition();
+
+	bool lodChanged = false;
+	for (auto& info : renderables)
+	{
+		if (info.renderable->getRenderType() == RenderTypes::StaticMesh)
+		{
+			auto mesh = static_cast<RenderableMesh*>(info.renderable);
+			lodChanged |= mesh->updateLod(transformManager, cameraPos, projectionScale, maxScreenError);
+		}
+	}
+
+	// static scenes only record their cmd buffers once, so they are recorded again with the new index ranges
+	if (lodChanged && sceneType == SceneType::Static)
+	{
+		vkInterface->getCmdBufferManager()->invalidateRecorded();
+	}
+}
+
+void RenderInterface::updateShadowCasters(std::unique_ptr<ComponentInterface>& componentInterface)
+{
+	auto& lightManager = componentInterface->getManager<LightManager>();
+	auto& transformManager = componentInterface->getManager<TransformManager>();
+
+	// all casters are updated before any are culled, as one that has moved can mark views to be drawn that other
+	// casters lie within
+	lightManager.clearShadowCasters();
+	for (auto& info : renderables)
+	{
+		if (info.renderable->getRenderType() == RenderTypes::ShadowMapped)
+		{
+			static_cast<RenderableShadow*>(info.renderable)->updateCaster(transformManager, lightManager);
+		}
+	}
+
+	// static scenes only record the shadow pass once, though the tiles it clears and draws into are part of the
+	// recording, as are the views each caster is drawn into and which casters are queued - so it is recorded again
+	// whenever views are out of date, i.e. they have moved or changed tile, or the casters drawn have changed
+	bool shadowsChanged = lightManager.cullShadowCasters();
+	if (shadowsChanged && sceneType == SceneType::Static)
+	{
+		vkInterface->getCmdBufferManager()->invalidateRecorded();
+	}
+}
+
+void RenderInterface::updateBufferHandles()
+{
+	auto& bufferManager = *vkInterface->getBufferManager();
+	for (auto& info : renderables)
+	{
+		if (info.renderable->getRenderType() == RenderTypes::StaticMesh)
+		{
+			static_cast<RenderableMesh*>(info.renderable)->updateBuffers(bufferManager);
+		}
+		else if (info.renderable->getRenderType() == RenderTypes::ShadowMapped)
+		{
+			static_cast<RenderableShadow*>(info.renderable)->updateBuffers(bufferManager);
+		}
+	}
 }
 
 void RenderInterface::prepareObjectQueue()
 {
 	RenderQueueInfo queueInfo;
 
+	// the queue is rebuilt each frame, as the casters drawn change with the lights and camera
+	renderQueue->clear();
+
 	for (auto& info : renderables)
 	{
+		// casters outside of every view that is drawn this frame have nothing to do
+		if (info.renderable->getRenderType() == RenderTypes::ShadowMapped &&
+		    !static_cast<RenderableShadow*>(info.renderable)->isDrawn())
+		{
+			continue;
+		}
 
 		switch (info.renderable->getRenderType())
 		{
@@ -193,13 +303,22 @@ void RenderInterface::prepareObjectQueue()
 void RenderInterface::render(double interpolation)
 {
 	// update buffer and texture descriptors before doing the rendering
-	vkInterface->getBufferManager()->update();
+	if (vkInterface->getBufferManager()->update(*vkInterface->getCmdBufferManager()))
+	{
+		updateBufferHandles();
+	}
 	vkInterface->gettextureManager()->update();
+	vkInterface->getDescriptorCache()->endFrame();
 
 	// add the renderables to the queue
 	// TODO: add visibility check
 	prepareObjectQueue();
 
+	if (skinningPass)
+	{
+		skinningPass->render(*vkInterface, sceneType);
+	}
+
 	renderer->render(vkInterface, sceneType, renderQueue);
 }
 }    // namespace OmegaEngine
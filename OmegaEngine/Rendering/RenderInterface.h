@@ -26,6 +26,7 @@ class PostProcessInterface;
 class RenderQueue;
 class ObjectManager;
 class ProgramStateManager;
+class SkinningPass;
 
 template <typename FuncReturn, typename T,
           FuncReturn (T::*callback)(VulkanAPI::SecondaryCommandBuffer &cmdBuffer,
@@ -103,12 +104,29 @@ public:
 
 	void initRenderer(std::unique_ptr<ComponentInterface> &componentInterface);
 
+	// a positive bias switches meshes to their coarser levels of detail sooner, trading quality for frame time.
+	// Each step of one doubles the error allowed on screen
+	void setLodBias(const float bias)
+	{
+		renderConfig.general.lodBias = bias;
+	}
+
 	// adds all renderables to render queue - TODO: add visisbility check
 	void prepareObjectQueue();
 
 	// renders the frame using the defined renderer
 	void render(double interpolation);
 
+private:
+	// selects the level of detail of each mesh from the current camera
+	void updateLods(std::unique_ptr<ComponentInterface> &componentInterface);
+
+	// redraws the shadows around casters that have moved, and culls the casters against the views to be drawn
+	void updateShadowCasters(std::unique_ptr<ComponentInterface> &componentInterface);
+
+	// the mesh buffers are moved when their pools grow, so the renderables fetch them again
+	void updateBufferHandles();
+
 private:
 	RenderConfig renderConfig;
 
@@ -120,6 +138,9 @@ private:
 
 	std::unique_ptr<ProgramStateManager> stateManager;
 
+	// optional compute skinning - skinned meshes are then drawn as static geometry by all passes
+	std::unique_ptr<SkinningPass> skinningPass;
+
 	std::unique_ptr<VulkanAPI::Interface> vkInterface;
 	std::unique_ptr<PostProcessInterface> postProcessInterface;
 
@@ -53,14 +53,22 @@ void RenderQueue::dispatch(std::unique_ptr<VulkanAPI::CommandBuffer>& cmdBuffer,
 	cmdBuffer->executeSecondaryCommands(1);
 }
 
-void RenderQueue::threadedDispatch(std::unique_ptr<VulkanAPI::CommandBuffer>& cmdBuffer, QueueType type)
+void RenderQueue::threadedDispatch(std::unique_ptr<VulkanAPI::CommandBuffer>& cmdBuffer, QueueType type,
+                                   const QueuePrologue& prologue)
 {
 	// submits the draw calls in the range specified for items in the queue
 	auto renderFunc = [](VulkanAPI::SecondaryCommandBuffer& secBuffer, std::vector<RenderQueueInfo>& renderQueue,
-	                     const uint32_t start, const uint32_t end, const uint32_t groupSize) -> void {
+	                     const uint32_t start, const uint32_t end, const uint32_t groupSize,
+	                     const QueuePrologue* prologue) -> void {
 		// start the secondary command buffer recording - using one cmd buffer and pool per thread
 		secBuffer.begin();
 
+		// only given to the first buffer, which is executed first
+		if (prologue && *prologue)
+		{
+			(*prologue)(secBuffer);
+		}
+
 		for (uint32_t i = start; i < end; i++)
 		{
 			renderQueue[i].renderFunction(renderQueue[i].renderableHandle, secBuffer, renderQueue[i].renderableData);
@@ -80,6 +88,14 @@ void RenderQueue::threadedDispatch(std::unique_ptr<VulkanAPI::CommandBuffer>& cm
 
 	uint32_t threadsUsed = 0;
 
+	// the prologue is still recorded if there is nothing to draw
+	if (queue.empty() && prologue)
+	{
+		auto& secondaryCmdBuffer = cmdBuffer->getSecondary(0);
+		renderFunc(secondaryCmdBuffer, queue, 0, 0, 0, &prologue);
+		threadsUsed = 1;
+	}
+
 	// TODO: threading is a bit crude at the mo - find a better way of splitting this up - maybe based on materials types, etc.
 	uint32_t threadGroupSize = static_cast<uint32_t>(queue.size() / threadCount);
 	threadGroupSize = threadGroupSize < 1 ? 1 : threadGroupSize;
@@ -93,12 +109,13 @@ void RenderQueue::threadedDispatch(std::unique_ptr<VulkanAPI::CommandBuffer>& cm
 		{
 
 			auto fut = threadPool.submitTask(renderFunc, std::ref(secondaryCmdBuffer), std::ref(queue), i,
-			                                 static_cast<uint32_t>(queue.size()), threadGroupSize);
+			                                 static_cast<uint32_t>(queue.size()), threadGroupSize,
+			                                 i == 0 ? &prologue : nullptr);
 			break;
 		}
 
 		auto fut = threadPool.submitTask(renderFunc, std::ref(secondaryCmdBuffer), std::ref(queue), i,
-		                                 i + threadGroupSize, threadGroupSize);
+		                                 i + threadGroupSize, threadGroupSize, i == 0 ? &prologue : nullptr);
 
 		++threadsUsed;
 	}
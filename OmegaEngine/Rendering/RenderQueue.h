@@ -3,6 +3,7 @@
 #include "VulkanAPI/CommandBuffer.h"
 #include "VulkanAPI/Common.h"
 
+#include <functional>
 #include <unordered_map>
 #include <vector>
 
@@ -70,6 +71,9 @@ struct RenderQueueInfo
 	QueueType queueType;
 };
 
+// recorded at the start of the first secondary buffer, so runs ahead of all the draws in the queue
+using QueuePrologue = std::function<void(VulkanAPI::SecondaryCommandBuffer &)>;
+
 class RenderQueue
 {
 public:
@@ -81,6 +85,15 @@ public:
 		renderQueues[renderInfo.queueType].push_back(renderInfo);
 	}
 
+	// empties the queues, keeping their memory, ready for the next frame's renderables
+	void clear()
+	{
+		for (auto &queue : renderQueues)
+		{
+			queue.second.clear();
+		}
+	}
+
 	static SortKey createSortKey(RenderStage layer, uint32_t materialId, RenderTypes shaderId);
 	void sortAll();
 
@@ -88,7 +101,8 @@ public:
 	            uint32_t end, uint32_t threadGroupSize);
 
 	void dispatch(std::unique_ptr<VulkanAPI::CommandBuffer> &cmdBuffer, QueueType type);
-	void threadedDispatch(std::unique_ptr<VulkanAPI::CommandBuffer> &cmdBuffer, QueueType type);
+	void threadedDispatch(std::unique_ptr<VulkanAPI::CommandBuffer> &cmdBuffer, QueueType type,
+	                      const QueuePrologue &prologue = nullptr);
 
 private:
 	// ordered by queue type
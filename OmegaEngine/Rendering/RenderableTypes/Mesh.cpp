@@ -9,15 +9,25 @@
 #include "Rendering/RenderQueue.h"
 #include "Rendering/Renderers/DeferredRenderer.h"
 #include "Threading/ThreadPool.h"
+#include "Utility/GeneralUtil.h"
 #include "VulkanAPI/BufferManager.h"
 #include "VulkanAPI/CommandBuffer.h"
 #include "VulkanAPI/Pipeline.h"
 #include "VulkanAPI/Sampler.h"
 #include "VulkanAPI/VkTextureManager.h"
 
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+
 namespace OmegaEngine
 {
 
+static_assert(sizeof(MeshManager::PackedVertex) == 20, "The packed vertex layout doesn't match the vertex inputs.");
+static_assert(sizeof(MeshManager::PackedSkinnedVertex) == 28,
+              "The packed skinned vertex layout doesn't match the vertex inputs.");
+
 RenderableMesh::RenderableMesh(std::unique_ptr<ComponentInterface>& componentInterface,
                                std::unique_ptr<VulkanAPI::Interface>& vkInterface, StaticMesh& mesh,
                                PrimitiveMesh& primitive, Object& obj,
@@ -25,8 +35,6 @@ RenderableMesh::RenderableMesh(std::unique_ptr<ComponentInterface>& componentInt
                                std::unique_ptr<RendererBase>& renderer)
     : RenderableBase(RenderTypes::StaticMesh)
 {
-	VulkanAPI::VkTextureManager::TextureLayoutInfo layoutInfo;
-
 	// get the material for this primitive mesh from the manager
 	auto& materialManager = componentInterface->getManager<MaterialManager>();
 	auto& mat = materialManager.get(primitive.materialId);
@@ -38,8 +46,9 @@ RenderableMesh::RenderableMesh(std::unique_ptr<ComponentInterface>& componentInt
 	instanceData = new MeshInstance;
 	MeshInstance* meshInstance = reinterpret_cast<MeshInstance*>(instanceData);
 
-	// skinned ior non-skinned mesh?
-	meshInstance->type = mesh.type;
+	// skinned ior non-skinned mesh? Meshes skinned by the compute pass are drawn as static meshes
+	StateMesh stateMesh = mesh.computeSkinned ? StateMesh::Static : mesh.type;
+	meshInstance->type = stateMesh;
 
 	// queue and state type - opaque or transparent texture
 	StateAlpha stateAlpha;
@@ -61,103 +70,129 @@ RenderableMesh::RenderableMesh(std::unique_ptr<ComponentInterface>& componentInt
 	// and will result in stuttering if created during the rendering loop.
 	// This can be reduced by loading cached data which will be added at some point in the future.
 	meshInstance->state =
-	    stateManager->createState(vkInterface, renderer, StateType::Mesh, mesh.topology, mesh.type, stateAlpha);
+	    stateManager->createState(vkInterface, renderer, StateType::Mesh, mesh.topology, stateMesh, stateAlpha);
 
 	// pointer to the mesh pipeline
 	if (mesh.type == StateMesh::Static)
 	{
-		meshInstance->vertexBuffer = vkInterface->getBufferManager()->getBuffer("StaticVertices");
-		layoutInfo = vkInterface->gettextureManager()->getTextureDescriptorLayout("Mesh");
+		meshInstance->vertexBufferId = "StaticVertices";
+	}
+	else if (mesh.type == StateMesh::StaticPacked)
+	{
+		meshInstance->vertexBufferId = "PackedVertices";
+	}
+	else if (mesh.computeSkinned)
+	{
+		meshInstance->vertexBufferId = "SkinnedOutput";
 	}
 	else
 	{
-		meshInstance->vertexBuffer = vkInterface->getBufferManager()->getBuffer("SkinnedVertices");
-		layoutInfo = vkInterface->gettextureManager()->getTextureDescriptorLayout("SkinnedMesh");
+		meshInstance->vertexBufferId =
+		    mesh.type == StateMesh::SkinnedPacked ? "PackedSkinnedVertices" : "SkinnedVertices";
 		meshInstance->skinnedDynamicOffset = obj.getComponent<SkinnedComponent>().dynamicUboOffset;
 	}
+	meshInstance->quantisationIndex = mesh.quantisationIndex;
 
 	// index into the main buffer - this is the vertex offset plus the offset into the actual memory segment
 	meshInstance->vertexOffset = mesh.vertexBufferOffset;
 	meshInstance->indexOffset = mesh.indexBufferOffset;
-	meshInstance->indexBuffer = vkInterface->getBufferManager()->getBuffer("Indices");
+	if (mesh.shortIndices)
+	{
+		meshInstance->indexBufferId = "ShortIndices";
+		meshInstance->indexType = vk::IndexType::eUint16;
+	}
+	else
+	{
+		meshInstance->indexBufferId = "Indices";
+		meshInstance->indexType = vk::IndexType::eUint32;
+	}
+	updateBuffers(*vkInterface->getBufferManager());
 
 	// per face indicies
 	meshInstance->indexPrimitiveOffset = primitive.indexBase;
 	meshInstance->indexPrimitiveCount = primitive.indexCount;
 
-	meshInstance->descriptorSet.init(vkInterface->getDevice(), *layoutInfo.layout, layoutInfo.setValue);
-	vkInterface->gettextureManager()->updateGroupedDescriptorSet(meshInstance->descriptorSet, mat.name.c_str(),
-	                                                             layoutInfo.setValue);
-
-	// material push block - ugly but can't see a way around this bulk of code!
-	meshInstance->materialPushBlock.baseColorFactor = mat.factors.baseColour;
-	meshInstance->materialPushBlock.metallicFactor = mat.factors.metallic;
-	meshInstance->materialPushBlock.roughnessFactor = mat.factors.roughness;
-	meshInstance->materialPushBlock.emissiveFactor = mat.factors.emissive;
-	meshInstance->materialPushBlock.specularFactor = mat.factors.specular;
-	meshInstance->materialPushBlock.diffuseFactor =
-	    OEMaths::vec3f{ mat.factors.diffuse.getX(), mat.factors.diffuse.getY(), mat.factors.diffuse.getZ() };
-	meshInstance->materialPushBlock.alphaMask = (float)mat.alphaMask;
-	meshInstance->materialPushBlock.alphaMaskCutoff = mat.alphaMaskCutOff;
-	meshInstance->materialPushBlock.haveBaseColourMap =
-	    mat.hasTexture[(int)ModelMaterial::TextureId::BaseColour] ? 1 : 0;
-	meshInstance->materialPushBlock.haveMrMap =
-	    mat.hasTexture[(int)ModelMaterial::TextureId::MetallicRoughness] ? 1 : 0;
-	meshInstance->materialPushBlock.haveNormalMap = mat.hasTexture[(int)ModelMaterial::TextureId::Normal] ? 1 : 0;
-	meshInstance->materialPushBlock.haveAoMap = mat.hasTexture[(int)ModelMaterial::TextureId::Occlusion] ? 1 : 0;
-	meshInstance->materialPushBlock.haveEmissiveMap = mat.hasTexture[(int)ModelMaterial::TextureId::Emissive] ? 1 : 0;
-	meshInstance->materialPushBlock.usingSpecularGlossiness = mat.usingSpecularGlossiness ? 1 : 0;
-	meshInstance->materialPushBlock.baseColourUvSet = mat.uvSets.baseColour;
-	meshInstance->materialPushBlock.metallicRoughnessUvSet = mat.uvSets.metallicRoughness;
-	meshInstance->materialPushBlock.normalUvSet = mat.uvSets.normal;
-	meshInstance->materialPushBlock.occlusionUvSet = mat.uvSets.occlusion;
-	meshInstance->materialPushBlock.emissiveUvSet = mat.uvSets.emissive;
-
-	if (meshInstance->materialPushBlock.usingSpecularGlossiness)
-	{
-		meshInstance->materialPushBlock.metallicRoughnessUvSet = mat.uvSets.specularGlossiness;
-		meshInstance->materialPushBlock.baseColourUvSet = mat.uvSets.diffuse;
+	for (uint32_t i = 0; i < primitive.lodCount; ++i)
+	{
+		meshInstance->lods[i] = { primitive.lods[i].indexBase, primitive.lods[i].indexCount, primitive.lods[i].error };
 	}
+	meshInstance->lodCount = primitive.lodCount;
+	meshInstance->center = primitive.center;
+	meshInstance->radius = primitive.radius;
+	meshInstance->transformIndex = obj.getComponent<TransformComponent>().index;
+
+	meshInstance->materialIndex = primitive.materialId;
+}
+
+void RenderableMesh::updateBuffers(VulkanAPI::BufferManager& bufferManager)
+{
+	MeshInstance* meshInstance = reinterpret_cast<MeshInstance*>(instanceData);
+	meshInstance->vertexBuffer = bufferManager.getBuffer(meshInstance->vertexBufferId);
+	meshInstance->indexBuffer = bufferManager.getBuffer(meshInstance->indexBufferId);
 }
 
 void RenderableMesh::createMeshPipeline(std::unique_ptr<VulkanAPI::Interface>& vkInterface,
                                         std::unique_ptr<RendererBase>& renderer,
                                         std::unique_ptr<ProgramState>& state, StateId::StateFlags& flags)
 {
-	// load shaders
-	if (flags.mesh == StateMesh::Static)
+	// load shaders - all the vertex layouts share the same fragment shader
+	const char* vertexShader = nullptr;
+	switch (flags.mesh)
 	{
-		if (!state->shader.add(vkInterface->getDevice(), "model/model-vert.spv", VulkanAPI::StageType::Vertex,
-		                       "model/model-frag.spv", VulkanAPI::StageType::Fragment))
-		{
-			LOGGER_ERROR("Unable to create static model shaders.");
-		}
+	case StateMesh::Static:
+		vertexShader = "model/model-vert.spv";
+		break;
+	case StateMesh::Skinned:
+		vertexShader = "model/model_skinned-vert.spv";
+		break;
+	case StateMesh::StaticPacked:
+		vertexShader = "model/model_packed-vert.spv";
+		break;
+	case StateMesh::SkinnedPacked:
+		vertexShader = "model/model_skinned_packed-vert.spv";
+		break;
 	}
-	else if (flags.mesh == StateMesh::Skinned)
+
+	if (!state->shader.add(vkInterface->getDevice(), vertexShader, VulkanAPI::StageType::Vertex,
+	                       "model/model-frag.spv", VulkanAPI::StageType::Fragment))
 	{
-		if (!state->shader.add(vkInterface->getDevice(), "model/model_skinned-vert.spv", VulkanAPI::StageType::Vertex,
-		                       "model/model-frag.spv", VulkanAPI::StageType::Fragment))
-		{
-			LOGGER_ERROR("Unable to create skinned model shaders.");
-		}
+		LOGGER_ERROR("Unable to create model shaders.");
 	}
 
 	// get pipeline layout and vertedx attributes by reflection of shader
 	state->shader.imageReflection(state->descriptorLayout, state->imageLayout);
 	state->shader.bufferReflection(state->descriptorLayout, state->bufferLayout);
-	state->descriptorLayout.create(vkInterface->getDevice(), MAX_MATERIAL_SETS);
+	state->descriptorLayout.create(vkInterface->getDevice());
 
-	// we only want to init the uniform buffer sets, the material image samplers will be created by the materials themselves
+	// we only want the buffer sets, the material textures are in the bindless set of the texture manager.
+	// The buffers are bound by name, so states with the same set layout and buffer names share their sets
+	std::unordered_map<uint32_t, uint64_t> setKeys;
 	for (auto& buffer : state->bufferLayout.layouts)
 	{
-		state->descriptorSet.init(vkInterface->getDevice(), state->descriptorLayout.getLayout(buffer.set),
-		                          state->descriptorLayout.getDescriptorPool(), buffer.set);
+		auto iter = setKeys.emplace(buffer.set, 0).first;
+		iter->second = Util::hashBytes(buffer.name.data(), buffer.name.size(), iter->second);
+	}
+
+	std::set<uint32_t> newSets;
+	for (auto& setKey : setKeys)
+	{
+		vk::DescriptorSet set;
+		if (vkInterface->getDescriptorCache()->get(state->descriptorLayout, setKey.first, setKey.second, set))
+		{
+			newSets.emplace(setKey.first);
+		}
+		state->descriptorSet.addSet(setKey.first, set);
 	}
 
-	// sort out the descriptor sets - as long as we have initilaised the VkBuffers, we don't need to have filled the buffers yet
-	// material sets will be created and owned by the actual material - note: these will always be set ZERO
+	// sort out the descriptor sets - as long as we have initilaised the VkBuffers, we don't need to have filled the buffers yet.
+	// Shared sets have already been written
 	for (auto& layout : state->bufferLayout.layouts)
 	{
+		if (newSets.find(layout.set) == newSets.end())
+		{
+			continue;
+		}
+
 		// the shader must use these identifying names for uniform buffers -
 		if (layout.name == "CameraUbo")
 		{
@@ -167,33 +202,43 @@ void RenderableMesh::createMeshPipeline(std::unique_ptr<VulkanAPI::Interface>& v
 		else if (layout.name == "Dynamic_StaticMeshUbo")
 		{
 			vkInterface->getBufferManager()->enqueueDescrUpdate("Transform", &state->descriptorSet, layout.set,
-			                                                    layout.binding, layout.type);
+			                                                    layout.binding, layout.type, layout.range);
 		}
 		else if (layout.name == "Dynamic_SkinnedUbo")
 		{
 			vkInterface->getBufferManager()->enqueueDescrUpdate("SkinnedTransform", &state->descriptorSet, layout.set,
+			                                                    layout.binding, layout.type, layout.range);
+		}
+		else if (layout.name == "JointPalette")
+		{
+			vkInterface->getBufferManager()->enqueueDescrUpdate("SkinnedJoints", &state->descriptorSet, layout.set,
+			                                                    layout.binding, layout.type);
+		}
+		else if (layout.name == "MeshQuantisation")
+		{
+			vkInterface->getBufferManager()->enqueueDescrUpdate("MeshQuantisation", &state->descriptorSet, layout.set,
+			                                                    layout.binding, layout.type);
+		}
+		else if (layout.name == "MaterialBuffer")
+		{
+			vkInterface->getBufferManager()->enqueueDescrUpdate("Materials", &state->descriptorSet, layout.set,
 			                                                    layout.binding, layout.type);
 		}
 	}
 
-	// inform the texture manager the layout of textures associated with the mesh shader
-	// TODO : automate this somehow rather than hard coded values
-	const uint8_t materialSet = 2;
-	if (flags.mesh == StateMesh::Static)
-	{
-		vkInterface->gettextureManager()->bindTexturesToDescriptorLayout("Mesh", &state->descriptorLayout, materialSet);
-	}
-	else if (flags.mesh == StateMesh::Skinned)
-	{
-		vkInterface->gettextureManager()->bindTexturesToDescriptorLayout("SkinnedMesh", &state->descriptorLayout,
-		                                                                 materialSet);
-	}
+	// the set layout is created from the same bindings, so the texture manager's set can be bound with this pipeline
+	state->descriptorSet.addSet(VulkanAPI::VkTextureManager::BindlessSet,
+	                            vkInterface->gettextureManager()->getBindlessSet());
 
 	state->shader.pipelineLayoutReflect(state->pipelineLayout);
 	state->pipelineLayout.create(vkInterface->getDevice(), state->descriptorLayout.getLayout());
 
 	// create the graphics pipeline
 	state->shader.pipelineReflection(state->pipeline);
+	if (isPackedMesh(flags.mesh))
+	{
+		addPackedVertexInputs(state->pipeline, flags.mesh);
+	}
 
 	// use stencil to fill in with ones where geometry is drawn
 	state->pipeline.setStencilStateFrontAndBack(vk::CompareOp::eAlways, vk::StencilOp::eReplace,
@@ -208,34 +253,115 @@ void RenderableMesh::createMeshPipeline(std::unique_ptr<VulkanAPI::Interface>& v
 	                       VulkanAPI::PipelineType::Graphics);
 }
 
+bool RenderableMesh::updateLod(TransformManager& transformManager, const OEMaths::vec3f& cameraPosition,
+                               const float projectionScale, const float maxScreenError)
+{
+	MeshInstance* meshInstance = reinterpret_cast<MeshInstance*>(instanceData);
+	if (meshInstance->lodCount <= 1)
+	{
+		return false;
+	}
+
+	// the bounding sphere in world space - the radius is scaled by the largest axis of the transform
+	const float* world = transformManager.getWorldMatrix(meshInstance->transformIndex).getData();
+	const OEMaths::vec3f& c = meshInstance->center;
+
+	float center[3];
+	float scale = 0.0f;
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		center[k] = world[k] * c.getX() + world[4 + k] * c.getY() + world[8 + k] * c.getZ() + world[12 + k];
+
+		float axis = world[k * 4] * world[k * 4] + world[k * 4 + 1] * world[k * 4 + 1] +
+		             world[k * 4 + 2] * world[k * 4 + 2];
+		scale = std::max(scale, axis);
+	}
+
+	float dx = center[0] - cameraPosition.getX();
+	float dy = center[1] - cameraPosition.getY();
+	float dz = center[2] - cameraPosition.getZ();
+	float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+	float radius = meshInstance->radius * std::sqrt(scale);
+
+	// the camera is inside the bounds, so always the full detail
+	uint32_t lod = meshInstance->currentLod;
+	if (distance <= radius)
+	{
+		lod = 0;
+	}
+	else
+	{
+		// the errors are relative to the radius, so this is all that's needed to project them
+		float screenSize = radius * projectionScale / distance;
+
+		while (lod + 1 < meshInstance->lodCount &&
+		       meshInstance->lods[lod + 1].error * screenSize <= maxScreenError * (1.0f - LodHysteresis))
+		{
+			++lod;
+		}
+		while (lod > 0 && meshInstance->lods[lod].error * screenSize > maxScreenError * (1.0f + LodHysteresis))
+		{
+			--lod;
+		}
+	}
+
+	if (lod == meshInstance->currentLod)
+	{
+		return false;
+	}
+
+	meshInstance->currentLod = lod;
+	meshInstance->indexPrimitiveOffset = meshInstance->lods[lod].indexBase;
+	meshInstance->indexPrimitiveCount = meshInstance->lods[lod].indexCount;
+	return true;
+}
+
 void RenderableMesh::render(VulkanAPI::SecondaryCommandBuffer& cmdBuffer, void* instance)
 {
 	MeshInstance* instanceData = (MeshInstance*)instance;
 
 	std::vector<uint32_t> dynamicOffsets{ instanceData->transformDynamicOffset };
-	if (instanceData->type == StateMesh::Skinned)
+	if (isSkinnedMesh(instanceData->type))
 	{
 		dynamicOffsets.push_back(instanceData->skinnedDynamicOffset);
 	}
 
-	// merge the material set with the mesh ubo sets
+	// the mesh sets include the material buffer and textures, so are the same for all meshes of this state
 	ProgramState* state = instanceData->state;
-	std::vector<vk::DescriptorSet> materialSet = instanceData->descriptorSet.get();
 	std::vector<vk::DescriptorSet> meshSet = state->descriptorSet.get();
-	meshSet.insert(meshSet.end(), materialSet.begin(), materialSet.end());
 
 	cmdBuffer.setViewport();
 	cmdBuffer.setScissor();
 	cmdBuffer.bindPipeline(state->pipeline);
 	cmdBuffer.bindDynamicDescriptors(state->pipelineLayout, meshSet, VulkanAPI::PipelineType::Graphics, dynamicOffsets);
-	cmdBuffer.bindPushBlock(state->pipelineLayout, vk::ShaderStageFlagBits::eFragment,
-	                        sizeof(MeshInstance::MaterialPushBlock), &instanceData->materialPushBlock);
+	cmdBuffer.bindPushBlock(state->pipelineLayout, vk::ShaderStageFlagBits::eFragment, sizeof(uint32_t),
+	                        &instanceData->materialIndex);
 
 	vk::DeviceSize offset = { instanceData->vertexBuffer.offset };
 	cmdBuffer.bindVertexBuffer(instanceData->vertexBuffer.buffer, offset);
+	// the indices are relative to the mesh, so the vertex offset is added by the draw
+	uint32_t indexSize = instanceData->indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
 	cmdBuffer.bindIndexBuffer(instanceData->indexBuffer.buffer,
-	                          instanceData->indexBuffer.offset + (instanceData->indexOffset * sizeof(uint32_t)));
-	cmdBuffer.drawIndexed(instanceData->indexPrimitiveCount, instanceData->indexPrimitiveOffset);
+	                          instanceData->indexBuffer.offset + (instanceData->indexOffset * indexSize),
+	                          instanceData->indexType);
+	cmdBuffer.drawIndexed(instanceData->indexPrimitiveCount, instanceData->indexPrimitiveOffset,
+	                      static_cast<int32_t>(instanceData->vertexOffset), instanceData->quantisationIndex);
+}
+
+void RenderableMesh::addPackedVertexInputs(VulkanAPI::Pipeline& pipeline, const StateMesh type)
+{
+	// position, uv0, uv1 and the octahedral normal
+	pipeline.setVertexInputFormat(0, vk::Format::eR16G16B16A16Snorm, 8);
+	pipeline.setVertexInputFormat(1, vk::Format::eR16G16Sfloat, 4);
+	pipeline.setVertexInputFormat(2, vk::Format::eR16G16Sfloat, 4);
+	pipeline.setVertexInputFormat(3, vk::Format::eR16G16Snorm, 4);
+
+	// weights and joints
+	if (type == StateMesh::SkinnedPacked)
+	{
+		pipeline.setVertexInputFormat(4, vk::Format::eR8G8B8A8Unorm, 4);
+		pipeline.setVertexInputFormat(5, vk::Format::eR8G8B8A8Uint, 4);
+	}
 }
 
 }    // namespace OmegaEngine
@@ -1,4 +1,5 @@
 #pragma once
+#include "Models/MeshSimplifier.h"
 #include "OEMaths/OEMaths.h"
 #include "RenderableBase.h"
 #include "Rendering/RenderInterface.h"
@@ -7,13 +8,13 @@
 #include "VulkanAPI/Interface.h"
 #include "Rendering/ProgramStateManager.h"
 
-// Number of combined image sampler sets allowed for materials. This allows for materials to be added - this value will need monitoring
-#define MAX_MATERIAL_SETS 50
+#include <array>
 
 // forward decleartions
 namespace VulkanAPI
 {
 class Sampler;
+class Pipeline;
 class CommandBuffer;
 class BufferManager;
 class VkTextureManager;
@@ -27,6 +28,7 @@ class ComponentInterface;
 class ProgramStateManager;
 class ThreadPool;
 class Object;
+class TransformManager;
 struct StaticMesh;
 struct PrimitiveMesh;
 enum class StateMesh;
@@ -48,55 +50,44 @@ public:
 		uint32_t indexPrimitiveOffset;    // this equates to buffer_offset + sub-offset
 		uint32_t indexPrimitiveCount;
 
+		// the levels of detail of the primitive - the index data above is that of the current level
+		struct Lod
+		{
+			uint32_t indexBase = 0;
+			uint32_t indexCount = 0;
+			float error = 0.0f;
+		};
+
+		std::array<Lod, MeshSimplifier::MaxLods> lods;
+		uint32_t lodCount = 1;
+		uint32_t currentLod = 0;
+
+		// model space bounds of the primitive and the object's transform, for finding its size on screen
+		OEMaths::vec3f center;
+		float radius = 0.0f;
+		uint32_t transformIndex = 0;
+
 		// the starting offsets within the main vertices/indices buffer
 		uint32_t indexOffset;    // index into large buffer
 		uint32_t vertexOffset;
 
-		// vertex and index buffer memory info
+		// vertex and index buffer memory info - the ids are kept so the buffers can be found again if moved
+		const char* vertexBufferId = nullptr;
+		const char* indexBufferId = nullptr;
 		VulkanAPI::Buffer vertexBuffer;
 		VulkanAPI::Buffer indexBuffer;
+		vk::IndexType indexType = vk::IndexType::eUint32;
 
-		// all material data required to draw
-		// storing this material data in two places for threading purposes.
-		struct MaterialPushBlock
-		{
-			// colour factors
-			OEMaths::vec4f baseColorFactor;
-			OEMaths::vec3f emissiveFactor;
-			float pad0;
-			OEMaths::vec3f diffuseFactor;
-			float pad1;
-			OEMaths::vec3f specularFactor;
-			float pad2;
-			float metallicFactor;
-			float roughnessFactor;
-
-			// alpha
-			float alphaMask;
-			float alphaMaskCutoff;
-
-			// uv sets for each texture
-			uint32_t baseColourUvSet;
-			uint32_t metallicRoughnessUvSet;
-			uint32_t normalUvSet;
-			uint32_t emissiveUvSet;
-			uint32_t occlusionUvSet;
-
-			// indication whether we have a ceratin texture map
-			uint32_t haveBaseColourMap;
-			uint32_t haveNormalMap;
-			uint32_t haveEmissiveMap;
-			uint32_t haveMrMap;
-			uint32_t haveAoMap;
-			uint32_t usingSpecularGlossiness;
-		} materialPushBlock;
-
-		// vulkan stuff for material textures
-		VulkanAPI::DescriptorSet descriptorSet;
+		// the material factors are held in the material buffer, and its textures in the bindless set, so only
+		// the index is needed to draw
+		uint32_t materialIndex = 0;
 
 		// offset into transform buffer for this mesh
 		uint32_t transformDynamicOffset = 0;
 		uint32_t skinnedDynamicOffset = 0;
+
+		// packed meshes only - drawn as the first instance so the shader can find the dequantisation transform
+		uint32_t quantisationIndex = 0;
 	};
 
 	void* getHandle() override
@@ -111,10 +102,25 @@ public:
 
 	void render(VulkanAPI::SecondaryCommandBuffer& cmdBuffer, void* instanceData) override;
 
+	// fetches the vertex and index buffers again - the mesh pools are moved when they grow
+	void updateBuffers(VulkanAPI::BufferManager& bufferManager);
+
+	// chooses the level of detail from the size of the primitive on screen - the coarsest level whose error is
+	// within the limit is used. A level is only left once its error is past the limit by the hysteresis fraction,
+	// so meshes don't flicker between levels at the boundary. The limit is a fraction of half the screen height,
+	// and the projection scale is the cotangent of half the vertical fov. Returns true if the level has changed
+	bool updateLod(TransformManager& transformManager, const OEMaths::vec3f& cameraPosition, const float projectionScale,
+	               const float maxScreenError);
+
 	static void RenderableMesh::createMeshPipeline(std::unique_ptr<VulkanAPI::Interface>& vkInterface,
 	                                               std::unique_ptr<RendererBase>& renderer, 
 	                                               std::unique_ptr<ProgramState>& state, StateId::StateFlags& flags);
 
+	// the packed formats can't be reflected from the shader so are set here. The full layout is always described,
+	// even if the shader doesn't read all of it, so the stride matches the buffer
+	static void addPackedVertexInputs(VulkanAPI::Pipeline& pipeline, const StateMesh type);
+
 private:
+	static constexpr float LodHysteresis = 0.2f;
 };
 }    // namespace OmegaEngine
@@ -1,5 +1,7 @@
 #include "Shadow.h"
+#include "Managers/TransformManager.h"
 #include "ObjectInterface/ComponentTypes.h"
+#include "ObjectInterface/Object.h"
 #include "Rendering/RenderCommon.h"
 #include "Rendering/RenderInterface.h"
 #include "Rendering/Renderers/RendererBase.h"
@@ -10,14 +12,18 @@
 #include "VulkanAPI/DataTypes/Texture.h"
 #include "VulkanAPI/Shader.h"
 #include "VulkanAPI/Interface.h"
+#include "VulkanAPI/Queue.h"
+
+#include <algorithm>
+#include <cmath>
 
 namespace OmegaEngine
 {
 
 RenderableShadow::RenderableShadow(std::unique_ptr<ProgramStateManager>& stateManager,
                                    std::unique_ptr<VulkanAPI::Interface>& vkInterface, ShadowComponent& component,
-                                   StaticMesh& mesh, PrimitiveMesh& primitive, uint32_t lightCount,
-                                   uint32_t lightAlignmentSize, std::unique_ptr<RendererBase>& renderer)
+                                   StaticMesh& mesh, PrimitiveMesh& primitive, Object& obj,
+                                   LightManager& lightManager, std::unique_ptr<RendererBase>& renderer)
     : RenderableBase(RenderTypes::ShadowMapped)
 {
 	// fill out the data which will be used for rendering
@@ -29,28 +35,58 @@ RenderableShadow::RenderableShadow(std::unique_ptr<ProgramStateManager>& stateMa
 
 	queueType = QueueType::Shadow;
 
-	// pointer to the mesh pipeline
+	// pointer to the mesh pipeline - meshes skinned by the compute pass are drawn as static meshes
+	StateMesh stateMesh = mesh.computeSkinned ? StateMesh::Static : mesh.type;
 	shadowInstance->state =
-	    stateManager->createState(vkInterface, renderer, StateType::ShadowMapped, mesh.topology, mesh.type, StateAlpha::Opaque);
+	    stateManager->createState(vkInterface, renderer, StateType::ShadowMapped, mesh.topology, stateMesh, StateAlpha::Opaque);
 
 	// pointer to the mesh pipeline
 	if (mesh.type == StateMesh::Static)
 	{
-		shadowInstance->vertexBuffer = vkInterface->getBufferManager()->getBuffer("StaticVertices");
+		shadowInstance->vertexBufferId = "StaticVertices";
+	}
+	else if (mesh.type == StateMesh::StaticPacked)
+	{
+		shadowInstance->vertexBufferId = "PackedVertices";
+	}
+	else if (mesh.type == StateMesh::SkinnedPacked)
+	{
+		shadowInstance->vertexBufferId = "PackedSkinnedVertices";
+	}
+	else if (mesh.computeSkinned)
+	{
+		shadowInstance->vertexBufferId = "SkinnedOutput";
 	}
 	else
 	{
-		shadowInstance->vertexBuffer = vkInterface->getBufferManager()->getBuffer("SkinnedVertices");
+		shadowInstance->vertexBufferId = "SkinnedVertices";
 	}
+	shadowInstance->quantisationIndex = mesh.quantisationIndex;
 
 	// index into the main buffer - this is the vertex offset plus the offset into the actual memory segment
 	shadowInstance->vertexOffset = mesh.vertexBufferOffset;
 	shadowInstance->indexOffset = mesh.indexBufferOffset;
-	shadowInstance->indexBuffer = vkInterface->getBufferManager()->getBuffer("Indices");
+	if (mesh.shortIndices)
+	{
+		shadowInstance->indexBufferId = "ShortIndices";
+		shadowInstance->indexType = vk::IndexType::eUint16;
+	}
+	else
+	{
+		shadowInstance->indexBufferId = "Indices";
+		shadowInstance->indexType = vk::IndexType::eUint32;
+	}
+	updateBuffers(*vkInterface->getBufferManager());
+	shadowInstance->indexPrimitiveOffset = primitive.indexBase;
 	shadowInstance->indexCount = primitive.indexCount;
 
-	shadowInstance->lightCount = lightCount;
-	shadowInstance->lightAlignmentSize = lightAlignmentSize;
+	shadowInstance->lightManager = &lightManager;
+	shadowInstance->viewAlignmentSize = lightManager.getAlignmentSize();
+
+	shadowInstance->center = primitive.center;
+	shadowInstance->radius = primitive.radius;
+	shadowInstance->transformIndex = obj.getComponent<TransformComponent>().index;
+	shadowInstance->isSkinned = isSkinnedMesh(mesh.type);
 
 	shadowInstance->biasClamp = component.biasClamp;
 	shadowInstance->biasConstant = component.biasConstant;
@@ -61,11 +97,20 @@ RenderableShadow::~RenderableShadow()
 {
 }
 
+void RenderableShadow::updateBuffers(VulkanAPI::BufferManager& bufferManager)
+{
+	ShadowInstance* shadowInstance = reinterpret_cast<ShadowInstance*>(instanceData);
+	shadowInstance->vertexBuffer = bufferManager.getBuffer(shadowInstance->vertexBufferId);
+	shadowInstance->indexBuffer = bufferManager.getBuffer(shadowInstance->indexBufferId);
+}
+
 void RenderableShadow::createShadowPipeline(std::unique_ptr<VulkanAPI::Interface>& vkInterface,
                                             std::unique_ptr<RendererBase>& renderer,
                                             std::unique_ptr<ProgramState>& state, StateId::StateFlags& flags)
 {
-	if (!state->shader.add(vkInterface->getDevice(), "shadow/mapped-vert.spv", VulkanAPI::StageType::Vertex))
+	// the packed layouts need the position dequantising
+	const char* vertexShader = isPackedMesh(flags.mesh) ? "Shadow/mapped_packed-vert.spv" : "Shadow/mapped-vert.spv";
+	if (!state->shader.add(vkInterface->getDevice(), vertexShader, VulkanAPI::StageType::Vertex))
 	{
 		LOGGER_ERROR("Unable to create static shadow shaders.");
 	}
@@ -83,6 +128,11 @@ void RenderableShadow::createShadowPipeline(std::unique_ptr<VulkanAPI::Interface
 		if (layout.name == "Dynamic_Ubo")
 		{
 			vkInterface->getBufferManager()->enqueueDescrUpdate("LightDynamic", &state->descriptorSet, layout.set,
+			                                                    layout.binding, layout.type, layout.range);
+		}
+		else if (layout.name == "MeshQuantisation")
+		{
+			vkInterface->getBufferManager()->enqueueDescrUpdate("MeshQuantisation", &state->descriptorSet, layout.set,
 			                                                    layout.binding, layout.type);
 		}
 	}
@@ -92,6 +142,10 @@ void RenderableShadow::createShadowPipeline(std::unique_ptr<VulkanAPI::Interface
 
 	// create the graphics pipeline
 	state->shader.pipelineReflection(state->pipeline);
+	if (isPackedMesh(flags.mesh))
+	{
+		RenderableMesh::addPackedVertexInputs(state->pipeline, flags.mesh);
+	}
 
 	state->pipeline.setDepthState(VK_TRUE, VK_TRUE);
 	state->pipeline.setRasterCullMode(vk::CullModeFlagBits::eBack);
@@ -103,22 +157,119 @@ void RenderableShadow::createShadowPipeline(std::unique_ptr<VulkanAPI::Interface
 }
 
 void RenderableShadow::createShadowPass(VulkanAPI::RenderPass& renderpass, VulkanAPI::Texture& image,
-                                        vk::Device& device, vk::PhysicalDevice& gpu, const vk::Format format,
-                                        const uint32_t width, const uint32_t height)
+                                        vk::Device& device, vk::PhysicalDevice& gpu, VulkanAPI::Queue& graphicsQueue,
+                                        const vk::Format format, const uint32_t size)
 {
 	// create empty image into which the depth will be drawn
-	image.createEmptyImage(format, width, height, 1,
-	                       vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled);
+	image.createEmptyImage(format, size, size, 1,
+	                       vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled |
+	                           vk::ImageUsageFlagBits::eTransferDst);
+
+	// the whole atlas starts at the far plane, so tiles which are never drawn into are unshadowed. It's left in
+	// the layout the pass begins and ends in
+	VulkanAPI::CommandBuffer clearCmdBuffer(device, graphicsQueue.getIndex());
+	clearCmdBuffer.createPrimary();
+
+	VulkanAPI::Image& atlas = image.getImage();
+	atlas.transition(vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, clearCmdBuffer.get());
 
-	// renderpass
+	vk::ClearDepthStencilValue clearValue(1.0f, 0);
+	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+	clearCmdBuffer.get().clearDepthStencilImage(atlas.get(), vk::ImageLayout::eTransferDstOptimal, &clearValue, 1,
+	                                            &range);
+
+	atlas.transition(vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+	                 clearCmdBuffer.get());
+
+	clearCmdBuffer.end();
+	graphicsQueue.flushCmdBuffer(clearCmdBuffer.get());
+
+	// renderpass - the depth of the tiles which aren't drawn this frame is kept
 	renderpass.init(device);
-	renderpass.addAttachment(format, VulkanAPI::FinalLayoutType::Auto);
+	renderpass.addPreservedAttachment(format, VulkanAPI::FinalLayoutType::Auto);
 	renderpass.addSubpassDependency(VulkanAPI::DependencyTemplate::DepthStencilSubpassTop);
 	renderpass.addSubpassDependency(VulkanAPI::DependencyTemplate::DepthStencilSubpassBottom);
 	renderpass.prepareRenderPass();
 
 	// framebuffer
-	renderpass.prepareFramebuffer(image.getImageView(), width, height, 1);
+	renderpass.prepareFramebuffer(image.getImageView(), size, size, 1);
+}
+
+void RenderableShadow::clearShadowTiles(VulkanAPI::SecondaryCommandBuffer& cmdBuffer,
+                                        const std::vector<LightManager::ShadowView>& shadowViews)
+{
+	for (const LightManager::ShadowView& view : shadowViews)
+	{
+		if (view.needsRender && view.tile.isValid())
+		{
+			vk::Rect2D rect({ static_cast<int32_t>(view.tile.x), static_cast<int32_t>(view.tile.y) },
+			                { view.tile.size, view.tile.size });
+			cmdBuffer.clearDepthAttachment(rect);
+		}
+	}
+}
+
+void RenderableShadow::updateCaster(TransformManager& transformManager, LightManager& lightManager)
+{
+	ShadowInstance* shadowInstance = reinterpret_cast<ShadowInstance*>(instanceData);
+
+	// the bounding sphere in world space - the radius is scaled by the largest axis of the transform
+	const float* world = transformManager.getWorldMatrix(shadowInstance->transformIndex).getData();
+	const OEMaths::vec3f& c = shadowInstance->center;
+
+	float center[3];
+	float scale = 0.0f;
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		center[k] = world[k] * c.getX() + world[4 + k] * c.getY() + world[8 + k] * c.getZ() + world[12 + k];
+
+		float axis = world[k * 4] * world[k * 4] + world[k * 4 + 1] * world[k * 4 + 1] +
+		             world[k * 4 + 2] * world[k * 4 + 2];
+		scale = std::max(scale, axis);
+	}
+	float radius = shadowInstance->radius * std::sqrt(scale);
+
+	shadowInstance->casterIndex = lightManager.addShadowCaster(center, radius);
+
+	// the level of detail is selected by the mesh, so the shadow matches the geometry drawn into the gbuffer. A new
+	// level changes the shape of the caster, so its tiles are out of date as if it had moved
+	bool lodChanged = false;
+	const RenderableMesh::MeshInstance* meshInstance = shadowInstance->meshInstance;
+	if (meshInstance)
+	{
+		lodChanged = meshInstance->indexPrimitiveOffset != shadowInstance->indexPrimitiveOffset ||
+		             meshInstance->indexPrimitiveCount != shadowInstance->indexCount;
+		shadowInstance->indexPrimitiveOffset = meshInstance->indexPrimitiveOffset;
+		shadowInstance->indexCount = meshInstance->indexPrimitiveCount;
+	}
+
+	bool moved = !shadowInstance->hasWorldBounds || shadowInstance->isSkinned || lodChanged ||
+	             radius != shadowInstance->worldRadius || center[0] != shadowInstance->worldCenter[0] ||
+	             center[1] != shadowInstance->worldCenter[1] || center[2] != shadowInstance->worldCenter[2];
+	if (!moved)
+	{
+		return;
+	}
+
+	// the shadow is removed from where the caster was as well as drawn where it is now
+	if (shadowInstance->hasWorldBounds)
+	{
+		lightManager.invalidateShadows(shadowInstance->worldCenter, shadowInstance->worldRadius);
+	}
+	lightManager.invalidateShadows(center, radius);
+
+	std::copy(center, center + 3, shadowInstance->worldCenter);
+	shadowInstance->worldRadius = radius;
+	shadowInstance->hasWorldBounds = true;
+}
+
+bool RenderableShadow::isDrawn() const
+{
+	const ShadowInstance* shadowInstance = reinterpret_cast<const ShadowInstance*>(instanceData);
+
+	uint32_t viewCount = 0;
+	shadowInstance->lightManager->getCasterViews(shadowInstance->casterIndex, viewCount);
+	return viewCount > 0;
 }
 
 void RenderableShadow::render(VulkanAPI::SecondaryCommandBuffer& cmdBuffer, void* instance)
@@ -126,23 +277,43 @@ void RenderableShadow::render(VulkanAPI::SecondaryCommandBuffer& cmdBuffer, void
 	ShadowInstance* instanceData = (ShadowInstance*)instance;
 
 	ProgramState* state = instanceData->state;
+	const std::vector<LightManager::ShadowView>& shadowViews = instanceData->lightManager->getShadowViews();
+
+	// the object is only drawn from the point of view of the lights it was culled into, each into its own tile
+	uint32_t viewCount = 0;
+	const uint32_t* views = instanceData->lightManager->getCasterViews(instanceData->casterIndex, viewCount);
+	if (!viewCount)
+	{
+		return;
+	}
 
-	cmdBuffer.setViewport();
-	cmdBuffer.setScissor();
 	cmdBuffer.setDepthBias(instanceData->biasConstant, instanceData->biasClamp, instanceData->biasSlope);
 	cmdBuffer.bindPipeline(state->pipeline);
 
 	vk::DeviceSize offset = { instanceData->vertexBuffer.offset };
 	cmdBuffer.bindVertexBuffer(instanceData->vertexBuffer.buffer, offset);
-	cmdBuffer.bindIndexBuffer(instanceData->indexBuffer.buffer, instanceData->indexBuffer.offset);
+	uint32_t indexSize = instanceData->indexType == vk::IndexType::eUint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	cmdBuffer.bindIndexBuffer(instanceData->indexBuffer.buffer,
+	                          instanceData->indexBuffer.offset + (instanceData->indexOffset * indexSize),
+	                          instanceData->indexType);
 
-	// we need to render the object from each light sources point of view
-	for (uint32_t i = 0; i < instanceData->lightCount; ++i)
+	for (uint32_t v = 0; v < viewCount; ++v)
 	{
-		uint32_t dynamicBufferOffset = i * instanceData->lightAlignmentSize;
+		const uint32_t i = views[v];
+		const LightManager::ShadowView& view = shadowViews[i];
+
+		vk::Viewport viewport(static_cast<float>(view.tile.x), static_cast<float>(view.tile.y),
+		                      static_cast<float>(view.tile.size), static_cast<float>(view.tile.size), 0.0f, 1.0f);
+		vk::Rect2D scissor({ static_cast<int32_t>(view.tile.x), static_cast<int32_t>(view.tile.y) },
+		                   { view.tile.size, view.tile.size });
+		cmdBuffer.setViewport(viewport);
+		cmdBuffer.setScissor(scissor);
+
+		uint32_t dynamicBufferOffset = i * instanceData->viewAlignmentSize;
 		cmdBuffer.bindDynamicDescriptors(state->pipelineLayout, state->descriptorSet, VulkanAPI::PipelineType::Graphics,
 		                                 dynamicBufferOffset);
-		cmdBuffer.drawIndexed(instanceData->indexCount);
+		cmdBuffer.drawIndexed(instanceData->indexCount, instanceData->indexPrimitiveOffset,
+		                      static_cast<int32_t>(instanceData->vertexOffset), instanceData->quantisationIndex);
 	}
 }
 }    // namespace OmegaEngine
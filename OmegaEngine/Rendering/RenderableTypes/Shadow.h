@@ -1,4 +1,5 @@
 #pragma once
+#include "Managers/LightManager.h"
 #include "Managers/MeshManager.h"
 #include "RenderableBase.h"
 #include "Rendering/ProgramStateManager.h"
@@ -12,11 +13,14 @@ class BufferManager;
 class SecondaryCommandBuffer;
 class Texture;
 class Interface;
+class Queue;
 }    // namespace VulkanAPI
 
 namespace OmegaEngine
 {
 struct ShadowComponent;
+class Object;
+class TransformManager;
 
 class RenderableShadow : public RenderableBase
 {
@@ -27,16 +31,42 @@ public:
 		// pipeline
 		ProgramState* state;
 
-		// vertex and index buffer memory info for the cube
+		// vertex and index buffer memory info for the cube - the ids are kept so the buffers can be found again
+		const char* vertexBufferId = nullptr;
+		const char* indexBufferId = nullptr;
 		VulkanAPI::Buffer vertexBuffer;
 		VulkanAPI::Buffer indexBuffer;
+		vk::IndexType indexType = vk::IndexType::eUint32;
 
 		uint32_t indexCount = 0;
 		uint32_t vertexOffset = 0;
 		uint32_t indexOffset = 0;
 
-		uint32_t lightAlignmentSize = 0;
-		uint32_t lightCount = 0;
+		// the start of the primitive relative to the mesh's indices
+		uint32_t indexPrimitiveOffset = 0;
+
+		// packed meshes only - the index of the dequantisation transform, drawn as the first instance
+		uint32_t quantisationIndex = 0;
+
+		// the mesh drawn in the gbuffer pass - the index range of its current level of detail is drawn
+		const RenderableMesh::MeshInstance* meshInstance = nullptr;
+
+		// holds the views of all lights, and the list of those within which the caster lies and whose tiles are
+		// out of date - only these are drawn into
+		LightManager* lightManager = nullptr;
+		uint32_t casterIndex = 0;
+		uint32_t viewAlignmentSize = 0;
+
+		// model space bounds of the primitive and the object's transform
+		OEMaths::vec3f center;
+		float radius = 0.0f;
+		uint32_t transformIndex = 0;
+
+		// the world space bounds as of the last frame - skinned casters change shape, so are always out of date
+		float worldCenter[3] = {};
+		float worldRadius = 0.0f;
+		bool hasWorldBounds = false;
+		bool isSkinned = false;
 
 		float biasConstant = 0.0f;
 		float biasClamp = 0.0f;
@@ -45,7 +75,7 @@ public:
 
 	RenderableShadow(std::unique_ptr<ProgramStateManager>& stateManager,
 	                 std::unique_ptr<VulkanAPI::Interface>& vkInterface, ShadowComponent& component, StaticMesh& mesh,
-	                 PrimitiveMesh& primitive, uint32_t lightCount, uint32_t lightAlignmentSize,
+	                 PrimitiveMesh& primitive, Object& obj, LightManager& lightManager,
 	                 std::unique_ptr<RendererBase>& renderer);
 
 	~RenderableShadow();
@@ -54,9 +84,24 @@ public:
 	                                 std::unique_ptr<RendererBase>& renderer, std::unique_ptr<ProgramState>& state,
 	                                 StateId::StateFlags& flags);
 
+	// the atlas keeps its depth between frames, so is cleared once here and then only where tiles are redrawn
 	static void createShadowPass(VulkanAPI::RenderPass& renderpass, VulkanAPI::Texture& image, vk::Device& device,
-	                             vk::PhysicalDevice& gpu, const vk::Format format, const uint32_t width,
-	                             const uint32_t height);
+	                             vk::PhysicalDevice& gpu, VulkanAPI::Queue& graphicsQueue, const vk::Format format,
+	                             const uint32_t size);
+
+	// clears the tiles of the views about to be drawn - recorded ahead of the casters
+	static void clearShadowTiles(VulkanAPI::SecondaryCommandBuffer& cmdBuffer,
+	                             const std::vector<LightManager::ShadowView>& shadowViews);
+
+	// finds the world space bounds of the caster and adds them to the casters culled this frame. If it has moved,
+	// the views that could see it, before or after the move, are marked to be drawn again
+	void updateCaster(TransformManager& transformManager, LightManager& lightManager);
+
+	// false if the caster lies in none of the views drawn this frame, so can be left out of the queue
+	bool isDrawn() const;
+
+	// fetches the vertex and index buffers again - the mesh pools are moved when they grow
+	void updateBuffers(VulkanAPI::BufferManager& bufferManager);
 
 	// used to get the address of this instance
 	void* getHandle() override
@@ -64,6 +109,11 @@ public:
 		return this;
 	}
 
+	void setMeshInstance(const RenderableMesh::MeshInstance* meshInstance)
+	{
+		reinterpret_cast<ShadowInstance*>(instanceData)->meshInstance = meshInstance;
+	}
+
 	void render(VulkanAPI::SecondaryCommandBuffer& cmdBuffer, void* instanceData) override;
 
 private:
@@ -87,8 +87,8 @@ void RenderableSkybox::createSkyboxPipeline(std::unique_ptr<VulkanAPI::Interface
                                             std::unique_ptr<ProgramState>& state, StateId::StateFlags& flags)
 {
 	// load shaders
-	if (!state->shader.add(vkInterface->getDevice(), "env/Skybox/skybox-vert.spv", VulkanAPI::StageType::Vertex,
-	                       "env/Skybox/skybox-frag.spv", VulkanAPI::StageType::Fragment))
+	if (!state->shader.add(vkInterface->getDevice(), "Env/Skybox/skybox-vert.spv", VulkanAPI::StageType::Vertex,
+	                       "Env/Skybox/skybox-frag.spv", VulkanAPI::StageType::Fragment))
 	{
 		LOGGER_ERROR("Unable to create skybox shaders.");
 	}
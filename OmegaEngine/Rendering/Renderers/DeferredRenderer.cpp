@@ -42,10 +42,10 @@ DeferredRenderer::DeferredRenderer(VulkanAPI::Interface& vkInterface, RenderConf
 	// 1. render all objects into the gbuffer pass - seperate images for pos, base-colour, normal, pbr and emissive
 	createGbufferPass();
 
-	// 2. render the objects again but this time into a depth buffer for shadows
+	// 2. render the objects again but this time into a depth buffer for shadows - an atlas shared by all lights
 	shadowImage.init(device, gpu);
-	RenderableShadow::createShadowPass(shadowRenderpass, shadowImage, device, gpu, renderConfig.shadowFormat,
-	                                   renderConfig.shadowWidth, renderConfig.shadowHeight);
+	RenderableShadow::createShadowPass(shadowRenderpass, shadowImage, device, gpu, vkInterface.getGraphicsQueue(),
+	                                   renderConfig.shadowFormat, renderConfig.shadowAtlasSize);
 
 	// 3. The image attachments are used in the deffered pass to calcuate pixel colour based on lighting calculations
 	createDeferredPass();
@@ -148,8 +148,8 @@ void DeferredRenderer::createDeferredPipeline(std::unique_ptr<VulkanAPI::BufferM
                                               VulkanAPI::Swapchain& swapchain)
 {
 	// load the shaders and carry out reflection to create the pipeline and descriptor layouts
-	if (!state.shader.add(device, "renderer/deferred/deferred-vert.spv", VulkanAPI::StageType::Vertex,
-	                      "renderer/deferred/deferred-frag.spv", VulkanAPI::StageType::Fragment))
+	if (!state.shader.add(device, "Renderer/deferred/deferred-vert.spv", VulkanAPI::StageType::Vertex,
+	                      "Renderer/deferred/deferred-frag.spv", VulkanAPI::StageType::Fragment))
 	{
 		LOGGER_ERROR("Unable to load deferred renderer shaders.");
 	}
@@ -212,10 +212,25 @@ void DeferredRenderer::createDeferredPipeline(std::unique_ptr<VulkanAPI::BufferM
 		{
 			bufferManager->enqueueDescrUpdate("Camera", &state.descriptorSet, layout.set, layout.binding, layout.type);
 		}
-		if (layout.name == "LightUbo")
+		if (layout.name == "LightBuffer")
 		{
 			bufferManager->enqueueDescrUpdate("Light", &state.descriptorSet, layout.set, layout.binding, layout.type);
 		}
+		if (layout.name == "ClusterBuffer")
+		{
+			bufferManager->enqueueDescrUpdate("LightClusters", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type);
+		}
+		if (layout.name == "LightIndexBuffer")
+		{
+			bufferManager->enqueueDescrUpdate("LightIndices", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type);
+		}
+		if (layout.name == "ShadowBuffer")
+		{
+			bufferManager->enqueueDescrUpdate("LightShadows", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type);
+		}
 	}
 
 	// and finally create the pipeline
@@ -270,10 +285,20 @@ void DeferredRenderer::render(std::unique_ptr<VulkanAPI::Interface>& vkInterface
 			iblInterface->renderMaps(*vkInterface);
 		}
 
-		// draw all objects into the shadow offscreen depth buffer
-		Rendering::renderObjects(renderQueue, shadowRenderpass, shadowCmdBuffer, QueueType::Shadow, renderConfig, true);
+		// draw the shadow casters into the atlas - only the tiles of views that are out of date are cleared and drawn,
+		// the rest keep their depth from earlier frames
+		auto& shadowViews = lightManager->getShadowViews();
+		Rendering::renderObjects(renderQueue, shadowRenderpass, shadowCmdBuffer, QueueType::Shadow, renderConfig,
+		                         false, [&shadowViews](VulkanAPI::SecondaryCommandBuffer& cmdBuffer) {
+			                         RenderableShadow::clearShadowTiles(cmdBuffer, shadowViews);
+		                         });
 		shadowCmdBuffer->end();
 
+		for (auto& view : shadowViews)
+		{
+			view.needsRender = false;
+		}
+
 		auto& deferredCmdBuffer = cmdBufferManager->beginNewFame(deferredCmdBufferHandle);
 
 		// generate the g-buffers by drawing the components into the offscreen frame-buffers
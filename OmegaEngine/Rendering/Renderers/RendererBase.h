@@ -11,6 +11,7 @@ namespace VulkanAPI
 namespace OmegaEngine
 {
 	// forward defs
+	class LightManager;
 	class RenderInterface;
 	class RenderQueue;
 	enum class SceneType;
@@ -50,6 +51,12 @@ namespace OmegaEngine
 			return forwardRenderpass;
 		}
 
+		// the shadow views, and their tiles of the shadow atlas, belong to the light manager
+		void setLightManager(LightManager* manager)
+		{
+			lightManager = manager;
+		}
+
 		// abstract functions
 		virtual void render(std::unique_ptr<VulkanAPI::Interface>& vkInterface, SceneType sceneType, std::unique_ptr<RenderQueue>& renderQueue) = 0;
 
@@ -64,6 +71,8 @@ namespace OmegaEngine
 
 		// forward-pass - for skybox rendering in the deferred pipeline
 		VulkanAPI::RenderPass forwardRenderpass;
+
+		LightManager* lightManager = nullptr;
 		
 		RendererType type;
 	};
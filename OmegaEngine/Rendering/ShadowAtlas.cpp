@@ -0,0 +1,98 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace OmegaEngine
+{
+
+void ShadowAtlas::init(const uint32_t size)
+{
+	assert(size >= CellSize && (size & (size - 1)) == 0);
+
+	atlasSize = size;
+	gridSize = size / CellSize;
+	used.assign(gridSize * gridSize, 0);
+}
+
+void ShadowAtlas::reset()
+{
+	std::fill(used.begin(), used.end(), 0);
+}
+
+bool ShadowAtlas::isFree(const uint32_t cellX, const uint32_t cellY, const uint32_t cells) const
+{
+	for (uint32_t y = cellY; y < cellY + cells; ++y)
+	{
+		for (uint32_t x = cellX; x < cellX + cells; ++x)
+		{
+			if (used[y * gridSize + x])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void ShadowAtlas::fill(const uint32_t cellX, const uint32_t cellY, const uint32_t cells)
+{
+	for (uint32_t y = cellY; y < cellY + cells; ++y)
+	{
+		std::fill_n(used.begin() + y * gridSize + cellX, cells, 1);
+	}
+}
+
+bool ShadowAtlas::reserve(const Tile &tile)
+{
+	if (!tile.isValid() || tile.x + tile.size > atlasSize || tile.y + tile.size > atlasSize)
+	{
+		return false;
+	}
+
+	const uint32_t cells = tile.size / CellSize;
+	if (!isFree(tile.x / CellSize, tile.y / CellSize, cells))
+	{
+		return false;
+	}
+
+	fill(tile.x / CellSize, tile.y / CellSize, cells);
+	return true;
+}
+
+ShadowAtlas::Tile ShadowAtlas::allocate(const uint32_t size)
+{
+	uint32_t tileSize = std::min(std::max(size, CellSize), atlasSize);
+
+	// round down to a power of two
+	while (tileSize & (tileSize - 1))
+	{
+		tileSize &= tileSize - 1;
+	}
+
+	for (; tileSize >= CellSize; tileSize >>= 1)
+	{
+		// only the positions aligned to the tile size are tried
+		const uint32_t cells = tileSize / CellSize;
+		for (uint32_t y = 0; y < gridSize; y += cells)
+		{
+			for (uint32_t x = 0; x < gridSize; x += cells)
+			{
+				if (isFree(x, y, cells))
+				{
+					fill(x, y, cells);
+
+					Tile tile;
+					tile.x = x * CellSize;
+					tile.y = y * CellSize;
+					tile.size = tileSize;
+					return tile;
+				}
+			}
+		}
+	}
+
+	return Tile{};
+}
+
+} // namespace OmegaEngine
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace OmegaEngine
+{
+
+// Hands out square tiles of a single shadow depth image. Tiles are powers of two in size and aligned to their size,
+// so the atlas never fragments into gaps no tile can use. The tiles are worked out again each frame, but a tile
+// held last frame can be claimed back before anything new is placed, so its depth can be kept rather than redrawn
+class ShadowAtlas
+{
+
+public:
+	// the smallest tile - the atlas is tracked as a grid of cells of this size
+	static constexpr uint32_t CellSize = 128;
+
+	struct Tile
+	{
+		uint32_t x = 0;
+		uint32_t y = 0;
+
+		// zero if the light has no space in the atlas
+		uint32_t size = 0;
+
+		bool isValid() const
+		{
+			return size > 0;
+		}
+
+		bool operator==(const Tile &other) const
+		{
+			return x == other.x && y == other.y && size == other.size;
+		}
+	};
+
+	ShadowAtlas() = default;
+
+	// the size must be a power of two of at least the cell size
+	void init(const uint32_t atlasSize);
+
+	// frees all tiles, ready for the next frame
+	void reset();
+
+	// claims a tile from last frame - false if it has since been taken
+	bool reserve(const Tile &tile);
+
+	// places a tile of the given size, or the largest smaller size that still fits. The tile is invalid if the
+	// atlas is full
+	Tile allocate(const uint32_t size);
+
+	uint32_t getSize() const
+	{
+		return atlasSize;
+	}
+
+private:
+	bool isFree(const uint32_t cellX, const uint32_t cellY, const uint32_t cells) const;
+	void fill(const uint32_t cellX, const uint32_t cellY, const uint32_t cells);
+
+private:
+	uint32_t atlasSize = 0;
+	uint32_t gridSize = 0;
+
+	// one entry per cell, non-zero if held by a tile
+	std::vector<uint8_t> used;
+};
+
+} // namespace OmegaEngine
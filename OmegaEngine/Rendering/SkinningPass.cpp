@@ -0,0 +1,124 @@
+#include "SkinningPass.h"
+#include "Managers/MeshManager.h"
+#include "Rendering/RenderInterface.h"
+#include "Utility/logger.h"
+#include "VulkanAPI/BufferManager.h"
+#include "VulkanAPI/CommandBuffer.h"
+#include "VulkanAPI/Interface.h"
+#include "VulkanAPI/Pipeline.h"
+#include "VulkanAPI/Shader.h"
+
+namespace OmegaEngine
+{
+
+static_assert(sizeof(MeshManager::SkinnedVertex) == SkinningPass::InputStride * sizeof(float),
+              "The skinned vertex layout doesn't match the compute skinning shader.");
+static_assert(sizeof(MeshManager::Vertex) == SkinningPass::OutputStride * sizeof(float),
+              "The static vertex layout doesn't match the compute skinning shader.");
+
+SkinningPass::SkinningPass(VulkanAPI::Interface &vkInterface)
+{
+	cmdBufferHandle = vkInterface.getCmdBufferManager()->createInstance();
+}
+
+SkinningPass::~SkinningPass()
+{
+}
+
+void SkinningPass::createPipeline(VulkanAPI::Interface &vkInterface)
+{
+	if (!state.shader.add(vkInterface.getDevice(), "model/skinning-comp.spv", VulkanAPI::StageType::Compute))
+	{
+		LOGGER_ERROR("Unable to create compute skinning shader.");
+	}
+
+	state.shader.bufferReflection(state.descriptorLayout, state.bufferLayout);
+	state.descriptorLayout.create(vkInterface.getDevice());
+	state.descriptorSet.init(vkInterface.getDevice(), state.descriptorLayout);
+
+	auto &bufferManager = vkInterface.getBufferManager();
+	for (auto &layout : state.bufferLayout.layouts)
+	{
+		// the shader must use these identifying names for the buffers
+		if (layout.name == "SkinnedVertexIn")
+		{
+			bufferManager->enqueueDescrUpdate("SkinnedVertices", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type);
+		}
+		else if (layout.name == "SkinnedVertexOut")
+		{
+			bufferManager->enqueueDescrUpdate("SkinnedOutput", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type);
+		}
+		else if (layout.name == "Dynamic_SkinnedUbo")
+		{
+			bufferManager->enqueueDescrUpdate("SkinnedTransform", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type, layout.range);
+		}
+		else if (layout.name == "JointPalette")
+		{
+			bufferManager->enqueueDescrUpdate("SkinnedJoints", &state.descriptorSet, layout.set, layout.binding,
+			                                  layout.type);
+		}
+	}
+
+	state.shader.pipelineLayoutReflect(state.pipelineLayout);
+	state.pipelineLayout.create(vkInterface.getDevice(), state.descriptorLayout.getLayout());
+	state.pipeline.create(vkInterface.getDevice(), state.shader, state.pipelineLayout,
+	                      VulkanAPI::PipelineType::Compute);
+
+	isPrepared = true;
+}
+
+void SkinningPass::addMesh(VulkanAPI::Interface &vkInterface, StaticMesh &mesh, const uint32_t skinnedDynamicOffset)
+{
+	if (!isPrepared)
+	{
+		createPipeline(vkInterface);
+	}
+
+	jobs.push_back({ mesh.vertexBufferOffset, mesh.vertexCount, skinnedDynamicOffset });
+}
+
+void SkinningPass::render(VulkanAPI::Interface &vkInterface, SceneType sceneType)
+{
+	auto &cmdBufferManager = vkInterface.getCmdBufferManager();
+
+	// static scenes are only recorded once, as with the other passes
+	if (sceneType == SceneType::Static && cmdBufferManager->isRecorded(cmdBufferHandle))
+	{
+		return;
+	}
+
+	// the cmd buffer is submitted every frame, so is always recorded even when there is nothing to skin
+	auto &cmdBuffer = cmdBufferManager->beginNewFame(cmdBufferHandle);
+
+	if (!jobs.empty())
+	{
+		// the previous frame may still be reading the output as vertex input
+		cmdBuffer->memoryBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eComputeShader,
+		                         {}, {});
+
+		cmdBuffer->bindPipeline(state.pipeline);
+
+		for (auto &job : jobs)
+		{
+			cmdBuffer->bindDescriptors(state.pipelineLayout, state.descriptorSet, 1, &job.skinnedDynamicOffset,
+			                           VulkanAPI::PipelineType::Compute);
+
+			SkinningPushBlock pushBlock{ job.vertexOffset, job.vertexCount };
+			cmdBuffer->bindPushBlock(state.pipelineLayout, vk::ShaderStageFlagBits::eCompute,
+			                         sizeof(SkinningPushBlock), &pushBlock);
+
+			cmdBuffer->dispatch((job.vertexCount + WorkGroupSize - 1) / WorkGroupSize, 1, 1);
+		}
+
+		// make the skinned vertices visible to the vertex input of the following passes
+		cmdBuffer->memoryBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eVertexInput,
+		                         vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eVertexAttributeRead);
+	}
+
+	cmdBuffer->end();
+}
+
+}    // namespace OmegaEngine
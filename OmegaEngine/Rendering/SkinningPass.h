@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Rendering/ProgramStateManager.h"
+#include "VulkanAPI/CommandBufferManager.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace VulkanAPI
+{
+class Interface;
+}    // namespace VulkanAPI
+
+namespace OmegaEngine
+{
+struct StaticMesh;
+enum class SceneType;
+
+// Skins all the skinned vertices once per frame in a compute shader, before any of the passes which draw them.
+// The output uses the static vertex layout, so the shadow and gbuffer passes draw skinned meshes with the
+// static pipelines
+class SkinningPass
+{
+
+public:
+	// must match the local size declared in the compute shader
+	static constexpr uint32_t WorkGroupSize = 64;
+
+	// vertex sizes in floats - the shader reads and writes the vertices as float arrays
+	static constexpr uint32_t InputStride = 19;
+	static constexpr uint32_t OutputStride = 11;
+
+	struct SkinningJob
+	{
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+
+		// offset into the skinned dynamic buffer - where the joints for this mesh start in the palette
+		uint32_t skinnedDynamicOffset;
+	};
+
+	struct SkinningPushBlock
+	{
+		uint32_t vertexOffset;
+		uint32_t vertexCount;
+	};
+
+	SkinningPass(VulkanAPI::Interface &vkInterface);
+	~SkinningPass();
+
+	// the pipeline isn't created until the first mesh is added, as the descriptors rely on the
+	// vertex and joint buffers already being allocated
+	void createPipeline(VulkanAPI::Interface &vkInterface);
+
+	void addMesh(VulkanAPI::Interface &vkInterface, StaticMesh &mesh, const uint32_t skinnedDynamicOffset);
+
+	// records the skinning dispatches into this pass's cmd buffer. This is the first cmd buffer to be submitted
+	// each frame, so the output is ready for the shadow and gbuffer passes
+	void render(VulkanAPI::Interface &vkInterface, SceneType sceneType);
+
+private:
+	// the cmd buffer is created before the renderers, so it's submitted first
+	VulkanAPI::CmdBufferHandle cmdBufferHandle;
+
+	ProgramState state;
+	bool isPrepared = false;
+
+	std::vector<SkinningJob> jobs;
+};
+
+}    // namespace OmegaEngine
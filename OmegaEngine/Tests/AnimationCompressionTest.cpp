@@ -0,0 +1,228 @@
+#include "Models/AnimationCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace OmegaEngine;
+
+namespace
+{
+// allows for the float rounding when interpolating between the decoded keys
+constexpr float Epsilon = 1e-6f;
+
+// half a quantised step of a smallest three component - the components span +/- 1/sqrt(2) over 15 bits
+constexpr float HalfSmallestStep = 0.70710678f / CompressedTrack::MaxSmallest;
+
+uint32_t failures = 0;
+
+void check(const bool condition, const char *test, const char *message, const uint32_t key)
+{
+	if (!condition)
+	{
+		printf("%s failed: %s (key %u)\n", test, message, key);
+		++failures;
+	}
+}
+
+// samples the compressed track at one of the original keyframes, in the same way as the animation manager
+void sampleTrack(const CompressedTimeline &timeline, const CompressedTrack &track, const float time,
+                 const bool isStep, const bool isRotation, float *out)
+{
+	float units = std::floor(std::min(std::max(timeline.toUnits(time), 0.0f), CompressedTimeline::MaxUnits) + 0.5f);
+
+	uint32_t start = 0;
+	float phase = 0.0f;
+	if (timeline.size() > 1)
+	{
+		auto iter = std::upper_bound(timeline.keys.begin(), timeline.keys.end(), units,
+		                             [](const float value, const uint16_t key) { return value < key; });
+		start = static_cast<uint32_t>(iter - timeline.keys.begin());
+		start = std::min(std::max(start, 1u) - 1, timeline.size() - 2);
+
+		float interval = static_cast<float>(timeline.keys[start + 1] - timeline.keys[start]);
+		if (!isStep && interval > 0.0f)
+		{
+			phase = std::min(std::max((units - timeline.keys[start]) / interval, 0.0f), 1.0f);
+		}
+	}
+	uint32_t end = std::min(start + 1, timeline.size() - 1);
+
+	float startKey[4], endKey[4];
+	track.decodePair(start, end, startKey, endKey);
+
+	float length = 0.0f;
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		out[c] = startKey[c] * (1.0f - phase) + endKey[c] * phase;
+		length += out[c] * out[c];
+	}
+
+	if (isRotation && length > 0.0f)
+	{
+		length = std::sqrt(length);
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			out[c] /= length;
+		}
+	}
+}
+
+float componentError(const float *a, const OEMaths::vec4f &b, const uint32_t c)
+{
+	float value[4] = { b.getX(), b.getY(), b.getZ(), b.getW() };
+	return std::abs(a[c] - value[c]);
+}
+
+void testTranslation()
+{
+	AnimationCompressor::Settings settings;
+	AnimationCompressor compressor(settings);
+
+	// a straight line followed by a curve - the keys along the line should be removed
+	std::vector<float> timeStamps;
+	std::vector<OEMaths::vec4f> outputs;
+	for (uint32_t i = 0; i < 120; ++i)
+	{
+		float time = static_cast<float>(i) / 30.0f;
+		timeStamps.emplace_back(time);
+		if (i < 60)
+		{
+			outputs.emplace_back(time * 2.0f, 1.0f, -time, 0.0f);
+		}
+		else
+		{
+			outputs.emplace_back(4.0f + std::sin(time * 3.0f), 1.0f + std::cos(time), -2.0f, 0.0f);
+		}
+	}
+
+	CompressedTimeline timeline;
+	CompressedTrack track;
+	compressor.compress(timeStamps, outputs, AnimationCompressor::TrackType::Translation,
+	                    AnimationCompressor::KeyReduction::Linear, timeline, track);
+
+	check(track.format == CompressedTrack::Format::Ranged, "translation", "not a ranged track", 0);
+	check(timeline.size() == track.size(), "translation", "key and output counts differ", 0);
+	check(timeline.size() < timeStamps.size(), "translation", "no keys were removed", 0);
+
+	for (uint32_t i = 0; i < timeStamps.size(); ++i)
+	{
+		float key[4];
+		sampleTrack(timeline, track, timeStamps[i], false, false, key);
+
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			float bound = settings.translationTolerance + track.scale[c] * 0.5f + Epsilon;
+			check(componentError(key, outputs[i], c) <= bound, "translation", "error above the tolerance", i);
+		}
+	}
+
+	check(compressor.getStats().maxTranslationError <= settings.translationTolerance + track.scale[0] * 0.5f + Epsilon,
+	      "translation", "reported error above the tolerance", 0);
+}
+
+void testRotation()
+{
+	AnimationCompressor::Settings settings;
+	AnimationCompressor compressor(settings);
+
+	// a rotation around the y axis of more than a full turn, so the quaternion passes through its other
+	// hemisphere. Every other key is also given as -q, which is the same rotation
+	std::vector<float> timeStamps;
+	std::vector<OEMaths::vec4f> outputs;
+	for (uint32_t i = 0; i < 90; ++i)
+	{
+		float time = static_cast<float>(i) / 30.0f;
+		float halfAngle = time * 1.5f;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+
+		timeStamps.emplace_back(time);
+		outputs.emplace_back(0.0f, std::sin(halfAngle) * sign, 0.0f, std::cos(halfAngle) * sign);
+	}
+
+	CompressedTimeline timeline;
+	CompressedTrack track;
+	compressor.compress(timeStamps, outputs, AnimationCompressor::TrackType::Rotation,
+	                    AnimationCompressor::KeyReduction::Linear, timeline, track);
+
+	check(track.format == CompressedTrack::Format::SmallestThree, "rotation", "not a smallest three track", 0);
+	check(timeline.size() == track.size(), "rotation", "key and output counts differ", 0);
+	check(timeline.size() < timeStamps.size(), "rotation", "no keys were removed", 0);
+
+	for (uint32_t i = 0; i < timeStamps.size(); ++i)
+	{
+		float key[4];
+		sampleTrack(timeline, track, timeStamps[i], false, true, key);
+
+		// q and -q are the same rotation, so compare against whichever is closest
+		float value[4] = { outputs[i].getX(), outputs[i].getY(), outputs[i].getZ(), outputs[i].getW() };
+		float error = 0.0f;
+		float negatedError = 0.0f;
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			error = std::max(error, std::abs(key[c] - value[c]));
+			negatedError = std::max(negatedError, std::abs(key[c] + value[c]));
+		}
+
+		float bound = settings.rotationTolerance + HalfSmallestStep + Epsilon;
+		check(std::min(error, negatedError) <= bound, "rotation", "error above the tolerance", i);
+	}
+
+	check(compressor.getStats().maxRotationError <= settings.rotationTolerance + HalfSmallestStep + Epsilon,
+	      "rotation", "reported error above the tolerance", 0);
+}
+
+void testStep()
+{
+	AnimationCompressor::Settings settings;
+	AnimationCompressor compressor(settings);
+
+	// a scale which holds its value for ten keys at a time - only the changes should be kept
+	std::vector<float> timeStamps;
+	std::vector<OEMaths::vec4f> outputs;
+	for (uint32_t i = 0; i < 50; ++i)
+	{
+		float value = 1.0f + static_cast<float>(i / 10) * 0.25f;
+		timeStamps.emplace_back(static_cast<float>(i) * 0.1f);
+		outputs.emplace_back(value, value * 2.0f, 1.0f, 0.0f);
+	}
+
+	CompressedTimeline timeline;
+	CompressedTrack track;
+	compressor.compress(timeStamps, outputs, AnimationCompressor::TrackType::Scale,
+	                    AnimationCompressor::KeyReduction::Step, timeline, track);
+
+	check(timeline.size() == track.size(), "step", "key and output counts differ", 0);
+
+	// the first and last keys, and one at each of the four changes
+	check(timeline.size() == 6, "step", "unexpected number of keys kept", timeline.size());
+
+	for (uint32_t i = 0; i < timeStamps.size(); ++i)
+	{
+		float key[4];
+		sampleTrack(timeline, track, timeStamps[i], true, false, key);
+
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			float bound = settings.scaleTolerance + track.scale[c] * 0.5f + Epsilon;
+			check(componentError(key, outputs[i], c) <= bound, "step", "error above the tolerance", i);
+		}
+	}
+}
+
+} // namespace
+
+int main()
+{
+	testTranslation();
+	testRotation();
+	testStep();
+
+	if (failures > 0)
+	{
+		printf("%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
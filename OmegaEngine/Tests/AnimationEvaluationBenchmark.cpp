@@ -0,0 +1,193 @@
+#include "Managers/AnimationManager.h"
+#include "Models/ModelAnimation.h"
+#include "ObjectInterface/ComponentTypes.h"
+#include "ObjectInterface/Object.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+using namespace OmegaEngine;
+
+namespace
+{
+constexpr uint32_t JointCount = 32;
+constexpr uint32_t KeyCount = 60;
+constexpr float KeyRate = 30.0f;
+
+constexpr uint32_t FrameCount = 60;
+constexpr float FrameTime = 1.0f / 60.0f;
+
+// the joints are a chain, each a short distance above its parent
+constexpr float JointLength = 0.1f;
+
+// the skeletons are laid out on a grid around the camera, so all are within the full rate distance
+constexpr uint32_t GridWidth = 32;
+constexpr float GridSpacing = 0.5f;
+
+// stands in for the transform manager - the world matrices are fixed, as the poses aren't written back
+class BenchmarkTransforms : public AnimationManager::TransformSource
+{
+public:
+	void addNode(const OEMaths::vec3f &position, const uint32_t depth)
+	{
+		OEMaths::vec3f translation = position;
+		worldMatrices.emplace_back(OEMaths::mat4f::translate(translation));
+		depths.emplace_back(depth);
+	}
+
+	void getLocalPose(const std::vector<uint32_t> &indices, OEMaths::TransformArrays &pose) override
+	{
+		pose = OEMaths::TransformArrays();
+		for (uint32_t index : indices)
+		{
+			float height = depths[index] > 0 ? JointLength : 0.0f;
+			pose.add(OEMaths::vec3f{ 0.0f, height, 0.0f }, OEMaths::vec3f{ 1.0f, 1.0f, 1.0f },
+			         OEMaths::quatf{ 0.0f, 0.0f, 0.0f, 1.0f });
+		}
+	}
+
+	const OEMaths::mat4f &getWorldMatrix(const uint32_t index) override
+	{
+		return worldMatrices[index];
+	}
+
+	uint32_t getDepth(const uint32_t index) override
+	{
+		return depths[index];
+	}
+
+private:
+	std::vector<OEMaths::mat4f> worldMatrices;
+	std::vector<uint32_t> depths;
+};
+
+// each joint sways about the z axis and bobs along y, offset in phase down the chain
+std::unique_ptr<ModelAnimation> buildAnimation()
+{
+	auto animation = std::make_unique<ModelAnimation>();
+	animation->name = "benchmark";
+	animation->start = 0.0f;
+	animation->end = (KeyCount - 1) / KeyRate;
+
+	for (uint32_t joint = 0; joint < JointCount; ++joint)
+	{
+		ModelAnimation::Sampler rotation;
+		ModelAnimation::Sampler translation;
+		rotation.interpolation = "LINEAR";
+		translation.interpolation = "LINEAR";
+
+		for (uint32_t key = 0; key < KeyCount; ++key)
+		{
+			float time = key / KeyRate;
+			float phase = 6.2831853f * key / (KeyCount - 1) + joint * 0.2f;
+			float angle = 0.25f * std::sin(phase);
+
+			rotation.timeStamps.emplace_back(time);
+			rotation.outputs.emplace_back(0.0f, 0.0f, std::sin(angle * 0.5f), std::cos(angle * 0.5f));
+			translation.timeStamps.emplace_back(time);
+			translation.outputs.emplace_back(0.0f, JointLength + 0.01f * std::cos(phase), 0.0f, 0.0f);
+		}
+
+		uint32_t samplerIndex = static_cast<uint32_t>(animation->samplers.size());
+		animation->samplers.emplace_back(rotation);
+		animation->samplers.emplace_back(translation);
+		animation->channels.push_back({ "rotation", samplerIndex });
+		animation->channels.push_back({ "translation", samplerIndex + 1 });
+	}
+	return animation;
+}
+
+struct Scene
+{
+	AnimationManager manager;
+	BenchmarkTransforms transforms;
+	std::vector<std::unique_ptr<Object>> nodes;
+};
+
+void buildScene(Scene &scene, const uint32_t skeletonCount)
+{
+	for (uint32_t i = 0; i < skeletonCount; ++i)
+	{
+		uint32_t bufferOffset = scene.manager.getBufferOffset();
+		uint32_t skeletonIndex = scene.manager.addSkeleton();
+		auto animation = buildAnimation();
+		scene.manager.addAnimation(animation, skeletonIndex);
+
+		float x = (static_cast<float>(i % GridWidth) - GridWidth * 0.5f) * GridSpacing;
+		float z = (static_cast<float>(i / GridWidth) - GridWidth * 0.5f) * GridSpacing;
+
+		for (uint32_t joint = 0; joint < JointCount; ++joint)
+		{
+			uint32_t transformIndex = i * JointCount + joint;
+			scene.transforms.addNode(OEMaths::vec3f{ x, joint * JointLength, z }, joint);
+
+			auto node = std::make_unique<Object>(transformIndex);
+			std::unique_ptr<ModelTransform> transform;
+			node->addComponent<TransformComponent>(transform);
+			node->getComponent<TransformComponent>().index = transformIndex;
+
+			std::vector<uint32_t> channels = { joint * 2, joint * 2 + 1 };
+			AnimationComponent component(0, channels, bufferOffset);
+			scene.manager.addComponentToManager(&component, *node);
+
+			scene.nodes.emplace_back(std::move(node));
+		}
+	}
+
+	// every skeleton is evaluated each frame, so the timings aren't skewed by the lods
+	AnimationManager::LodSettings settings;
+	settings.halfRateDistance = 1000.0f;
+	settings.quarterRateDistance = 1000.0f;
+	settings.boneReductionDistance = 0.0f;
+	settings.pauseOffscreen = false;
+	scene.manager.setLodSettings(settings);
+
+	scene.manager.prepareSkeletons(scene.transforms);
+}
+
+// returns the average time of a frame in milliseconds
+double timeFrames(Scene &scene, const bool threaded)
+{
+	// planes which contain everything
+	float frustumPlanes[24];
+	for (uint32_t i = 0; i < 24; ++i)
+	{
+		frustumPlanes[i] = (i % 4) == 3 ? 1.0f : 0.0f;
+	}
+	const OEMaths::vec3f cameraPos{ 0.0f, 1.0f, 0.0f };
+
+	// the first frame sizes the batches and poses
+	scene.manager.evaluateSkeletons(scene.transforms, cameraPos, frustumPlanes, FrameTime, threaded);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t frame = 0; frame < FrameCount; ++frame)
+	{
+		scene.manager.evaluateSkeletons(scene.transforms, cameraPos, frustumPlanes, FrameTime, threaded);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - start).count() / FrameCount;
+}
+} // namespace
+
+int main()
+{
+	// timings only - the results vary with the machine, so the benchmark never fails
+	const uint32_t skeletonCounts[] = { 1, 10, 100, 1000 };
+
+	printf("%u joints per skeleton, %u frames\n", JointCount, FrameCount);
+	for (uint32_t count : skeletonCounts)
+	{
+		Scene scene;
+		buildScene(scene, count);
+
+		double serial = timeFrames(scene, false);
+		double pooled = timeFrames(scene, true);
+		printf("%5u skeletons: serial %8.3f ms, pooled %8.3f ms, speed up %.2fx\n", count, serial, pooled,
+		       pooled > 0.0 ? serial / pooled : 0.0);
+	}
+	return 0;
+}
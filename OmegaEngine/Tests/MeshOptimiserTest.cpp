@@ -0,0 +1,158 @@
+#include "Models/MeshOptimiser.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace OmegaEngine;
+
+namespace
+{
+constexpr uint32_t GridSize = 32;
+constexpr uint32_t CacheSize = 16;
+
+uint32_t failures = 0;
+
+void check(const bool condition, const char *test, const char *message)
+{
+	if (!condition)
+	{
+		printf("%s failed: %s\n", test, message);
+		++failures;
+	}
+}
+
+// a flat grid of quads, each split into two triangles. The triangles are shuffled so the input
+// order has no locality for the cache optimisation to start from
+void buildGrid(std::vector<float> &positions, std::vector<uint32_t> &indices, const bool shuffle)
+{
+	const uint32_t rowSize = GridSize + 1;
+	for (uint32_t y = 0; y < rowSize; ++y)
+	{
+		for (uint32_t x = 0; x < rowSize; ++x)
+		{
+			positions.emplace_back(static_cast<float>(x));
+			positions.emplace_back(static_cast<float>(y));
+			positions.emplace_back(0.0f);
+		}
+	}
+
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (uint32_t y = 0; y < GridSize; ++y)
+	{
+		for (uint32_t x = 0; x < GridSize; ++x)
+		{
+			uint32_t i0 = y * rowSize + x;
+			uint32_t i1 = i0 + 1;
+			uint32_t i2 = i0 + rowSize;
+			uint32_t i3 = i2 + 1;
+			triangles.push_back({ i0, i2, i1 });
+			triangles.push_back({ i1, i2, i3 });
+		}
+	}
+
+	if (shuffle)
+	{
+		std::mt19937 rng(1234);
+		std::shuffle(triangles.begin(), triangles.end(), rng);
+	}
+
+	for (const auto &tri : triangles)
+	{
+		indices.insert(indices.end(), tri.begin(), tri.end());
+	}
+}
+
+// the triangles of the index list, each rotated so its smallest index is first. The winding is kept,
+// so a flipped triangle won't match
+std::vector<std::array<uint32_t, 3>> sortedTriangles(const std::vector<uint32_t> &indices)
+{
+	std::vector<std::array<uint32_t, 3>> triangles;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		std::array<uint32_t, 3> tri = { indices[i], indices[i + 1], indices[i + 2] };
+		std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+		triangles.emplace_back(tri);
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+bool isPermutation(const std::vector<uint32_t> &input, const std::vector<uint32_t> &output)
+{
+	return input.size() == output.size() && sortedTriangles(input) == sortedTriangles(output);
+}
+
+void testVertexCache(const bool shuffle)
+{
+	const char *name = shuffle ? "vertex cache (shuffled grid)" : "vertex cache (ordered grid)";
+
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	buildGrid(positions, indices, shuffle);
+	const size_t vertexCount = positions.size() / 3;
+
+	std::vector<uint32_t> output(indices.size());
+	MeshOptimiser::optimiseVertexCache(indices.data(), indices.size(), vertexCount, output.data());
+
+	check(isPermutation(indices, output), name, "output isn't a permutation of the input triangles");
+
+	auto before = MeshOptimiser::analyseVertexCache(indices.data(), indices.size(), vertexCount, CacheSize);
+	auto after = MeshOptimiser::analyseVertexCache(output.data(), output.size(), vertexCount, CacheSize);
+	printf("%s: acmr %.3f -> %.3f\n", name, before.acmr, after.acmr);
+
+	check(after.acmr <= before.acmr, name, "acmr is worse than the input");
+
+	// the forsyth ordering of a grid should be well under one miss per triangle
+	check(after.acmr < 1.0f, name, "acmr is above 1.0");
+}
+
+void testOverdraw()
+{
+	const char *name = "overdraw";
+	const float threshold = 1.05f;
+
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	buildGrid(positions, indices, true);
+	const size_t vertexCount = positions.size() / 3;
+
+	// the overdraw pass expects cache optimised input
+	std::vector<uint32_t> cacheOptimised(indices.size());
+	MeshOptimiser::optimiseVertexCache(indices.data(), indices.size(), vertexCount, cacheOptimised.data());
+
+	std::vector<uint32_t> output(indices.size());
+	MeshOptimiser::optimiseOverdraw(cacheOptimised.data(), cacheOptimised.size(), positions.data(), vertexCount,
+	                                3 * sizeof(float), CacheSize, threshold, output.data());
+
+	check(isPermutation(indices, output), name, "output isn't a permutation of the input triangles");
+
+	auto before = MeshOptimiser::analyseVertexCache(indices.data(), indices.size(), vertexCount, CacheSize);
+	auto cached = MeshOptimiser::analyseVertexCache(cacheOptimised.data(), cacheOptimised.size(), vertexCount,
+	                                                CacheSize);
+	auto after = MeshOptimiser::analyseVertexCache(output.data(), output.size(), vertexCount, CacheSize);
+	printf("%s: acmr %.3f -> %.3f\n", name, before.acmr, after.acmr);
+
+	check(after.acmr <= before.acmr, name, "acmr is worse than the input");
+
+	// the clusters may only give up as much of the cache gain as the threshold allows
+	check(after.acmr <= cached.acmr * threshold, name, "acmr is above the threshold of the cache optimised order");
+}
+
+} // namespace
+
+int main()
+{
+	testVertexCache(false);
+	testVertexCache(true);
+	testOverdraw();
+
+	if (failures > 0)
+	{
+		printf("%u checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <queue>
 
@@ -19,7 +20,7 @@ public:
 
 	bool tryPop(T& value)
 	{
-		std::lock_guard<std::mutex> lock{ qeueMutex };
+		std::lock_guard<std::mutex> lock{ queueMutex };
 		if (values.empty() || finished)
 		{
 			return false;
@@ -1,9 +1,13 @@
 #include "BufferManager.h"
+#include "VulkanAPI/CommandBufferManager.h"
 #include "VulkanAPI/Descriptors.h"
 #include "utility/logger.h"
 
 #include "Engine/Omega_Global.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace VulkanAPI
 {
 namespace Util
@@ -50,6 +54,38 @@ void createBuffer(vk::Device &device, vk::PhysicalDevice &gpu, const uint32_t si
 }
 } // namespace Util
 
+MappedBuffer::MappedBuffer(const char *_id, const uint32_t elementSize, const uint32_t _chunkSize,
+                           const bool alignElements)
+    : id(_id)
+    , alignedSize(alignElements ? Util::alignmentSize(elementSize) : elementSize)
+    , chunkSize(_chunkSize)
+{
+}
+
+bool MappedBuffer::reserve(const uint32_t count)
+{
+	if (count <= capacity)
+	{
+		return false;
+	}
+
+	// grow in whole chunks, though at least double to keep the number of moves down for large scenes
+	uint32_t newCapacity = ((count + chunkSize - 1) / chunkSize) * chunkSize;
+	newCapacity = std::max(newCapacity, capacity * 2);
+
+	BufferMapEvent event{ id, static_cast<uint64_t>(newCapacity) * alignedSize };
+	OmegaEngine::Global::eventManager()->instantNotification<BufferMapEvent>(event);
+
+	if (!event.mapped)
+	{
+		LOGGER_ERROR("Unable to map buffer with id: %s", id);
+	}
+
+	data = event.mapped;
+	capacity = newCapacity;
+	return true;
+}
+
 BufferManager::BufferManager(vk::Device dev, vk::PhysicalDevice physicalDevice, Queue queue)
     : device(dev)
     , gpu(physicalDevice)
@@ -57,6 +93,8 @@ BufferManager::BufferManager(vk::Device dev, vk::PhysicalDevice physicalDevice,
 {
 	OmegaEngine::Global::eventManager()
 	    ->registerListener<BufferManager, BufferUpdateEvent, &BufferManager::updateBuffer>(this);
+	OmegaEngine::Global::eventManager()
+	    ->registerListener<BufferManager, BufferMapEvent, &BufferManager::mapBuffer>(this);
 
 	memoryAllocator = std::make_unique<MemoryAllocator>(device, gpu, graphicsQueue);
 }
@@ -71,15 +109,14 @@ void BufferManager::enqueueDescrUpdate(DescrSetUpdateInfo &descriptorUpdate)
 }
 
 void BufferManager::enqueueDescrUpdate(const char *id, DescriptorSet *set, uint32_t setValue,
-                                       uint32_t binding, vk::DescriptorType descriptorType)
+                                       uint32_t binding, vk::DescriptorType descriptorType, uint64_t range)
 {
-	descriptorSetUpdateQueue.push_back({ id, set, setValue, binding, descriptorType });
+	descriptorSetUpdateQueue.push_back({ id, set, setValue, binding, descriptorType, range });
 }
 
 void BufferManager::updateBuffer(BufferUpdateEvent &event)
 {
 	// sanity debugging checks
-	assert(event.data != nullptr);
 	assert(event.size > 0);
 
 	MemorySegment buffer;
@@ -98,26 +135,93 @@ void BufferManager::updateBuffer(BufferUpdateEvent &event)
 	// check that the maanger doesn't already contain the same id - if it does then update the buffer
 	if (iter != buffers.end())
 	{
+		// no data for an existing buffer is a request for more room
+		if (!event.data)
+		{
+			if (iter->second.getSize() < event.size)
+			{
+				moveBuffer(iter->first, iter->second, event.memoryType, event.size);
+			}
+			return;
+		}
 
 		buffer = iter->second;
-		memoryAllocator->mapDataToSegment(buffer, event.data, event.size);
+		memoryAllocator->mapDataToSegment(buffer, event.data, event.size, event.offset);
 
 		if (event.flushMemory)
 		{
 			vk::MappedMemoryRange mem_range(memoryAllocator->getDeviceMemory(buffer.getId()),
-			                                (uint64_t)buffer.getOffset(), event.size);
+			                                (uint64_t)buffer.getOffset() + event.offset, event.size);
 			device.flushMappedMemoryRanges(1, &mem_range);
 		}
 	}
 	else
 	{
-		// otherwise create a new memory segment
+		// otherwise create a new memory segment - sub-range updates are only valid for existing buffers
+		assert(event.offset == 0);
 		MemorySegment buffer = memoryAllocator->allocate(event.memoryType, event.size);
-		memoryAllocator->mapDataToSegment(buffer, event.data, event.size);
+
+		// no data means the buffer will be written on the gpu side - i.e. by a compute shader
+		if (event.data)
+		{
+			memoryAllocator->mapDataToSegment(buffer, event.data, event.size);
+		}
 		buffers[event.id] = buffer;
 	}
 }
 
+void BufferManager::mapBuffer(BufferMapEvent &event)
+{
+	assert(event.size > 0);
+
+	auto iter = buffers.begin();
+	while (iter != buffers.end())
+	{
+		if (std::strcmp(iter->first, event.id) == 0)
+		{
+			break;
+		}
+		iter++;
+	}
+
+	if (iter == buffers.end())
+	{
+		MemorySegment segment =
+		    memoryAllocator->allocate(MemoryUsage::VK_BUFFER_DYNAMIC, static_cast<uint32_t>(event.size));
+		buffers[event.id] = segment;
+		event.mapped = memoryAllocator->getMappedPtr(segment);
+		return;
+	}
+
+	MemorySegment &segment = iter->second;
+	if (segment.getSize() < event.size)
+	{
+		// too small, so move to a larger segment and copy the current contents across
+		moveBuffer(iter->first, segment, MemoryUsage::VK_BUFFER_DYNAMIC, event.size);
+	}
+
+	event.mapped = memoryAllocator->getMappedPtr(segment);
+}
+
+void BufferManager::moveBuffer(const char *id, MemorySegment &segment, MemoryUsage usage, const uint64_t size)
+{
+	MemorySegment newSegment = memoryAllocator->allocate(usage, static_cast<uint32_t>(size));
+	memoryAllocator->copySegment(segment, newSegment, segment.getSize());
+
+	// the old segment is only destroyed once the cmd buffers in flight have completed
+	retiredSegments.emplace_back(segment);
+	segment = newSegment;
+
+	// the descriptors pointing at the old segment are now stale - they are rewritten at the next update
+	for (auto &binding : descriptorBindings)
+	{
+		if (std::strcmp(binding.id, id) == 0)
+		{
+			descriptorSetUpdateQueue.emplace_back(binding);
+		}
+	}
+}
+
 void BufferManager::updateDescriptors()
 {
 
@@ -145,7 +249,20 @@ void BufferManager::updateDescriptors()
 				MemorySegment segment = iter->second;
 				descr.set->writeSet(descr.setValue, descr.binding, descr.descriptorType,
 				                    memoryAllocator->getMemoryBuffer(segment.getId()),
-				                    segment.getOffset(), segment.getSize());
+				                    segment.getOffset(),
+				                    descr.range ? static_cast<uint32_t>(descr.range) : segment.getSize());
+
+				// keep a record in case the buffer is moved - rebinds are already in the list
+				auto bindIter = std::find_if(descriptorBindings.begin(), descriptorBindings.end(),
+				                             [&descr](const DescrSetUpdateInfo &info) {
+					                             return info.set == descr.set &&
+					                                    info.setValue == descr.setValue &&
+					                                    info.binding == descr.binding;
+				                             });
+				if (bindIter == descriptorBindings.end())
+				{
+					descriptorBindings.emplace_back(descr);
+				}
 			}
 		}
 	}
@@ -153,9 +270,24 @@ void BufferManager::updateDescriptors()
 	descriptorSetUpdateQueue.clear();
 }
 
-void BufferManager::update()
+bool BufferManager::update(CommandBufferManager &cmdBufferManager)
 {
+	// the sets of moved buffers aren't update after bind, so can't be rewritten whilst bound by a cmd buffer which
+	// is pending or will be submitted again
+	bool moved = !retiredSegments.empty();
+	if (moved)
+	{
+		cmdBufferManager.invalidateRecorded();
+
+		for (auto &segment : retiredSegments)
+		{
+			memoryAllocator->destroySegment(segment);
+		}
+		retiredSegments.clear();
+	}
+
 	updateDescriptors();
+	return moved;
 }
 
 Buffer BufferManager::getBuffer(const char *id)
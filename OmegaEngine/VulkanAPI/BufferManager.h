@@ -20,7 +20,10 @@ uint32_t alignmentSize(const uint32_t size);
 
 // forward decleartions
 class DescriptorSet;
+class CommandBufferManager;
 
+// if no data is given, the buffer is allocated but left uninitialised - for buffers written by the gpu. If the buffer
+// already exists and is smaller than the size given, it is moved to a larger segment and its contents copied across
 struct BufferUpdateEvent : public OmegaEngine::Event
 {
 	BufferUpdateEvent(const char *_id, void *_data, uint64_t _size, MemoryUsage _usage)
@@ -40,6 +43,18 @@ struct BufferUpdateEvent : public OmegaEngine::Event
 	{
 	}
 
+	// used for updating a sub-range of an already existing buffer - offset is in bytes from the start of the buffer
+	BufferUpdateEvent(const char *_id, void *_data, uint64_t _size, MemoryUsage _usage, bool flush,
+	                  uint64_t _offset)
+	    : id(_id)
+	    , data(_data)
+	    , size(_size)
+	    , memoryType(_usage)
+	    , flushMemory(flush)
+	    , offset(_offset)
+	{
+	}
+
 	BufferUpdateEvent()
 	{
 	}
@@ -49,6 +64,73 @@ struct BufferUpdateEvent : public OmegaEngine::Event
 	uint64_t size = 0;
 	MemoryUsage memoryType;
 	bool flushMemory = false;
+	uint64_t offset = 0;
+};
+
+// requests a persistently mapped host buffer of at least the specified size. The mapped pointer is returned
+// through the event, so this must be sent via instantNotification rather than queued.
+// If an exsisting buffer is too small, it will be moved and its contents copied across
+struct BufferMapEvent : public OmegaEngine::Event
+{
+	BufferMapEvent(const char *_id, uint64_t _size)
+	    : id(_id)
+	    , size(_size)
+	{
+	}
+
+	BufferMapEvent()
+	{
+	}
+
+	const char *id;
+	uint64_t size = 0;
+	void *mapped = nullptr;
+};
+
+// A growable array of elements which lives in persistently mapped gpu memory. Elements are written
+// in place so there is no need for a BufferUpdateEvent. The capacity grows in chunks; if the buffer moves,
+// the buffer manager rebinds any descriptors which use it.
+// Elements are aligned for use with dynamic offsets, unless the buffer is indexed as an array in the shader
+// (i.e. a storage buffer), in which case they are tightly packed
+class MappedBuffer
+{
+public:
+	MappedBuffer(const char *id, const uint32_t elementSize, const uint32_t chunkSize,
+	             const bool alignElements = true);
+
+	// ensures there is room for the required number of elements - returns true if the buffer was reallocated
+	bool reserve(const uint32_t count);
+
+	template <typename T>
+	T *get(const uint32_t index)
+	{
+		assert(index < capacity);
+		return reinterpret_cast<T *>(static_cast<uint8_t *>(data) + index * alignedSize);
+	}
+
+	// the byte offset of an element - used for dynamic buffer offsets
+	uint32_t getOffset(const uint32_t index) const
+	{
+		return index * alignedSize;
+	}
+
+	uint32_t getAlignedSize() const
+	{
+		return alignedSize;
+	}
+
+	uint32_t getCapacity() const
+	{
+		return capacity;
+	}
+
+private:
+	const char *id;
+	uint32_t alignedSize = 0;
+	uint32_t chunkSize = 0;
+	uint32_t capacity = 0;
+
+	void *data = nullptr;
 };
 
 struct Buffer
@@ -67,6 +149,10 @@ public:
 		uint32_t setValue = 0;
 		uint32_t binding = 0;
 		vk::DescriptorType descriptorType;
+
+		// zero binds the whole buffer. Dynamic buffers must give the size of one element, as the
+		// dynamic offset is added on top
+		uint64_t range = 0;
 	};
 
 	BufferManager(vk::Device dev, vk::PhysicalDevice physicalDevice, Queue qeuue);
@@ -74,16 +160,23 @@ public:
 
 	void enqueueDescrUpdate(DescrSetUpdateInfo &descriptorUpdate);
 	void enqueueDescrUpdate(const char *id, DescriptorSet *set, uint32_t setValue, uint32_t binding,
-	                        vk::DescriptorType descriptorType);
+	                        vk::DescriptorType descriptorType, uint64_t range = 0);
 
-	void update();
+	// buffers moved since the last frame are released here, once the cmd buffers which may still use them have
+	// completed. These are then recorded again, as the sets they bind are rewritten. Returns true if any buffers
+	// were moved, in which case handles from getBuffer must be fetched again
+	bool update(CommandBufferManager &cmdBufferManager);
 	void updateDescriptors();
 	void updateBuffer(BufferUpdateEvent &event);
+	void mapBuffer(BufferMapEvent &event);
 
 	// returns a wrapper containing vulkan memory buffer information
 	Buffer getBuffer(const char *id);
 
 private:
+	// moves the buffer to a larger segment, copying its contents, and queues the rebinding of its descriptors
+	void moveBuffer(const char *id, MemorySegment &segment, MemoryUsage usage, const uint64_t size);
+
 	// local vulkan instance
 	vk::Device device;
 	vk::PhysicalDevice gpu;
@@ -95,6 +188,12 @@ private:
 
 	// a queue of descriptor sets which need updating this frame
 	std::vector<DescrSetUpdateInfo> descriptorSetUpdateQueue;
+
+	// descriptor sets which have been written - kept so they can be rebound if a buffer is moved
+	std::vector<DescrSetUpdateInfo> descriptorBindings;
+
+	// the segments of moved buffers - the previous frame may still be reading from these
+	std::vector<MemorySegment> retiredSegments;
 };
 
 } // namespace VulkanAPI
@@ -290,6 +290,18 @@ void CommandBuffer::drawQuad()
 	cmdBuffer.draw(3, 1, 0, 0);
 }
 
+void CommandBuffer::dispatch(const uint32_t groupCountX, const uint32_t groupCountY, const uint32_t groupCountZ)
+{
+	cmdBuffer.dispatch(groupCountX, groupCountY, groupCountZ);
+}
+
+void CommandBuffer::memoryBarrier(vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage,
+                                  vk::AccessFlags srcAccess, vk::AccessFlags dstAccess)
+{
+	vk::MemoryBarrier barrier(srcAccess, dstAccess);
+	cmdBuffer.pipelineBarrier(srcStage, dstStage, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
 // secondary command buffer functions ===========================
 SecondaryCommandBuffer::SecondaryCommandBuffer()
 {
@@ -410,6 +422,11 @@ void SecondaryCommandBuffer::bindIndexBuffer(vk::Buffer &buffer, uint32_t offset
 	cmdBuffer.bindIndexBuffer(buffer, offset, vk::IndexType::eUint32);
 }
 
+void SecondaryCommandBuffer::bindIndexBuffer(vk::Buffer &buffer, uint32_t offset, vk::IndexType type)
+{
+	cmdBuffer.bindIndexBuffer(buffer, offset, type);
+}
+
 void SecondaryCommandBuffer::setViewport()
 {
 	cmdBuffer.setViewport(0, 1, &viewPort);
@@ -420,11 +437,28 @@ void SecondaryCommandBuffer::setScissor()
 	cmdBuffer.setScissor(0, 1, &scissor);
 }
 
+void SecondaryCommandBuffer::setViewport(const vk::Viewport &viewport)
+{
+	cmdBuffer.setViewport(0, 1, &viewport);
+}
+
+void SecondaryCommandBuffer::setScissor(const vk::Rect2D &rect)
+{
+	cmdBuffer.setScissor(0, 1, &rect);
+}
+
 void SecondaryCommandBuffer::setDepthBias(float biasConstant, float biasClamp, float biasSlope)
 {
 	cmdBuffer.setDepthBias(biasConstant, biasClamp, biasSlope);
 }
 
+void SecondaryCommandBuffer::clearDepthAttachment(const vk::Rect2D &rect)
+{
+	vk::ClearAttachment attachment(vk::ImageAspectFlagBits::eDepth, 0, vk::ClearDepthStencilValue(1.0f, 0));
+	vk::ClearRect clearRect(rect, 0, 1);
+	cmdBuffer.clearAttachments(1, &attachment, 1, &clearRect);
+}
+
 void SecondaryCommandBuffer::drawIndexed(uint32_t indexCount)
 {
 	cmdBuffer.drawIndexed(indexCount, 1, 0, 0, 0);
@@ -435,6 +469,12 @@ void SecondaryCommandBuffer::drawIndexed(const uint32_t indexCount, const uint32
 	cmdBuffer.drawIndexed(indexCount, 1, indexOffset, 0, 0);
 }
 
+void SecondaryCommandBuffer::drawIndexed(const uint32_t indexCount, const uint32_t indexOffset,
+                                         const int32_t vertexOffset, const uint32_t firstInstance)
+{
+	cmdBuffer.drawIndexed(indexCount, 1, indexOffset, vertexOffset, firstInstance);
+}
+
 // command pool functions =====================================================================
 
 void CommandBuffer::createCmdPool()
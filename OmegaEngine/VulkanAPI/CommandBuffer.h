@@ -49,14 +49,25 @@ public:
 	                   void *data);
 	void bindVertexBuffer(vk::Buffer &buffer, vk::DeviceSize offset);
 	void bindIndexBuffer(vk::Buffer &buffer, uint32_t offset);
+	void bindIndexBuffer(vk::Buffer &buffer, uint32_t offset, vk::IndexType type);
 
 	void setViewport();
 	void setScissor();
+	void setViewport(const vk::Viewport &viewport);
+	void setScissor(const vk::Rect2D &rect);
 	void setDepthBias(float biasConstant, float biasClamp, float biasSlope);
 
+	// clears part of the depth attachment of the current pass to the far plane
+	void clearDepthAttachment(const vk::Rect2D &rect);
+
 	void drawIndexed(uint32_t indexCount);
 	void drawIndexed(const uint32_t indexCount, const uint32_t indexOffset);
 
+	// the vertex offset is added to each index. The first instance is visible to the shader as gl_InstanceIndex,
+	// so can be used to index per-draw data
+	void drawIndexed(const uint32_t indexCount, const uint32_t indexOffset, const int32_t vertexOffset,
+	                 const uint32_t firstInstance);
+
 	// helper funcs
 	vk::CommandBuffer &get()
 	{
@@ -141,6 +152,13 @@ public:
 	void drawIndexed(uint32_t indexCount);
 	void drawQuad();
 
+	// compute functions
+	void dispatch(const uint32_t groupCountX, const uint32_t groupCountY, const uint32_t groupCountZ);
+
+	// synchronisation - a global memory barrier between the two stages
+	void memoryBarrier(vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage,
+	                   vk::AccessFlags srcAccess, vk::AccessFlags dstAccess);
+
 	// command pool
 	void createCmdPool();
 
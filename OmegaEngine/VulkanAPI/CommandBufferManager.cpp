@@ -125,6 +125,19 @@ std::unique_ptr<VulkanAPI::CommandBuffer> &CommandBufferManager::beginNewFame(
 	return cmdBuffers[handle].cmdBuffer;
 }
 
+void CommandBufferManager::invalidateRecorded()
+{
+	for (auto &buffer : cmdBuffers)
+	{
+		if (buffer.cmdBuffer != nullptr)
+		{
+			// the buffer was submitted last frame, so the fence will be signalled
+			VK_CHECK_RESULT(device.waitForFences(1, &buffer.fence, VK_TRUE, UINT64_MAX));
+			buffer.cmdBuffer.reset();
+		}
+	}
+}
+
 void CommandBufferManager::submitOnce(CmdBufferHandle handle)
 {
 }
@@ -68,6 +68,10 @@ public:
 		return cmdBuffers[handle].cmdBuffer != nullptr;
 	}
 
+	// waits for the recorded buffers to complete and then discards them, so they are recorded again on the next
+	// frame. Static scenes only record their cmd buffers once, so this is needed whenever what they draw changes
+	void invalidateRecorded();
+
 private:
 	vk::Device &device;
 	vk::PhysicalDevice gpu;
@@ -1,4 +1,7 @@
 #include "Descriptors.h"
+#include "Utility/GeneralUtil.h"
+
+#include <algorithm>
 
 namespace VulkanAPI
 {
@@ -16,6 +19,16 @@ void writeSet(vk::Device device, vk::DescriptorSet &descriptorSet, uint32_t set,
 }
 } // namespace Util
 
+// the number of descriptors of each type a pool has room for, per set
+static const vk::DescriptorPoolSize poolSizesPerSet[] = { { vk::DescriptorType::eUniformBuffer, 4 },
+	                                                      { vk::DescriptorType::eUniformBufferDynamic, 2 },
+	                                                      { vk::DescriptorType::eStorageBuffer, 4 },
+	                                                      { vk::DescriptorType::eStorageBufferDynamic, 2 },
+	                                                      { vk::DescriptorType::eCombinedImageSampler, 4 },
+	                                                      { vk::DescriptorType::eStorageImage, 2 } };
+
+std::atomic<uint32_t> DescriptorSet::writeCount{ 0 };
+
 DescriptorLayout::DescriptorLayout()
 {
 }
@@ -25,33 +38,65 @@ DescriptorLayout::~DescriptorLayout()
 }
 
 void DescriptorLayout::addLayout(uint32_t set, uint32_t binding, vk::DescriptorType bindType,
-                                 vk::ShaderStageFlags flags)
+                                 vk::ShaderStageFlags flags, const uint32_t count)
 {
-	vk::DescriptorSetLayoutBinding layout(binding, bindType, 1, flags, nullptr);
+	vk::DescriptorSetLayoutBinding layout(binding, bindType, count, flags, nullptr);
 
 	layout_bind.layouts[set].push_back(layout);
+	layout_bind.bindingFlags[set].push_back({});
 
 	// increase count depending on type
 	switch (bindType)
 	{
 	case vk::DescriptorType::eUniformBuffer:
-		++layout_bind.uboCount;
+		layout_bind.uboCount += count;
 		break;
 	case vk::DescriptorType::eStorageBuffer:
-		++layout_bind.ssboCount;
+		layout_bind.ssboCount += count;
 		break;
 	case vk::DescriptorType::eUniformBufferDynamic:
-		++layout_bind.uboDynamicCount;
+		layout_bind.uboDynamicCount += count;
 		break;
 	case vk::DescriptorType::eStorageBufferDynamic:
-		++layout_bind.ssboDynamicCount;
+		layout_bind.ssboDynamicCount += count;
 		break;
 	case vk::DescriptorType::eCombinedImageSampler:
-		++layout_bind.samplerCount;
+		layout_bind.samplerCount += count;
 		break;
 	}
 }
 
+void DescriptorLayout::addBindlessLayout(uint32_t set, uint32_t binding, vk::DescriptorType bindType,
+                                         vk::ShaderStageFlags flags, const uint32_t count)
+{
+	addLayout(set, binding, bindType, flags, count);
+
+	layout_bind.bindingFlags[set].back() = vk::DescriptorBindingFlagBitsEXT::ePartiallyBound |
+	                                       vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind |
+	                                       vk::DescriptorBindingFlagBitsEXT::eUpdateUnusedWhilePending;
+	layout_bind.updateAfterBind = true;
+}
+
+uint64_t DescriptorLayout::getLayoutHash(uint32_t set)
+{
+	auto iter = layout_bind.layouts.find(set);
+	assert(iter != layout_bind.layouts.end());
+
+	auto &flags = layout_bind.bindingFlags[set];
+
+	uint64_t hash = ::Util::hashBytes(&set, sizeof(uint32_t));
+	for (uint32_t i = 0; i < iter->second.size(); ++i)
+	{
+		const vk::DescriptorSetLayoutBinding &binding = iter->second[i];
+
+		// the fields are hashed separately as the binding struct also holds a pointer
+		uint32_t fields[] = { binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount,
+			                  static_cast<uint32_t>(binding.stageFlags), static_cast<uint32_t>(flags[i]) };
+		hash = ::Util::hashBytes(fields, sizeof(fields), hash);
+	}
+	return hash;
+}
+
 void DescriptorLayout::create(vk::Device dev, const uint32_t imageSets)
 {
 	// store for destructor
@@ -108,7 +153,12 @@ void DescriptorLayout::create(vk::Device dev, const uint32_t imageSets)
 	{
 		set_count += imageSets - 1;
 	}
-	vk::DescriptorPoolCreateInfo createInfo({}, set_count, static_cast<uint32_t>(pools.size()),
+	vk::DescriptorPoolCreateFlags poolFlags;
+	if (layout_bind.updateAfterBind)
+	{
+		poolFlags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT;
+	}
+	vk::DescriptorPoolCreateInfo createInfo(poolFlags, set_count, static_cast<uint32_t>(pools.size()),
 	                                        pools.data());
 	VK_CHECK_RESULT(device.createDescriptorPool(&createInfo, nullptr, &pool));
 
@@ -119,6 +169,20 @@ void DescriptorLayout::create(vk::Device dev, const uint32_t imageSets)
 		vk::DescriptorSetLayoutCreateInfo layoutInfo({}, static_cast<uint32_t>(binding.size()),
 		                                             binding.data());
 
+		// sets with bindless bindings must be created with their binding flags
+		auto &flags = layout_bind.bindingFlags[set.first];
+		bool isBindless = std::any_of(flags.begin(), flags.end(), [](const vk::DescriptorBindingFlagsEXT &flag) {
+			return static_cast<bool>(flag);
+		});
+
+		vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo(static_cast<uint32_t>(flags.size()),
+		                                                           flags.data());
+		if (isBindless)
+		{
+			layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT;
+			layoutInfo.pNext = &flagsInfo;
+		}
+
 		vk::DescriptorSetLayout layout;
 		VK_CHECK_RESULT(device.createDescriptorSetLayout(&layoutInfo, nullptr, &layout));
 		descriptorLayouts.push_back(std::make_tuple(set.first, layout));
@@ -197,6 +261,7 @@ void DescriptorSet::writeSet(ImageReflection::ShaderImageLayout &imageLayout,
 	vk::WriteDescriptorSet writeSet(descriptorSets[imageLayout.set], imageLayout.binding, 0, 1,
 	                                imageLayout.type, &image_info, nullptr, nullptr);
 	device.updateDescriptorSets(1, &writeSet, 0, nullptr);
+	++writeCount;
 }
 
 void DescriptorSet::writeSet(uint32_t set, uint32_t binding, vk::DescriptorType type,
@@ -206,6 +271,17 @@ void DescriptorSet::writeSet(uint32_t set, uint32_t binding, vk::DescriptorType
 	vk::WriteDescriptorSet writeSet(descriptorSets[set], binding, 0, 1, type, nullptr, &buffer_info,
 	                                nullptr);
 	device.updateDescriptorSets(1, &writeSet, 0, nullptr);
+	++writeCount;
+}
+
+void DescriptorSet::writeArraySet(uint32_t set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+                                  vk::Sampler &sampler, vk::ImageView &imageView, vk::ImageLayout layout)
+{
+	vk::DescriptorImageInfo image_info(sampler, imageView, layout);
+	vk::WriteDescriptorSet writeSet(descriptorSets[set], binding, arrayElement, 1, type, &image_info, nullptr,
+	                                nullptr);
+	device.updateDescriptorSets(1, &writeSet, 0, nullptr);
+	++writeCount;
 }
 
 void DescriptorSet::writeSet(uint32_t set, uint32_t binding, vk::DescriptorType type,
@@ -215,5 +291,100 @@ void DescriptorSet::writeSet(uint32_t set, uint32_t binding, vk::DescriptorType
 	vk::WriteDescriptorSet writeSet(descriptorSets[set], binding, 0, 1, type, &image_info, nullptr,
 	                                nullptr);
 	device.updateDescriptorSets(1, &writeSet, 0, nullptr);
+	++writeCount;
 }
+
+DescriptorPoolAllocator::~DescriptorPoolAllocator()
+{
+	destroy();
+}
+
+void DescriptorPoolAllocator::init(vk::Device dev)
+{
+	device = dev;
+}
+
+void DescriptorPoolAllocator::destroy()
+{
+	for (auto &pool : pools)
+	{
+		device.destroyDescriptorPool(pool, nullptr);
+	}
+	pools.clear();
+}
+
+void DescriptorPoolAllocator::addPool()
+{
+	std::vector<vk::DescriptorPoolSize> sizes;
+	for (const vk::DescriptorPoolSize &size : poolSizesPerSet)
+	{
+		sizes.emplace_back(size.type, size.descriptorCount * SetsPerPool);
+	}
+
+	vk::DescriptorPoolCreateInfo createInfo({}, SetsPerPool, static_cast<uint32_t>(sizes.size()), sizes.data());
+
+	vk::DescriptorPool pool;
+	VK_CHECK_RESULT(device.createDescriptorPool(&createInfo, nullptr, &pool));
+	pools.emplace_back(pool);
+}
+
+vk::DescriptorSet DescriptorPoolAllocator::allocate(vk::DescriptorSetLayout &layout)
+{
+	assert(device);
+
+	if (pools.empty())
+	{
+		addPool();
+	}
+
+	vk::DescriptorSetAllocateInfo allocInfo(pools.back(), 1, &layout);
+	vk::DescriptorSet descriptorSet;
+
+	vk::Result result = device.allocateDescriptorSets(&allocInfo, &descriptorSet);
+	if (result == vk::Result::eErrorOutOfPoolMemory || result == vk::Result::eErrorFragmentedPool)
+	{
+		// the current pool is full - chain on a new one. A set which doesn't fit in an empty pool is an error
+		addPool();
+		allocInfo.descriptorPool = pools.back();
+		result = device.allocateDescriptorSets(&allocInfo, &descriptorSet);
+	}
+	VK_CHECK_RESULT(result);
+
+	return descriptorSet;
+}
+
+DescriptorSetCache::DescriptorSetCache(vk::Device device)
+{
+	allocator.init(device);
+}
+
+DescriptorSetCache::~DescriptorSetCache()
+{
+}
+
+bool DescriptorSetCache::get(DescriptorLayout &layout, uint32_t set, uint64_t key, vk::DescriptorSet &descriptorSet)
+{
+	SetKey setKey{ layout.getLayoutHash(set), key };
+
+	auto iter = sets.find(setKey);
+	if (iter != sets.end())
+	{
+		++stats.cacheHits;
+		descriptorSet = iter->second;
+		return false;
+	}
+
+	descriptorSet = allocator.allocate(layout.getLayout(set));
+	sets.emplace(setKey, descriptorSet);
+
+	++stats.setsAllocated;
+	stats.pools = allocator.getPoolCount();
+	return true;
+}
+
+void DescriptorSetCache::endFrame()
+{
+	stats.writesPerFrame = DescriptorSet::takeWriteCount();
+}
+
 } // namespace VulkanAPI
@@ -2,8 +2,10 @@
 #include "VulkanAPI/Common.h"
 #include "VulkanAPI/Shader.h"
 
+#include <atomic>
 #include <tuple>
 #include <unordered_map>
+#include <vector>
 
 namespace VulkanAPI
 {
@@ -31,13 +33,26 @@ public:
 		uint32_t uboDynamicCount = 0;
 		uint32_t ssboDynamicCount = 0;
 		uint32_t storageImageCount = 0;
+
+		// the binding flags of each set, in the same order as the bindings. Only non-empty for bindless bindings
+		std::unordered_map<uint32_t, std::vector<vk::DescriptorBindingFlagsEXT>> bindingFlags;
+		bool updateAfterBind = false;
 	};
 
+	// the size of bindless descriptor arrays - this is the limit on the number of textures in use by materials
+	static constexpr uint32_t MaxBindlessDescriptors = 16384;
+
 	DescriptorLayout();
 	~DescriptorLayout();
 
 	void addLayout(uint32_t set, uint32_t binding, vk::DescriptorType bindType,
-	               vk::ShaderStageFlags flags);
+	               vk::ShaderStageFlags flags, const uint32_t count = 1);
+
+	// an array of descriptors indexed in the shader. Only the elements which are used need to have been written,
+	// and elements can be written whilst the set is bound. Layouts with the same bindless bindings are compatible,
+	// so one set can be shared by many pipelines
+	void addBindlessLayout(uint32_t set, uint32_t binding, vk::DescriptorType bindType,
+	                       vk::ShaderStageFlags flags, const uint32_t count = MaxBindlessDescriptors);
 
 	void create(vk::Device device, const uint32_t imageSets = 1);
 
@@ -65,6 +80,10 @@ public:
 		return pool;
 	}
 
+	// a hash of the bindings of the set - sets with the same hash are identically defined, so a descriptor set
+	// allocated with the layout of one can be used with the other
+	uint64_t getLayoutHash(uint32_t set);
+
 private:
 	vk::Device device;
 
@@ -97,6 +116,23 @@ public:
 	void writeSet(uint32_t set, uint32_t binding, vk::DescriptorType type, vk::Sampler &sampler,
 	              vk::ImageView &imageView, vk::ImageLayout layout);
 
+	// writes one element of a descriptor array
+	void writeArraySet(uint32_t set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+	                   vk::Sampler &sampler, vk::ImageView &imageView, vk::ImageLayout layout);
+
+	// the descriptor writes made by all sets since the last call - used for the cache stats
+	static uint32_t takeWriteCount()
+	{
+		return writeCount.exchange(0);
+	}
+
+	// adds a set allocated elsewhere, such as a bindless set shared between pipelines, so it is bound along with
+	// this object's sets
+	void addSet(uint32_t set, vk::DescriptorSet &descriptorSet)
+	{
+		descriptorSets[set] = descriptorSet;
+	}
+
 	vk::DescriptorSet &get(uint32_t set)
 	{
 		assert(!descriptorSets.empty());
@@ -145,6 +181,96 @@ private:
 
 	// one for all the sets that will be created
 	std::unordered_map<uint32_t, vk::DescriptorSet> descriptorSets;
+
+	static std::atomic<uint32_t> writeCount;
+};
+
+// Descriptor pools which grow as needed. Each pool has room for a fixed number of sets, and when it is exhausted
+// another pool is chained on, so the number of sets doesn't need to be known when creating the pipelines
+class DescriptorPoolAllocator
+{
+
+public:
+	static constexpr uint32_t SetsPerPool = 64;
+
+	DescriptorPoolAllocator() = default;
+	~DescriptorPoolAllocator();
+
+	void init(vk::Device device);
+	void destroy();
+
+	vk::DescriptorSet allocate(vk::DescriptorSetLayout &layout);
+
+	uint32_t getPoolCount() const
+	{
+		return static_cast<uint32_t>(pools.size());
+	}
+
+private:
+	void addPool();
+
+private:
+	vk::Device device;
+
+	// the last pool is the one in use - the others are full
+	std::vector<vk::DescriptorPool> pools;
+};
+
+// Hands out descriptor sets shared by all users of the same layout and key, such as the buffer sets of the pipelines
+// created from the same shaders. The key identifies the contents - a set is only allocated, and so only written,
+// the first time the layout and key are seen. Bindless sets aren't supported as these need their own pool
+class DescriptorSetCache
+{
+
+public:
+	struct Stats
+	{
+		uint32_t pools = 0;
+		uint32_t setsAllocated = 0;
+		uint32_t cacheHits = 0;
+
+		// the descriptor writes made during the last frame
+		uint32_t writesPerFrame = 0;
+	};
+
+	DescriptorSetCache(vk::Device device);
+	~DescriptorSetCache();
+
+	// returns true if the set was allocated by this call, in which case its descriptors need writing
+	bool get(DescriptorLayout &layout, uint32_t set, uint64_t key, vk::DescriptorSet &descriptorSet);
+
+	// called once all the descriptors for the frame have been written
+	void endFrame();
+
+	const Stats &getStats() const
+	{
+		return stats;
+	}
+
+private:
+	struct SetKey
+	{
+		uint64_t layoutHash;
+		uint64_t key;
+
+		bool operator==(const SetKey &other) const
+		{
+			return layoutHash == other.layoutHash && key == other.key;
+		}
+	};
+
+	struct SetKeyHash
+	{
+		size_t operator()(const SetKey &key) const noexcept
+		{
+			return static_cast<size_t>(key.layoutHash ^ (key.key * 0x9e3779b97f4a7c15ULL));
+		}
+	};
+
+	DescriptorPoolAllocator allocator;
+	std::unordered_map<SetKey, vk::DescriptorSet, SetKeyHash> sets;
+
+	Stats stats;
 };
 
 } // namespace VulkanAPI
@@ -385,18 +385,44 @@ void Device::prepareDevice()
 		requiredFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
 	}
 
-	const std::vector<const char *> swapChainExtension = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	const std::vector<const char *> deviceExtensionNames = { VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+		                                                     VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME };
 
-	if (!findExtensionProperties(swapChainExtension[0], extensions))
+	if (!findExtensionProperties(VK_KHR_SWAPCHAIN_EXTENSION_NAME, extensions))
 	{
 		LOGGER_ERROR("Critical error! Swap chain extension not found.");
 	}
 
+	// material textures are held in one bindless array, indexed by the material in the shader
+	if (!findExtensionProperties(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, extensions))
+	{
+		LOGGER_ERROR("Critical error! Descriptor indexing extension not found.");
+	}
+
+	vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures;
+	vk::PhysicalDeviceFeatures2 features2;
+	features2.pNext = &indexingFeatures;
+	physical.getFeatures2(&features2);
+
+	if (!indexingFeatures.runtimeDescriptorArray || !indexingFeatures.descriptorBindingPartiallyBound ||
+	    !indexingFeatures.descriptorBindingSampledImageUpdateAfterBind ||
+	    !indexingFeatures.descriptorBindingUpdateUnusedWhilePending)
+	{
+		LOGGER_ERROR("Critical error! The gpu doesn't support the descriptor indexing features required.");
+	}
+
+	vk::PhysicalDeviceDescriptorIndexingFeaturesEXT requiredIndexingFeatures;
+	requiredIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	requiredIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	requiredIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	requiredIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
 	vk::DeviceCreateInfo createInfo({}, static_cast<uint32_t>(queueInfo.size()), queueInfo.data(),
 	                                static_cast<uint32_t>(requiredLayers.size()),
 	                                requiredLayers.empty() ? nullptr : requiredLayers.data(),
-	                                static_cast<uint32_t>(swapChainExtension.size()),
-	                                swapChainExtension.data(), &requiredFeatures);
+	                                static_cast<uint32_t>(deviceExtensionNames.size()),
+	                                deviceExtensionNames.data(), &requiredFeatures);
+	createInfo.pNext = &requiredIndexingFeatures;
 
 	VK_CHECK_RESULT(physical.createDevice(&createInfo, nullptr, &device));
 
@@ -195,6 +195,9 @@ void Image::transition(vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
 		dstBarrier = vk::AccessFlagBits::eDepthStencilAttachmentRead |
 		             vk::AccessFlagBits::eDepthStencilAttachmentWrite;
 		break;
+	case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+		dstBarrier = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eShaderRead;
+		break;
 	default:
 		dstBarrier = (vk::AccessFlagBits)0;
 	}
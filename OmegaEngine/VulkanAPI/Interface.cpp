@@ -1,6 +1,7 @@
 #include "Interface.h"
 #include "VulkanAPI/BufferManager.h"
 #include "VulkanAPI/CommandBufferManager.h"
+#include "VulkanAPI/Descriptors.h"
 #include "VulkanAPI/Device.h"
 #include "VulkanAPI/MemoryAllocator.h"
 #include "VulkanAPI/SemaphoreManager.h"
@@ -36,6 +37,7 @@ Interface::Interface(VulkanAPI::Device &dev, const uint32_t windowWidth, const u
 	textureManager = std::make_unique<VkTextureManager>(device, gpu, graphicsQueue);
 	cmdBufferManager = std::make_unique<CommandBufferManager>(device, gpu, graphicsQueue,
 	                                                          presentionQueue, swapchainKhr, mode);
+	descriptorCache = std::make_unique<DescriptorSetCache>(device);
 }
 
 Interface::~Interface()
@@ -13,6 +13,7 @@ namespace VulkanAPI
 class BufferManager;
 class VkTextureManager;
 class CommandBufferManager;
+class DescriptorSetCache;
 class Device;
 enum class NewFrameMode;
 
@@ -64,6 +65,11 @@ public:
 		return cmdBufferManager;
 	}
 
+	std::unique_ptr<DescriptorSetCache> &getDescriptorCache()
+	{
+		return descriptorCache;
+	}
+
 private:
 	vk::Device device;
 	vk::PhysicalDevice gpu;
@@ -80,6 +86,7 @@ private:
 	std::unique_ptr<BufferManager> bufferManager;
 	std::unique_ptr<VkTextureManager> textureManager;
 	std::unique_ptr<CommandBufferManager> cmdBufferManager;
+	std::unique_ptr<DescriptorSetCache> descriptorCache;
 };
 
 } // namespace VulkanAPI
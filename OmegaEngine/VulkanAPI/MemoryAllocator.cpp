@@ -2,6 +2,8 @@
 #include "Utility/logger.h"
 #include "VulkanAPI/CommandBuffer.h"
 
+#include <algorithm>
+
 namespace VulkanAPI
 {
 
@@ -93,18 +95,22 @@ uint32_t MemoryAllocator::allocateBlock(MemoryType type, uint32_t size)
 		    vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
 		    block.blockMemory, block.blockBuffer);
 
+		// map the whole block once - as the memory is coherent, writes are visible without flushing
+		VK_CHECK_RESULT(device.mapMemory(block.blockMemory, 0, allocatedSize, (vk::MemoryMapFlags)0, &block.mapped));
+
 		block.type = MemoryType::VK_BLOCK_TYPE_HOST;
 	}
 	else if (type == MemoryType::VK_BLOCK_TYPE_LOCAL)
 	{
 		allocatedSize = (size == 0) ? static_cast<uint32_t>(ALLOC_BLOCK_SIZE_LOCAL) : size;
 
-		// locally created buffers have the transfer dest bit as the data will be copied from a temporary hosted buffer to the local destination buffer
+		// locally created buffers have the transfer dest bit as the data will be copied from a temporary hosted buffer to the local destination buffer,
+		// and the transfer src bit so the contents of moved buffers can be copied across
 		createBuffer(
 		    allocatedSize,
-		    vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer |
-		        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eUniformBuffer |
-		        vk::BufferUsageFlagBits::eStorageBuffer,
+		    vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc |
+		        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer |
+		        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
 		    vk::MemoryPropertyFlagBits::eDeviceLocal, block.blockMemory, block.blockBuffer);
 
 		block.type = MemoryType::VK_BLOCK_TYPE_LOCAL;
@@ -166,10 +172,16 @@ MemorySegment MemoryAllocator::allocate(MemoryUsage memoryUsage, uint32_t size)
 	// ensure that there is enough free space in this particular block to accomodate the data segment
 	uint32_t offset = findFreeSegment(blockId, segmentSize);
 
-	// if error code returned, allocate another block of memory of the required type
+	// if error code returned, allocate another block of memory of the required type - large segments get a block of their own
 	if (offset == UINT32_MAX)
 	{
-		blockId = allocateBlock(memoryUsage);
+		MemoryType type = (memoryUsage & MemoryUsage::VK_BUFFER_DYNAMIC) ? MemoryType::VK_BLOCK_TYPE_HOST :
+		                                                                   MemoryType::VK_BLOCK_TYPE_LOCAL;
+		uint32_t defaultSize = type == MemoryType::VK_BLOCK_TYPE_HOST ?
+		                           static_cast<uint32_t>(ALLOC_BLOCK_SIZE_HOST) :
+		                           static_cast<uint32_t>(ALLOC_BLOCK_SIZE_LOCAL);
+
+		blockId = allocateBlock(type, std::max(defaultSize, segmentSize));
 		offset = findFreeSegment(blockId, segmentSize);
 	}
 
@@ -263,27 +275,32 @@ void MemoryAllocator::mapDataToSegment(MemorySegment &segment, void *data, uint3
 	// With device local, we must first create a buffer on the host, map the data to that and then copyCmd it across to local memory
 	if (block.type == MemoryType::VK_BLOCK_TYPE_HOST)
 	{
-		segment.map(device, block.blockMemory, segment.getOffset(), data, totalSize, offset);
+		assert(totalSize + offset <= segment.getSize());
+		memcpy(static_cast<char *>(block.mapped) + segment.getOffset() + offset, data, totalSize);
 	}
 	else if (block.type == MemoryType::VK_BLOCK_TYPE_LOCAL)
 	{
-		// start by creating host-visible buffers
+		assert(totalSize + offset <= segment.getSize());
+
+		// start by creating a host-visible staging buffer - only as large as the range being written, so updating
+		// part of a large buffer doesn't need a staging buffer of the whole size
 		vk::Buffer tempBuffer;
 		vk::DeviceMemory tempMemory;
-		createBuffer(segment.getSize(), vk::BufferUsageFlagBits::eTransferSrc,
+		createBuffer(totalSize, vk::BufferUsageFlagBits::eTransferSrc,
 		             vk::MemoryPropertyFlagBits::eHostVisible |
 		                 vk::MemoryPropertyFlagBits::eHostCoherent,
 		             tempMemory, tempBuffer);
 
-		// map data to temporary buffer
-		segment.map(device, tempMemory, 0, data, totalSize,
-		            offset); // mem offseting not allowed for device local buffer
+		void *mapped = nullptr;
+		VK_CHECK_RESULT(device.mapMemory(tempMemory, 0, totalSize, (vk::MemoryMapFlags)0, &mapped));
+		memcpy(mapped, data, totalSize);
+		device.unmapMemory(tempMemory);
 
 		// create cmd buffer for copy and transfer to device local memory
 		CommandBuffer copyCmdBuffer(device, graphicsQueue.getIndex());
 		copyCmdBuffer.createPrimary();
 
-		vk::BufferCopy bufferCopy{ 0, segment.getOffset(), segment.getSize() };
+		vk::BufferCopy bufferCopy{ 0, segment.getOffset() + offset, totalSize };
 		copyCmdBuffer.get().copyBuffer(tempBuffer, block.blockBuffer, 1, &bufferCopy);
 		copyCmdBuffer.end();
 		graphicsQueue.flushCmdBuffer(copyCmdBuffer.get());
@@ -294,6 +311,41 @@ void MemoryAllocator::mapDataToSegment(MemorySegment &segment, void *data, uint3
 	}
 }
 
+void MemoryAllocator::copySegment(const MemorySegment &src, const MemorySegment &dst, uint32_t size)
+{
+	assert(size <= src.getSize() && size <= dst.getSize());
+
+	// host blocks are mapped, so can be copied directly - otherwise the copy is done on the gpu
+	void *srcData = getMappedPtr(src);
+	void *dstData = getMappedPtr(dst);
+	if (srcData && dstData)
+	{
+		memcpy(dstData, srcData, size);
+		return;
+	}
+
+	CommandBuffer copyCmdBuffer(device, graphicsQueue.getIndex());
+	copyCmdBuffer.createPrimary();
+
+	vk::BufferCopy bufferCopy{ src.getOffset(), dst.getOffset(), size };
+	copyCmdBuffer.get().copyBuffer(memoryBlocks[src.getId()].blockBuffer, memoryBlocks[dst.getId()].blockBuffer, 1,
+	                               &bufferCopy);
+	copyCmdBuffer.end();
+	graphicsQueue.flushCmdBuffer(copyCmdBuffer.get());
+}
+
+void *MemoryAllocator::getMappedPtr(const MemorySegment &segment)
+{
+	assert(segment.getId() < (int32_t)memoryBlocks.size());
+	MemoryBlock &block = memoryBlocks[segment.getId()];
+
+	if (!block.mapped)
+	{
+		return nullptr;
+	}
+	return static_cast<char *>(block.mapped) + segment.getOffset();
+}
+
 void MemoryAllocator::destroySegment(MemorySegment &segment)
 {
 	if (segment.getSize() <= 0)
@@ -323,6 +375,10 @@ void MemoryAllocator::destroyBlock(uint32_t id)
 	{
 
 		// handle the vulkan side first
+		if (memoryBlocks[id].mapped)
+		{
+			device.unmapMemory(memoryBlocks[id].blockMemory);
+		}
 		device.destroyBuffer(memoryBlocks[id].blockBuffer, nullptr);
 		device.freeMemory(memoryBlocks[id].blockMemory, nullptr);
 
@@ -385,14 +441,16 @@ void MemoryAllocator::outputLog()
 void MemorySegment::map(vk::Device dev, vk::DeviceMemory memory, const uint32_t offset,
                         void *sourceData, uint32_t totalSize, uint32_t mappedOffset)
 {
-	assert(totalSize <= size);
+	assert(totalSize + mappedOffset <= size);
 
 	if (data == nullptr)
 	{
 
 		VK_CHECK_RESULT(dev.mapMemory(memory, offset, size, (vk::MemoryMapFlags)0, &data));
-		memcpy(data, sourceData, totalSize);
+		void *mapped = static_cast<char *>(data) + mappedOffset;
+		memcpy(mapped, sourceData, totalSize);
 		dev.unmapMemory(memory);
+		data = nullptr;
 	}
 	else
 	{
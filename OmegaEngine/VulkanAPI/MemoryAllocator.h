@@ -122,9 +122,16 @@ public:
 
 	// Segment allocation functions and mapping
 	MemorySegment allocate(MemoryUsage usage, uint32_t size);
+	void destroySegment(MemorySegment &segment);
 	void mapDataToSegment(MemorySegment &segment, void *data, uint32_t totalSize,
 	                      uint32_t offset = 0);
 
+	// copies the contents of one segment to the start of another - used when a buffer is moved to a larger segment
+	void copySegment(const MemorySegment &src, const MemorySegment &dst, uint32_t size);
+
+	// host blocks are persistently mapped - returns nullptr for device local segments
+	void *getMappedPtr(const MemorySegment &segment);
+
 	// useful diagnostic functions
 	void outputLog();
 
@@ -142,6 +149,9 @@ private:
 		// vulkan info
 		vk::DeviceMemory blockMemory;
 		vk::Buffer blockBuffer;
+
+		// host blocks are mapped for their lifetime
+		void *mapped = nullptr;
 	};
 
 	// Block allocation functions
@@ -151,7 +161,6 @@ private:
 	void destroyAllBlocks();
 
 	// segment functions
-	void destroySegment(MemorySegment &segment);
 	uint32_t findBlockType(MemoryUsage usage);
 	uint32_t findFreeSegment(uint32_t blockId, uint32_t size);
 
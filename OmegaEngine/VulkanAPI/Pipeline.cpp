@@ -70,6 +70,20 @@ void Pipeline::addVertexInput(uint32_t location, vk::Format format, uint32_t siz
 	vertexAttrDescr.push_back(attr_descr);
 }
 
+void Pipeline::setVertexInputFormat(uint32_t location, vk::Format format, uint32_t size)
+{
+	for (auto& attr : vertexAttrDescr)
+	{
+		if (attr.location == location)
+		{
+			attr.format = format;
+			attr.offset = size;
+			return;
+		}
+	}
+	addVertexInput(location, format, size);
+}
+
 void Pipeline::updateVertexInput()
 {
 	// check for empty vertex
@@ -306,4 +320,18 @@ void Pipeline::create(vk::Device dev, PipelineType _type)
 	VK_CHECK_RESULT(device.createGraphicsPipelines({}, 1, &createInfo, nullptr, &pipeline));
 }
 
+void Pipeline::create(vk::Device dev, Shader& shader, PipelineLayout& layout, PipelineType _type)
+{
+	assert(_type == PipelineType::Compute);
+	assert(shader.size() == 1);
+
+	device = dev;
+	type = _type;
+	this->pipelineLayout = layout.get();
+
+	vk::ComputePipelineCreateInfo createInfo({}, *shader.getPipelineData(), pipelineLayout, nullptr, 0);
+
+	VK_CHECK_RESULT(device.createComputePipelines({}, 1, &createInfo, nullptr, &pipeline));
+}
+
 }    // namespace VulkanAPI
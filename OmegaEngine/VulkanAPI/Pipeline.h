@@ -31,6 +31,10 @@ public:
 	void addVertexInput(uint32_t location, vk::Format format, uint32_t size);
 	void updateVertexInput();
 
+	// replaces the reflected format of a vertex input, or adds the input if the shader doesn't declare it.
+	// Reflection only knows the shader type, so packed formats (i.e. snorm16 into a vec4) must be set here
+	void setVertexInputFormat(uint32_t location, vk::Format format, uint32_t size);
+
 	void setRasterCullMode(vk::CullModeFlags cull_mode);
 	void setRasterFrontFace(vk::FrontFace front_face);
 	void setRasterDepthClamp(bool state);
@@ -56,6 +60,9 @@ public:
 	void create(vk::Device dev, RenderPass &renderpass, Shader &shader, PipelineType _type);
 	void create(vk::Device dev, PipelineType _type);
 
+	// compute pipelines only require the shader and layout
+	void create(vk::Device dev, Shader &shader, PipelineLayout &layout, PipelineType _type);
+
 	PipelineType getPipelineType() const
 	{
 		return type;
@@ -58,7 +58,7 @@ vk::ImageLayout RenderPass::getFinalTransitionLayout(vk::Format format)
 	return result;
 }
 
-void RenderPass::addAttachment(const vk::Format format, const FinalLayoutType layoutType, bool clearAttachment)
+vk::ImageLayout RenderPass::getFinalLayout(const vk::Format format, const FinalLayoutType layoutType)
 {
 	vk::ImageLayout finalLayout;
 	switch(layoutType)
@@ -76,6 +76,12 @@ void RenderPass::addAttachment(const vk::Format format, const FinalLayoutType la
 		finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 		break;
 	}
+	return finalLayout;
+}
+
+void RenderPass::addAttachment(const vk::Format format, const FinalLayoutType layoutType, bool clearAttachment)
+{
+	vk::ImageLayout finalLayout = getFinalLayout(format, layoutType);
 
 	vk::AttachmentDescription attachDescr(
 	    {}, format, vk::SampleCountFlagBits::e1,
@@ -86,6 +92,17 @@ void RenderPass::addAttachment(const vk::Format format, const FinalLayoutType la
 	attachment.push_back(attachDescr);
 }
 
+void RenderPass::addPreservedAttachment(const vk::Format format, const FinalLayoutType layoutType)
+{
+	vk::ImageLayout finalLayout = getFinalLayout(format, layoutType);
+
+	vk::AttachmentDescription attachDescr({}, format, vk::SampleCountFlagBits::e1, vk::AttachmentLoadOp::eLoad,
+	                                      vk::AttachmentStoreOp::eStore, vk::AttachmentLoadOp::eLoad,
+	                                      vk::AttachmentStoreOp::eStore, finalLayout, finalLayout);
+
+	attachment.push_back(attachDescr);
+}
+
 void RenderPass::addSubPass(std::vector<vk::AttachmentReference>& colorRef,
                             std::vector<vk::AttachmentReference>& inputRef, vk::AttachmentReference* depthRef)
 {
@@ -42,6 +42,7 @@ public:
 	~RenderPass();
 
 	static vk::ImageLayout getFinalTransitionLayout(const vk::Format format);
+	static vk::ImageLayout getFinalLayout(const vk::Format format, const FinalLayoutType layoutType);
 	static bool isDepth(const vk::Format format);
 	static bool isStencil(const vk::Format format);
 
@@ -74,6 +75,10 @@ public:
 	void init(vk::Device dev);
 
 	void addAttachment(const vk::Format format, const FinalLayoutType layoutType, bool clearAttachment = true);
+
+	// the contents of the attachment are kept from the last time the pass was drawn, so the image must already be
+	// in the final layout when the pass begins
+	void addPreservedAttachment(const vk::Format format, const FinalLayoutType layoutType);
 	void addSubPass(std::vector<vk::AttachmentReference>& colorRef, std::vector<vk::AttachmentReference>& inputRef,
 	                vk::AttachmentReference* depthRef = nullptr);
 	void addSubPass(std::vector<vk::AttachmentReference>& colorRef,
@@ -77,7 +77,8 @@ bool Shader::add(vk::Device device, const std::string &filename1, StageType type
 
 bool Shader::loadShaderBinary(const char *filename, StageType type)
 {
-	std::string shaderDir(OMEGA_ASSETS_DIR "shaders/");
+	// the spir-v is compiled from assets/shaders by the build
+	std::string shaderDir(OMEGA_SHADER_DIR);
 	std::ifstream file(shaderDir + filename, std::ios_base::ate | std::ios_base::binary);
 	if (!file.is_open())
 	{
@@ -188,6 +189,15 @@ void Shader::imageReflection(DescriptorLayout &descriptorLayout, ImageReflection
 			uint32_t set = compiler.get_decoration(image.id, spv::DecorationDescriptorSet);
 			uint32_t binding = compiler.get_decoration(image.id, spv::DecorationBinding);
 
+			// runtime sized arrays are bindless - these are written by their owner, not through the reflected layouts
+			const spirv_cross::SPIRType &type = compiler.get_type(image.type_id);
+			if (!type.array.empty() && type.array[0] == 0)
+			{
+				descriptorLayout.addBindlessLayout(set, binding, vk::DescriptorType::eCombinedImageSampler,
+				                                   getStageFlags(StageType(i)));
+				continue;
+			}
+
 			Sampler sampler = getSamplerType(image.name);
 
 			// the image layout can also be set via the sampler name - Depth:: for depth sampler, Colour:: for colour samplers (default if none found)
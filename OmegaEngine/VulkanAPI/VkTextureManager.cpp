@@ -18,132 +18,113 @@ VkTextureManager::VkTextureManager(vk::Device &dev, vk::PhysicalDevice &physical
 	        this);
 	OmegaEngine::Global::eventManager()
 	    ->registerListener<VkTextureManager, MaterialTextureUpdateEvent,
-	                       &VkTextureManager::updateGroupedTexture>(this);
+	                       &VkTextureManager::updateMaterialTexture>(this);
+
+	// the bindless material textures - only the elements in use are written
+	bindlessLayout.addBindlessLayout(BindlessSet, 0, vk::DescriptorType::eCombinedImageSampler,
+	                                 vk::ShaderStageFlagBits::eFragment);
+	bindlessLayout.create(device);
+	bindlessSet.init(device, bindlessLayout, BindlessSet);
+
+	createFallbackTextures();
 }
 
 VkTextureManager::~VkTextureManager()
 {
 }
 
-void VkTextureManager::updateGroupedTexture(MaterialTextureUpdateEvent &event)
+void VkTextureManager::createFallbackTextures()
 {
-	assert(event.mappedTexture != nullptr);
+	// white, black and a normal pointing straight out of the surface
+	const uint8_t pixels[][4] = { { 255, 255, 255, 255 }, { 0, 0, 0, 255 }, { 128, 128, 255, 255 } };
+	static_assert(sizeof(pixels) / sizeof(pixels[0]) == static_cast<uint32_t>(FallbackTexture::Count),
+	              "A pixel is needed for each fallback texture.");
 
-	MaterialTextureInfo tex_info;
-	tex_info.texture.init(device, gpu, graphicsQueue);
-	tex_info.texture.map(*event.mappedTexture);
-	tex_info.sampler.create(device, event.sampler);
-	tex_info.binding = event.binding;
+	for (uint32_t i = 0; i < fallbackTextures.size(); ++i)
+	{
+		OmegaEngine::MappedTexture mapped;
+		mapped.mapTexture(1, 1, 4, const_cast<uint8_t *>(pixels[i]), OmegaEngine::TextureFormat::Image8UC4);
 
-	groupedTextures[event.id].push_back(tex_info);
-}
+		TextureInfo &fallback = fallbackTextures[i];
+		fallback.texture.init(device, gpu, graphicsQueue);
+		fallback.texture.map(mapped);
+		fallback.sampler.create(device, SamplerType::Clamp);
 
-void VkTextureManager::updateGroupedDescriptors()
-{
-
-	for (auto &descr : descriptorSetUpdateQueue)
-	{
-		assert(descr.set != nullptr);
-		MaterialTextureInfo texture = groupedTextures[descr.id][descr.binding];
-		descr.set->writeSet(descr.setValue, descr.binding,
-		                    vk::DescriptorType::eCombinedImageSampler, texture.sampler.getSampler(),
-		                    texture.texture.getImageView(),
-		                    vk::ImageLayout::eShaderReadOnlyOptimal);
+		bindlessSet.writeArraySet(BindlessSet, 0, i, vk::DescriptorType::eCombinedImageSampler,
+		                          fallback.sampler.getSampler(), fallback.texture.getImageView(),
+		                          vk::ImageLayout::eShaderReadOnlyOptimal);
 	}
 }
 
-void VkTextureManager::bindTexturesToDescriptorLayout(const char *id, DescriptorLayout *layout,
-                                                      uint32_t setValue)
+Texture &VkTextureManager::getCachedTexture(const std::string &assetId, OmegaEngine::MappedTexture &mappedTexture)
 {
-	assert(layout != nullptr);
-
-	auto iter = textureLayouts.begin();
-	while (iter != textureLayouts.end())
+	auto iter = textureCache.find(assetId);
+	if (iter != textureCache.end())
 	{
-		if (std::strcmp(iter->first, id) == 0)
-		{
-			break;
-		}
-		iter++;
+		++cacheStats.hits;
+		return iter->second;
 	}
 
-	if (iter != textureLayouts.end())
-	{
-		LOGGER_INFO("Texture layout binding of id %s was already registered.\n", id);
-	}
-	textureLayouts[id] = { layout, setValue };
+	Texture texture;
+	texture.init(device, gpu, graphicsQueue);
+	texture.map(mappedTexture);
+	++cacheStats.uploads;
+
+	return textureCache.emplace(assetId, texture).first->second;
 }
 
-VkTextureManager::TextureLayoutInfo &VkTextureManager::getTextureDescriptorLayout(const char *id)
+void VkTextureManager::updateMaterialTexture(MaterialTextureUpdateEvent &event)
 {
-	auto iter = textureLayouts.begin();
-	while (iter != textureLayouts.end())
-	{
-
-		if (std::strcmp(iter->first, id) == 0)
-		{
-			break;
-		}
-		iter++;
-	}
+	assert(event.mappedTexture != nullptr);
 
-	if (iter == textureLayouts.end())
+	if (event.textureIndex < static_cast<uint32_t>(FallbackTexture::Count) ||
+	    event.textureIndex >= DescriptorLayout::MaxBindlessDescriptors)
 	{
-		LOGGER_ERROR("Layout with id %s was not registered with vulkan texture manager.\n", id);
+		LOGGER_ERROR("Material texture index %i is outside of the bindless texture array.", event.textureIndex);
 	}
-	return iter->second;
-}
 
-void VkTextureManager::updateGroupedDescriptorSet(DescriptorSet &set, const char *id,
-                                                  uint32_t setValue)
-{
-	auto iter = groupedTextures.begin();
-	while (iter != groupedTextures.end())
+	// the element is already written with this texture - nothing to do
+	auto slot = materialTextures.find(event.textureIndex);
+	if (slot != materialTextures.end() && slot->second.assetId == event.assetId &&
+	    slot->second.samplerType == event.sampler)
 	{
-		if (iter->first == id)
-		{
-			break;
-		}
-		iter++;
+		return;
 	}
 
-	if (iter == groupedTextures.end())
-	{
-		LOGGER_ERROR("An id of %s has not been registered with the vulkan texture manager.\n", id);
-	}
+	// the texture only holds handles, so copies of it refer to the same image
+	Texture &texture = getCachedTexture(event.assetId, *event.mappedTexture);
 
-	for (auto &texture : iter->second)
-	{
-		set.writeSet(setValue, texture.binding, vk::DescriptorType::eCombinedImageSampler,
-		             texture.sampler.getSampler(), texture.texture.getImageView(),
-		             vk::ImageLayout::eShaderReadOnlyOptimal);
-	}
+	MaterialTextureInfo &info = materialTextures[event.textureIndex];
+	info.assetId = event.assetId;
+	info.samplerType = event.sampler;
+	info.sampler.create(device, event.sampler);
+
+	// the set is created with update after bind, so this is fine whilst the set is in use by the command buffers
+	bindlessSet.writeArraySet(BindlessSet, 0, event.textureIndex, vk::DescriptorType::eCombinedImageSampler,
+	                          info.sampler.getSampler(), texture.getImageView(),
+	                          vk::ImageLayout::eShaderReadOnlyOptimal);
 }
 
 void VkTextureManager::updateTexture(TextureUpdateEvent &event)
 {
 	assert(event.textureInfo != nullptr);
 
+	if (textures.find(event.id) != textures.end())
+	{
+		++cacheStats.hits;
+		return;
+	}
+
 	TextureInfo tex_info;
-	tex_info.texture.init(device, gpu, graphicsQueue);
-	tex_info.texture.map(event.textureInfo->texture);
+	tex_info.texture = getCachedTexture(event.id, event.textureInfo->texture);
 	tex_info.sampler.create(device, event.textureInfo->samplerType);
 
-	textures[event.id.c_str()] = tex_info;
+	textures.emplace(event.id, tex_info);
 }
 
 vk::ImageView &VkTextureManager::getTextureImageView(const char *name)
 {
-	auto iter = textures.begin();
-	while (iter != textures.end())
-	{
-		if (std::strcmp(iter->first, name) == 0)
-		{
-			break;
-		}
-		iter++;
-	}
-
+	auto iter = textures.find(name);
 	if (iter == textures.end())
 	{
 		LOGGER_ERROR("Unable to find texture with id: %s.\n", name);
@@ -151,7 +132,6 @@ vk::ImageView &VkTextureManager::getTextureImageView(const char *name)
 
 	return iter->second.texture.getImageView();
 }
-
 void VkTextureManager::enqueueDescrUpdate(const char *id, VulkanAPI::DescriptorSet *descriptorSet,
                                           VulkanAPI::Sampler *sampler, uint32_t set,
                                           uint32_t binding)
@@ -167,16 +147,7 @@ void VkTextureManager::updateDescriptors()
 		for (auto &descr : descriptorSetUpdateQueue)
 		{
 
-			auto iter = textures.begin();
-			while (iter != textures.end())
-			{
-				if (std::strcmp(iter->first, descr.id) == 0)
-				{
-					break;
-				}
-				iter++;
-			}
-
+			auto iter = textures.find(descr.id);
 			if (iter != textures.end())
 			{
 				descr.set->writeSet(
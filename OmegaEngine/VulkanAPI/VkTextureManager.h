@@ -4,7 +4,10 @@
 #include "Managers/EventManager.h"
 #include "VulkanAPI/Common.h"
 #include "VulkanAPI/DataTypes/Texture.h"
+#include "VulkanAPI/Descriptors.h"
 #include "VulkanAPI/Sampler.h"
+#include <array>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 
@@ -19,17 +22,20 @@ class Queue;
 
 struct MaterialTextureUpdateEvent : public OmegaEngine::Event
 {
-	MaterialTextureUpdateEvent(std::string _id, uint32_t _binding,
-	                           OmegaEngine::MappedTexture *_mapped, SamplerType _sampler)
-	    : id(_id)
-	    , binding(_binding)
+	MaterialTextureUpdateEvent(uint32_t _textureIndex, std::string _assetId, OmegaEngine::MappedTexture *_mapped,
+	                           SamplerType _sampler)
+	    : textureIndex(_textureIndex)
+	    , assetId(_assetId)
 	    , mappedTexture(_mapped)
 	    , sampler(_sampler)
 	{
 	}
 
-	std::string id;
-	uint32_t binding = 0;
+	// the element of the bindless texture array - as given by the material manager
+	uint32_t textureIndex = 0;
+
+	// the id of the image in the asset manager - materials sharing an image pass the same id
+	std::string assetId;
 	OmegaEngine::MappedTexture *mappedTexture = nullptr;
 	SamplerType sampler;
 };
@@ -51,23 +57,30 @@ class VkTextureManager
 {
 
 public:
-	struct MaterialTextureInfo
+	struct TextureInfo
 	{
 		Texture texture;
 		Sampler sampler;
-		uint32_t binding = 0;
 	};
 
-	struct TextureInfo
+	// the set number of the material textures in the mesh shaders
+	static constexpr uint32_t BindlessSet = 2;
+
+	// 1x1 textures held in the first elements of the bindless array, which materials without a map point at.
+	// Black has an alpha of one. The flat normal index is also used by the model shader
+	enum class FallbackTexture : uint32_t
 	{
-		Texture texture;
-		Sampler sampler;
+		White,
+		Black,
+		FlatNormal,
+		Count
 	};
 
-	struct TextureLayoutInfo
+	struct CacheStats
 	{
-		DescriptorLayout *layout = nullptr;
-		uint32_t setValue;
+		// textures uploaded to the gpu, and requests for an asset id which had already been uploaded
+		uint32_t uploads = 0;
+		uint32_t hits = 0;
 	};
 
 	struct DescrSetUpdateInfo
@@ -88,36 +101,59 @@ public:
 	void updateDescriptors();
 	void update();
 
-	// updates a single descriptor set with a texture set identified by its unique id
-	void updateGroupedDescriptorSet(DescriptorSet &set, const char *id, uint32_t setValue);
+	// uploads a material texture and writes it to its element of the bindless array
+	void updateMaterialTexture(MaterialTextureUpdateEvent &event);
 
-	void updateGroupedTexture(MaterialTextureUpdateEvent &event);
-	void updateGroupedDescriptors();
+	vk::ImageView &getTextureImageView(const char *name);
 
-	// associates an id with a descriptor layout. Used for materials, etc. were there are multiple descriptor sets but one layout
-	void bindTexturesToDescriptorLayout(const char *id, DescriptorLayout *layout,
-	                                    uint32_t setValue);
+	const CacheStats &getCacheStats() const
+	{
+		return cacheStats;
+	}
 
-	TextureLayoutInfo &getTextureDescriptorLayout(const char *id);
+	// all material textures are held in this one set, which is bound along with the mesh pipeline sets
+	vk::DescriptorSet &getBindlessSet()
+	{
+		return bindlessSet.get(BindlessSet);
+	}
 
-	vk::ImageView &getTextureImageView(const char *name);
+private:
+	// the gpu texture of the asset, uploading the mapped texture if this is the first time the id is seen
+	Texture &getCachedTexture(const std::string &assetId, OmegaEngine::MappedTexture &mappedTexture);
+
+	void createFallbackTextures();
 
 private:
 	vk::Device device;
 	vk::PhysicalDevice gpu;
 	VulkanAPI::Queue graphicsQueue;
 
-	// dedicated container for material textures i.e. grouped
-	std::unordered_map<std::string, std::vector<MaterialTextureInfo>> groupedTextures;
+	// the asset and sampler of each element written to the bindless array
+	struct MaterialTextureInfo
+	{
+		std::string assetId;
+		SamplerType samplerType;
+		Sampler sampler;
+	};
+
+	std::unordered_map<uint32_t, MaterialTextureInfo> materialTextures;
+
+	DescriptorLayout bindlessLayout;
+	DescriptorSet bindlessSet;
+
+	// the gpu textures uploaded, keyed by asset id. The asset manager queues all images again whenever one is
+	// added, and identical images share an id, so each is only uploaded once
+	std::unordered_map<std::string, Texture> textureCache;
+	CacheStats cacheStats;
+
+	// the fallback textures aren't assets, so are held here
+	std::array<TextureInfo, static_cast<uint32_t>(FallbackTexture::Count)> fallbackTextures;
 
 	// single textures derived from the asset manager
-	std::unordered_map<const char *, TextureInfo> textures;
+	std::unordered_map<std::string, TextureInfo> textures;
 
 	// a queue of descriptor sets which need updating on a per frame basis - for single textures
 	std::vector<DescrSetUpdateInfo> descriptorSetUpdateQueue;
-
-	// associate textures with descriptor layouts
-	std::unordered_map<const char *, TextureLayoutInfo> textureLayouts;
 };
 
 } // namespace VulkanAPI
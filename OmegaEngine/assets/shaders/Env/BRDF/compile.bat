@@ -1,2 +0,0 @@
-C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe -V lutBRDF.frag
-pause
\ No newline at end of file
@@ -1,4 +0,0 @@
-
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe irradiance_map.vert -o irradiance_map-vert.spv 
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe irradiance_map.frag -o irradiance_map-frag.spv
-pause
\ No newline at end of file
@@ -1,4 +0,0 @@
-
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe specularmap.vert -o specularmap-vert.spv 
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe specularmap.frag -o specularmap-frag.spv
-pause
\ No newline at end of file
@@ -1,4 +0,0 @@
-
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe skybox.vert -o skybox-vert.spv 
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe skybox.frag -o skybox-frag.spv
-pause
\ No newline at end of file
@@ -1,4 +0,0 @@
-
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe deferred.vert -o deferred-vert.spv 
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe deferred.frag -o deferred-frag.spv
-pause
\ No newline at end of file
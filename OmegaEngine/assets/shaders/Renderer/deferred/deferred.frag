@@ -24,17 +24,49 @@ layout (location = 1) in vec3 inCameraPos;
 
 layout (location = 0) out vec4 outFrag;
 
-// make sure this matches the manager - could use a specilization constant
-#define MAX_SPOT_LIGHTS 50	
-#define MAX_POINT_LIGHTS 50
-#define MAX_DIR_LIGHTS 5
+// make sure these match the light cluster builder
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
 
-layout (set = 0, binding = 2) uniform LightUbo
+// make sure this matches the light manager
+#define CASCADE_COUNT 4
+
+// directional lights first, then the spot and point lights
+layout (set = 0, binding = 2) readonly buffer LightBuffer
+{
+	Light lights[];
+} light_buffer;
+
+layout (set = 0, binding = 3) readonly buffer ClusterBuffer
+{
+	mat4 view;
+	vec4 cascadeSplits;		// the view space depth at which each cascade ends
+	float projScaleX;
+	float projScaleY;
+	float sliceScale;
+	float sliceBias;
+	uint dirLightCount;
+	uint localLightCount;
+	uint pad0;
+	uint pad1;
+	
+	// the offset into the light index list and the light count of each cluster
+	uvec2 ranges[CLUSTER_COUNT];
+} cluster;
+
+// indices relative to the first spot light
+layout (set = 0, binding = 4) readonly buffer LightIndexBuffer
 {
-	SpotLight spotLights[MAX_SPOT_LIGHTS];
-	PointLight pointLights[MAX_POINT_LIGHTS];
-	DirectionalLight dirLights[MAX_DIR_LIGHTS];
-} light_ubo;
+	uint indices[];
+} light_indices;
+
+// the shadow views of all lights - their tiles share the one shadow sampler
+layout (set = 0, binding = 5) readonly buffer ShadowBuffer
+{
+	ShadowView views[];
+} shadow_buffer;
 
 layout (push_constant) uniform pushConstants
 {
@@ -70,6 +102,40 @@ vec3 calculateIBL(vec3 N, float NdotV, float roughness, vec3 reflection, vec3 di
 	return diffuse + specular;
 }
 
+float calculateShadow(uint viewIndex, vec3 pos)
+{
+	ShadowView view = shadow_buffer.views[viewIndex];
+	return shadowPCF(view.viewProj * vec4(pos, 1.0), view.atlasRect, Depth_shadowSampler);
+}
+
+// the cascade of a directional light that covers the view space depth
+float calculateCascadeShadow(uint firstView, vec3 pos, float depth)
+{
+	if (depth > cluster.cascadeSplits[CASCADE_COUNT - 1])
+	{
+		return 1.0;
+	}
+	
+	uint cascade = 0;
+	for (uint i = 0; i < CASCADE_COUNT - 1; ++i)
+	{
+		cascade += depth > cluster.cascadeSplits[i] ? 1u : 0u;
+	}
+	return calculateShadow(firstView + cascade, pos);
+}
+
+uint getClusterIndex(vec4 viewPos)
+{
+	float depth = max(viewPos.z, 1e-4);
+	
+	// the same projection the clusters were built from, so the tile always matches the bounds on the cpu side
+	vec2 ndc = viewPos.xy * vec2(cluster.projScaleX, cluster.projScaleY) / depth;
+	vec2 tile = clamp((ndc * 0.5 + 0.5) * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y), vec2(0.0), vec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+	float slice = clamp(log(depth) * cluster.sliceScale + cluster.sliceBias, 0.0, float(CLUSTER_GRID_Z - 1));
+	
+	return (uint(slice) * CLUSTER_GRID_Y + uint(tile.y)) * CLUSTER_GRID_X + uint(tile.x);
+}
+
 void main()
 {	
 	vec3 inPos = texture(positionSampler, inUv).rgb;
@@ -97,43 +163,36 @@ void main()
 	// apply additional lighting contribution to specular 
 	vec3 colour = vec3(0.0);
 		
-	// spot lights
-	for(int i = 0; i < 2; ++i) 
+	// point and spot lights - only those reaching the cluster of this pixel
+	vec4 viewPos = cluster.view * vec4(inPos, 1.0);
+	uvec2 range = cluster.ranges[getClusterIndex(viewPos)];
+	for(uint i = 0; i < range.y; ++i) 
 	{  
-		SpotLight light = light_ubo.spotLights[i];
+		Light light = light_buffer.lights[cluster.dirLightCount + light_indices.indices[range.x + i]];
 		
 		vec3 lightPos = light.pos.xyz - inPos;
 		vec3 L = normalize(lightPos);
 		float intensity = light.colour.a;
 	
-		float attenuation = calculateDistance(lightPos, light.fallOut);
-		attenuation *= calculateAngle(light.direction.xyz, L, light.scale, light.offset); 	
-		
-		colour += specularContribution(L, V, N, baseColour, metallic, alphaRoughness, attenuation, intensity, light.colour.rgb, specReflectance, specReflectance90);
-	}
-	
-	// point lights
-	for(int i = 0; i < 1; ++i) 
-	{  
-		PointLight light = light_ubo.pointLights[i];
-		
-		vec3 lightPos = light.pos.xyz - inPos;
-		vec3 L = normalize(lightPos);
-		float intensity = light.colour.a;
+		float attenuation = calculateDistance(lightPos, light.pos.w);
+		if (light.type == SPOT_LIGHT)
+		{
+			attenuation *= calculateAngle(light.direction.xyz, L, light.scale, light.offset); 	
+		}
+		attenuation *= calculateShadow(light.shadowIndex, inPos);
 		
-		float attenuation = calculateDistance(lightPos, light.fallOut);
 		colour += specularContribution(L, V, N, baseColour, metallic, alphaRoughness, attenuation, intensity, light.colour.rgb, specReflectance, specReflectance90);
 	}
 	
 	// directional lights
-	for(int i = 0; i < 1; ++i) 
+	for(uint i = 0; i < cluster.dirLightCount; ++i) 
 	{  
-		DirectionalLight light = light_ubo.dirLights[i];
+		Light light = light_buffer.lights[i];
 		
 		//vec3 L = light.direction.xyz;
 		vec3 L = calculateSunArea(light.direction.xyz, light.pos.xyz, R);
 		float intensity = light.colour.a;
-		float attenuation = 1.0f;
+		float attenuation = calculateCascadeShadow(light.shadowIndex, inPos, viewPos.z);
 		colour += specularContribution(L, V, N, baseColour, metallic, alphaRoughness, attenuation, intensity, light.colour.rgb, specReflectance, specReflectance90);
 	}
 	
@@ -151,27 +210,6 @@ void main()
 	colour += emissive; 
 		
 	outFrag = vec4(colour, 1.0);
-	
-	// finally adjust the colour if in shadow for each light source
-	for(int i = 0; i < 2; i++) 
-	{
-		SpotLight light = light_ubo.spotLights[i];
-		
-		vec4 shadowClip	= light.viewMatrix * vec4(inPos, 1.0);
-		float shadowFactor = shadowPCF(shadowClip, Depth_shadowSampler);
-			
-		outFrag *= shadowFactor;
-	}
-	
-	for(int i = 0; i < 1; i++) 
-	{
-		PointLight light = light_ubo.pointLights[i];
-		
-		vec4 shadowClip	= light.viewMatrix * vec4(inPos, 1.0);
-		float shadowFactor = shadowPCF(shadowClip, Depth_shadowSampler);
-			
-		outFrag *= shadowFactor;
-	}
 }
 		
 		
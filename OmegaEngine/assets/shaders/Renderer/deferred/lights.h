@@ -1,31 +1,20 @@
 #ifndef LIGHTS_H
 #define LIGHTS_H
 
-struct SpotLight
+#define SPOT_LIGHT 0
+#define POINT_LIGHT 1
+#define DIRECTIONAL_LIGHT 2
+
+// all light types share the one struct - fields a type doesn't use are zero. The fall out is in pos.w
+struct Light
 {
-		mat4 viewMatrix;
 		vec4 pos;
 		vec4 direction;
 		vec4 colour;
 		float scale;
 		float offset;
-		float fallOut;
-};
-
-struct PointLight
-{
-		mat4 viewMatrix;
-		vec4 pos;
-		vec4 colour;
-		float fallOut;
-};
-
-struct DirectionalLight
-{
-		mat4 viewMatrix;
-		vec4 pos;
-		vec4 direction;
-		vec4 colour;
+		uint type;
+		uint shadowIndex;	// the light's shadow view - directional lights have one per cascade
 };
 
 float calculateAngle(vec3 lightDir, vec3 L, float scale, float offset)
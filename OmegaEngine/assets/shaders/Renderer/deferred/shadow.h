@@ -1,48 +1,48 @@
 #ifndef SHADOW_H
 #define SHADOW_H
 
-// shadow projection
-float textureProj(vec4 P, vec2 offset, sampler2D shadowSampler)
+// a view the shadows are drawn from, and where its tile lies in the atlas
+struct ShadowView
 {
-	const float shadowFactor = 0.1f;
-	
-	float shadow = 1.0;
-	vec4 shadowCoord = P / P.w;
-	shadowCoord.st = shadowCoord.st * 0.5 + 0.5;
+	mat4 viewProj;
+	vec4 atlasRect;		// offset and size in uvs - a zero size means the view has no tile
+};
+
+// shadow filter PCF - the fraction of a 3x3 grid of samples that are lit. The samples are kept within the view's
+// tile, and positions outside the view are lit
+float shadowPCF(vec4 shadowClip, vec4 atlasRect, sampler2D shadowSampler)
+{
+	if (atlasRect.z <= 0.0 || shadowClip.w <= 0.0)
+	{
+		return 1.0;
+	}
 	
-	if (shadowCoord.z > -1.0 && shadowCoord.z < 1.0) 
+	vec3 shadowCoord = shadowClip.xyz / shadowClip.w;
+	if (abs(shadowCoord.x) > 1.0 || abs(shadowCoord.y) > 1.0 || shadowCoord.z < 0.0 || shadowCoord.z > 1.0)
 	{
-		float dist = texture(shadowSampler, vec2(shadowCoord.st + offset)).r;
-		if (shadowCoord.w > 0.0 && dist < shadowCoord.z) 
-		{
-			shadow = shadowFactor;
-		}
+		return 1.0;
 	}
-	return shadow;
-}
-
-// shadow filter PCF
-float shadowPCF(vec4 shadowCoord, sampler2D shadowSampler)
-{
-	ivec2 dim = textureSize(shadowSampler, 0).xy;
+	
+	vec2 texel = 1.0 / vec2(textureSize(shadowSampler, 0));
+	vec2 uv = atlasRect.xy + (shadowCoord.xy * 0.5 + 0.5) * atlasRect.zw;
+	vec2 minUv = atlasRect.xy + texel * 0.5;
+	vec2 maxUv = atlasRect.xy + atlasRect.zw - texel * 0.5;
+	
 	float scale = 1.5;
-	float dx = scale * 1.0 / float(dim.x);
-	float dy = scale * 1.0 / float(dim.y);
-
-	float shadowFactor = 0.0;
-	int count = 0;
+	float lit = 0.0;
 	int range = 1;
 
 	for (int x = -range; x <= range; x++)
 	{
 		for (int y = -range; y <= range; y++)
 		{
-			shadowFactor += textureProj(shadowCoord, vec2(dx * x, dy * y), shadowSampler);
-			count++;
+			vec2 sampleUv = clamp(uv + vec2(x, y) * texel * scale, minUv, maxUv);
+			float dist = texture(shadowSampler, sampleUv).r;
+			lit += dist < shadowCoord.z ? 0.0 : 1.0;
 		}
 	}
 
-	return shadowFactor / count;
+	return lit / 9.0;
 }
 
-#endif
\ No newline at end of file
+#endif
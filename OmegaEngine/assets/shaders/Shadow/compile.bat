@@ -1,3 +0,0 @@
-
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe mapped.vert -o mapped-vert.spv 
-pause
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 450
+
+// only the position of the packed layouts is read
+layout (location = 0) in vec4 inPos;		// snorm16
+
+layout (set = 0, binding = 0) uniform Dynamic_Ubo
+{
+	mat4 lightMvp;
+} ubo;
+
+struct Quantisation
+{
+	vec4 offset;
+	vec4 scale;
+};
+
+// indexed by the first instance of the draw
+layout (set = 0, binding = 1) readonly buffer MeshQuantisation
+{
+	Quantisation meshes[];
+} quantisation;
+
+void main()
+{
+	Quantisation quant = quantisation.meshes[gl_InstanceIndex];
+	gl_Position = ubo.lightMvp * vec4(inPos.xyz * quant.scale.xyz + quant.offset.xyz, 1.0);
+}
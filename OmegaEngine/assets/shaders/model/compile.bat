@@ -1,5 +0,0 @@
-
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe model.vert -o model-vert.spv 
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe model.frag -o model-frag.spv
-C:/VulkanSDK/1.0.65.0/Bin32/glslc.exe model-skinned.vert -o model_skinned-vert.spv
-pause
\ No newline at end of file
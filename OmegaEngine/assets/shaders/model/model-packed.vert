@@ -0,0 +1,67 @@
+#version 450
+
+// the packed vertex layout - the formats are set by RenderableMesh::addPackedVertexInputs
+layout (location = 0) in vec4 inPos;		// snorm16, dequantised below
+layout (location = 1) in vec2 inUv0;		// half
+layout (location = 2) in vec2 inUv1;		// half
+layout (location = 3) in vec2 inNormal;		// octahedral, snorm16
+
+layout (set = 0, binding = 0) uniform CameraUbo
+{
+	mat4 mvp;
+
+} camera_ubo;
+
+layout (set = 1, binding = 0) uniform Dynamic_StaticMeshUbo
+{
+	mat4 modelMatrix;
+} mesh_ubo;
+
+struct Quantisation
+{
+	vec4 offset;
+	vec4 scale;
+};
+
+// indexed by the first instance of the draw
+layout (set = 1, binding = 1) readonly buffer MeshQuantisation
+{
+	Quantisation meshes[];
+} quantisation;
+
+layout (location = 0) out vec2 outUv0;
+layout (location = 1) out vec2 outUv1;
+layout (location = 2) out vec3 outNormal;
+layout (location = 3) out vec3 outPos;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{	
+	Quantisation quant = quantisation.meshes[gl_InstanceIndex];
+	vec4 localPos = vec4(inPos.xyz * quant.scale.xyz + quant.offset.xyz, 1.0);
+	vec3 normal = decodeOctahedral(inNormal);
+
+	mat4 normalTransform = mesh_ubo.modelMatrix;
+	vec4 pos = normalTransform * localPos;
+	outNormal = (normalTransform * vec4(normal, 1.0)).xyz;
+	
+	pos.y = -pos.y;
+	outPos = pos.xyz / pos.w;	// perspective divide correction
+	
+	gl_Position = camera_ubo.mvp * vec4(outPos, 1.0);
+	outUv0 = inUv0;
+	outUv1 = inUv1;
+}
@@ -0,0 +1,90 @@
+#version 450
+
+// the packed skinned vertex layout - the formats are set by RenderableMesh::addPackedVertexInputs
+layout (location = 0) in vec4 inPos;		// snorm16, dequantised below
+layout (location = 1) in vec2 inUv0;		// half
+layout (location = 2) in vec2 inUv1;		// half
+layout (location = 3) in vec2 inNormal;		// octahedral, snorm16
+layout (location = 4) in vec4 inWeights;	// unorm8
+layout (location = 5) in uvec4 inBoneId;	// uint8
+
+layout (set = 0, binding = 0) uniform CameraUbo
+{
+	mat4 mvp;
+
+} camera_ubo;
+
+// not used by skinned meshes, the joint matrices are already in world space. Though kept so the
+// set layout matches the static mesh
+layout (set = 1, binding = 0) uniform Dynamic_StaticMeshUbo
+{
+	mat4 modelMatrix;
+} mesh_ubo;
+
+// where this skin's joints start in the palette
+layout (set = 1, binding = 1) uniform Dynamic_SkinnedUbo
+{
+	uint jointOffset;
+	uint jointCount;
+} skinned_ubo;
+
+// the joint matrices for all skins
+layout (set = 1, binding = 2) readonly buffer JointPalette
+{
+	mat4 joints[];
+} palette;
+
+struct Quantisation
+{
+	vec4 offset;
+	vec4 scale;
+};
+
+// indexed by the first instance of the draw
+layout (set = 1, binding = 3) readonly buffer MeshQuantisation
+{
+	Quantisation meshes[];
+} quantisation;
+
+layout (location = 0) out vec2 outUv0;
+layout (location = 1) out vec2 outUv1;
+layout (location = 2) out vec3 outNormal;
+layout (location = 3) out vec3 outPos;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{	
+	Quantisation quant = quantisation.meshes[gl_InstanceIndex];
+	vec4 localPos = vec4(inPos.xyz * quant.scale.xyz + quant.offset.xyz, 1.0);
+	vec3 normal = decodeOctahedral(inNormal);
+
+	uint offset = skinned_ubo.jointOffset;
+	mat4 boneTransform = palette.joints[offset + inBoneId.x] * inWeights.x;
+	boneTransform += palette.joints[offset + inBoneId.y] * inWeights.y;
+	boneTransform += palette.joints[offset + inBoneId.z] * inWeights.z;
+	boneTransform += palette.joints[offset + inBoneId.w] * inWeights.w;
+		
+	mat4 normalTransform = boneTransform;
+	vec4 pos = normalTransform * localPos;
+
+	outNormal = normalize(transpose(inverse(mat3(normalTransform))) * normal);
+
+	outPos = pos.xyz / pos.w;	// perspective divide
+	
+	gl_Position = camera_ubo.mvp * vec4(outPos, 1.0);
+	outUv0 = inUv0;
+	outUv1 = inUv1;
+}
@@ -7,25 +7,32 @@ layout (location = 3) in vec3 inNormal;
 layout (location = 4) in vec4 inWeights;
 layout (location = 5) in vec4 inBoneId;
 
-#define MAX_BONES 6
-
 layout (set = 0, binding = 0) uniform CameraUbo
 {
 	mat4 mvp;
 
 } camera_ubo;
 
+// not used by skinned meshes, the joint matrices are already in world space. Though kept so the
+// set layout matches the static mesh
 layout (set = 1, binding = 0) uniform Dynamic_StaticMeshUbo
 {
 	mat4 modelMatrix;
 } mesh_ubo;
 
+// where this skin's joints start in the palette
 layout (set = 1, binding = 1) uniform Dynamic_SkinnedUbo
 {
-	mat4 bones[MAX_BONES];
-	float jointCount;
+	uint jointOffset;
+	uint jointCount;
 } skinned_ubo;
 
+// the joint matrices for all skins
+layout (set = 1, binding = 2) readonly buffer JointPalette
+{
+	mat4 joints[];
+} palette;
+
 layout (location = 0) out vec2 outUv0;
 layout (location = 1) out vec2 outUv1;
 layout (location = 2) out vec3 outNormal;
@@ -40,12 +47,13 @@ void main()
 {	
 	vec4 pos;
 	
-	mat4 boneTransform = skinned_ubo.bones[int(inBoneId.x)] * inWeights.x;
-	boneTransform += skinned_ubo.bones[int(inBoneId.y)] * inWeights.y;
-	boneTransform += skinned_ubo.bones[int(inBoneId.z)] * inWeights.z;
-	boneTransform += skinned_ubo.bones[int(inBoneId.w)] * inWeights.w;
+	uint offset = skinned_ubo.jointOffset;
+	mat4 boneTransform = palette.joints[offset + uint(inBoneId.x)] * inWeights.x;
+	boneTransform += palette.joints[offset + uint(inBoneId.y)] * inWeights.y;
+	boneTransform += palette.joints[offset + uint(inBoneId.z)] * inWeights.z;
+	boneTransform += palette.joints[offset + uint(inBoneId.w)] * inWeights.w;
 		
-	mat4 normalTransform = mesh_ubo.modelMatrix * boneTransform;
+	mat4 normalTransform = boneTransform;
 	pos = normalTransform * inPos;
 
     // inverse-transpose for non-uniform scaling - expensive computations here - maybe remove this?
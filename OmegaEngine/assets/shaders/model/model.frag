@@ -1,25 +1,14 @@
 #version 450
 
-layout (set = 2, binding = 0) uniform sampler2D baseColourMap;
-layout (set = 2, binding = 1) uniform sampler2D normalMap;
-layout (set = 2, binding = 2) uniform sampler2D mrMap;
-layout (set = 2, binding = 3) uniform sampler2D emissiveMap;
-layout (set = 2, binding = 4) uniform sampler2D aoMap;
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout (location = 0) in vec2 inUv0;
-layout (location = 1) in vec2 inUv1;
-layout (location = 2) in vec3 inNormal;
-layout (location = 3) in vec3 inPos;
-
-layout(push_constant) uniform pushConstants 
+// the material factors and texture indices - must match the MaterialBufferInfo layout
+struct Material
 {
 	vec4 baseColorFactor;
-	vec3 emissiveFactor;
-	float pad0;
-	vec3 diffuseFactor;
-	float pad1;
-	vec3 specularFactor;
-	float pad2;
+	vec4 emissiveFactor;
+	vec4 diffuseFactor;
+	vec4 specularFactor;
 	float metallicFactor;	
 	float roughnessFactor;	
 	float alphaMask;	
@@ -29,14 +18,37 @@ layout(push_constant) uniform pushConstants
 	uint normalUvSet;
 	uint emissiveUvSet;
 	uint occlusionUvSet;
-	uint haveBaseColourMap;
-	uint haveNormalMap;
-	uint haveEmissiveMap;
-	uint haveMrMap;
-	uint haveAoMap;
 	uint usingSpecularGlossiness;
+	uint pad0;
+	uint pad1;
+	uint baseColourTexture;
+	uint normalTexture;
+	uint mrTexture;
+	uint emissiveTexture;
+	uint aoTexture;
+	uint pad2;
+	uint pad3;
+	uint pad4;
+};
+
+layout (set = 0, binding = 1) readonly buffer MaterialBuffer
+{
+	Material materials[];
+};
 
-} material;
+// all material textures - indexed by the texture indices of the material. Materials without a map point at a
+// shared 1x1 fallback which gives the same result as the factors alone
+layout (set = 2, binding = 0) uniform sampler2D textures[];
+
+layout (location = 0) in vec2 inUv0;
+layout (location = 1) in vec2 inUv1;
+layout (location = 2) in vec3 inNormal;
+layout (location = 3) in vec3 inPos;
+
+layout(push_constant) uniform pushConstants 
+{
+	uint materialIndex;
+} push;
 
 layout (location = 0) out vec4 outPosition;
 layout (location = 1) out vec4 outColour;
@@ -46,6 +58,9 @@ layout (location = 4) out vec4 outEmissive;
 
 #define EPSILON 0.0000001
 
+// materials without a normal map point at this fallback, which is flat, so the map isn't needed
+#define FLAT_NORMAL_TEXTURE 2
+
 float convertMetallic(vec3 diffuse, vec3 specular, float maxSpecular)
 {
 	float perceivedDiffuse = sqrt(0.299 * diffuse.r * diffuse.r + 0.587 * diffuse.g * diffuse.g + 0.114 * diffuse.b * diffuse.b);
@@ -64,10 +79,10 @@ float convertMetallic(vec3 diffuse, vec3 specular, float maxSpecular)
 }
 
 // The most copied function in the world! From here: http://www.thetenthplanet.de/archives/1180
-vec3 peturbNormal(vec2 tex_coord)
+vec3 peturbNormal(uint normalTexture, vec2 tex_coord)
 {
 	// convert normal to -1, 1 coord system
-	vec3 tangentNormal = texture(normalMap, tex_coord).xyz * 2.0 - 1.0;
+	vec3 tangentNormal = texture(textures[nonuniformEXT(normalTexture)], tex_coord).xyz * 2.0 - 1.0;
 
 	vec3 q1 = dFdx(inPos);			// edge1
 	vec3 q2 = dFdy(inPos);			// edge2
@@ -84,6 +99,8 @@ vec3 peturbNormal(vec2 tex_coord)
 
 void main()
 {
+	Material material = materials[push.materialIndex];
+
 	// albedo
 	vec4 baseColour;
 	
@@ -95,12 +112,7 @@ void main()
 	vec2 occlusion_uv = material.occlusionUvSet == 0 ? inUv0 : inUv1;
 	
 	if (material.alphaMask == 0.0) {
-		if (material.haveBaseColourMap > 0) {
-			baseColour = texture(baseColourMap, baseColour_uv) * material.baseColorFactor;
-		}
-		else {
-			baseColour = material.baseColorFactor;
-		}
+		baseColour = texture(textures[nonuniformEXT(material.baseColourTexture)], baseColour_uv) * material.baseColorFactor;
 		if (baseColour.a < material.alphaMaskCutoff) {
 			discard;
 		}	
@@ -108,9 +120,9 @@ void main()
 
 	// normal
 	vec3 normal; 
-	if (material.haveNormalMap > 0) {
+	if (material.normalTexture != FLAT_NORMAL_TEXTURE) {
 
-		normal = peturbNormal(normal_uv);
+		normal = peturbNormal(material.normalTexture, normal_uv);
 	}
 	else {
 		normal = normalize(inNormal);
@@ -125,15 +137,9 @@ void main()
 		roughness = material.roughnessFactor;
 		metallic = material.metallicFactor;
 
-		if (material.haveMrMap > 0) {
-			vec4 mrSample = texture(mrMap, mr_uv);
-			roughness = clamp(mrSample.g * roughness, 0.0, 1.0);
-			metallic = mrSample.b * metallic;
-		} 
-		else {
-			roughness = clamp(roughness, 0.04, 1.0);
-			metallic = clamp(metallic, 0.0, 1.0);
-		}
+		vec4 mrSample = texture(textures[nonuniformEXT(material.mrTexture)], mr_uv);
+		roughness = clamp(mrSample.g * roughness, 0.04, 1.0);
+		metallic = clamp(mrSample.b * metallic, 0.0, 1.0);
 	}
 
 	else {
@@ -142,21 +148,11 @@ void main()
 		vec4 diffuse;
 		vec3 specular;
 
-		if (material.haveMrMap > 0) {
-			roughness = 1.0 - texture(mrMap, mr_uv).a;
-			specular = texture(mrMap, mr_uv).rgb;
-
-		} else {
-			roughness = 0.0;
-			specular = vec3(0.0);
-		}
+		vec4 sgSample = texture(textures[nonuniformEXT(material.mrTexture)], mr_uv);
+		roughness = 1.0 - sgSample.a;
+		specular = sgSample.rgb;
 		
-		if (material.haveBaseColourMap > 0) {
-			diffuse = texture(baseColourMap, baseColour_uv);
-		}
-		else {
-			diffuse = material.baseColorFactor;
-		}
+		diffuse = texture(textures[nonuniformEXT(material.baseColourTexture)], baseColour_uv) * material.baseColorFactor;
 
 		float maxSpecular = max(max(specular.r, specular.g), specular.b);
 
@@ -173,21 +169,12 @@ void main()
 	outPbr = vec2(metallic, roughness);
 
 	// ao
-	float ambient = 1.0;
-	if (material.haveAoMap > 0) {
-        ambient = texture(aoMap, occlusion_uv).x;
-	}
+	float ambient = texture(textures[nonuniformEXT(material.aoTexture)], occlusion_uv).x;
 	outColour.a = ambient;
 
 	// emmisive
-	vec3 emissive;
-	if (material.haveEmissiveMap > 0) {
-        emissive = texture(emissiveMap, emissive_uv).rgb;
-		emissive *= material.emissiveFactor.rgb;
-	}
-	else { 
-   		emissive = material.emissiveFactor.rgb;
-	}
+	vec3 emissive = texture(textures[nonuniformEXT(material.emissiveTexture)], emissive_uv).rgb;
+	emissive *= material.emissiveFactor.rgb;
 	outEmissive = vec4(emissive, 1.0);
 	
 	outPosition = vec4(inPos, 1.0);
@@ -27,6 +27,33 @@ uint32_t generateTypeId(const char *typeName)
 	return crc32c(0, typeName, std::strlen(typeName));
 }
 
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+	const uint64_t prime = 1099511628211ULL;
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	uint64_t hash = seed ^ (size * prime);
+
+	// fnv-1a, though eight bytes at a time as the asset data can be large
+	while (size >= sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(uint64_t));
+		hash = (hash ^ word) * prime;
+		bytes += sizeof(uint64_t);
+		size -= sizeof(uint64_t);
+	}
+	while (size--)
+	{
+		hash = (hash ^ *bytes++) * prime;
+	}
+
+	// mix the upper and lower bits, as the multiply only carries changes upwards
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
 void *alloc_align(size_t alignmentSize, size_t size)
 {
 	void *data = nullptr;
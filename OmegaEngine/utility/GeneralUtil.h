@@ -29,6 +29,10 @@ public:
 	}
 };
 
+// a 64-bit hash of a block of memory, used to find duplicate asset data. Not suitable for cryptographic use.
+// The seed allows several blocks to be combined into one hash
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
 // aligned memory allocation
 void *alloc_align(size_t alignmentSize, size_t size);
 